@@ -0,0 +1,59 @@
+/*
+ * bench.h
+ *
+ * On-device benchmark battery. Every case runs one hardware path and
+ * fills a result with named metrics; the report prints each case as a
+ * "BENCH {json}" line and saves the whole run on the SD card.
+ */
+
+#ifndef BENCH_BENCH_H_
+#define BENCH_BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define BENCH_MAX_METRICS   (8)
+#define BENCH_SD_ROOT       "/sdcard"
+
+// the unit is part of the key, e.g. "kbytes_per_s", so reports diff by key
+typedef struct {
+    const char  *key;
+    double      value;
+} bench_metric_t;
+
+typedef struct {
+    int             num;
+    bench_metric_t  m[BENCH_MAX_METRICS];
+    // short reason when the case was skipped or failed
+    const char      *note;
+} bench_result_t;
+
+typedef struct {
+    const char  *name;
+    esp_err_t   (*run)(bench_result_t *res);
+} bench_case_t;
+
+void bench_metric(bench_result_t *res, const char *key, double value);
+
+// bench_report.c
+void bench_report_begin();
+void bench_report_case(const char *name, esp_err_t err, const bench_result_t *res, int64_t elapsed_us);
+// writes the collected run to the SD card
+void bench_report_end();
+
+// the panel shares the i2c bus with the codec, before audio_board_init
+void bench_oled_init();
+
+// one per hardware path
+esp_err_t bench_sd_write(bench_result_t *res);
+esp_err_t bench_sd_read(bench_result_t *res);
+esp_err_t bench_http_upload(bench_result_t *res);
+esp_err_t bench_http_download(bench_result_t *res);
+esp_err_t bench_i2s_playback(bench_result_t *res);
+esp_err_t bench_i2s_playback_sd_load(bench_result_t *res);
+esp_err_t bench_oled_flush(bench_result_t *res);
+esp_err_t bench_afe_load(bench_result_t *res);
+
+#endif /* BENCH_BENCH_H_ */
@@ -0,0 +1,237 @@
+#include "bench.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+#include "audio_element.h"
+#include "audio_mem.h"
+#include "audio_pipeline.h"
+#include "audio_recorder.h"
+#include "filter_resample.h"
+#include "i2s_stream.h"
+#include "raw_stream.h"
+#include "recorder_sr.h"
+#include "board.h"
+
+static const char *TAG = "bench_afe";
+
+#ifndef CODEC_ADC_SAMPLE_RATE
+#define CODEC_ADC_SAMPLE_RATE       (48000)
+#endif
+#ifndef CODEC_ADC_BITS_PER_SAMPLE
+#define CODEC_ADC_BITS_PER_SAMPLE   I2S_BITS_PER_SAMPLE_16BIT
+#endif
+
+#define AFE_MAX_TASKS   (48)
+#define AFE_MAX_CORES   (2)
+// AFE and model buffers allocated, tasks at steady state
+#define AFE_SETTLE_MS   (2000)
+// tasks listed in the log above this share
+#define AFE_LIST_MIN    (5)
+
+typedef struct {
+    TaskHandle_t    handle;
+    uint32_t        counter;
+} run_prev_t;
+
+static TaskStatus_t         *tasks;
+static run_prev_t           before[AFE_MAX_TASKS];
+static int                  before_num;
+static TaskHandle_t         base[AFE_MAX_TASKS];
+static int                  base_num;
+static audio_element_handle_t raw_read;
+static volatile uint32_t    wakeups;
+
+static int _read(int16_t *buffer, int buf_sz, void *user_ctx, TickType_t ticks)
+{
+    return raw_stream_read(raw_read, (char *)buffer, buf_sz);
+}
+
+static esp_err_t _event(audio_rec_evt_t type, void *user_data)
+{
+    if (type == AUDIO_REC_WAKEUP_START) {
+        wakeups++;
+    }
+    return ESP_OK;
+}
+
+static bool _in_base(TaskHandle_t handle)
+{
+    for (int i = 0; i < base_num; i++) {
+        if (base[i] == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t _before(TaskHandle_t handle)
+{
+    for (int i = 0; i < before_num; i++) {
+        if (before[i].handle == handle) {
+            return before[i].counter;
+        }
+    }
+    return 0;
+}
+
+static audio_pipeline_handle_t _capture_start()
+{
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    if (pipeline == NULL) {
+        return NULL;
+    }
+
+    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
+    i2s_cfg.type = AUDIO_STREAM_READER;
+    i2s_cfg.i2s_config.sample_rate = CODEC_ADC_SAMPLE_RATE;
+    i2s_cfg.i2s_config.use_apll = 0;
+#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
+    i2s_cfg.i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+#else
+    i2s_cfg.i2s_config.bits_per_sample = CODEC_ADC_BITS_PER_SAMPLE;
+#endif
+    audio_element_handle_t i2s = i2s_stream_init(&i2s_cfg);
+
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    raw_cfg.type = AUDIO_STREAM_READER;
+    raw_read = raw_stream_init(&raw_cfg);
+
+    audio_pipeline_register(pipeline, i2s, "i2s");
+    audio_pipeline_register(pipeline, raw_read, "raw");
+#if CODEC_ADC_SAMPLE_RATE != (16000)
+    rsp_filter_cfg_t rsp_cfg = DEFAULT_RESAMPLE_FILTER_CONFIG();
+    rsp_cfg.src_rate = CODEC_ADC_SAMPLE_RATE;
+    rsp_cfg.dest_rate = 16000;
+#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 2)
+    rsp_cfg.mode = RESAMPLE_UNCROSS_MODE;
+    rsp_cfg.src_ch = 4;
+    rsp_cfg.dest_ch = 4;
+    rsp_cfg.max_indata_bytes = 1024;
+#endif
+    audio_pipeline_register(pipeline, rsp_filter_init(&rsp_cfg), "filter");
+    const char *link_tag[3] = { "i2s", "filter", "raw" };
+    audio_pipeline_link(pipeline, &link_tag[0], 3);
+#else
+    const char *link_tag[2] = { "i2s", "raw" };
+    audio_pipeline_link(pipeline, &link_tag[0], 2);
+#endif
+    audio_pipeline_run(pipeline);
+    return pipeline;
+}
+
+// the firmware's recorder: wakenet on, no multinet, no encoder
+static audio_rec_handle_t _recorder_start()
+{
+    recorder_sr_cfg_t sr_cfg = DEFAULT_RECORDER_SR_CFG();
+    sr_cfg.afe_cfg.memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
+    sr_cfg.afe_cfg.wakenet_init = true;
+    sr_cfg.multinet_init = false;
+    sr_cfg.afe_cfg.aec_init = false;
+    sr_cfg.afe_cfg.agc_mode = AFE_MN_PEAK_NO_AGC;
+#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
+    sr_cfg.afe_cfg.pcm_config.mic_num = 1;
+    sr_cfg.afe_cfg.pcm_config.ref_num = 1;
+    sr_cfg.afe_cfg.pcm_config.total_ch_num = 2;
+    sr_cfg.input_order[0] = DAT_CH_0;
+    sr_cfg.input_order[1] = DAT_CH_1;
+#endif
+
+    audio_rec_cfg_t cfg = AUDIO_RECORDER_DEFAULT_CFG();
+    cfg.read = (recorder_data_read_t)&_read;
+    cfg.sr_handle = recorder_sr_create(&sr_cfg, &cfg.sr_iface);
+    cfg.event_cb = _event;
+    cfg.vad_off = 1000;
+    return audio_recorder_create(&cfg);
+}
+
+esp_err_t bench_afe_load(bench_result_t *res){
+    uint32_t total_before = 0;
+    uint32_t total = 0;
+
+    tasks = audio_calloc(AFE_MAX_TASKS, sizeof(TaskStatus_t));
+    if (tasks == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // whatever runs before capture starts is not the AFE's
+    base_num = uxTaskGetSystemState(tasks, AFE_MAX_TASKS, &total);
+    for (int i = 0; i < base_num; i++) {
+        base[i] = tasks[i].xHandle;
+    }
+    size_t int_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    size_t spi_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    wakeups = 0;
+    audio_pipeline_handle_t pipeline = _capture_start();
+    audio_rec_handle_t recorder = pipeline ? _recorder_start() : NULL;
+    if (recorder == NULL) {
+        res->note = "recorder create failed";
+        if (pipeline) {
+            audio_pipeline_stop(pipeline);
+            audio_pipeline_wait_for_stop(pipeline);
+            audio_pipeline_deinit(pipeline);
+        }
+        audio_free(tasks);
+        return ESP_FAIL;
+    }
+    vTaskDelay(pdMS_TO_TICKS(AFE_SETTLE_MS));
+    bench_metric(res, "internal_used_kb", (int_free - heap_caps_get_free_size(MALLOC_CAP_INTERNAL)) / 1024.0);
+    bench_metric(res, "psram_used_kb", (spi_free - heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) / 1024.0);
+
+    before_num = uxTaskGetSystemState(tasks, AFE_MAX_TASKS, &total_before);
+    for (int i = 0; i < before_num; i++) {
+        before[i].handle = tasks[i].xHandle;
+        before[i].counter = tasks[i].ulRunTimeCounter;
+    }
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_BENCH_AFE_SECONDS * 1000));
+    int num = uxTaskGetSystemState(tasks, AFE_MAX_TASKS, &total);
+    uint32_t elapsed = total - total_before;
+
+    uint32_t idle[AFE_MAX_CORES] = { 0 };
+    uint32_t afe = 0;
+    for (int i = 0; i < num && elapsed; i++) {
+        TaskStatus_t *t = &tasks[i];
+        uint32_t permille = (uint64_t)(t->ulRunTimeCounter - _before(t->xHandle)) * 1000 / elapsed;
+        if (strncmp(t->pcTaskName, "IDLE", 4) == 0) {
+            int c = t->pcTaskName[4] - '0';
+            if (c >= 0 && c < AFE_MAX_CORES) {
+                idle[c] = permille;
+            }
+            continue;
+        }
+        if (!_in_base(t->xHandle)) {
+            afe += permille;
+        }
+        if (permille >= AFE_LIST_MIN) {
+            ESP_LOGI(TAG, "  %-16s %3u.%u%%%s", t->pcTaskName, permille / 10, permille % 10,
+                     _in_base(t->xHandle) ? "" : " (capture/AFE)");
+        }
+    }
+
+    audio_recorder_destroy(recorder);
+    audio_pipeline_stop(pipeline);
+    audio_pipeline_wait_for_stop(pipeline);
+    audio_pipeline_terminate(pipeline);
+    audio_pipeline_deinit(pipeline);
+    audio_free(tasks);
+    tasks = NULL;
+
+    if (num == 0 || elapsed == 0) {
+        res->note = "no run time stats";
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    // capture, AFE feed/fetch and recorder tasks, of one core
+    bench_metric(res, "afe_tasks_pct", afe / 10.0);
+    for (int c = 0; c < portNUM_PROCESSORS && c < AFE_MAX_CORES; c++) {
+        bench_metric(res, c == 0 ? "core0_load_pct" : "core1_load_pct", idle[c] < 1000 ? (1000 - idle[c]) / 10.0 : 0);
+    }
+    bench_metric(res, "wakeups", wakeups);
+    return ESP_OK;
+}
@@ -0,0 +1,134 @@
+#include "bench.h"
+#include "http_chunk.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "sdkconfig.h"
+
+#include "audio_mem.h"
+
+#if CONFIG_BENCH_HTTP_ENABLE
+
+static const char *TAG = "bench_http";
+
+#define HTTP_CHUNK      (4096)
+#define HTTP_BYTES      (CONFIG_BENCH_HTTP_BYTES * 1024)
+#define HTTP_TIMEOUT_MS (10 * 1000)
+
+static esp_http_client_handle_t _client(const char *url, esp_http_client_method_t method)
+{
+    esp_http_client_config_t cfg = {
+        .url = url,
+        .method = method,
+        .timeout_ms = HTTP_TIMEOUT_MS,
+        .buffer_size = HTTP_CHUNK,
+    };
+    return esp_http_client_init(&cfg);
+}
+
+static void _throughput(bench_result_t *res, uint32_t bytes, int64_t us)
+{
+    bench_metric(res, "bytes", bytes);
+    bench_metric(res, "ms", us / 1000.0);
+    bench_metric(res, "kbytes_per_s", us > 0 ? bytes * 1000000.0 / 1024 / us : 0);
+}
+
+// chunked POST framed like the file2http upload
+esp_err_t bench_http_upload(bench_result_t *res){
+    char hdr[HTTP_CHUNK_HDR_MAX];
+    uint8_t *buf = audio_calloc(1, HTTP_CHUNK);
+    esp_http_client_handle_t http = _client(CONFIG_BENCH_UPLOAD_URL, HTTP_METHOD_POST);
+    esp_err_t err = ESP_OK;
+    uint32_t sent = 0;
+
+    if (buf == NULL || http == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    int64_t start = esp_timer_get_time();
+    // -1: Transfer-Encoding chunked
+    err = esp_http_client_open(http, -1);
+    if (err != ESP_OK) {
+        res->note = "connect failed";
+        goto out;
+    }
+    int64_t connected = esp_timer_get_time();
+    int hlen = http_chunk_header(hdr, HTTP_CHUNK);
+    while (sent < HTTP_BYTES) {
+        if (esp_http_client_write(http, hdr, hlen) <= 0
+            || esp_http_client_write(http, (char *)buf, HTTP_CHUNK) <= 0
+            || esp_http_client_write(http, HTTP_CHUNK_CRLF, 2) <= 0) {
+            err = ESP_FAIL;
+            res->note = "write failed";
+            break;
+        }
+        sent += HTTP_CHUNK;
+    }
+    if (err == ESP_OK && esp_http_client_write(http, HTTP_CHUNK_END, 5) <= 0) {
+        err = ESP_FAIL;
+    }
+    if (err == ESP_OK) {
+        esp_http_client_fetch_headers(http);
+        int status = esp_http_client_get_status_code(http);
+        bench_metric(res, "status", status);
+        if (status / 100 != 2) {
+            err = ESP_FAIL;
+            res->note = "server refused";
+        }
+    }
+    _throughput(res, sent, esp_timer_get_time() - start);
+    bench_metric(res, "connect_ms", (connected - start) / 1000.0);
+    ESP_LOGI(TAG, "uploaded %u bytes", sent);
+out:
+    if (http) {
+        esp_http_client_close(http);
+        esp_http_client_cleanup(http);
+    }
+    audio_free(buf);
+    return err;
+}
+
+esp_err_t bench_http_download(bench_result_t *res){
+    uint8_t *buf = audio_calloc(1, HTTP_CHUNK);
+    esp_http_client_handle_t http = _client(CONFIG_BENCH_DOWNLOAD_URL, HTTP_METHOD_GET);
+    esp_err_t err = ESP_OK;
+    uint32_t got = 0;
+
+    if (buf == NULL || http == NULL) {
+        err = ESP_ERR_NO_MEM;
+        goto out;
+    }
+    int64_t start = esp_timer_get_time();
+    err = esp_http_client_open(http, 0);
+    if (err != ESP_OK) {
+        res->note = "connect failed";
+        goto out;
+    }
+    esp_http_client_fetch_headers(http);
+    int64_t first = esp_timer_get_time();
+    int status = esp_http_client_get_status_code(http);
+    int ret;
+    while ((ret = esp_http_client_read(http, (char *)buf, HTTP_CHUNK)) > 0) {
+        got += ret;
+    }
+    _throughput(res, got, esp_timer_get_time() - start);
+    bench_metric(res, "first_byte_ms", (first - start) / 1000.0);
+    bench_metric(res, "status", status);
+    if (status / 100 != 2 || ret < 0 || got == 0) {
+        err = ESP_FAIL;
+        res->note = "bad response";
+    }
+    ESP_LOGI(TAG, "downloaded %u bytes", got);
+out:
+    if (http) {
+        esp_http_client_close(http);
+        esp_http_client_cleanup(http);
+    }
+    audio_free(buf);
+    return err;
+}
+
+#endif /* CONFIG_BENCH_HTTP_ENABLE */
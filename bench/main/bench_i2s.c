@@ -0,0 +1,170 @@
+#include "bench.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "audio_element.h"
+#include "audio_mem.h"
+#include "audio_pipeline.h"
+#include "i2s_stream.h"
+#include "raw_stream.h"
+#include "ringbuf.h"
+#include "board.h"
+
+static const char *TAG = "bench_i2s";
+
+#ifndef CODEC_ADC_BITS_PER_SAMPLE
+#define CODEC_ADC_BITS_PER_SAMPLE  I2S_BITS_PER_SAMPLE_16BIT
+#endif
+
+// 10ms of 48kHz stereo, the mixer frame of the firmware
+#define I2S_RATE            (48000)
+#define I2S_FRAME_SAMPLES   (I2S_RATE / 100)
+#define I2S_FRAME_BYTES     (I2S_FRAME_SAMPLES * 2 * sizeof(int16_t))
+// ring filling up before an empty one counts as underrun
+#define I2S_WARMUP_FRAMES   (10)
+// the firmware mixer priority
+#define I2S_PRODUCER_PRIO   (10)
+
+#define LOAD_FILE           BENCH_SD_ROOT "/load.bin"
+#define LOAD_CHUNK          (4096)
+// the load file wraps so a long run does not fill the card
+#define LOAD_FILE_MAX       (8 * 1024 * 1024)
+
+static volatile bool    load_run;
+static volatile bool    load_running;
+static uint32_t         load_bytes;
+
+static void _sd_load_task(void *arg)
+{
+    uint8_t *buf = audio_calloc(1, LOAD_CHUNK);
+    FILE *fp = fopen(LOAD_FILE, "wb");
+
+    load_bytes = 0;
+    while (load_run && buf && fp) {
+        if (fwrite(buf, LOAD_CHUNK, 1, fp) != 1) {
+            break;
+        }
+        // push every chunk to the card, as the voice writer does over time
+        fflush(fp);
+        load_bytes += LOAD_CHUNK;
+        if (ftell(fp) >= LOAD_FILE_MAX) {
+            rewind(fp);
+        }
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    remove(LOAD_FILE);
+    audio_free(buf);
+    load_running = false;
+    vTaskDelete(NULL);
+}
+
+static esp_err_t _playback(bench_result_t *res, bool sd_load)
+{
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
+    int16_t *frame = audio_calloc(1, I2S_FRAME_BYTES);
+
+    raw_cfg.type = AUDIO_STREAM_WRITER;
+    i2s_cfg.type = AUDIO_STREAM_WRITER;
+    i2s_cfg.i2s_config.sample_rate = I2S_RATE;
+    i2s_cfg.i2s_config.use_apll = 0;
+#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
+    i2s_cfg.i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+#else
+    i2s_cfg.i2s_config.bits_per_sample = CODEC_ADC_BITS_PER_SAMPLE;
+    i2s_cfg.need_expand = (CODEC_ADC_BITS_PER_SAMPLE != I2S_BITS_PER_SAMPLE_16BIT);
+#endif
+
+    audio_pipeline_handle_t pipeline = audio_pipeline_init(&pipeline_cfg);
+    audio_element_handle_t raw = raw_stream_init(&raw_cfg);
+    audio_element_handle_t i2s = i2s_stream_init(&i2s_cfg);
+    if (!frame || !pipeline || !raw || !i2s) {
+        audio_free(frame);
+        return ESP_ERR_NO_MEM;
+    }
+    audio_pipeline_register(pipeline, raw, "raw");
+    audio_pipeline_register(pipeline, i2s, "i2s");
+    const char *link_tag[2] = { "raw", "i2s" };
+    audio_pipeline_link(pipeline, &link_tag[0], 2);
+    ringbuf_handle_t rb = audio_element_get_output_ringbuf(raw);
+
+    // quiet 1kHz tone, a glitch is audible on top of the counters
+    for (int i = 0; i < I2S_FRAME_SAMPLES; i++) {
+        frame[2 * i] = frame[2 * i + 1] = (int16_t)(2000 * sinf(2 * M_PI * 1000 * i / I2S_RATE));
+    }
+    if (sd_load) {
+        load_run = load_running = true;
+        if (xTaskCreate(_sd_load_task, "sd_load", 3 * 1024, NULL, 5, NULL) != pdPASS) {
+            load_running = false;
+        }
+    }
+    UBaseType_t prio = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, I2S_PRODUCER_PRIO);
+    audio_pipeline_run(pipeline);
+
+    const uint32_t frames = CONFIG_BENCH_I2S_SECONDS * 100;
+    uint32_t underruns = 0;
+    int64_t max_gap = 0;
+    int64_t last = esp_timer_get_time();
+    int64_t start = last;
+    esp_err_t err = ESP_OK;
+    for (uint32_t n = 0; n < frames; n++) {
+        if (n >= I2S_WARMUP_FRAMES && rb_bytes_filled(rb) == 0) {
+            // the i2s writer drained everything, DMA plays silence
+            underruns++;
+        }
+        if (raw_stream_write(raw, (char *)frame, I2S_FRAME_BYTES) != I2S_FRAME_BYTES) {
+            err = ESP_FAIL;
+            res->note = "raw write failed";
+            break;
+        }
+        int64_t now = esp_timer_get_time();
+        if (n >= I2S_WARMUP_FRAMES && now - last > max_gap) {
+            max_gap = now - last;
+        }
+        last = now;
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    vTaskPrioritySet(NULL, prio);
+
+    load_run = false;
+    while (load_running) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    audio_pipeline_stop(pipeline);
+    audio_pipeline_wait_for_stop(pipeline);
+    audio_pipeline_terminate(pipeline);
+    audio_pipeline_deinit(pipeline);
+    audio_free(frame);
+
+    bench_metric(res, "frames", frames);
+    bench_metric(res, "underruns", underruns);
+    bench_metric(res, "max_write_gap_ms", max_gap / 1000.0);
+    // above 1.0 the writer could not keep up with the i2s clock
+    bench_metric(res, "wall_per_audio", elapsed / (frames * 10000.0));
+    if (sd_load) {
+        bench_metric(res, "load_kbytes_per_s", load_bytes * 1000000.0 / 1024 / elapsed);
+    }
+    ESP_LOGI(TAG, "%u frames, %u underruns, max gap %lld us%s", frames, underruns, max_gap,
+             sd_load ? ", SD load" : "");
+    return err;
+}
+
+esp_err_t bench_i2s_playback(bench_result_t *res){
+    return _playback(res, false);
+}
+
+esp_err_t bench_i2s_playback_sd_load(bench_result_t *res){
+    return _playback(res, true);
+}
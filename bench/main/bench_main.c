@@ -0,0 +1,98 @@
+#include "bench.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+
+#include "esp_peripherals.h"
+#include "periph_wifi.h"
+#include "board.h"
+
+static const char *TAG = "bench";
+
+#define BENCH_WIFI_TIMEOUT_MS   (20 * 1000)
+// settle between cases, lets the previous case's tasks exit
+#define BENCH_GAP_MS            (500)
+
+static const bench_case_t cases[] = {
+    { "sd_write",               bench_sd_write },
+    { "sd_read",                bench_sd_read },
+#if CONFIG_BENCH_HTTP_ENABLE
+    { "http_upload",            bench_http_upload },
+    { "http_download",          bench_http_download },
+#endif
+    { "i2s_playback",           bench_i2s_playback },
+    { "i2s_playback_sd_load",   bench_i2s_playback_sd_load },
+    { "oled_flush",             bench_oled_flush },
+    { "afe_load",               bench_afe_load },
+};
+
+static bool net_up;
+
+void bench_metric(bench_result_t *res, const char *key, double value){
+    if (res->num < BENCH_MAX_METRICS) {
+        res->m[res->num++] = (bench_metric_t) { .key = key, .value = value };
+    }
+}
+
+static void _net_start(esp_periph_set_handle_t set)
+{
+#if CONFIG_BENCH_HTTP_ENABLE
+    ESP_ERROR_CHECK(esp_netif_init());
+    periph_wifi_cfg_t wifi_cfg = {
+        .ssid = CONFIG_WIFI_SSID,
+        .password = CONFIG_WIFI_PASSWORD,
+    };
+    esp_periph_handle_t wifi_handle = periph_wifi_init(&wifi_cfg);
+    esp_periph_start(set, wifi_handle);
+    net_up = periph_wifi_wait_for_connected(wifi_handle, pdMS_TO_TICKS(BENCH_WIFI_TIMEOUT_MS)) == ESP_OK;
+    if (!net_up) {
+        ESP_LOGW(TAG, "No Wi-Fi, HTTP cases are skipped");
+    }
+#endif
+}
+
+void app_main(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(err);
+
+    esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
+    esp_periph_set_handle_t set = esp_periph_set_init(&periph_cfg);
+    audio_board_sdcard_init(set, SD_MODE_1_LINE);
+    bench_oled_init();
+
+    audio_board_handle_t board_handle = audio_board_init();
+    audio_hal_ctrl_codec(board_handle->audio_hal, AUDIO_HAL_CODEC_MODE_BOTH, AUDIO_HAL_CTRL_START);
+    audio_hal_set_volume(board_handle->audio_hal, 60);
+
+    _net_start(set);
+
+    bench_report_begin();
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        bench_result_t res = { 0 };
+        int64_t start = esp_timer_get_time();
+
+        if (strncmp(cases[i].name, "http_", 5) == 0 && !net_up) {
+            res.note = "no wifi";
+            err = ESP_ERR_INVALID_STATE;
+        } else {
+            ESP_LOGI(TAG, "[%d/%d] %s", i + 1, sizeof(cases) / sizeof(cases[0]), cases[i].name);
+            err = cases[i].run(&res);
+        }
+        bench_report_case(cases[i].name, err, &res, esp_timer_get_time() - start);
+        vTaskDelay(pdMS_TO_TICKS(BENCH_GAP_MS));
+    }
+    bench_report_end();
+}
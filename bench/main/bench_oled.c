@@ -0,0 +1,67 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "ssd1306.h"
+
+static const char *TAG = "bench_oled";
+
+#define OLED_WIDTH      (128)
+#define OLED_HEIGHT     (64)
+#define OLED_PAGES      (OLED_HEIGHT / 8)
+
+static SSD1306_t    dev;
+static uint8_t      bitmap[64 * 64 / 8];
+
+void bench_oled_init(){
+    ssd1306_init(&dev, OLED_WIDTH, OLED_HEIGHT);
+    ssd1306_clear_screen(&dev, false);
+    ssd1306_contrast(&dev, 0xff);
+    ssd1306_display_text(&dev, 0, "bench", 5, false);
+}
+
+static double _per_s(int n, int64_t us)
+{
+    return us > 0 ? n * 1000000.0 / us : 0;
+}
+
+esp_err_t bench_oled_flush(bench_result_t *res){
+    const int frames = CONFIG_BENCH_OLED_FRAMES;
+    char line[17];
+
+    // whole framebuffer, what a full screen redraw costs
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < frames; i++) {
+        dev._page[i % OLED_PAGES]._segs[i % OLED_WIDTH] ^= 0xff;
+        ssd1306_show_buffer(&dev);
+    }
+    int64_t flush_us = esp_timer_get_time() - start;
+
+    // one text line per call, the status line updates of the firmware
+    start = esp_timer_get_time();
+    for (int i = 0; i < frames; i++) {
+        snprintf(line, sizeof(line), "frame %10d", i);
+        ssd1306_display_text(&dev, i % OLED_PAGES, line, 16, false);
+    }
+    int64_t text_us = esp_timer_get_time() - start;
+
+    memset(bitmap, 0xa5, sizeof(bitmap));
+    start = esp_timer_get_time();
+    for (int i = 0; i < frames / 10 + 1; i++) {
+        ssd1306_bitmaps(&dev, 32, 0, bitmap, 64, 64, i & 1);
+    }
+    int64_t bitmap_us = (esp_timer_get_time() - start) / (frames / 10 + 1);
+    ssd1306_clear_screen(&dev, false);
+
+    bench_metric(res, "flush_fps", _per_s(frames, flush_us));
+    bench_metric(res, "flush_kbytes_per_s", _per_s(frames, flush_us) * OLED_WIDTH * OLED_PAGES / 1024);
+    bench_metric(res, "text_lines_per_s", _per_s(frames, text_us));
+    bench_metric(res, "bitmap_64x64_ms", bitmap_us / 1000.0);
+    ESP_LOGI(TAG, "%d frames in %lld ms", frames, flush_us / 1000);
+    return ESP_OK;
+}
@@ -0,0 +1,99 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_idf_version.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "bench_report";
+
+#ifndef ADF_VER
+#define ADF_VER "unknown"
+#endif
+
+#define REPORT_LINE_LEN     (512)
+#define REPORT_MAX_CASES    (16)
+#define REPORT_MAX_FILES    (100)
+
+// every line of the run, written to the SD card at the end
+static char     lines[REPORT_MAX_CASES + 2][REPORT_LINE_LEN];
+static int      num_lines;
+static int      failed;
+
+static void _emit(const char *line)
+{
+    // one line per record, tools/bench_report.py greps for the prefix
+    printf("BENCH %s\n", line);
+    if (num_lines < sizeof(lines) / sizeof(lines[0])) {
+        strncpy(lines[num_lines++], line, REPORT_LINE_LEN - 1);
+    }
+}
+
+void bench_report_begin(){
+    char line[REPORT_LINE_LEN];
+    esp_chip_info_t chip;
+    const esp_app_desc_t *app = esp_ota_get_app_description();
+
+    esp_chip_info(&chip);
+    num_lines = 0;
+    failed = 0;
+    snprintf(line, sizeof(line),
+             "{\"type\":\"meta\",\"app\":\"%s\",\"idf\":\"%s\",\"adf\":\"%s\",\"chip\":\"%s\","
+             "\"chip_rev\":%d,\"cores\":%d,\"board_rev\":\"%s\",\"psram\":%u,\"built\":\"%s %s\"}",
+             app->version, esp_get_idf_version(), ADF_VER, CONFIG_IDF_TARGET, chip.revision, chip.cores,
+             CONFIG_BENCH_BOARD_REV, heap_caps_get_total_size(MALLOC_CAP_SPIRAM), app->date, app->time);
+    _emit(line);
+}
+
+void bench_report_case(const char *name, esp_err_t err, const bench_result_t *res, int64_t elapsed_us){
+    char line[REPORT_LINE_LEN];
+    int len;
+
+    if (err != ESP_OK) {
+        failed++;
+    }
+    len = snprintf(line, sizeof(line), "{\"type\":\"case\",\"name\":\"%s\",\"ok\":%s,\"err\":\"%s\",\"elapsed_ms\":%lld,\"note\":\"%s\",\"metrics\":{",
+                   name, err == ESP_OK ? "true" : "false", esp_err_to_name(err), elapsed_us / 1000,
+                   res->note ? res->note : "");
+    for (int i = 0; i < res->num && len < sizeof(line); i++) {
+        len += snprintf(line + len, sizeof(line) - len, "%s\"%s\":%.3f", i ? "," : "", res->m[i].key, res->m[i].value);
+    }
+    if (len < sizeof(line)) {
+        snprintf(line + len, sizeof(line) - len, "}}");
+    }
+    _emit(line);
+}
+
+void bench_report_end(){
+    char line[REPORT_LINE_LEN];
+    char path[32];
+    struct stat st;
+    FILE *fp = NULL;
+
+    snprintf(line, sizeof(line), "{\"type\":\"end\",\"cases\":%d,\"failed\":%d}", num_lines - 1, failed);
+    _emit(line);
+
+    // next free bench_<n>.jsonl, runs are kept side by side
+    for (int i = 0; i < REPORT_MAX_FILES; i++) {
+        snprintf(path, sizeof(path), BENCH_SD_ROOT "/bench_%d.jsonl", i);
+        if (stat(path, &st) != 0) {
+            fp = fopen(path, "w");
+            break;
+        }
+    }
+    if (fp == NULL) {
+        ESP_LOGW(TAG, "Report not saved, no SD card or %d reports already", REPORT_MAX_FILES);
+        return;
+    }
+    for (int i = 0; i < num_lines; i++) {
+        fprintf(fp, "%s\n", lines[i]);
+    }
+    fclose(fp);
+    ESP_LOGI(TAG, "Report saved to %s, %d failed", path, failed);
+}
@@ -0,0 +1,167 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "audio_element.h"
+#include "audio_event_iface.h"
+#include "audio_mem.h"
+#include "audio_pipeline.h"
+#include "fatfs_stream.h"
+#include "raw_stream.h"
+
+static const char *TAG = "bench_sd";
+
+#define SD_FILE         BENCH_SD_ROOT "/bench.bin"
+#define SD_CHUNK        (4096)
+#define SD_BYTES        (CONFIG_BENCH_SD_BYTES * 1024)
+// the file element reports finished once its close returned
+#define SD_DONE_MS      (30 * 1000)
+
+typedef struct {
+    audio_pipeline_handle_t     pipeline;
+    audio_element_handle_t      raw;
+    audio_element_handle_t      file;
+    audio_event_iface_handle_t  evt;
+} sd_pipe_t;
+
+static esp_err_t _pipe_build(sd_pipe_t *p, audio_stream_type_t type)
+{
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
+    fatfs_stream_cfg_t fs_cfg = FATFS_STREAM_CFG_DEFAULT();
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+
+    // write: [raw]-->fatfs_stream-->[sd], read: [sd]-->fatfs_stream-->[raw]
+    raw_cfg.type = type == AUDIO_STREAM_WRITER ? AUDIO_STREAM_WRITER : AUDIO_STREAM_READER;
+    fs_cfg.type = type;
+    p->pipeline = audio_pipeline_init(&pipeline_cfg);
+    p->raw = raw_stream_init(&raw_cfg);
+    p->file = fatfs_stream_init(&fs_cfg);
+    p->evt = audio_event_iface_init(&evt_cfg);
+    if (!p->pipeline || !p->raw || !p->file || !p->evt) {
+        return ESP_ERR_NO_MEM;
+    }
+    audio_element_set_uri(p->file, SD_FILE);
+    audio_pipeline_register(p->pipeline, p->raw, "raw");
+    audio_pipeline_register(p->pipeline, p->file, "file");
+    const char *write_tags[2] = { "raw", "file" };
+    const char *read_tags[2] = { "file", "raw" };
+    audio_pipeline_link(p->pipeline, type == AUDIO_STREAM_WRITER ? write_tags : read_tags, 2);
+    audio_pipeline_set_listener(p->pipeline, p->evt);
+    return ESP_OK;
+}
+
+static void _pipe_destroy(sd_pipe_t *p)
+{
+    if (p->pipeline) {
+        audio_pipeline_stop(p->pipeline);
+        audio_pipeline_wait_for_stop(p->pipeline);
+        audio_pipeline_terminate(p->pipeline);
+        audio_pipeline_remove_listener(p->pipeline);
+        audio_pipeline_deinit(p->pipeline);
+    } else {
+        if (p->raw) {
+            audio_element_deinit(p->raw);
+        }
+        if (p->file) {
+            audio_element_deinit(p->file);
+        }
+    }
+    if (p->evt) {
+        audio_event_iface_destroy(p->evt);
+    }
+}
+
+static esp_err_t _wait_file_done(sd_pipe_t *p)
+{
+    audio_event_iface_msg_t msg;
+
+    while (audio_event_iface_listen(p->evt, &msg, pdMS_TO_TICKS(SD_DONE_MS)) == ESP_OK) {
+        if (msg.source == (void *)p->file && msg.cmd == AEL_MSG_CMD_REPORT_STATUS) {
+            int status = (int)msg.data;
+            if (status == AEL_STATUS_STATE_FINISHED) {
+                return ESP_OK;
+            }
+            if (status == AEL_STATUS_ERROR_OPEN || status == AEL_STATUS_ERROR_OUTPUT
+                || status == AEL_STATUS_ERROR_INPUT) {
+                return ESP_FAIL;
+            }
+        }
+    }
+    return ESP_ERR_TIMEOUT;
+}
+
+static void _throughput(bench_result_t *res, uint32_t bytes, int64_t us)
+{
+    bench_metric(res, "bytes", bytes);
+    bench_metric(res, "ms", us / 1000.0);
+    bench_metric(res, "kbytes_per_s", us > 0 ? bytes * 1000000.0 / 1024 / us : 0);
+}
+
+esp_err_t bench_sd_write(bench_result_t *res){
+    sd_pipe_t p = { 0 };
+    uint8_t *buf = audio_calloc(1, SD_CHUNK);
+    esp_err_t err = buf ? _pipe_build(&p, AUDIO_STREAM_WRITER) : ESP_ERR_NO_MEM;
+
+    if (err == ESP_OK) {
+        for (int i = 0; i < SD_CHUNK; i++) {
+            buf[i] = i;
+        }
+        audio_pipeline_run(p.pipeline);
+        int64_t start = esp_timer_get_time();
+        uint32_t written = 0;
+        while (written < SD_BYTES) {
+            int ret = raw_stream_write(p.raw, (char *)buf, SD_CHUNK);
+            if (ret <= 0) {
+                err = ESP_FAIL;
+                res->note = "raw write failed";
+                break;
+            }
+            written += ret;
+        }
+        // end of stream, the file element closes the file and finishes
+        audio_element_set_ringbuf_done(p.raw);
+        if (err == ESP_OK) {
+            err = _wait_file_done(&p);
+        }
+        _throughput(res, written, esp_timer_get_time() - start);
+        ESP_LOGI(TAG, "wrote %u bytes", written);
+    }
+    _pipe_destroy(&p);
+    audio_free(buf);
+    return err;
+}
+
+esp_err_t bench_sd_read(bench_result_t *res){
+    sd_pipe_t p = { 0 };
+    uint8_t *buf = audio_calloc(1, SD_CHUNK);
+    esp_err_t err = buf ? _pipe_build(&p, AUDIO_STREAM_READER) : ESP_ERR_NO_MEM;
+
+    if (err == ESP_OK) {
+        audio_pipeline_run(p.pipeline);
+        int64_t start = esp_timer_get_time();
+        uint32_t got = 0;
+        int ret;
+        while ((ret = raw_stream_read(p.raw, (char *)buf, SD_CHUNK)) > 0) {
+            got += ret;
+        }
+        _throughput(res, got, esp_timer_get_time() - start);
+        if (got < SD_BYTES) {
+            // sd_write failed or the card is missing
+            res->note = "short read";
+            err = ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "read %u bytes", got);
+    }
+    _pipe_destroy(&p);
+    audio_free(buf);
+    remove(SD_FILE);
+    return err;
+}
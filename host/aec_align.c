@@ -0,0 +1,136 @@
+/*
+ * aec_align.c
+ *
+ * Offline check of the software AEC reference alignment. Each capture /
+ * playback WAV pair (16 kHz, 16 bit) is cut into windows of the firmware
+ * calibration length and every window goes through aec_ref_estimate_delay.
+ * The estimate is compared with the known playback to capture delay of
+ * the pair; windows where the playback is near silent carry no timing and
+ * are skipped. Exits 1 when a window is off by more than the tolerance.
+ *
+ *   host_aec_align [-c mic_ch] [-m max_ms] [-t tol_ms] capture.wav playback.wav delay_ms ...
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "aec_ref.h"
+#include "wav_header.h"
+
+// same capture length as the boot calibration in wwe_work.c
+#define WINDOW          (AEC_REF_SAMPLE_RATE)
+// mean playback amplitude below this does not count as a test signal
+#define SILENCE_LEVEL   (64)
+
+#define SAMPLES_TO_MS(n)    ((n) * 1000 / AEC_REF_SAMPLE_RATE)
+
+// channel ch of a 16 kHz 16 bit file as mono, or all channels averaged when ch < 0
+static int16_t *_load(const char *path, int ch, int *len)
+{
+    FILE *fp = fopen(path, "rb");
+    wav_info_t info;
+    int16_t *pcm = NULL;
+
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", path);
+        return NULL;
+    }
+    if (!wav_header_read(fp, &info) || info.bits != 16 || info.rate != AEC_REF_SAMPLE_RATE
+        || info.channels == 0 || ch >= info.channels) {
+        fprintf(stderr, "%s: need 16 bit %d Hz PCM with channel %d\n", path, AEC_REF_SAMPLE_RATE, ch < 0 ? 0 : ch);
+        goto out;
+    }
+    int frames = info.data_size / (info.channels * sizeof(int16_t));
+    int16_t *frame = malloc(info.channels * sizeof(int16_t));
+    pcm = malloc(frames * sizeof(int16_t));
+    if (frame == NULL || pcm == NULL) {
+        free(frame);
+        free(pcm);
+        pcm = NULL;
+        goto out;
+    }
+    int n;
+    for (n = 0; n < frames && fread(frame, sizeof(int16_t), info.channels, fp) == info.channels; n++) {
+        int32_t sum = 0;
+        for (int c = 0; c < info.channels; c++) {
+            sum += frame[c];
+        }
+        pcm[n] = ch < 0 ? (int16_t)(sum / info.channels) : frame[ch];
+    }
+    free(frame);
+    *len = n;
+out:
+    fclose(fp);
+    return pcm;
+}
+
+static bool _silent(const int16_t *pcm, int n)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += pcm[i] < 0 ? -pcm[i] : pcm[i];
+    }
+    return sum < (int64_t)SILENCE_LEVEL * n;
+}
+
+int main(int argc, char **argv)
+{
+    int mic_ch = 0;
+    int max_ms = AEC_REF_MAX_DELAY_MS;
+    int tol_ms = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:m:t:")) != -1) {
+        switch (opt) {
+            case 'c': mic_ch = atoi(optarg); break;
+            case 'm': max_ms = atoi(optarg); break;
+            case 't': tol_ms = atoi(optarg); break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind >= argc || (argc - optind) % 3 != 0 || mic_ch < 0 || max_ms <= 0) {
+        fprintf(stderr, "usage: %s [-c mic_ch] [-m max_ms] [-t tol_ms] capture.wav playback.wav delay_ms ...\n",
+                argv[0]);
+        return 2;
+    }
+
+    int windows = 0, skipped = 0, off = 0;
+    int err_sum = 0, err_max = 0;
+
+    printf("%-28s %6s %8s %8s %6s\n", "capture", "window", "expected", "measured", "error");
+    for (int p = optind; p < argc; p += 3) {
+        int mic_len = 0, ref_len = 0;
+        int expected = atoi(argv[p + 2]);
+        int16_t *mic = _load(argv[p], mic_ch, &mic_len);
+        int16_t *ref = _load(argv[p + 1], -1, &ref_len);
+        if (mic == NULL || ref == NULL) {
+            free(mic);
+            free(ref);
+            return 1;
+        }
+        int len = mic_len < ref_len ? mic_len : ref_len;
+        for (int w = 0; w + WINDOW <= len; w += WINDOW) {
+            if (_silent(ref + w, WINDOW)) {
+                skipped++;
+                continue;
+            }
+            int lag = aec_ref_estimate_delay(mic + w, ref + w, WINDOW, max_ms * AEC_REF_SAMPLE_RATE / 1000);
+            int measured = SAMPLES_TO_MS(lag);
+            int err = abs(measured - expected);
+            printf("%-28s %6d %8d %8d %6d%s\n", argv[p], w / WINDOW, expected, measured, measured - expected,
+                   err > tol_ms ? " !" : "");
+            windows++;
+            err_sum += err;
+            err_max = err > err_max ? err : err_max;
+            off += err > tol_ms;
+        }
+        free(mic);
+        free(ref);
+    }
+    printf("%d windows, %d silent skipped, mean error %d ms, max %d ms, %d over %d ms\n", windows, skipped,
+           windows ? err_sum / windows : 0, err_max, off, tol_ms);
+    return off || windows == 0;
+}
@@ -0,0 +1,433 @@
+/*
+ * bench.c
+ *
+ * Host benchmarks of the hardware independent firmware modules. Every
+ * case is checked once for a known result, then timed until it ran for
+ * at least the target time (default 200 ms, -t <ms>). Reports ns/op and,
+ * where a case moves data, MB/s; display cases also report the bus bytes
+ * and vTaskDelay ticks the firmware would spend per call.
+ *
+ *   host_bench [-t ms] [filter]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "shim.h"
+
+#include "wav_header.h"
+#include "http_chunk.h"
+#include "msg_pool.h"
+#include "mixer_kernel.h"
+#include "aec_ref.h"
+#include "metrics.h"
+#include "ssd1306.h"
+
+typedef struct {
+    const char  *name;
+    // payload bytes handled by one op, 0 when throughput is meaningless
+    size_t      bytes;
+    void        (*op)(void);
+    // NULL or returns 0 when op produces the expected result
+    int         (*check)(void);
+} bench_case_t;
+
+static volatile uint32_t sink;
+
+static uint64_t _now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* wav header */
+
+static uint8_t wav_hdr[WAV_HEADER_LEN];
+
+static void op_wav_header()
+{
+    wav_header_build(wav_hdr, sink, 1, 16000, 16);
+}
+
+static int check_wav_header()
+{
+    static const uint8_t expect[WAV_HEADER_LEN] = {
+        'R', 'I', 'F', 'F', 0x24, 0x7d, 0x00, 0x00, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ',
+        0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x80, 0x3e, 0x00, 0x00,
+        0x00, 0x7d, 0x00, 0x00, 0x02, 0x00, 0x10, 0x00, 'd', 'a', 't', 'a', 0x00, 0x7d, 0x00, 0x00,
+    };
+    // one second of 16kHz/16bit/mono
+    wav_header_build(wav_hdr, 32000, 1, 16000, 16);
+    return memcmp(wav_hdr, expect, WAV_HEADER_LEN);
+}
+
+/* chunked upload framing */
+
+#define CHUNK_PAYLOAD   (4096)
+
+static char     chunk_hdr[HTTP_CHUNK_HDR_MAX];
+static uint8_t  chunk_payload[CHUNK_PAYLOAD];
+static uint8_t  chunk_out[CHUNK_PAYLOAD + HTTP_CHUNK_HDR_MAX + 2];
+static uint32_t chunk_len = 1;
+
+static void op_chunk_header()
+{
+    sink += http_chunk_header(chunk_hdr, chunk_len++);
+}
+
+static void op_chunk_header_sprintf()
+{
+    // what file2http did before
+    sink += sprintf(chunk_hdr, "%x\r\n", chunk_len++);
+}
+
+// one 4 KB chunk framed into a send buffer
+static void op_chunk_frame()
+{
+    int n = http_chunk_header((char *)chunk_out, CHUNK_PAYLOAD);
+    memcpy(chunk_out + n, chunk_payload, CHUNK_PAYLOAD);
+    memcpy(chunk_out + n + CHUNK_PAYLOAD, HTTP_CHUNK_CRLF, 2);
+    sink += n;
+}
+
+static int check_chunk_header()
+{
+    static const uint32_t lens[] = { 0, 1, 9, 10, 15, 16, 255, 4096, 65535, 0x12345678, 0xffffffff };
+    char ref[16];
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        int n = http_chunk_header(chunk_hdr, lens[i]);
+        int m = snprintf(ref, sizeof(ref), "%x\r\n", lens[i]);
+        if (n != m || memcmp(chunk_hdr, ref, n) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* main loop messages */
+
+static void op_msg_roundtrip()
+{
+    main_msg_t *msg;
+
+    main_msg_post_xfer(FILE2HTTP, "/sdcard/wav_12.wav", "http://192.168.1.10:8000");
+    xQueueReceive(main_q, &msg, 0);
+    sink += msg->msg_id;
+    msg_pool_free(msg);
+}
+
+static int check_msg()
+{
+    main_msg_t *msg = NULL;
+
+    if (!main_msg_post_xfer(HTTP2PLAYER, "http://a/b.mp3", NULL)
+        || xQueueReceive(main_q, &msg, 0) != pdTRUE) {
+        return 1;
+    }
+    int bad = msg->msg_id != HTTP2PLAYER || strcmp(msg->xfer.src, "http://a/b.mp3") || msg->xfer.dst[0];
+    msg_pool_free(msg);
+    // a full pool refuses instead of blocking, quietly here
+    esp_log_level_t level = host_log_level;
+    host_log_level = ESP_LOG_NONE;
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        main_msg_post(EXIT);
+    }
+    bad |= main_msg_post(EXIT);
+    host_log_level = level;
+    while (xQueueReceive(main_q, &msg, 0) == pdTRUE) {
+        msg_pool_free(msg);
+    }
+    return bad;
+}
+
+/* mixer */
+
+// 10 ms of 48kHz stereo, the mixer frame
+#define MIX_FRAMES  (480)
+
+static int16_t  mix_in[3][MIX_FRAMES * MIXER_KERNEL_CHANNELS];
+static int16_t  mix_out[MIX_FRAMES * MIXER_KERNEL_CHANNELS];
+static int32_t  mix_acc[MIX_FRAMES * MIXER_KERNEL_CHANNELS];
+
+static void op_mix3()
+{
+    const int16_t *in[3] = { mix_in[0], mix_in[1], mix_in[2] };
+    const int32_t from[3] = { MIXER_GAIN_UNITY, MIXER_GAIN_UNITY / 2, MIXER_GAIN_UNITY / 4 };
+    const int32_t to[3] = { MIXER_GAIN_UNITY, MIXER_GAIN_UNITY / 3, MIXER_GAIN_UNITY / 4 };
+    mixer_kernel_mix(mix_out, mix_acc, in, from, to, 3, MIX_FRAMES);
+    sink += mix_out[0];
+}
+
+static int check_mix()
+{
+    const int16_t *in[3] = { mix_in[0], NULL, NULL };
+    const int32_t g[3] = { MIXER_GAIN_UNITY, 0, 0 };
+
+    for (int i = 0; i < MIX_FRAMES * MIXER_KERNEL_CHANNELS; i++) {
+        mix_in[0][i] = (int16_t)(i * 37);
+        mix_in[1][i] = (int16_t)(i * -11);
+        mix_in[2][i] = (int16_t)(i * 5);
+    }
+    // a single input at unity passes through unchanged
+    mixer_kernel_mix(mix_out, mix_acc, in, g, g, 3, MIX_FRAMES);
+    return memcmp(mix_out, mix_in[0], sizeof(mix_out));
+}
+
+/* aec delay estimate */
+
+// 1 s of 16 kHz, the mic lags the reference by 120 ms
+#define AEC_N       (16000)
+#define AEC_LAG     (AEC_REF_SAMPLE_RATE * 120 / 1000)
+
+static int16_t aec_mic[AEC_N];
+static int16_t aec_ref[AEC_N];
+
+static void op_aec_estimate()
+{
+    sink += aec_ref_estimate_delay(aec_mic, aec_ref, AEC_N, AEC_REF_SAMPLE_RATE * AEC_REF_MAX_DELAY_MS / 1000);
+}
+
+static int check_aec()
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < AEC_N; i++) {
+        seed = seed * 1103515245 + 12345;
+        aec_ref[i] = (int16_t)(seed >> 16);
+    }
+    for (int i = 0; i < AEC_N; i++) {
+        aec_mic[i] = i >= AEC_LAG ? aec_ref[i - AEC_LAG] / 2 : 0;
+    }
+    int lag = aec_ref_estimate_delay(aec_mic, aec_ref, AEC_N, AEC_REF_SAMPLE_RATE * AEC_REF_MAX_DELAY_MS / 1000);
+    return lag != AEC_LAG;
+}
+
+/* metrics exposition */
+
+#define METRICS_OUT_LEN (16 * 1024)
+
+static char     metrics_out[METRICS_OUT_LEN];
+static int      metrics_len;
+
+static void collect_counter(metrics_writer_t *w)
+{
+    metrics_value(w, NULL, 12345);
+}
+
+static void collect_labeled(metrics_writer_t *w)
+{
+    static const char *tasks[] = { "i2s", "mixer", "afe_feed", "afe_fetch", "recorder", "decoder", "net", "sd" };
+    for (int i = 0; i < 8; i++) {
+        metrics_value(w, tasks[i], i * 100);
+    }
+}
+
+static void collect_hist(metrics_writer_t *w)
+{
+    static const char *stages[] = { "wake_to_vad", "speech", "upload", "response", "end_to_end" };
+    uint32_t le[15];
+    uint32_t counts[16];
+    for (int b = 0; b < 16; b++) {
+        counts[b] = b;
+        if (b < 15) {
+            le[b] = (1u << b) - 1;
+        }
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics_hist(w, stages[i], le, counts, 16, 4321);
+    }
+}
+
+static const metric_family_t bench_families[] = {
+    { "wake_total", "Wake words detected", METRIC_COUNTER, NULL, collect_counter },
+    { "cpu_task_load_permille", "Task CPU share", METRIC_GAUGE, "task", collect_labeled },
+    { "task_stack_free_bytes", "Task stack high water mark", METRIC_GAUGE, "task", collect_labeled },
+    { "latency_ms", "Voice pipeline stage latency", METRIC_HISTOGRAM, "stage", collect_hist },
+};
+
+static int _metrics_flush(void *ctx, const char *data, int len)
+{
+    if (metrics_len + len > METRICS_OUT_LEN) {
+        return -1;
+    }
+    memcpy(metrics_out + metrics_len, data, len);
+    metrics_len += len;
+    return 0;
+}
+
+static void op_metrics_prometheus()
+{
+    metrics_len = 0;
+    metrics_render(METRICS_FMT_PROMETHEUS, _metrics_flush, NULL);
+    sink += metrics_len;
+}
+
+static void op_metrics_json()
+{
+    metrics_len = 0;
+    metrics_render(METRICS_FMT_JSON, _metrics_flush, NULL);
+    sink += metrics_len;
+}
+
+static int check_metrics()
+{
+    for (size_t i = 0; i < sizeof(bench_families) / sizeof(bench_families[0]); i++) {
+        metrics_register(&bench_families[i]);
+    }
+    op_metrics_prometheus();
+    metrics_out[metrics_len] = 0;
+    if (strstr(metrics_out, "wake_total 12345\n") == NULL
+        || strstr(metrics_out, "latency_ms_bucket{stage=\"speech\",le=\"+Inf\"} 120\n") == NULL) {
+        return 1;
+    }
+    op_metrics_json();
+    metrics_out[metrics_len] = 0;
+    return strstr(metrics_out, "\"wake_total\":{\"type\":\"counter\",\"help\":\"Wake words detected\",\"value\":12345}") == NULL;
+}
+
+/* ssd1306 framebuffer */
+
+static SSD1306_t    oled;
+static uint8_t      bitmap[64 * 64 / 8];
+
+static void op_oled_text()
+{
+    ssd1306_display_text(&oled, 2, "Listening...    ", 16, false);
+}
+
+static void op_oled_text_x3()
+{
+    ssd1306_display_text_x3(&oled, 2, "12:34", 5, false);
+}
+
+static void op_oled_clear()
+{
+    ssd1306_clear_screen(&oled, false);
+}
+
+static void op_oled_line()
+{
+    _ssd1306_line(&oled, 0, 0, 127, 63, false);
+    _ssd1306_line(&oled, 0, 63, 127, 0, false);
+}
+
+static void op_oled_scroll()
+{
+    // framebuffer only, no display
+    ssd1306_wrap_arround(&oled, SCROLL_UP, 0, 127, -1);
+}
+
+static void op_oled_bitmap()
+{
+    ssd1306_bitmaps(&oled, 32, 0, bitmap, 64, 64, false);
+}
+
+static void op_oled_show()
+{
+    ssd1306_show_buffer(&oled);
+}
+
+static int check_oled()
+{
+    ssd1306_init(&oled, 128, 64);
+    ssd1306_display_text(&oled, 0, "A", 1, false);
+    // font8x8 'A' in page layout, first column
+    if (oled._page[0]._segs[0] != 0x7c) {
+        return 1;
+    }
+    memset(bitmap, 0xa5, sizeof(bitmap));
+    return 0;
+}
+
+static const bench_case_t cases[] = {
+    { "wav_header",             WAV_HEADER_LEN,     op_wav_header,          check_wav_header },
+    { "chunk_header",           0,                  op_chunk_header,        check_chunk_header },
+    { "chunk_header_sprintf",   0,                  op_chunk_header_sprintf, NULL },
+    { "chunk_frame_4k",         CHUNK_PAYLOAD,      op_chunk_frame,         NULL },
+    { "msg_post_recv_free",     sizeof(main_msg_t), op_msg_roundtrip,       check_msg },
+    { "mixer_mix3_10ms",        sizeof(mix_out),    op_mix3,                check_mix },
+    { "aec_estimate_1s",        sizeof(aec_mic),    op_aec_estimate,        check_aec },
+    { "metrics_prometheus",     0,                  op_metrics_prometheus,  check_metrics },
+    { "metrics_json",           0,                  op_metrics_json,        NULL },
+    { "oled_text_16",           16,                 op_oled_text,           check_oled },
+    { "oled_text_x3_5",         5,                  op_oled_text_x3,        NULL },
+    { "oled_clear",             0,                  op_oled_clear,          NULL },
+    { "oled_line_x2",           0,                  op_oled_line,           NULL },
+    { "oled_scroll_up",         0,                  op_oled_scroll,         NULL },
+    { "oled_bitmap_64x64",      sizeof(bitmap),     op_oled_bitmap,         NULL },
+    { "oled_show_buffer",       128 * 8,            op_oled_show,           NULL },
+};
+
+static void _run(const bench_case_t *c, uint64_t target_ns)
+{
+    uint64_t iters = 1;
+    uint64_t elapsed;
+
+    for (;;) {
+        host_bus = (host_bus_stats_t){ 0 };
+        host_ticks_delayed = 0;
+        uint64_t start = _now_ns();
+        for (uint64_t i = 0; i < iters; i++) {
+            c->op();
+        }
+        elapsed = _now_ns() - start;
+        if (elapsed >= target_ns) {
+            break;
+        }
+        iters = elapsed ? iters * 2 : iters * 16;
+    }
+
+    double ns = (double)elapsed / iters;
+    printf("%-24s %10" PRIu64 " %12.1f", c->name, iters, ns);
+    if (c->bytes) {
+        printf(" %10.1f", c->bytes / ns * 1e3);
+    } else {
+        printf(" %10s", "-");
+    }
+    if (host_bus.bytes || host_ticks_delayed) {
+        printf("  bus %" PRIu64 " B/op in %" PRIu64 " xfers, %" PRIu64 " ticks/op",
+               host_bus.bytes / iters, host_bus.transactions / iters, host_ticks_delayed / iters);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t target_ms = 200;
+    const char *filter = NULL;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            target_ms = strtoull(argv[++i], NULL, 10);
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    init_msg_pool();
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (cases[i].check && cases[i].check() != 0) {
+            printf("FAIL %s: unexpected result\n", cases[i].name);
+            failed++;
+        }
+    }
+    if (failed) {
+        return 1;
+    }
+
+    printf("%-24s %10s %12s %10s\n", "case", "iters", "ns/op", "MB/s");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (filter == NULL || strstr(cases[i].name, filter)) {
+            _run(&cases[i], target_ms * 1000000ull);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * gen_aec_pair.c
+ *
+ * Writes a synthetic capture / playback WAV pair for host_aec_align. The
+ * playback is stereo noise, the capture has the mic on channel 0, the
+ * playback attenuated and delayed by delay_ms plus a little noise, and
+ * the raw reference on channel 1. The last second of the playback is
+ * silent so the skip of silent windows is exercised as well.
+ *
+ *   host_gen_aec_pair capture.wav playback.wav delay_ms [seconds]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "aec_ref.h"
+#include "wav_header.h"
+
+static uint32_t seed = 1;
+
+static int16_t _noise(int shift)
+{
+    seed = seed * 1103515245 + 12345;
+    return (int16_t)(seed >> 16) >> shift;
+}
+
+static FILE *_open(const char *path, int frames, int channels)
+{
+    uint8_t hdr[WAV_HEADER_LEN];
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", path);
+        return NULL;
+    }
+    wav_header_build(hdr, frames * channels * sizeof(int16_t), channels, AEC_REF_SAMPLE_RATE, 16);
+    fwrite(hdr, 1, sizeof(hdr), fp);
+    return fp;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr, "usage: %s capture.wav playback.wav delay_ms [seconds]\n", argv[0]);
+        return 2;
+    }
+    int lag = atoi(argv[3]) * AEC_REF_SAMPLE_RATE / 1000;
+    int seconds = argc > 4 ? atoi(argv[4]) : 4;
+    int frames = seconds * AEC_REF_SAMPLE_RATE;
+    int loud = frames - AEC_REF_SAMPLE_RATE;
+    int16_t *ref = calloc(frames, sizeof(int16_t));
+
+    if (ref == NULL || lag < 0 || seconds < 2) {
+        fprintf(stderr, "bad delay or length\n");
+        free(ref);
+        return 2;
+    }
+    for (int i = 0; i < loud; i++) {
+        ref[i] = _noise(1);
+    }
+
+    FILE *cap = _open(argv[1], frames, 2);
+    FILE *play = _open(argv[2], frames, 2);
+    if (cap == NULL || play == NULL) {
+        free(ref);
+        return 1;
+    }
+    for (int i = 0; i < frames; i++) {
+        int16_t echo = i >= lag ? ref[i - lag] / 4 : 0;
+        int16_t c[2] = { echo + _noise(6), ref[i] };
+        int16_t p[2] = { ref[i], ref[i] };
+        fwrite(c, sizeof(int16_t), 2, cap);
+        fwrite(p, sizeof(int16_t), 2, play);
+    }
+    free(ref);
+    return (fclose(cap) != 0) | (fclose(play) != 0);
+}
@@ -0,0 +1,378 @@
+/*
+ * job_sim.c
+ *
+ * The firmware job scheduler (main/job_sched.c, compiled unchanged) driving
+ * mocked pipelines under bursty load. Each burst is one conversation: an
+ * upload, the spoken answer right behind it, and now and then local media,
+ * a download or a barge-in that cancels playback. The mocks take the time
+ * building, re-arming, aborting and switching wakenet take on the device
+ * (scaled down), a mock reactor thread reports results like reactor.c.
+ * One start in SIM_STUCK_EVERY finds the last run not stopping, like
+ * pipeline_graph_rearm timing out.
+ *
+ * Reports the queueing delay per priority, submit to the pipeline's start
+ * call, and how long the reactor's done callback blocked. Exits 1 when a
+ * mock sees the scheduler break a rule: a pipeline started twice or
+ * before it was built, a resource over its limit, an upload with wakenet
+ * listening, a pipeline destroyed while it or one sharing an element with
+ * it runs, a stuck pipeline started again without a rebuild, or jobs never
+ * ending.
+ *
+ *   host_job_sim [-n bursts] [-s seed] [-v]
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "job_sched.h"
+
+#define SIM_MAX_JOBS        (1024)
+// pipeline calls on the device, ms
+#define SIM_BUILD_MS        (8)
+#define SIM_RELEASE_MS      (4)
+#define SIM_REARM_MS        (3)
+#define SIM_STOP_MS         (5)
+#define SIM_WWE_MS          (2)
+#define SIM_RELEASE_POLL_MS (50)
+#define SIM_DRAIN_MS        (10000)
+#define SIM_STUCK_EVERY     (20)
+
+typedef struct {
+    pipe_type_t type;
+    job_prio_t  prio;
+    int64_t     submit_us;
+    int64_t     start_us;
+} sim_job_t;
+
+typedef struct {
+    bool                active;
+    int64_t             end_us;
+    reactor_result_t    result;
+    reactor_done_cb_t   done;
+} sim_op_t;
+
+typedef struct {
+    const char  *name;
+    uint32_t    res;
+    // service time range, ms
+    int         min_ms;
+    int         max_ms;
+    // the pipeline it shares an element with, PIPE_TYPE_MAX for none
+    pipe_type_t shares;
+} sim_pipe_t;
+
+// res and shares must match job_ops in job_sched.c
+static const sim_pipe_t pipes[PIPE_TYPE_MAX] = {
+    [PIPE_FILE2HTTP]    = { "file2http",    JOB_RES_BIT(JOB_RES_NET) | JOB_RES_BIT(JOB_RES_SD),      40,  120, PIPE_FILE2PLAYER },
+    [PIPE_HTTP2FILE]    = { "http2file",    JOB_RES_BIT(JOB_RES_NET) | JOB_RES_BIT(JOB_RES_SD),      100, 300, PIPE_TYPE_MAX },
+    [PIPE_FILE2PLAYER]  = { "file2player",  JOB_RES_BIT(JOB_RES_I2S_OUT) | JOB_RES_BIT(JOB_RES_SD),  200, 500, PIPE_FILE2HTTP },
+    [PIPE_HTTP2PLAYER]  = { "http2player",  JOB_RES_BIT(JOB_RES_I2S_OUT) | JOB_RES_BIT(JOB_RES_NET), 150, 400, PIPE_TYPE_MAX },
+};
+
+static const int res_limit[JOB_RES_MAX] = { 1, 2, 1 };
+static const char *prio_names[JOB_PRIO_MAX] = { "low", "normal", "high" };
+
+static pthread_mutex_t  sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_job_t        sim_jobs[SIM_MAX_JOBS];
+static sim_op_t         ops[PIPE_TYPE_MAX];
+static bool             built[PIPE_TYPE_MAX];
+// rearm timed out, must be destroyed before the next start
+static bool             stuck[PIPE_TYPE_MAX];
+static int              stuck_starts;
+static int              res_used[JOB_RES_MAX];
+static bool             wwe_enabled = true;
+static unsigned int     seed = 1;
+static int              violations;
+static int64_t          done_us_max;
+static volatile bool    sim_end;
+
+#define VIOLATION(...) do {                         \
+        printf("VIOLATION: " __VA_ARGS__);          \
+        printf("\n");                               \
+        violations++;                               \
+    } while (0)
+
+static void _sleep_ms(int ms)
+{
+    usleep(ms * 1000);
+}
+
+static int _rand(int lo, int hi)
+{
+    return lo + rand_r(&seed) % (hi - lo + 1);
+}
+
+/* mocked firmware calls */
+
+const char *reactor_result_str(reactor_result_t result){
+    static const char *names[] = { "running", "done", "aborted", "timeout", "stalled", "error" };
+    return result <= REACTOR_ERROR ? names[result] : "?";
+}
+
+void enable_wwe_pipeline(bool enable){
+    _sleep_ms(SIM_WWE_MS);
+    pthread_mutex_lock(&sim_lock);
+    wwe_enabled = enable;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static void _init(pipe_type_t type)
+{
+    _sleep_ms(SIM_BUILD_MS);
+    pthread_mutex_lock(&sim_lock);
+    if (built[type]) {
+        VIOLATION("%s built twice", pipes[type].name);
+    }
+    built[type] = true;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static void _deinit(pipe_type_t type)
+{
+    pthread_mutex_lock(&sim_lock);
+    if (ops[type].active) {
+        VIOLATION("%s destroyed while running", pipes[type].name);
+    }
+    if (pipes[type].shares != PIPE_TYPE_MAX && ops[pipes[type].shares].active) {
+        VIOLATION("%s destroyed while %s runs on its shared element", pipes[type].name,
+                  pipes[pipes[type].shares].name);
+    }
+    built[type] = false;
+    stuck[type] = false;
+    pthread_mutex_unlock(&sim_lock);
+    _sleep_ms(SIM_RELEASE_MS);
+}
+
+static esp_err_t _start(pipe_type_t type, const char *src, reactor_done_cb_t done)
+{
+    int64_t now = esp_timer_get_time();
+    int idx = atoi(src);
+
+    // pipeline_graph_rearm waits for the last run to stop
+    _sleep_ms(SIM_REARM_MS);
+    pthread_mutex_lock(&sim_lock);
+    sim_jobs[idx].start_us = now;
+    if (!built[type]) {
+        VIOLATION("%s started before it was built", pipes[type].name);
+    }
+    if (stuck[type]) {
+        VIOLATION("%s started again without a rebuild", pipes[type].name);
+    }
+    if (_rand(1, SIM_STUCK_EVERY) == 1) {
+        stuck[type] = true;
+        stuck_starts++;
+        pthread_mutex_unlock(&sim_lock);
+        return ESP_ERR_TIMEOUT;
+    }
+    if (ops[type].active) {
+        VIOLATION("%s started while running", pipes[type].name);
+    }
+    if (type == PIPE_FILE2HTTP && wwe_enabled) {
+        VIOLATION("upload started with wakenet enabled");
+    }
+    for (int r = 0; r < JOB_RES_MAX; r++) {
+        if ((pipes[type].res & JOB_RES_BIT(r)) && ++res_used[r] > res_limit[r]) {
+            VIOLATION("resource %d used %d times, limit %d", r, res_used[r], res_limit[r]);
+        }
+    }
+    ops[type].active = true;
+    ops[type].result = REACTOR_DONE;
+    ops[type].end_us = esp_timer_get_time() + _rand(pipes[type].min_ms, pipes[type].max_ms) * 1000;
+    ops[type].done = done;
+    pthread_mutex_unlock(&sim_lock);
+    return ESP_OK;
+}
+
+static void _abort(pipe_type_t type)
+{
+    pthread_mutex_lock(&sim_lock);
+    if (ops[type].active && ops[type].result == REACTOR_DONE) {
+        ops[type].result = REACTOR_ABORTED;
+        ops[type].end_us = esp_timer_get_time() + SIM_STOP_MS * 1000;
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+#define SIM_PIPE(name, type)                                                        \
+    void init_##name() { _init(type); }                                             \
+    void deinit_##name() { _deinit(type); }                                         \
+    esp_err_t start_##name(const char *src, const char *dst, reactor_done_cb_t done) { \
+        return _start(type, src, done);                                             \
+    }                                                                               \
+    void abort_##name() { _abort(type); }
+
+SIM_PIPE(file2http, PIPE_FILE2HTTP)
+SIM_PIPE(http2file, PIPE_HTTP2FILE)
+SIM_PIPE(file2player, PIPE_FILE2PLAYER)
+SIM_PIPE(http2player, PIPE_HTTP2PLAYER)
+
+// reports ended operations like the reactor task
+static void *_reactor(void *arg)
+{
+    while (!sim_end) {
+        for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+            reactor_done_cb_t done = NULL;
+            reactor_result_t result = REACTOR_DONE;
+
+            pthread_mutex_lock(&sim_lock);
+            if (ops[t].active && esp_timer_get_time() >= ops[t].end_us) {
+                ops[t].active = false;
+                done = ops[t].done;
+                result = ops[t].result;
+                for (int r = 0; r < JOB_RES_MAX; r++) {
+                    if (pipes[t].res & JOB_RES_BIT(r)) {
+                        res_used[r]--;
+                    }
+                }
+            }
+            pthread_mutex_unlock(&sim_lock);
+            if (done) {
+                int64_t start = esp_timer_get_time();
+                done(t, result);
+                int64_t us = esp_timer_get_time() - start;
+                done_us_max = us > done_us_max ? us : done_us_max;
+            }
+        }
+        usleep(500);
+    }
+    return NULL;
+}
+
+/* load */
+
+static int num_jobs;
+static int64_t last_release_us;
+
+// sleeps until at, polling the idle release like the main loop
+static void _wait_until(int64_t at)
+{
+    int64_t now;
+    while ((now = esp_timer_get_time()) < at) {
+        if (now - last_release_us >= SIM_RELEASE_POLL_MS * 1000) {
+            job_sched_release_idle();
+            last_release_us = now;
+        }
+        usleep(1000);
+    }
+}
+
+static void _submit(pipe_type_t type, job_prio_t prio)
+{
+    char src[16];
+
+    if (num_jobs == SIM_MAX_JOBS) {
+        return;
+    }
+    sim_job_t *job = &sim_jobs[num_jobs];
+    job->type = type;
+    job->prio = prio;
+    job->submit_us = esp_timer_get_time();
+    snprintf(src, sizeof(src), "%d", num_jobs++);
+    job_sched_submit(type, prio, src, NULL);
+}
+
+static void _burst()
+{
+    // the answer follows the upload within a few ms
+    _submit(PIPE_FILE2HTTP, JOB_PRIO_NORMAL);
+    _wait_until(esp_timer_get_time() + _rand(0, 20) * 1000);
+    _submit(PIPE_HTTP2PLAYER, JOB_PRIO_HIGH);
+    if (_rand(0, 2) == 0) {
+        _submit(PIPE_FILE2PLAYER, JOB_PRIO_LOW);
+    }
+    if (_rand(0, 9) < 3) {
+        _submit(PIPE_HTTP2FILE, JOB_PRIO_LOW);
+    }
+    if (_rand(0, 9) == 0) {
+        _wait_until(esp_timer_get_time() + _rand(10, 100) * 1000);
+        job_sched_cancel_res(JOB_RES_I2S_OUT);
+    }
+}
+
+static int _cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void _report(int bursts, int64_t took_us)
+{
+    static int64_t wait[SIM_MAX_JOBS];
+    job_sched_stats_t st;
+
+    printf("%d bursts, %d jobs in %.1f s\n", bursts, num_jobs, took_us / 1e6);
+    printf("%-8s %6s %8s %8s %8s %8s   queued ms\n", "prio", "jobs", "avg", "p50", "p95", "max");
+    for (int p = JOB_PRIO_MAX - 1; p >= 0; p--) {
+        int n = 0;
+        int64_t sum = 0;
+        for (int i = 0; i < num_jobs; i++) {
+            if ((int)sim_jobs[i].prio == p && sim_jobs[i].start_us) {
+                wait[n] = sim_jobs[i].start_us - sim_jobs[i].submit_us;
+                sum += wait[n++];
+            }
+        }
+        if (n == 0) {
+            continue;
+        }
+        qsort(wait, n, sizeof(wait[0]), _cmp_int64);
+        printf("%-8s %6d %8.1f %8.1f %8.1f %8.1f\n", prio_names[p], n, sum / n / 1e3, wait[n / 2] / 1e3,
+               wait[n * 95 / 100] / 1e3, wait[n - 1] / 1e3);
+    }
+    job_sched_get_stats(&st);
+    printf("submitted %" PRIu32 ", completed %" PRIu32 ", failed %" PRIu32 ", cancelled %" PRIu32
+           ", preempted %" PRIu32 ", rejected %" PRIu32 ", builds %" PRIu32 ", releases %" PRIu32 "\n",
+           st.submitted, st.completed, st.failed, st.cancelled, st.preempted, st.rejected, st.builds, st.releases);
+    printf("stuck starts %d, reactor done callback max %" PRId64 " us\n", stuck_starts, done_us_max);
+}
+
+int main(int argc, char **argv)
+{
+    int bursts = 20;
+    int opt;
+    pthread_t reactor;
+    job_sched_stats_t st;
+
+    while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+        switch (opt) {
+            case 'n': bursts = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 10); break;
+            case 'v': host_log_level = ESP_LOG_INFO; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc || bursts <= 0) {
+        fprintf(stderr, "usage: %s [-n bursts] [-s seed] [-v]\n", argv[0]);
+        return 2;
+    }
+
+    init_job_sched();
+    pthread_create(&reactor, NULL, _reactor, NULL);
+
+    int64_t start_us = esp_timer_get_time();
+    for (int b = 0; b < bursts; b++) {
+        _burst();
+        _wait_until(esp_timer_get_time() + _rand(100, 600) * 1000);
+    }
+    int64_t drain_end = esp_timer_get_time() + SIM_DRAIN_MS * 1000;
+    do {
+        _wait_until(esp_timer_get_time() + 10 * 1000);
+        job_sched_get_stats(&st);
+    } while (st.completed + st.failed + st.cancelled < st.submitted && esp_timer_get_time() < drain_end);
+    int64_t took_us = esp_timer_get_time() - start_us;
+    if (st.completed + st.failed + st.cancelled < st.submitted) {
+        VIOLATION("%" PRIu32 " jobs never ended", st.submitted - st.completed - st.failed - st.cancelled);
+    }
+    sim_end = true;
+    pthread_join(reactor, NULL);
+
+    _report(bursts, took_us);
+    printf("%d violations\n", violations);
+    return violations != 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * replay_host.c
+ *
+ * Host run of the recorder path behind the AFE. The WAV file is fed
+ * through replay.c like the firmware feed, a stub recognizer fires the
+ * events of a label file at their exact positions, and utterances are
+ * written with voice_file.c following the assistant's recording rules.
+ * The replay report is logged as on the device.
+ *
+ *   host_replay [-o dir] [-c channels] [-s speed] [-j] input.wav labels.txt
+ *
+ * Labels are Audacity exports, one "start end name [arg]" per line, times
+ * in seconds: wake, wake_end, vad_start, vad_end, command <id>, and
+ * speech for a vad_start/vad_end pair spanning the region.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "replay.h"
+#include "voice_file.h"
+
+#define MAX_LABELS      (256)
+// frames per feed read, what the AFE feed task pulls at 16kHz
+#define FEED_FRAMES     (512)
+#define MAX_CHANNELS    (4)
+
+typedef struct {
+    uint32_t        frame;
+    replay_event_t  ev;
+    int             arg;
+} label_t;
+
+typedef enum {
+    HOST_IDLE = 0,
+    HOST_WAKE,
+    HOST_LISTENING,
+} host_state_t;
+
+static label_t      labels[MAX_LABELS];
+static int          num_labels;
+static host_state_t state;
+static voice_file_t voice;
+static int          voice_cnt;
+static const char   *out_dir = ".";
+
+static bool _add(double t, replay_event_t ev, int arg)
+{
+    if (num_labels == MAX_LABELS || t < 0) {
+        return false;
+    }
+    labels[num_labels++] = (label_t) { .frame = (uint32_t)(t * REPLAY_SAMPLE_RATE + 0.5), .ev = ev, .arg = arg };
+    return true;
+}
+
+static int _cmp_label(const void *a, const void *b)
+{
+    const label_t *la = a;
+    const label_t *lb = b;
+    if (la->frame != lb->frame) {
+        return la->frame < lb->frame ? -1 : 1;
+    }
+    return la->ev - lb->ev;
+}
+
+static bool _load_labels(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[128];
+    char name[32];
+    double start, end;
+    int arg, n, lineno = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "open %s failed\n", path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        arg = 0;
+        n = sscanf(line, "%lf %lf %31s %d", &start, &end, name, &arg);
+        if (n <= 0) {
+            continue;
+        }
+        bool ok = n >= 3;
+        if (ok && strcmp(name, "speech") == 0) {
+            ok = _add(start, REPLAY_EV_VAD_START, 0) && _add(end, REPLAY_EV_VAD_END, 0);
+        } else if (ok) {
+            int ev;
+            for (ev = 0; ev < REPLAY_EV_MAX; ev++) {
+                if (strcmp(name, replay_event_str(ev)) == 0) {
+                    break;
+                }
+            }
+            ok = ev < REPLAY_EV_MAX && _add(start, ev, arg);
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: bad label: %s", path, lineno, line);
+            fclose(fp);
+            return false;
+        }
+    }
+    fclose(fp);
+    qsort(labels, num_labels, sizeof(label_t), _cmp_label);
+    return true;
+}
+
+static void _voice_end(bool keep)
+{
+    uint32_t bytes = voice_file_close(&voice, keep);
+    replay_mark_file(voice.name, bytes, keep);
+}
+
+// what the assistant does with the recorder events, minus tones and upload
+static void _fire(const label_t *l)
+{
+    replay_mark(l->ev, l->arg);
+    switch (l->ev) {
+        case REPLAY_EV_WAKE:
+            if (state == HOST_LISTENING) {
+                _voice_end(false);
+            }
+            state = HOST_WAKE;
+            break;
+        case REPLAY_EV_WAKE_END:
+            if (state == HOST_WAKE) {
+                state = HOST_IDLE;
+            }
+            break;
+        case REPLAY_EV_VAD_START:
+            if (state != HOST_LISTENING) {
+                char name[VOICE_FILE_NAME_LEN];
+                const wav_info_t fmt = { .channels = 1, .rate = REPLAY_SAMPLE_RATE, .bits = 16 };
+                snprintf(name, sizeof(name), "%s/wav_%d.wav", out_dir, voice_cnt++);
+                if (voice_file_open(&voice, name, &fmt)) {
+                    state = HOST_LISTENING;
+                } else {
+                    fprintf(stderr, "open %s failed\n", name);
+                }
+            }
+            break;
+        case REPLAY_EV_VAD_END:
+            if (state == HOST_LISTENING) {
+                _voice_end(true);
+                state = HOST_IDLE;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int channels = 2;
+    int speed = 0;
+    bool json = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:c:s:j")) != -1) {
+        switch (opt) {
+            case 'o': out_dir = optarg; break;
+            case 'c': channels = atoi(optarg); break;
+            case 's': speed = atoi(optarg); break;
+            case 'j': json = true; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind + 2 != argc || channels < 1 || channels > MAX_CHANNELS) {
+        fprintf(stderr, "usage: %s [-o dir] [-c channels] [-s speed] [-j] input.wav labels.txt\n", argv[0]);
+        return 2;
+    }
+    host_log_level = ESP_LOG_INFO;
+    if (!_load_labels(argv[optind + 1]) || !replay_start(argv[optind], speed, 1)) {
+        return 1;
+    }
+
+    static int16_t feed[FEED_FRAMES * MAX_CHANNELS];
+    int16_t mono[FEED_FRAMES];
+    uint32_t pos = 0;
+    int next = 0;
+
+    while (replay_active()) {
+        while (next < num_labels && labels[next].frame <= pos) {
+            _fire(&labels[next++]);
+        }
+        // stop at the next label so it fires on its exact frame
+        uint32_t n = FEED_FRAMES;
+        if (next < num_labels && labels[next].frame - pos < n) {
+            n = labels[next].frame - pos;
+        }
+        if (replay_read(feed, n * channels * sizeof(int16_t), channels) <= 0) {
+            break;
+        }
+        if (state == HOST_LISTENING) {
+            for (uint32_t i = 0; i < n; i++) {
+                mono[i] = feed[i * channels];
+            }
+            voice_file_write(&voice, mono, n * sizeof(int16_t));
+        }
+        pos += n;
+    }
+    if (state == HOST_LISTENING) {
+        // rec_end, the recorder ran out of data mid utterance
+        _voice_end(true);
+    }
+    if (next < num_labels) {
+        fprintf(stderr, "%d labels after the end of the replay were not fired\n", num_labels - next);
+    }
+    if (json) {
+        static char buf[8 * 1024];
+        replay_json(buf, sizeof(buf));
+        printf("%s\n", buf);
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * audio_mem.h (host shim)
+ */
+
+#ifndef HOST_SHIM_AUDIO_MEM_H_
+#define HOST_SHIM_AUDIO_MEM_H_
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define audio_malloc(size)      malloc(size)
+#define audio_calloc(n, size)   calloc(n, size)
+#define audio_free(ptr)         free(ptr)
+#define mem_assert(x)           assert(x)
+
+#endif /* HOST_SHIM_AUDIO_MEM_H_ */
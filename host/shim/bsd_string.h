@@ -0,0 +1,15 @@
+/*
+ * bsd_string.h (host shim)
+ *
+ * strlcpy as newlib has it, for C libraries without one. Force included
+ * when the configure check does not find it.
+ */
+
+#ifndef HOST_SHIM_BSD_STRING_H_
+#define HOST_SHIM_BSD_STRING_H_
+
+#include <stddef.h>
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+#endif /* HOST_SHIM_BSD_STRING_H_ */
@@ -0,0 +1,14 @@
+/*
+ * driver/i2c.h (host shim)
+ *
+ * The ssd1306 transport is replaced by shim.c, nothing needed here.
+ */
+
+#ifndef HOST_SHIM_DRIVER_I2C_H_
+#define HOST_SHIM_DRIVER_I2C_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#endif /* HOST_SHIM_DRIVER_I2C_H_ */
@@ -0,0 +1,10 @@
+/*
+ * driver/spi_master.h (host shim)
+ */
+
+#ifndef HOST_SHIM_DRIVER_SPI_MASTER_H_
+#define HOST_SHIM_DRIVER_SPI_MASTER_H_
+
+typedef void *spi_device_handle_t;
+
+#endif /* HOST_SHIM_DRIVER_SPI_MASTER_H_ */
@@ -0,0 +1,36 @@
+/*
+ * esp_log.h (host shim)
+ *
+ * Lines at or above host_log_level go to stderr, the rest is dropped so
+ * log calls cost about what a filtered ESP_LOG does on target.
+ */
+
+#ifndef HOST_SHIM_ESP_LOG_H_
+#define HOST_SHIM_ESP_LOG_H_
+
+// esp_log.h on target pulls in stdio.h, ssd1306.c relies on that
+#include <stdio.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+extern esp_log_level_t host_log_level;
+
+void host_log(esp_log_level_t level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, fmt, ...) host_log(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) host_log(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) host_log(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) host_log(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) host_log(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#endif /* HOST_SHIM_ESP_LOG_H_ */
@@ -0,0 +1,15 @@
+/*
+ * esp_timer.h (host shim)
+ *
+ * Monotonic clock plus the ticks passed to vTaskDelay, so code that paces
+ * itself against esp_timer sees its delays elapse without sleeping.
+ */
+
+#ifndef HOST_SHIM_ESP_TIMER_H_
+#define HOST_SHIM_ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* HOST_SHIM_ESP_TIMER_H_ */
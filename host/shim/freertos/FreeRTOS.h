@@ -0,0 +1,31 @@
+/*
+ * FreeRTOS.h (host shim)
+ *
+ * Just enough of the FreeRTOS types for the portable modules, critical
+ * sections map to a pthread mutex.
+ */
+
+#ifndef HOST_SHIM_FREERTOS_H_
+#define HOST_SHIM_FREERTOS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef int             BaseType_t;
+typedef unsigned int    UBaseType_t;
+typedef uint32_t        TickType_t;
+
+#define pdTRUE          (1)
+#define pdFALSE         (0)
+#define pdPASS          (pdTRUE)
+#define pdFAIL          (pdFALSE)
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS  (10)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+
+#endif /* HOST_SHIM_FREERTOS_H_ */
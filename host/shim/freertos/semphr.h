@@ -0,0 +1,19 @@
+/*
+ * semphr.h (host shim)
+ *
+ * Mutex semaphores only, on a pthread mutex.
+ */
+
+#ifndef HOST_SHIM_SEMPHR_H_
+#define HOST_SHIM_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+// ticks 0 polls, anything else waits for the mutex
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#endif /* HOST_SHIM_SEMPHR_H_ */
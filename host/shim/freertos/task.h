@@ -0,0 +1,27 @@
+/*
+ * task.h (host shim)
+ *
+ * vTaskDelay does not sleep, the ticks a benchmark asked for are counted
+ * in host_ticks_delayed so blocking waits show up in the report. Tasks are
+ * pthreads, core and priority are ignored; notifications are a counter.
+ */
+
+#ifndef HOST_SHIM_TASK_H_
+#define HOST_SHIM_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+extern uint64_t host_ticks_delayed;
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *task, BaseType_t core);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+#endif /* HOST_SHIM_TASK_H_ */
@@ -0,0 +1,286 @@
+/*
+ * shim.c
+ *
+ * Host implementations behind the shim headers: log sink, tick counter and
+ * clock, FreeRTOS tasks, mutexes and the queue, mem_track on libc and an
+ * ssd1306 transport that counts what would go over the bus instead of
+ * driving it.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mem_track.h"
+#include "ssd1306.h"
+#include "shim.h"
+
+esp_log_level_t     host_log_level = ESP_LOG_WARN;
+uint64_t            host_ticks_delayed;
+host_bus_stats_t    host_bus;
+
+void host_log(esp_log_level_t level, const char *tag, const char *fmt, ...){
+    va_list ap;
+
+    if (level > host_log_level) {
+        return;
+    }
+    fprintf(stderr, "%c %s: ", "NEWIDV"[level], tag);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void vTaskDelay(TickType_t ticks){
+    host_ticks_delayed += ticks;
+}
+
+TickType_t xTaskGetTickCount(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000 / portTICK_PERIOD_MS + ts.tv_nsec / 1000000 / portTICK_PERIOD_MS);
+}
+
+int64_t esp_timer_get_time(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000
+           + (int64_t)host_ticks_delayed * portTICK_PERIOD_MS * 1000;
+}
+
+struct host_task {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  notified;
+    uint32_t        notify;
+    TaskFunction_t  fn;
+    void            *arg;
+};
+
+static __thread struct host_task *current_task;
+
+static void *_task_main(void *arg)
+{
+    struct host_task *task = arg;
+    current_task = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core){
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->notified, NULL);
+    task->fn = fn;
+    task->arg = arg;
+    if (handle) {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, _task_main, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task){
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks){
+    struct host_task *task = current_task;
+    struct timespec until;
+    uint32_t n;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += (time_t)ticks * portTICK_PERIOD_MS / 1000;
+    until.tv_nsec += (long)(ticks * portTICK_PERIOD_MS % 1000) * 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&task->notified, &task->lock);
+        } else if (pthread_cond_timedwait(&task->notified, &task->lock, &until) != 0) {
+            break;
+        }
+    }
+    n = task->notify;
+    if (n) {
+        task->notify = clear ? 0 : n - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return n;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void){
+    SemaphoreHandle_t sem = malloc(sizeof(pthread_mutex_t));
+    if (sem) {
+        pthread_mutex_init(sem, NULL);
+    }
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks){
+    if (ticks == 0) {
+        return pthread_mutex_trylock(sem) == 0 ? pdTRUE : pdFALSE;
+    }
+    pthread_mutex_lock(sem);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem){
+    pthread_mutex_unlock(sem);
+    return pdTRUE;
+}
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+    uint8_t         items[];
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size){
+    QueueHandle_t q = calloc(1, sizeof(struct host_queue) + length * item_size);
+    if (q == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->length = length;
+    q->item_size = item_size;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q){
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->changed);
+    free(q);
+}
+
+// ticks 0 polls, anything else waits until the queue changes
+static bool _wait(QueueHandle_t q, bool for_space, TickType_t ticks)
+{
+    while (for_space ? q->count == q->length : q->count == 0) {
+        if (ticks == 0) {
+            return false;
+        }
+        pthread_cond_wait(&q->changed, &q->lock);
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks){
+    pthread_mutex_lock(&q->lock);
+    if (!_wait(q, true, ticks)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFAIL;
+    }
+    memcpy(&q->items[((q->head + q->count) % q->length) * q->item_size], item, q->item_size);
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks){
+    pthread_mutex_lock(&q->lock);
+    if (!_wait(q, false, ticks)) {
+        pthread_mutex_unlock(&q->lock);
+        return pdFALSE;
+    }
+    memcpy(item, &q->items[q->head * q->item_size], q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q){
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t n = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+void *mem_calloc(mem_sys_t sys, size_t n, size_t size){
+    return calloc(n, size);
+}
+
+void *mem_malloc(mem_sys_t sys, size_t size){
+    return malloc(size);
+}
+
+void mem_free(void *ptr){
+    free(ptr);
+}
+
+// same framing as ssd1306_i2c.c, the ESP-IDF i2c calls become byte counts
+void i2c_init(SSD1306_t *dev, int width, int height){
+    dev->_address = I2CAddress;
+    dev->_flip = false;
+    dev->_width = width;
+    dev->_height = height;
+    dev->_pages = height == 32 ? 4 : 8;
+}
+
+void i2c_display_image(SSD1306_t *dev, int page, int seg, uint8_t *images, int width){
+    if (page >= dev->_pages || seg >= dev->_width) {
+        return;
+    }
+    // command transaction for column/page, then the data transaction
+    host_bus.transactions += 2;
+    host_bus.bytes += (1 + 1 + 3) + (1 + 1 + width);
+}
+
+void i2c_contrast(SSD1306_t *dev, int contrast){
+    host_bus.transactions++;
+    host_bus.bytes += 4;
+}
+
+void i2c_hardware_scroll(SSD1306_t *dev, ssd1306_scroll_type_t scroll){
+    host_bus.transactions++;
+    host_bus.bytes += 10;
+}
+
+void spi_init(SSD1306_t *dev, int width, int height){
+    i2c_init(dev, width, height);
+    dev->_address = SPIAddress;
+}
+
+void spi_display_image(SSD1306_t *dev, int page, int seg, uint8_t *images, int width){
+    i2c_display_image(dev, page, seg, images, width);
+}
+
+void spi_contrast(SSD1306_t *dev, int contrast){
+    i2c_contrast(dev, contrast);
+}
+
+void spi_hardware_scroll(SSD1306_t *dev, ssd1306_scroll_type_t scroll){
+    i2c_hardware_scroll(dev, scroll);
+}
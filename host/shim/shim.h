@@ -0,0 +1,22 @@
+/*
+ * shim.h
+ *
+ * Counters the host shims keep for the benchmark report.
+ */
+
+#ifndef HOST_SHIM_SHIM_H_
+#define HOST_SHIM_SHIM_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint64_t transactions;
+    uint64_t bytes;
+} host_bus_stats_t;
+
+// display bus traffic the ssd1306 transport would have sent
+extern host_bus_stats_t host_bus;
+// ticks passed to vTaskDelay
+extern uint64_t host_ticks_delayed;
+
+#endif /* HOST_SHIM_SHIM_H_ */
@@ -0,0 +1,27 @@
+/*
+ * adf_sim.h (job_sim)
+ *
+ * Opaque ADF and board types, enough for the headers job_sched.c pulls
+ * in. board.h, audio_*.h and esp_peripherals.h all include this.
+ */
+
+#ifndef HOST_SIM_ADF_SIM_H_
+#define HOST_SIM_ADF_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct audio_element *audio_element_handle_t;
+typedef struct audio_pipeline *audio_pipeline_handle_t;
+typedef struct esp_periph_set *esp_periph_set_handle_t;
+
+typedef struct {
+    int     cmd;
+    void    *source;
+    void    *data;
+    int     data_len;
+} audio_event_iface_msg_t;
+
+#endif /* HOST_SIM_ADF_SIM_H_ */
@@ -0,0 +1,10 @@
+/*
+ * audio_event_iface.h (job_sim)
+ */
+
+#ifndef HOST_SIM_AUDIO_EVENT_IFACE_H_
+#define HOST_SIM_AUDIO_EVENT_IFACE_H_
+
+#include "adf_sim.h"
+
+#endif /* HOST_SIM_AUDIO_EVENT_IFACE_H_ */
@@ -0,0 +1,10 @@
+/*
+ * audio_pipeline.h (job_sim)
+ */
+
+#ifndef HOST_SIM_AUDIO_PIPELINE_H_
+#define HOST_SIM_AUDIO_PIPELINE_H_
+
+#include "adf_sim.h"
+
+#endif /* HOST_SIM_AUDIO_PIPELINE_H_ */
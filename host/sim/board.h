@@ -0,0 +1,10 @@
+/*
+ * board.h (job_sim)
+ */
+
+#ifndef HOST_SIM_BOARD_H_
+#define HOST_SIM_BOARD_H_
+
+#include "adf_sim.h"
+
+#endif /* HOST_SIM_BOARD_H_ */
@@ -0,0 +1,26 @@
+/*
+ * esp_heap_caps.h (job_sim)
+ *
+ * No heap to report on the host, every size reads 0.
+ */
+
+#ifndef HOST_SIM_ESP_HEAP_CAPS_H_
+#define HOST_SIM_ESP_HEAP_CAPS_H_
+
+#include <stddef.h>
+
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_SPIRAM       (1 << 10)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+
+static inline size_t heap_caps_get_free_size(int caps)
+{
+    return 0;
+}
+
+static inline size_t heap_caps_get_minimum_free_size(int caps)
+{
+    return 0;
+}
+
+#endif /* HOST_SIM_ESP_HEAP_CAPS_H_ */
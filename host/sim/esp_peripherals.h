@@ -0,0 +1,10 @@
+/*
+ * esp_peripherals.h (job_sim)
+ */
+
+#ifndef HOST_SIM_ESP_PERIPHERALS_H_
+#define HOST_SIM_ESP_PERIPHERALS_H_
+
+#include "adf_sim.h"
+
+#endif /* HOST_SIM_ESP_PERIPHERALS_H_ */
@@ -0,0 +1,15 @@
+/*
+ * sdkconfig.h (job_sim)
+ *
+ * The options job_sched.c reads, release timeout shortened to the
+ * simulated time scale.
+ */
+
+#ifndef HOST_SIM_SDKCONFIG_H_
+#define HOST_SIM_SDKCONFIG_H_
+
+#define CONFIG_PIPELINE_IDLE_RELEASE_MS     200
+#define CONFIG_TASK_REACTOR_CORE            0
+#define CONFIG_TASK_REACTOR_PRIO            10
+
+#endif /* HOST_SIM_SDKCONFIG_H_ */
@@ -0,0 +1,26 @@
+/*
+ * test.h
+ *
+ * Minimal checks for the host tests: a failed CHECK prints where and
+ * counts, main returns TEST_RESULT() so ctest sees the failure.
+ */
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+
+static int test_failed;
+
+#define CHECK(cond, ...) do {                                           \
+        if (!(cond)) {                                                  \
+            printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #cond);      \
+            printf(__VA_ARGS__);                                        \
+            printf("\n");                                               \
+            test_failed++;                                              \
+        }                                                               \
+    } while (0)
+
+#define TEST_RESULT() (test_failed ? (printf("%d checks failed\n", test_failed), 1) : (printf("ok\n"), 0))
+
+#endif /* HOST_TEST_H_ */
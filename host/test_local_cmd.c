@@ -0,0 +1,108 @@
+/*
+ * test_local_cmd.c
+ *
+ * Local command list parsing: actions and rows, the MultiNet phrase
+ * string, comments, blank lines and CRLF, and every rejected form
+ * including overflow of the command table and of the phrase buffer.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "local_cmd_list.h"
+#include "test.h"
+
+static local_cmd_list_t list;
+
+static bool _row(int id, local_action_t act, const char *phrases)
+{
+    const local_cmd_t *cmd = &list.cmds[id];
+    return cmd->action == act && cmd->len == strlen(phrases)
+           && strncmp(list.phrases + cmd->off, phrases, cmd->len) == 0;
+}
+
+static void test_valid()
+{
+    CHECK(local_cmd_list_parse(&list, "light_on=da kai dian deng,kai dian deng\n"
+                                      "stop=ting zhi\n"
+                                      "cloud=jin tian tian qi"), "parse");
+    CHECK(list.num == 3, "%d rows", list.num);
+    CHECK(_row(0, LOCAL_ACT_LIGHT_ON, "da kai dian deng,kai dian deng"), "row 0");
+    CHECK(_row(1, LOCAL_ACT_STOP, "ting zhi"), "row 1");
+    CHECK(_row(2, LOCAL_ACT_NONE, "jin tian tian qi"), "row 2, no trailing newline");
+    CHECK(strcmp(list.phrases, "da kai dian deng,kai dian deng;ting zhi;jin tian tian qi;") == 0,
+          "phrases '%s'", list.phrases);
+    CHECK(strcmp(local_cmd_action_str(LOCAL_ACT_VOLUME_DOWN), "volume_down") == 0, "action name");
+    CHECK(strcmp(local_cmd_action_str(LOCAL_ACT_MAX), "?") == 0, "action out of range");
+}
+
+static void test_skipped()
+{
+    CHECK(local_cmd_list_parse(&list, "# local commands\r\n"
+                                      "\r\n"
+                                      "volume_up=a,b\r\n"
+                                      "   \n"
+                                      "#volume_down=c\n"
+                                      "\n"
+                                      "volume_down=c  \r\n"), "parse");
+    CHECK(list.num == 2, "%d rows", list.num);
+    CHECK(_row(0, LOCAL_ACT_VOLUME_UP, "a,b"), "row 0 without CR");
+    CHECK(_row(1, LOCAL_ACT_VOLUME_DOWN, "c"), "row 1 without trailing blanks");
+    CHECK(strcmp(list.phrases, "a,b;c;") == 0, "phrases '%s'", list.phrases);
+}
+
+static void test_rejected()
+{
+    const char *bad[] = {
+        "",
+        "# only a comment\n\n",
+        "light_on=a\nswitch_on=b\n",
+        "light_on=a\nlight_on a\n",
+        "light_on=\n",
+        "=a\n",
+        "light_on=a;b\n",
+        "light_on;=a\n",
+        " light_on=a\n",
+    };
+
+    for (int i = 0; i < (int)(sizeof(bad) / sizeof(bad[0])); i++) {
+        CHECK(!local_cmd_list_parse(&list, bad[i]), "accepted '%s'", bad[i]);
+    }
+}
+
+static void test_overflow()
+{
+    char text[LOCAL_CMD_PHRASES_LEN * 2];
+    int len = 0;
+
+    for (int i = 0; i < LOCAL_CMD_MAX; i++) {
+        len += sprintf(text + len, "stop=p%d\n", i);
+    }
+    CHECK(local_cmd_list_parse(&list, text), "%d commands", LOCAL_CMD_MAX);
+    CHECK(list.num == LOCAL_CMD_MAX, "%d rows", list.num);
+    CHECK(_row(LOCAL_CMD_MAX - 1, LOCAL_ACT_STOP, "p31"), "last row");
+    strcat(text, "light_on=one more\n");
+    CHECK(!local_cmd_list_parse(&list, text), "%d commands", LOCAL_CMD_MAX + 1);
+
+    // phrases plus ';' plus the terminator fill the buffer exactly
+    char phrase[LOCAL_CMD_PHRASES_LEN];
+    memset(phrase, 'a', sizeof(phrase));
+    phrase[LOCAL_CMD_PHRASES_LEN - 2] = 0;
+    snprintf(text, sizeof(text), "stop=%s\n", phrase);
+    CHECK(local_cmd_list_parse(&list, text), "phrases of %d bytes", LOCAL_CMD_PHRASES_LEN - 1);
+    CHECK(strlen(list.phrases) == LOCAL_CMD_PHRASES_LEN - 1, "phrases length %d", (int)strlen(list.phrases));
+    phrase[LOCAL_CMD_PHRASES_LEN - 2] = 'a';
+    phrase[LOCAL_CMD_PHRASES_LEN - 1] = 0;
+    snprintf(text, sizeof(text), "stop=%s\n", phrase);
+    CHECK(!local_cmd_list_parse(&list, text), "phrases of %d bytes", LOCAL_CMD_PHRASES_LEN);
+}
+
+int main()
+{
+    host_log_level = ESP_LOG_NONE;
+    test_valid();
+    test_skipped();
+    test_rejected();
+    test_overflow();
+    return TEST_RESULT();
+}
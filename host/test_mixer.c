@@ -0,0 +1,188 @@
+/*
+ * test_mixer.c
+ *
+ * Mix kernel results: sums of several inputs, fixed and ramped gains,
+ * saturation of full scale inputs and the gain clamp. Port bookkeeping:
+ * underruns for short gaps and long stalls, none for an end of stream.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mixer_kernel.h"
+#include "test.h"
+
+#define FRAMES  (64)
+#define N       (FRAMES * MIXER_KERNEL_CHANNELS)
+
+static int16_t in[MIXER_KERNEL_MAX_INPUTS][N];
+static int16_t out[N];
+static int32_t acc[N];
+
+static void _fill(int16_t *buf, int16_t v)
+{
+    for (int s = 0; s < N; s++) {
+        buf[s] = v;
+    }
+}
+
+static void test_sum()
+{
+    const int16_t *src[4] = { in[0], in[1], in[2], NULL };
+    const int32_t g[4] = { MIXER_GAIN_UNITY, MIXER_GAIN_UNITY, MIXER_GAIN_UNITY, MIXER_GAIN_UNITY };
+
+    for (int s = 0; s < N; s++) {
+        in[0][s] = (int16_t)(s * 37);
+        in[1][s] = (int16_t)(s * -11);
+        in[2][s] = (int16_t)(1000 - s);
+    }
+    mixer_kernel_mix(out, acc, src, g, g, 4, FRAMES);
+    for (int s = 0; s < N; s++) {
+        CHECK(out[s] == s * 37 - s * 11 + 1000 - s, "sample %d is %d", s, out[s]);
+    }
+}
+
+static void test_gain()
+{
+    const int16_t *src[2] = { in[0], in[1] };
+    const int32_t g[2] = { mixer_kernel_gain(50), mixer_kernel_gain(25) };
+
+    _fill(in[0], 8000);
+    _fill(in[1], -8000);
+    mixer_kernel_mix(out, acc, src, g, g, 2, FRAMES);
+    for (int s = 0; s < N; s++) {
+        CHECK(out[s] == 2000, "sample %d is %d", s, out[s]);
+    }
+
+    // zero gain skips the input
+    const int32_t off[2] = { MIXER_GAIN_UNITY, 0 };
+    mixer_kernel_mix(out, acc, src, off, off, 2, FRAMES);
+    CHECK(out[0] == 8000 && out[N - 1] == 8000, "%d %d", out[0], out[N - 1]);
+}
+
+static void test_ramp()
+{
+    const int16_t *src[1] = { in[0] };
+    const int32_t from[1] = { 0 };
+    const int32_t to[1] = { MIXER_GAIN_UNITY };
+
+    _fill(in[0], 16000);
+    mixer_kernel_mix(out, acc, src, from, to, 1, FRAMES);
+    CHECK(out[0] == 0 && out[1] == 0, "first frame %d %d", out[0], out[1]);
+    for (int s = 2; s < N; s += 2) {
+        CHECK(out[s] == out[s + 1], "frame %d L %d R %d", s / 2, out[s], out[s + 1]);
+        CHECK(out[s] >= out[s - 2], "frame %d falls %d -> %d", s / 2, out[s - 2], out[s]);
+    }
+    // the last frame is one step short of the target gain
+    CHECK(out[N - 1] < 16000 && out[N - 1] > 16000 - 2 * 16000 / FRAMES, "last frame %d", out[N - 1]);
+}
+
+static void test_clip()
+{
+    const int16_t *src[MIXER_KERNEL_MAX_INPUTS];
+    int32_t g[MIXER_KERNEL_MAX_INPUTS];
+
+    for (int i = 0; i < MIXER_KERNEL_MAX_INPUTS; i++) {
+        src[i] = in[i];
+        g[i] = MIXER_GAIN_UNITY;
+    }
+    // all inputs at full scale, the int32 sum must not wrap
+    for (int i = 0; i < MIXER_KERNEL_MAX_INPUTS; i++) {
+        _fill(in[i], INT16_MAX);
+    }
+    mixer_kernel_mix(out, acc, src, g, g, MIXER_KERNEL_MAX_INPUTS, FRAMES);
+    for (int s = 0; s < N; s++) {
+        CHECK(out[s] == INT16_MAX, "sample %d is %d", s, out[s]);
+    }
+    for (int i = 0; i < MIXER_KERNEL_MAX_INPUTS; i++) {
+        _fill(in[i], INT16_MIN);
+    }
+    mixer_kernel_mix(out, acc, src, g, g, MIXER_KERNEL_MAX_INPUTS, FRAMES);
+    for (int s = 0; s < N; s++) {
+        CHECK(out[s] == INT16_MIN, "sample %d is %d", s, out[s]);
+    }
+
+    // a clamped gain above 100% saturates instead of overflowing
+    for (int i = 0; i < MIXER_KERNEL_MAX_INPUTS; i++) {
+        g[i] = mixer_kernel_gain(400);
+        _fill(in[i], i & 1 ? INT16_MIN : INT16_MAX);
+    }
+    _fill(in[1], INT16_MAX);
+    mixer_kernel_mix(out, acc, src, g, g, MIXER_KERNEL_MAX_INPUTS, FRAMES);
+    CHECK(out[0] == INT16_MAX, "sample 0 is %d", out[0]);
+}
+
+static void test_gain_clamp()
+{
+    CHECK(mixer_kernel_gain(100) == MIXER_GAIN_UNITY, "%d", mixer_kernel_gain(100));
+    CHECK(mixer_kernel_gain(150) == MIXER_GAIN_UNITY, "%d", mixer_kernel_gain(150));
+    CHECK(mixer_kernel_gain(-20) == 0, "%d", mixer_kernel_gain(-20));
+    CHECK(mixer_kernel_gain(30) == 30 * MIXER_GAIN_UNITY / 100, "%d", mixer_kernel_gain(30));
+}
+
+#define FRAME_BYTES (FRAMES * MIXER_KERNEL_CHANNELS * 2)
+
+// one mixer frame with filled bytes in the port ring, returns what was read
+static int _port_frame(mixer_port_state_t *p, int filled, bool eos, int *underruns)
+{
+    int got = 0;
+
+    if (mixer_kernel_port_want(p, filled, FRAME_BYTES)) {
+        // a dry ring reads nothing, the end of stream shows up then
+        got = filled < FRAME_BYTES ? filled : FRAME_BYTES;
+    }
+    *underruns += mixer_kernel_port_update(p, got, FRAME_BYTES, eos);
+    return got;
+}
+
+static void test_port()
+{
+    mixer_port_state_t p = { 0 };
+    int underruns = 0;
+
+    // idle port, nothing read and nothing counted
+    for (int f = 0; f < 10; f++) {
+        CHECK(_port_frame(&p, 0, false, &underruns) == 0, "idle frame %d read", f);
+    }
+    CHECK(!p.active && underruns == 0, "idle: active %d, %d underruns", p.active, underruns);
+
+    // steady stream
+    for (int f = 0; f < 10; f++) {
+        _port_frame(&p, FRAME_BYTES, false, &underruns);
+    }
+    CHECK(p.active && underruns == 0, "steady: active %d, %d underruns", p.active, underruns);
+
+    // a one frame gap is counted once the data is back
+    _port_frame(&p, 0, false, &underruns);
+    CHECK(p.active && underruns == 0, "gap: active %d, %d underruns", p.active, underruns);
+    _port_frame(&p, FRAME_BYTES, false, &underruns);
+    CHECK(underruns == 1, "short gap: %d underruns", underruns);
+
+    // a stall past the tail is counted when the port goes inactive, not again on resume
+    for (int f = 0; f < 50; f++) {
+        _port_frame(&p, 0, false, &underruns);
+    }
+    CHECK(!p.active && underruns == 2, "stall: active %d, %d underruns", p.active, underruns);
+    _port_frame(&p, FRAME_BYTES, false, &underruns);
+    _port_frame(&p, FRAME_BYTES, false, &underruns);
+    CHECK(p.active && underruns == 2, "resume: active %d, %d underruns", p.active, underruns);
+
+    // a partial tail is flushed, then the end of stream is no underrun
+    _port_frame(&p, FRAME_BYTES / 3, false, &underruns);
+    CHECK(_port_frame(&p, FRAME_BYTES / 3, false, &underruns) == FRAME_BYTES / 3, "tail not flushed");
+    for (int f = 0; f < 10; f++) {
+        _port_frame(&p, 0, true, &underruns);
+    }
+    CHECK(!p.active && underruns == 2, "end of stream: active %d, %d underruns", p.active, underruns);
+}
+
+int main()
+{
+    test_sum();
+    test_gain();
+    test_ramp();
+    test_clip();
+    test_gain_clamp();
+    test_port();
+    return TEST_RESULT();
+}
@@ -0,0 +1,159 @@
+/*
+ * test_msg_pool.c
+ *
+ * Message pool slot exhaustion and reuse: every slot handed out once,
+ * refusal without blocking when none is left, LIFO reuse of freed slots,
+ * payload copies, oversize rejection and alloc/free from two threads.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "msg_pool.h"
+#include "test.h"
+
+#define THREAD_ROUNDS   (100000)
+
+static void _drain()
+{
+    main_msg_t *msg;
+    while (xQueueReceive(main_q, &msg, 0) == pdTRUE) {
+        msg_pool_free(msg);
+    }
+}
+
+static void test_exhaustion()
+{
+    main_msg_t *msg[MSG_POOL_SLOTS];
+    msg_pool_stats_t st;
+
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        msg[i] = msg_pool_alloc();
+        CHECK(msg[i] != NULL, "slot %d", i);
+        for (int j = 0; j < i; j++) {
+            CHECK(msg[i] != msg[j], "slot %d handed out twice", j);
+        }
+    }
+    CHECK(msg_pool_alloc() == NULL, "alloc from an empty pool");
+    CHECK(!main_msg_post(EXIT), "post with no slot left");
+    CHECK(!main_msg_post_xfer(FILE2PLAYER, "/sdcard/a.mp3", NULL), "xfer post with no slot left");
+    msg_pool_get_stats(&st);
+    CHECK(st.in_use == MSG_POOL_SLOTS && st.high_water == MSG_POOL_SLOTS, "in use %u, high water %u",
+          st.in_use, st.high_water);
+    CHECK(st.no_slot == 3, "no_slot %u", st.no_slot);
+
+    // the slot freed last is the next one handed out
+    msg_pool_free(msg[3]);
+    main_msg_t *again = msg_pool_alloc();
+    CHECK(again == msg[3], "freed slot not reused");
+    msg_pool_free(NULL);
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        msg_pool_free(msg[i]);
+    }
+    msg_pool_get_stats(&st);
+    CHECK(st.in_use == 0 && st.high_water == MSG_POOL_SLOTS, "in use %u, high water %u", st.in_use,
+          st.high_water);
+}
+
+static void test_payload()
+{
+    char src[MSG_URL_LEN + 1];
+    main_msg_t *msg = NULL;
+    msg_pool_stats_t before, after;
+
+    // the sender's buffer is reused right after posting
+    strcpy(src, "http://server/answer.mp3");
+    CHECK(main_msg_post_xfer(HTTP2PLAYER, src, "/sdcard/answer.mp3"), "post");
+    memset(src, 'x', sizeof(src) - 1);
+    src[sizeof(src) - 1] = 0;
+    CHECK(xQueueReceive(main_q, &msg, 0) == pdTRUE, "receive");
+    if (msg) {
+        CHECK(msg->msg_id == HTTP2PLAYER, "msg_id %d", msg->msg_id);
+        CHECK(strcmp(msg->xfer.src, "http://server/answer.mp3") == 0, "src %s", msg->xfer.src);
+        CHECK(strcmp(msg->xfer.dst, "/sdcard/answer.mp3") == 0, "dst %s", msg->xfer.dst);
+        msg_pool_free(msg);
+    }
+
+    // longest that fits, then one more byte
+    msg_pool_get_stats(&before);
+    src[MSG_URL_LEN - 1] = 0;
+    CHECK(main_msg_post_xfer(FILE2HTTP, src, NULL), "%d byte url", MSG_URL_LEN - 1);
+    src[MSG_URL_LEN - 1] = 'x';
+    src[MSG_URL_LEN] = 0;
+    CHECK(!main_msg_post_xfer(FILE2HTTP, src, NULL), "%d byte url", MSG_URL_LEN);
+    CHECK(!main_msg_post_xfer(FILE2HTTP, "/sdcard/a.wav", src), "%d byte dst", MSG_URL_LEN);
+    msg_pool_get_stats(&after);
+    CHECK(after.oversize == before.oversize + 2, "oversize %u", after.oversize);
+    CHECK(after.in_use == 1, "oversize took a slot, in use %u", after.in_use);
+    _drain();
+}
+
+static void test_reuse()
+{
+    msg_pool_stats_t before, after;
+
+    msg_pool_get_stats(&before);
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+            main_msg_post(EXIT);
+        }
+        _drain();
+    }
+    msg_pool_get_stats(&after);
+    CHECK(after.posted == before.posted + 1000 * MSG_POOL_SLOTS, "posted %u", after.posted - before.posted);
+    CHECK(after.no_slot == before.no_slot && after.queue_full == before.queue_full, "no_slot %u, queue_full %u",
+          after.no_slot, after.queue_full);
+    CHECK(after.in_use == 0, "in use %u", after.in_use);
+}
+
+static void *_churn(void *arg)
+{
+    for (int i = 0; i < THREAD_ROUNDS; i++) {
+        main_msg_t *a = msg_pool_alloc();
+        main_msg_t *b = msg_pool_alloc();
+        msg_pool_free(a);
+        msg_pool_free(b);
+    }
+    return NULL;
+}
+
+static void test_threads()
+{
+    pthread_t t[2];
+    main_msg_t *msg[MSG_POOL_SLOTS];
+    msg_pool_stats_t st;
+
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&t[i], NULL, _churn, NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        pthread_join(t[i], NULL);
+    }
+    msg_pool_get_stats(&st);
+    CHECK(st.in_use == 0, "in use %u", st.in_use);
+    // no slot lost or duplicated
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        msg[i] = msg_pool_alloc();
+        CHECK(msg[i] != NULL, "slot %d", i);
+        for (int j = 0; j < i; j++) {
+            CHECK(msg[i] != msg[j], "slot %d handed out twice", j);
+        }
+    }
+    CHECK(msg_pool_alloc() == NULL, "more than %d slots", MSG_POOL_SLOTS);
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        msg_pool_free(msg[i]);
+    }
+}
+
+int main()
+{
+    // refusals log errors, expected here
+    host_log_level = ESP_LOG_NONE;
+    init_msg_pool();
+    test_exhaustion();
+    test_payload();
+    test_reuse();
+    test_threads();
+    return TEST_RESULT();
+}
@@ -0,0 +1,145 @@
+/*
+ * test_replay.c
+ *
+ * Replay reader against generated WAV files: header checks, file channels
+ * mapped onto the feed channels, reads across loop and tail boundaries,
+ * the silent tail and the end of the replay, and stop.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "replay.h"
+#include "wav_header.h"
+#include "test.h"
+
+#define TAIL_FRAMES (REPLAY_SAMPLE_RATE * REPLAY_TAIL_MS / 1000)
+// odd so reads straddle the loop and tail boundaries
+#define READ_FRAMES (300)
+
+static char path[64];
+
+// frame i channel c holds (c + 1) * 1000 + i % 1000
+static int16_t _sample(int i, int c)
+{
+    return (c + 1) * 1000 + i % 1000;
+}
+
+static bool _write_wav(int frames, int channels, uint32_t rate)
+{
+    uint8_t hdr[WAV_HEADER_LEN];
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL) {
+        return false;
+    }
+    wav_header_build(hdr, frames * channels * sizeof(int16_t), channels, rate, 16);
+    fwrite(hdr, 1, sizeof(hdr), fp);
+    for (int i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            int16_t s = _sample(i, c);
+            fwrite(&s, sizeof(s), 1, fp);
+        }
+    }
+    return fclose(fp) == 0;
+}
+
+// reads the whole replay, checks every frame, returns the frames read
+static int _read_all(int file_frames, int file_ch, int loops, int channels)
+{
+    int16_t buf[READ_FRAMES * 4];
+    int frame = 0;
+    int bad = 0;
+
+    while (replay_active()) {
+        int ret = replay_read(buf, READ_FRAMES * channels * sizeof(int16_t), channels);
+        if (ret == 0) {
+            break;
+        }
+        CHECK(ret == READ_FRAMES * channels * (int)sizeof(int16_t), "read returned %d", ret);
+        for (int i = 0; i < READ_FRAMES; i++, frame++) {
+            for (int c = 0; c < channels; c++) {
+                int16_t want = 0;
+                if (frame < file_frames * loops && c < file_ch) {
+                    want = _sample(frame % file_frames, c);
+                }
+                if (buf[i * channels + c] != want && bad++ < 5) {
+                    CHECK(false, "frame %d ch %d: %d, want %d", frame, c, buf[i * channels + c], want);
+                }
+            }
+        }
+    }
+    CHECK(bad == 0, "%d wrong samples", bad);
+    return frame;
+}
+
+static void test_reject()
+{
+    CHECK(!replay_start("/nonexistent/replay.wav", 0, 1), "missing file");
+    CHECK(_write_wav(100, 1, 8000), "write");
+    CHECK(!replay_start(path, 0, 1), "8 kHz file");
+    CHECK(replay_get_state() != REPLAY_RUNNING, "state after a rejected start");
+    CHECK(replay_read((int16_t[2]) {0}, 4, 2) == 0, "read without a replay");
+}
+
+static void test_channels(int file_ch, int channels)
+{
+    const int frames = 1000;
+    // the whole file and the tail, rounded up to whole reads
+    const int total = (frames + TAIL_FRAMES + READ_FRAMES - 1) / READ_FRAMES * READ_FRAMES;
+
+    CHECK(_write_wav(frames, file_ch, REPLAY_SAMPLE_RATE), "write");
+    CHECK(replay_start(path, 0, 1), "start %d ch file", file_ch);
+    CHECK(replay_active(), "active after start");
+    int n = _read_all(frames, file_ch, 1, channels);
+    CHECK(n == total, "%d ch into %d: %d frames, want %d", file_ch, channels, n, total);
+    CHECK(replay_get_state() == REPLAY_DONE, "state %d at the end", replay_get_state());
+    CHECK(!replay_active(), "active after the tail");
+    CHECK(replay_read((int16_t[2]) {0}, 4, 2) == 0, "read after the end");
+}
+
+static void test_loops()
+{
+    const int frames = 700;
+    const int total = (3 * frames + TAIL_FRAMES + READ_FRAMES - 1) / READ_FRAMES * READ_FRAMES;
+
+    CHECK(_write_wav(frames, 2, REPLAY_SAMPLE_RATE), "write");
+    CHECK(replay_start(path, 0, 3), "start");
+    CHECK(!replay_start(path, 0, 1), "second start while running");
+    int n = _read_all(frames, 2, 3, 2);
+    CHECK(n == total, "3 loops: %d frames, want %d", n, total);
+}
+
+static void test_stop()
+{
+    int16_t buf[READ_FRAMES];
+
+    CHECK(_write_wav(10000, 1, REPLAY_SAMPLE_RATE), "write");
+    CHECK(replay_start(path, 0, 1), "start");
+    CHECK(replay_read(buf, sizeof(buf), 1) == sizeof(buf), "read before stop");
+    replay_stop();
+    CHECK(replay_active(), "stop takes effect on the next read");
+    CHECK(replay_read(buf, sizeof(buf), 1) == 0, "read after stop");
+    CHECK(replay_get_state() == REPLAY_DONE, "state %d after stop", replay_get_state());
+    CHECK(replay_start(path, 0, 1), "start again after stop");
+    replay_stop();
+    replay_read(buf, sizeof(buf), 1);
+}
+
+int main()
+{
+    host_log_level = ESP_LOG_NONE;
+    snprintf(path, sizeof(path), "/tmp/test_replay_%d.wav", (int)getpid());
+
+    test_reject();
+    test_channels(1, 1);
+    test_channels(1, 3);
+    test_channels(2, 2);
+    test_channels(4, 2);
+    test_loops();
+    test_stop();
+    unlink(path);
+    return TEST_RESULT();
+}
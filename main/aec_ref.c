@@ -0,0 +1,236 @@
+#include "aec_ref.h"
+#include "mem_track.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "audio_mem.h"
+
+static const char *TAG = "aec_ref";
+
+// 512ms of 16kHz mono, power of two so indices can free-run
+#define REF_RING_SAMPLES    (8192)
+#define REF_RING_MASK       (REF_RING_SAMPLES - 1)
+// 48kHz -> 16kHz
+#define REF_DECIMATE        (3)
+// re-align when the fifo drifts more than this from the target delay
+#define REF_RESYNC_SLACK    (AEC_REF_SAMPLE_RATE / 50)
+
+#define MS_TO_SAMPLES(ms)   ((ms) * AEC_REF_SAMPLE_RATE / 1000)
+// a feed task that has not stopped capturing by then is not running
+#define CAL_STOP_WAIT_MS    (500)
+
+static int16_t              *ring;
+// single producer (mixer task) / single consumer (AFE feed task)
+static volatile uint32_t    ring_w;
+static volatile uint32_t    ring_r;
+static volatile int         delay_samples;
+static volatile bool        delay_changed;
+static int32_t              dec_acc;
+static int                  dec_cnt;
+
+static int16_t              *cal_mic;
+static int16_t              *cal_ref;
+static int                  cal_len;
+static int                  cal_pos;
+// set by start, cleared only by the feed task once it left the buffers alone
+static volatile bool        cal_active;
+// finish asks the feed task to stop capturing early
+static volatile bool        cal_stop;
+
+void aec_ref_init(int delay_ms){
+    ring = mem_calloc(MEM_SYS_RECORDER, REF_RING_SAMPLES, sizeof(int16_t));
+    mem_assert(ring);
+    aec_ref_set_delay(delay_ms);
+    // prefill silence so the consumer starts delay_samples behind
+    ring_r = 0;
+    ring_w = delay_samples;
+    ESP_LOGI(TAG, "Software AEC reference, delay %d ms", delay_ms);
+}
+
+void aec_ref_deinit(){
+    mem_free(ring);
+    ring = NULL;
+}
+
+void aec_ref_push(const int16_t *pcm, int frames){
+    if (ring == NULL) {
+        return;
+    }
+    uint32_t w = ring_w;
+    for (int i = 0; i < frames; i++) {
+        // stereo to mono, then box filter + decimate
+        dec_acc += (pcm[2 * i] + pcm[2 * i + 1]) >> 1;
+        if (++dec_cnt == REF_DECIMATE) {
+            ring[w & REF_RING_MASK] = (int16_t)(dec_acc / REF_DECIMATE);
+            w++;
+            dec_acc = 0;
+            dec_cnt = 0;
+        }
+    }
+    ring_w = w;
+}
+
+void aec_ref_fill(int16_t *pcm, int frames, int channels, int ref_ch){
+    if (ring == NULL) {
+        return;
+    }
+    uint32_t w = ring_w;
+    uint32_t r = ring_r;
+    bool cal = cal_active;
+    int target = cal ? 0 : delay_samples;
+    int level = (int)(w - r);
+
+    if (delay_changed || level < target - REF_RESYNC_SLACK || level > target + REF_RESYNC_SLACK) {
+        r = w - target;
+        level = target;
+        delay_changed = false;
+    }
+
+    for (int i = 0; i < frames; i++) {
+        int16_t ref = 0;
+        if (level > 0) {
+            ref = ring[r & REF_RING_MASK];
+            r++;
+            level--;
+        }
+        if (cal && cal_pos < cal_len) {
+            cal_mic[cal_pos] = pcm[i * channels];
+            cal_ref[cal_pos] = ref;
+            cal_pos++;
+        }
+        pcm[i * channels + ref_ch] = ref;
+    }
+    ring_r = r;
+    if (cal && (cal_pos == cal_len || cal_stop)) {
+        cal_active = false;
+    }
+}
+
+void aec_ref_set_delay(int delay_ms){
+    if (delay_ms < 0) {
+        delay_ms = 0;
+    } else if (delay_ms > AEC_REF_MAX_DELAY_MS) {
+        delay_ms = AEC_REF_MAX_DELAY_MS;
+    }
+    delay_samples = MS_TO_SAMPLES(delay_ms);
+    delay_changed = true;
+}
+
+int aec_ref_get_delay(){
+    return delay_samples * 1000 / AEC_REF_SAMPLE_RATE;
+}
+
+bool aec_ref_calibrate_start(int samples){
+    if (cal_active) {
+        ESP_LOGW(TAG, "Previous calibration still captured by the feed task");
+        return false;
+    }
+    // left by a finish that timed out, the feed task has let go of them since
+    mem_free(cal_mic);
+    mem_free(cal_ref);
+    cal_mic = mem_calloc(MEM_SYS_RECORDER, samples, sizeof(int16_t));
+    cal_ref = mem_calloc(MEM_SYS_RECORDER, samples, sizeof(int16_t));
+    if (cal_mic == NULL || cal_ref == NULL) {
+        mem_free(cal_mic);
+        mem_free(cal_ref);
+        cal_mic = cal_ref = NULL;
+        return false;
+    }
+    cal_len = samples;
+    cal_pos = 0;
+    cal_stop = false;
+    delay_changed = true;
+    cal_active = true;
+    return true;
+}
+
+bool aec_ref_calibrate_done(){
+    return !cal_active;
+}
+
+int aec_ref_calibrate_finish(int max_delay_ms){
+    int measured = -1;
+
+    if (cal_mic == NULL) {
+        return -1;
+    }
+    // the feed task may be inside aec_ref_fill, it lets go of the buffers itself
+    cal_stop = true;
+    for (int i = 0; i < CAL_STOP_WAIT_MS / 10 && cal_active; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (cal_active) {
+        // buffers stay allocated until the feed task lets go, the next start frees them
+        ESP_LOGW(TAG, "Feed task did not stop capturing, keep delay %d ms", aec_ref_get_delay());
+        return -1;
+    }
+    if (cal_pos == cal_len) {
+        int lag = aec_ref_estimate_delay(cal_mic, cal_ref, cal_len, MS_TO_SAMPLES(max_delay_ms));
+        measured = lag * 1000 / AEC_REF_SAMPLE_RATE;
+        ESP_LOGI(TAG, "Measured playback to capture delay %d ms (configured %d ms, error %d ms)",
+                 measured, aec_ref_get_delay(), measured - aec_ref_get_delay());
+        aec_ref_set_delay(measured);
+    } else {
+        ESP_LOGW(TAG, "Calibration incomplete, keep delay %d ms", aec_ref_get_delay());
+        delay_changed = true;
+    }
+    mem_free(cal_mic);
+    mem_free(cal_ref);
+    cal_mic = cal_ref = NULL;
+    return measured;
+}
+
+static int64_t xcorr(const int16_t *mic, const int16_t *ref, int n, int lag)
+{
+    int64_t sum = 0;
+    for (int i = 0; i + lag < n; i++) {
+        sum += (int32_t)mic[i + lag] * ref[i];
+    }
+    return sum;
+}
+
+int aec_ref_estimate_delay(const int16_t *mic, const int16_t *ref, int n, int max_lag){
+    const int dn = n / 4;
+    int16_t *dmic = mem_calloc(MEM_SYS_RECORDER, dn, sizeof(int16_t));
+    int16_t *dref = mem_calloc(MEM_SYS_RECORDER, dn, sizeof(int16_t));
+    int best = 0;
+    int64_t best_corr = INT64_MIN;
+
+    if (max_lag >= n) {
+        max_lag = n - 1;
+    }
+    if (dmic && dref) {
+        // box filter + 4x decimation, the coarse search is blind to sub-step lags otherwise
+        for (int i = 0; i < dn; i++) {
+            dmic[i] = (mic[4 * i] + mic[4 * i + 1] + mic[4 * i + 2] + mic[4 * i + 3]) >> 2;
+            dref[i] = (ref[4 * i] + ref[4 * i + 1] + ref[4 * i + 2] + ref[4 * i + 3]) >> 2;
+        }
+        const int dmax = max_lag / 4;
+        for (int lag = 0; lag <= dmax; lag++) {
+            int64_t c = xcorr(dmic, dref, dn - dmax + lag, lag);
+            if (c > best_corr) {
+                best_corr = c;
+                best = lag * 4;
+            }
+        }
+    }
+    mem_free(dmic);
+    mem_free(dref);
+
+    int coarse = best;
+    best_corr = INT64_MIN;
+    for (int lag = coarse - 4; lag <= coarse + 4; lag++) {
+        if (lag < 0 || lag > max_lag) {
+            continue;
+        }
+        int64_t c = xcorr(mic, ref, n - max_lag + lag, lag);
+        if (c > best_corr) {
+            best_corr = c;
+            best = lag;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,43 @@
+/*
+ * aec_ref.h
+ *
+ * Software playback reference for boards without hardware AEC loopback.
+ * The mixer pushes the final 48kHz stereo PCM it hands to the i2s writer,
+ * the AFE feed pulls it back as 16kHz mono, delayed by the measured
+ * playback-to-capture latency, into the reference channel.
+ */
+
+#ifndef MAIN_AEC_REF_H_
+#define MAIN_AEC_REF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AEC_REF_SAMPLE_RATE (16000)
+#define AEC_REF_MAX_DELAY_MS (400)
+
+void aec_ref_init(int delay_ms);
+void aec_ref_deinit();
+
+// producer side, called by the mixer with 48kHz interleaved stereo frames
+void aec_ref_push(const int16_t *pcm, int frames);
+// consumer side, overwrite channel ref_ch of an interleaved 16kHz capture buffer
+void aec_ref_fill(int16_t *pcm, int frames, int channels, int ref_ch);
+
+void aec_ref_set_delay(int delay_ms);
+int aec_ref_get_delay();
+
+// capture mic/reference pairs undelayed, then estimate the delay from them
+bool aec_ref_calibrate_start(int samples);
+bool aec_ref_calibrate_done();
+int aec_ref_calibrate_finish(int max_delay_ms);
+
+/**
+ * Lag (in samples) of mic relative to ref with the highest cross
+ * correlation, searched in [0, max_lag]. Coarse search on 4x decimated
+ * samples, then refined at full rate. Without scratch memory for the coarse
+ * pass only lags close to 0 are searched.
+ */
+int aec_ref_estimate_delay(const int16_t *mic, const int16_t *ref, int n, int max_lag);
+
+#endif /* MAIN_AEC_REF_H_ */
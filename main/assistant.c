@@ -0,0 +1,261 @@
+#include "main.h"
+#include "assistant.h"
+#include "job_sched.h"
+#include "cpu_load.h"
+#include "local_cmd.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_tone_uri.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "assistant";
+
+#define ASSIST_QUEUE_LEN        (16)
+#define ASSIST_TASK_STACK       (4 * 1024)
+// the recorder normally reports WAKEUP_END before this
+#define ASSIST_WAKE_TIMEOUT_MS  (10 * 1000)
+// upload finished, no answer started playing
+#define ASSIST_WAIT_TIMEOUT_MS  (15 * 1000)
+
+static const char *state_names[ASSIST_STATE_MAX] = {
+    [ASSIST_IDLE]       = "IDLE",
+    [ASSIST_WAKE]       = "WAKE",
+    [ASSIST_LISTENING]  = "LISTENING",
+    [ASSIST_UPLOADING]  = "UPLOADING",
+    [ASSIST_WAITING]    = "WAITING",
+    [ASSIST_SPEAKING]   = "SPEAKING",
+};
+
+static const char *event_names[ASSIST_EV_MAX] = {
+    [ASSIST_EV_WAKEUP]      = "wakeup",
+    [ASSIST_EV_WAKEUP_END]  = "wakeup_end",
+    [ASSIST_EV_VAD_START]   = "vad_start",
+    [ASSIST_EV_VAD_END]     = "vad_end",
+    [ASSIST_EV_REC_END]     = "rec_end",
+    [ASSIST_EV_UPLOAD_DONE] = "upload_done",
+    [ASSIST_EV_UPLOAD_FAIL] = "upload_fail",
+    [ASSIST_EV_SPEAK_START] = "speak_start",
+    [ASSIST_EV_SPEAK_DONE]  = "speak_done",
+    [ASSIST_EV_TIMEOUT]     = "timeout",
+    [ASSIST_EV_COMMAND]     = "command",
+};
+
+static const int state_timeout_ms[ASSIST_STATE_MAX] = {
+    [ASSIST_WAKE]       = ASSIST_WAKE_TIMEOUT_MS,
+    [ASSIST_WAITING]    = ASSIST_WAIT_TIMEOUT_MS,
+};
+
+static QueueHandle_t            evt_q;
+// written by the assistant task only
+static volatile assist_state_t  state = ASSIST_IDLE;
+static int64_t                  entered_us;
+static int64_t                  stage_us[ASSIST_STATE_MAX];
+static assist_stats_t           stats;
+
+static void _conversation_end()
+{
+    int64_t total = 0;
+    for (int s = ASSIST_WAKE; s < ASSIST_STATE_MAX; s++) {
+        stats.stage_us_last[s] = stage_us[s];
+        if (stage_us[s] > stats.stage_us_max[s]) {
+            stats.stage_us_max[s] = stage_us[s];
+        }
+        total += stage_us[s];
+    }
+    ESP_LOGI(TAG, "Conversation %u: wake %lld, listen %lld, upload %lld, wait %lld, speak %lld, total %lld ms",
+             stats.conversations, stage_us[ASSIST_WAKE] / 1000, stage_us[ASSIST_LISTENING] / 1000,
+             stage_us[ASSIST_UPLOADING] / 1000, stage_us[ASSIST_WAITING] / 1000,
+             stage_us[ASSIST_SPEAKING] / 1000, total / 1000);
+}
+
+static void _enter(assist_state_t to, assist_event_t ev)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (state == ASSIST_IDLE) {
+        memset(stage_us, 0, sizeof(stage_us));
+        stats.conversations++;
+    } else {
+        stage_us[state] += now - entered_us;
+    }
+    ESP_LOGI(TAG, "%s -> %s on %s, %lld ms in %s", state_names[state], state_names[to],
+             event_names[ev], (now - entered_us) / 1000, state_names[state]);
+    state = to;
+    entered_us = now;
+    if (to == ASSIST_IDLE) {
+        _conversation_end();
+    }
+}
+
+static void _handle(assist_event_t ev)
+{
+    assist_state_t from = state;
+
+    switch (ev) {
+        case ASSIST_EV_WAKEUP:
+            if (state == ASSIST_LISTENING) {
+                // a new wake word drops the utterance in progress
+                voice_rec_end(false);
+            }
+#if CONFIG_BARGE_IN_ENABLE
+            // the wake word interrupts the current response
+            job_sched_cancel_res(JOB_RES_I2S_OUT);
+#endif
+            if (state != ASSIST_IDLE) {
+                _enter(ASSIST_IDLE, ev);
+            }
+            _enter(ASSIST_WAKE, ev);
+            // played synchronously: events queue up until the tone is out, about 0.5 s
+            run_tone2player(tone_uri[TONE_TYPE_DINGDONG], NULL);
+            break;
+        case ASSIST_EV_VAD_START:
+            // also a follow-up utterance, or push-to-talk from IDLE
+            if (state == ASSIST_LISTENING) {
+                break;
+            }
+            if (voice_rec_begin()) {
+                _enter(ASSIST_LISTENING, ev);
+            }
+            break;
+        case ASSIST_EV_VAD_END:
+        case ASSIST_EV_REC_END:
+            if (state == ASSIST_LISTENING) {
+                _enter(voice_rec_end(true) ? ASSIST_UPLOADING : ASSIST_IDLE, ev);
+            }
+            break;
+        case ASSIST_EV_WAKEUP_END:
+            if (state == ASSIST_WAKE) {
+                _enter(ASSIST_IDLE, ev);
+            }
+            break;
+        case ASSIST_EV_UPLOAD_DONE:
+            if (state == ASSIST_UPLOADING) {
+                _enter(ASSIST_WAITING, ev);
+            }
+            break;
+        case ASSIST_EV_UPLOAD_FAIL:
+            if (state == ASSIST_UPLOADING) {
+                _enter(ASSIST_IDLE, ev);
+            }
+            break;
+        case ASSIST_EV_SPEAK_START:
+            if (state == ASSIST_UPLOADING || state == ASSIST_WAITING) {
+                _enter(ASSIST_SPEAKING, ev);
+            }
+            break;
+        case ASSIST_EV_SPEAK_DONE:
+            if (state == ASSIST_SPEAKING) {
+                stats.completed++;
+                _enter(ASSIST_IDLE, ev);
+            }
+            break;
+#if CONFIG_LOCAL_CMD_ENABLE
+        case ASSIST_EV_COMMAND:
+            // only while waiting for speech, later it is the server's turn
+            if (state != ASSIST_WAKE && state != ASSIST_LISTENING) {
+                break;
+            }
+            if (state == ASSIST_LISTENING) {
+                voice_rec_end(false);
+            }
+            // blocks for the action's tone like the wake tone above
+            local_cmd_run();
+            // end the wake window, the rest of the utterance is not uploaded
+            enable_wwe_trigger(false);
+            stats.local_commands++;
+            _enter(ASSIST_IDLE, ev);
+            break;
+#endif
+        case ASSIST_EV_TIMEOUT:
+            stats.timeouts++;
+            if (state == ASSIST_LISTENING) {
+                voice_rec_end(false);
+            }
+            _enter(ASSIST_IDLE, ev);
+            break;
+        default:
+            break;
+    }
+    if (state == from && ev != ASSIST_EV_WAKEUP) {
+        ESP_LOGD(TAG, "Ignore %s in %s", event_names[ev], state_names[state]);
+    }
+}
+
+static TickType_t _wait_ticks()
+{
+    if (state == ASSIST_LISTENING) {
+        // poll, the recorder read blocks until data is there
+        return 0;
+    }
+    if (state_timeout_ms[state] == 0) {
+        return portMAX_DELAY;
+    }
+    int64_t left_us = entered_us + (int64_t)state_timeout_ms[state] * 1000 - esp_timer_get_time();
+    return left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) : 0;
+}
+
+static void assistant_task(void *arg)
+{
+    assist_event_t ev;
+
+    while (1) {
+        TickType_t wait = _wait_ticks();
+        if (xQueueReceive(evt_q, &ev, wait) == pdTRUE) {
+            _handle(ev);
+        } else if (state == ASSIST_LISTENING) {
+            if (voice_rec_step() <= 0) {
+                _handle(ASSIST_EV_REC_END);
+            }
+        } else if (wait != portMAX_DELAY) {
+            _handle(ASSIST_EV_TIMEOUT);
+        }
+    }
+}
+
+// job scheduler, under its lock
+static void _on_job(pipe_type_t type, bool started, reactor_result_t result)
+{
+    if (type == PIPE_FILE2HTTP && !started) {
+        assistant_post(result == REACTOR_DONE ? ASSIST_EV_UPLOAD_DONE : ASSIST_EV_UPLOAD_FAIL);
+    } else if (type == PIPE_HTTP2PLAYER) {
+        assistant_post(started ? ASSIST_EV_SPEAK_START : ASSIST_EV_SPEAK_DONE);
+    }
+}
+
+void init_assistant(){
+    evt_q = xQueueCreate(ASSIST_QUEUE_LEN, sizeof(assist_event_t));
+    mem_assert(evt_q);
+    entered_us = esp_timer_get_time();
+    job_sched_set_observer(_on_job);
+    if (xTaskCreatePinnedToCore(assistant_task, "assistant", ASSIST_TASK_STACK, NULL,
+                                TASK_PRIO(VOICE_WRITER), NULL, TASK_CORE(VOICE_WRITER)) != pdPASS) {
+        ESP_LOGE(TAG, "Create assistant task failed");
+    }
+}
+
+bool assistant_post(assist_event_t ev){
+    if (xQueueSend(evt_q, &ev, 0) != pdPASS) {
+        stats.lost_events++;
+        ESP_LOGE(TAG, "Event queue full, lost %s", event_names[ev]);
+        return false;
+    }
+    return true;
+}
+
+assist_state_t assistant_get_state(){
+    return state;
+}
+
+const char *assistant_state_str(assist_state_t s){
+    return s < ASSIST_STATE_MAX ? state_names[s] : "?";
+}
+
+void assistant_get_stats(assist_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
@@ -0,0 +1,67 @@
+/*
+ * assistant.h
+ *
+ * Conversation state machine: IDLE -> WAKE -> LISTENING -> UPLOADING ->
+ * WAITING -> SPEAKING -> IDLE. Recorder callbacks and job completions only
+ * post events, the assistant task is the single owner of the state and
+ * of the voice recording. The entry time of each state is taken from
+ * esp_timer, the stage durations of a conversation are logged when it
+ * returns to IDLE.
+ */
+
+#ifndef MAIN_ASSISTANT_H_
+#define MAIN_ASSISTANT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    ASSIST_IDLE = 0,
+    ASSIST_WAKE,
+    ASSIST_LISTENING,
+    ASSIST_UPLOADING,
+    ASSIST_WAITING,
+    ASSIST_SPEAKING,
+    ASSIST_STATE_MAX,
+} assist_state_t;
+
+typedef enum {
+    ASSIST_EV_WAKEUP = 0,
+    ASSIST_EV_WAKEUP_END,
+    ASSIST_EV_VAD_START,
+    ASSIST_EV_VAD_END,
+    // recorder has no more data for the current utterance
+    ASSIST_EV_REC_END,
+    ASSIST_EV_UPLOAD_DONE,
+    ASSIST_EV_UPLOAD_FAIL,
+    ASSIST_EV_SPEAK_START,
+    ASSIST_EV_SPEAK_DONE,
+    ASSIST_EV_TIMEOUT,
+    // MultiNet command with a local action, see local_cmd.h
+    ASSIST_EV_COMMAND,
+    ASSIST_EV_MAX,
+} assist_event_t;
+
+typedef struct {
+    uint32_t conversations;
+    // ended in SPEAKING, or WAITING when nothing was played
+    uint32_t completed;
+    // ended by a command run on the device
+    uint32_t local_commands;
+    uint32_t timeouts;
+    uint32_t lost_events;
+    // time spent in each state, last conversation and worst case
+    int64_t  stage_us_last[ASSIST_STATE_MAX];
+    int64_t  stage_us_max[ASSIST_STATE_MAX];
+} assist_stats_t;
+
+void init_assistant();
+
+// from any task or callback, never blocks
+bool assistant_post(assist_event_t ev);
+assist_state_t assistant_get_state();
+const char *assistant_state_str(assist_state_t state);
+
+void assistant_get_stats(assist_stats_t *stats);
+
+#endif /* MAIN_ASSISTANT_H_ */
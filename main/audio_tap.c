@@ -0,0 +1,367 @@
+#include "main.h"
+#include "audio_tap.h"
+#include "cpu_load.h"
+#include "ctl_server.h"
+#include "mem_track.h"
+#include "voice_file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "ringbuf.h"
+#include "sdkconfig.h"
+
+#if CONFIG_AUDIO_TAP_ENABLE
+
+static const char *TAG = "audio_tap";
+
+#define TAP_RING_SIZE       (CONFIG_AUDIO_TAP_RING_KB * 1024)
+// drain unit, one UDP datagram
+#define TAP_CHUNK           (1024)
+#define TAP_DRAIN_MS        (20)
+#define TAP_TASK_STACK      (4 * 1024)
+#define TAP_DEST_LEN        (32)
+#define TAP_JSON_LEN        (1024)
+
+typedef struct {
+    int rate;
+    int channels;
+    int bits;
+} tap_fmt_t;
+
+static const char *tap_names[TAP_MAX] = {
+    [TAP_MIC]       = "mic",
+    [TAP_RESAMPLE]  = "resample",
+    [TAP_AFE_IN]    = "afe_in",
+    [TAP_REC_OUT]   = "rec_out",
+};
+
+volatile uint32_t           audio_tap_mask;
+// created on first use and kept, a producer may still be writing after its bit is cleared
+static ringbuf_handle_t     rings[TAP_MAX];
+static tap_fmt_t            fmts[TAP_MAX];
+static tap_stats_t          stats[TAP_MAX];
+// sink state below is owned by whoever holds tap_lock
+static SemaphoreHandle_t    tap_lock;
+static tap_sink_t           cur_sink;
+static char                 cur_dest[TAP_DEST_LEN];
+static int                  session;
+static voice_file_t         files[TAP_MAX];
+static int                  udp_sock = -1;
+static struct sockaddr_in   udp_addr;
+static uint32_t             udp_seq[TAP_MAX];
+static uint8_t              pkt[sizeof(tap_udp_hdr_t) + TAP_CHUNK];
+
+static esp_err_t _files_open(uint32_t mask, const char *dir)
+{
+    char name[VOICE_FILE_NAME_LEN];
+
+    for (int i = 0; i < TAP_MAX; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        const wav_info_t fmt = {
+            .channels = fmts[i].channels,
+            .rate = fmts[i].rate,
+            .bits = fmts[i].bits,
+        };
+        snprintf(name, sizeof(name), "%s/tap_%s_%d.%s", dir, tap_names[i], session, fmt.bits ? "wav" : "raw");
+        if (!voice_file_open(&files[i], name, fmt.bits ? &fmt : NULL)) {
+            ESP_LOGE(TAG, "Open %s failed", name);
+            for (int j = 0; j < i; j++) {
+                if (files[j].fp) {
+                    voice_file_close(&files[j], false);
+                }
+            }
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t _udp_open(const char *dest)
+{
+    char host[TAP_DEST_LEN];
+    const char *colon = strrchr(dest, ':');
+
+    if (colon == NULL || colon - dest >= sizeof(host)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(host, dest, colon - dest);
+    host[colon - dest] = 0;
+    memset(&udp_addr, 0, sizeof(udp_addr));
+    udp_addr.sin_family = AF_INET;
+    udp_addr.sin_port = htons(atoi(colon + 1));
+    if (inet_pton(AF_INET, host, &udp_addr.sin_addr) != 1 || udp_addr.sin_port == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    return udp_sock < 0 ? ESP_FAIL : ESP_OK;
+}
+
+static void _sink_close(uint32_t mask)
+{
+    if (cur_sink == TAP_SINK_UDP) {
+        close(udp_sock);
+        udp_sock = -1;
+        return;
+    }
+    for (int i = 0; i < TAP_MAX; i++) {
+        if ((mask & (1u << i)) && files[i].fp) {
+            uint32_t size = voice_file_close(&files[i], true);
+            ESP_LOGI(TAG, "%s: %u bytes in %s", tap_names[i], size, files[i].name);
+        }
+    }
+}
+
+static void _drain(uint32_t mask)
+{
+    tap_udp_hdr_t *hdr = (tap_udp_hdr_t *)pkt;
+    uint8_t *data = pkt + sizeof(tap_udp_hdr_t);
+
+    for (int i = 0; i < TAP_MAX; i++) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        tap_stats_t *st = &stats[i];
+        int filled = rb_bytes_filled(rings[i]);
+        while (filled > 0) {
+            int n = rb_read(rings[i], (char *)data, filled < TAP_CHUNK ? filled : TAP_CHUNK, 0);
+            if (n <= 0) {
+                break;
+            }
+            filled -= n;
+            bool ok;
+            if (cur_sink == TAP_SINK_UDP) {
+                hdr->magic = TAP_UDP_MAGIC;
+                hdr->tap = i;
+                hdr->channels = fmts[i].channels;
+                hdr->bits = fmts[i].bits;
+                hdr->reserved = 0;
+                hdr->len = n;
+                hdr->seq = udp_seq[i]++;
+                hdr->rate = fmts[i].rate;
+                hdr->dropped_bytes = st->dropped_bytes;
+                ok = sendto(udp_sock, pkt, sizeof(tap_udp_hdr_t) + n, 0,
+                            (struct sockaddr *)&udp_addr, sizeof(udp_addr)) >= 0;
+            } else {
+                ok = voice_file_write(&files[i], data, n);
+            }
+            if (ok) {
+                st->sent += n;
+            } else {
+                st->sink_errors++;
+            }
+        }
+    }
+}
+
+// rb_reset would race a producer still inside rb_write, read it empty instead; tap_lock held
+static void _discard(ringbuf_handle_t rb)
+{
+    int filled;
+
+    while ((filled = rb_bytes_filled(rb)) > 0
+           && rb_read(rb, (char *)pkt, filled < sizeof(pkt) ? filled : sizeof(pkt), 0) > 0) {
+    }
+}
+
+static void tap_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(TAP_DRAIN_MS));
+        if (audio_tap_mask == 0) {
+            continue;
+        }
+        xSemaphoreTake(tap_lock, portMAX_DELAY);
+        _drain(audio_tap_mask);
+        xSemaphoreGive(tap_lock);
+    }
+}
+
+void audio_tap_write(tap_point_t pt, const void *buf, int len){
+    tap_stats_t *st = &stats[pt];
+
+    if (len <= 0) {
+        return;
+    }
+    st->bytes += len;
+    // whole buffers or nothing, a partial one would shift the sample alignment
+    if (rb_bytes_available(rings[pt]) < len) {
+        st->dropped_bytes += len;
+        st->drops++;
+        return;
+    }
+    rb_write(rings[pt], (char *)buf, len, 0);
+}
+
+void audio_tap_set_format(tap_point_t pt, int rate, int channels, int bits){
+    fmts[pt].rate = rate;
+    fmts[pt].channels = channels;
+    fmts[pt].bits = bits;
+}
+
+esp_err_t audio_tap_start(uint32_t mask, tap_sink_t sink, const char *dest){
+    esp_err_t err = ESP_OK;
+
+    mask &= TAP_MASK_ALL;
+    if (mask == 0 || dest == NULL || strlen(dest) >= TAP_DEST_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    audio_tap_stop();
+
+    xSemaphoreTake(tap_lock, portMAX_DELAY);
+    for (int i = 0; i < TAP_MAX && err == ESP_OK; i++) {
+        if ((mask & (1u << i)) && rings[i] == NULL) {
+            rings[i] = rb_create(TAP_CHUNK, TAP_RING_SIZE / TAP_CHUNK);
+            err = rings[i] ? ESP_OK : ESP_ERR_NO_MEM;
+        }
+    }
+    session++;
+    cur_sink = sink;
+    if (err == ESP_OK) {
+        err = sink == TAP_SINK_UDP ? _udp_open(dest) : _files_open(mask, dest);
+    }
+    if (err == ESP_OK) {
+        for (int i = 0; i < TAP_MAX; i++) {
+            if (mask & (1u << i)) {
+                _discard(rings[i]);
+                memset(&stats[i], 0, sizeof(stats[i]));
+                udp_seq[i] = 0;
+            }
+        }
+        strcpy(cur_dest, dest);
+        audio_tap_mask = mask;
+        ESP_LOGI(TAG, "Taps 0x%x to %s %s", mask, sink == TAP_SINK_UDP ? "udp" : "file", dest);
+    }
+    xSemaphoreGive(tap_lock);
+    return err;
+}
+
+void audio_tap_stop(){
+    xSemaphoreTake(tap_lock, portMAX_DELAY);
+    uint32_t mask = audio_tap_mask;
+    audio_tap_mask = 0;
+    if (mask) {
+        // what is queued already still goes out
+        _drain(mask);
+        _sink_close(mask);
+        for (int i = 0; i < TAP_MAX; i++) {
+            if (mask & (1u << i)) {
+                ESP_LOGI(TAG, "%s: %llu bytes, sent %llu, dropped %u in %u buffers, %u sink errors",
+                         tap_names[i], stats[i].bytes, stats[i].sent, stats[i].dropped_bytes,
+                         stats[i].drops, stats[i].sink_errors);
+            }
+        }
+    }
+    xSemaphoreGive(tap_lock);
+}
+
+const char *audio_tap_str(tap_point_t pt){
+    return pt < TAP_MAX ? tap_names[pt] : "?";
+}
+
+void audio_tap_get_stats(tap_point_t pt, tap_stats_t *out){
+    memcpy(out, &stats[pt], sizeof(*out));
+}
+
+static uint32_t _parse_points(char *list)
+{
+    uint32_t mask = 0;
+    char *save = NULL;
+
+    for (char *p = strtok_r(list, ",", &save); p; p = strtok_r(NULL, ",", &save)) {
+        if (strcmp(p, "all") == 0) {
+            return TAP_MASK_ALL;
+        }
+        for (int i = 0; i < TAP_MAX; i++) {
+            if (strcmp(p, tap_names[i]) == 0) {
+                mask |= 1u << i;
+            }
+        }
+    }
+    return mask;
+}
+
+static int _json(char *buf, int len)
+{
+    int n = snprintf(buf, len, "{\"mask\":%u,\"sink\":\"%s\",\"dest\":\"%s\",\"taps\":{", audio_tap_mask,
+                     cur_sink == TAP_SINK_UDP ? "udp" : "file", cur_dest);
+    for (int i = 0; i < TAP_MAX && n < len; i++) {
+        n += snprintf(buf + n, len - n, "%s\"%s\":{\"on\":%d,\"rate\":%d,\"channels\":%d,\"bits\":%d,"
+                      "\"bytes\":%llu,\"sent\":%llu,\"dropped_bytes\":%u,\"drops\":%u,\"sink_errors\":%u}",
+                      i ? "," : "", tap_names[i], (audio_tap_mask >> i) & 1, fmts[i].rate, fmts[i].channels,
+                      fmts[i].bits, stats[i].bytes, stats[i].sent, stats[i].dropped_bytes, stats[i].drops,
+                      stats[i].sink_errors);
+    }
+    if (n < len) {
+        n += snprintf(buf + n, len - n, "}}\n");
+    }
+    return n < len ? n : len - 1;
+}
+
+// GET /tap: formats and counters as JSON.
+// POST /tap?points=<mic,resample,afe_in,rec_out|all>&sink=<file|udp>&dest=<dir|ip:port>, POST /tap?stop=1
+static esp_err_t _http_tap(httpd_req_t *req)
+{
+    char points[48];
+    char sink[8];
+    char dest[TAP_DEST_LEN];
+
+    if (req->method == HTTP_POST) {
+        if (ctl_server_query(req, "stop", sink, sizeof(sink))) {
+            audio_tap_stop();
+        } else {
+            if (!ctl_server_query(req, "points", points, sizeof(points))) {
+                strcpy(points, "all");
+            }
+            if (!ctl_server_query(req, "sink", sink, sizeof(sink))) {
+                strcpy(sink, "file");
+            }
+            if (!ctl_server_query(req, "dest", dest, sizeof(dest))) {
+                strcpy(dest, "/sdcard");
+            }
+            tap_sink_t s = strcmp(sink, "udp") == 0 ? TAP_SINK_UDP : TAP_SINK_FILE;
+            if (audio_tap_start(_parse_points(points), s, dest) != ESP_OK) {
+                return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST,
+                                           "points=<list|all>&sink=<file|udp>&dest=<dir|ip:port> or stop=1");
+            }
+        }
+    }
+    char *json = mem_malloc(MEM_SYS_SYSTEM, TAP_JSON_LEN);
+    if (json == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    int len = _json(json, TAP_JSON_LEN);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, json, len);
+    mem_free(json);
+    return err;
+}
+
+static const httpd_uri_t tap_uris[] = {
+    { .uri = "/tap", .method = HTTP_GET,  .handler = _http_tap },
+    { .uri = "/tap", .method = HTTP_POST, .handler = _http_tap },
+};
+
+void init_audio_tap(){
+    tap_lock = xSemaphoreCreateMutex();
+    mem_assert(tap_lock);
+    if (xTaskCreatePinnedToCore(tap_task, "audio_tap", TAP_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create audio_tap task failed");
+        return;
+    }
+    for (int i = 0; i < sizeof(tap_uris) / sizeof(tap_uris[0]); i++) {
+        ctl_server_register(&tap_uris[i]);
+    }
+    ESP_LOGI(TAG, "%d tap points on /tap, %d KB ring each", TAP_MAX, CONFIG_AUDIO_TAP_RING_KB);
+}
+
+#endif /* CONFIG_AUDIO_TAP_ENABLE */
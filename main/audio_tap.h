@@ -0,0 +1,96 @@
+/*
+ * audio_tap.h
+ *
+ * Copies of the capture path audio for field debugging. Each tap point is
+ * a bit in audio_tap_mask, while it is clear AUDIO_TAP() is a load and a
+ * branch. An enabled tap copies into its own ring without blocking, a
+ * buffer that does not fit is dropped whole and counted. A low priority
+ * task drains the rings into WAV files on the SD card, or into UDP
+ * datagrams for tools/tap_recv.py. POST /tap starts and stops taps, GET
+ * /tap reports formats and counters.
+ */
+
+#ifndef MAIN_AUDIO_TAP_H_
+#define MAIN_AUDIO_TAP_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+typedef enum {
+    // i2s reader output, codec rate and width
+    TAP_MIC = 0,
+    // filter output as read by the AFE feed
+    TAP_RESAMPLE,
+    // what the AFE gets, after replay and the AEC reference
+    TAP_AFE_IN,
+    // recorder output written to the utterance file
+    TAP_REC_OUT,
+    TAP_MAX,
+} tap_point_t;
+
+typedef enum {
+    TAP_SINK_FILE = 0,
+    TAP_SINK_UDP,
+} tap_sink_t;
+
+#define TAP_MASK_ALL        ((1u << TAP_MAX) - 1)
+
+// UDP datagram header, little endian, followed by len bytes of audio
+#define TAP_UDP_MAGIC       (0x5441)
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t  tap;
+    uint8_t  channels;
+    uint8_t  bits;
+    uint8_t  reserved;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t rate;
+    // running total for the tap, the receiver pads the gap with silence
+    uint32_t dropped_bytes;
+} tap_udp_hdr_t;
+
+typedef struct {
+    // offered by the audio path while enabled
+    uint64_t bytes;
+    uint64_t sent;
+    uint32_t dropped_bytes;
+    // buffers dropped because the ring was full
+    uint32_t drops;
+    uint32_t sink_errors;
+} tap_stats_t;
+
+extern volatile uint32_t audio_tap_mask;
+
+#if CONFIG_AUDIO_TAP_ENABLE
+#define AUDIO_TAP(pt, buf, len) \
+    do { \
+        if (__builtin_expect(audio_tap_mask & (1u << (pt)), 0)) { \
+            audio_tap_write((pt), (buf), (len)); \
+        } \
+    } while (0)
+#else
+#define AUDIO_TAP(pt, buf, len) do { } while (0)
+#endif
+
+// /tap endpoints and the drain task
+void init_audio_tap();
+// format of the audio at pt; bits 0 is not PCM, written without a WAV header
+void audio_tap_set_format(tap_point_t pt, int rate, int channels, int bits);
+
+/**
+ * Start the taps in mask, the running ones are stopped first. dest is a
+ * directory for TAP_SINK_FILE and "<ip>:<port>" for TAP_SINK_UDP.
+ */
+esp_err_t audio_tap_start(uint32_t mask, tap_sink_t sink, const char *dest);
+// files are closed with their final size
+void audio_tap_stop();
+
+// through AUDIO_TAP(), one producer task per tap point
+void audio_tap_write(tap_point_t pt, const void *buf, int len);
+const char *audio_tap_str(tap_point_t pt);
+void audio_tap_get_stats(tap_point_t pt, tap_stats_t *stats);
+
+#endif /* MAIN_AUDIO_TAP_H_ */
@@ -0,0 +1,188 @@
+#include "main.h"
+#include "cpu_load.h"
+#include "mem_track.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "audio_mem.h"
+
+static const char *TAG = "cpu_load";
+
+#define CPU_LOAD_TASK_STACK (3 * 1024)
+// tasks below 0.5% are summed up, not listed
+#define CPU_LOAD_LIST_MIN   (5)
+
+typedef struct {
+    const char  *name;
+    int         core;
+    int         prio;
+} task_place_t;
+
+static const task_place_t task_plan[] = {
+    { "i2s",            TASK_CORE(I2S),             TASK_PRIO(I2S) },
+    { "capture",        TASK_CORE(CAPTURE),         TASK_PRIO(CAPTURE) },
+    { "afe_feed",       TASK_CORE(AFE_FEED),        TASK_PRIO(AFE_FEED) },
+    { "afe_fetch",      TASK_CORE(AFE_FETCH),       TASK_PRIO(AFE_FETCH) },
+    { "recorder",       TASK_CORE(RECORDER),        TASK_PRIO(RECORDER) },
+    { "assistant",      TASK_CORE(VOICE_WRITER),    TASK_PRIO(VOICE_WRITER) },
+    { "mixer",          TASK_CORE(MIXER),           TASK_PRIO(MIXER) },
+    { "decoder",        TASK_CORE(DECODER),         TASK_PRIO(DECODER) },
+    { "net",            TASK_CORE(NET),             TASK_PRIO(NET) },
+    { "sd",             TASK_CORE(SD),              TASK_PRIO(SD) },
+    { "reactor",        TASK_CORE(REACTOR),         TASK_PRIO(REACTOR) },
+    { "job_sched",      TASK_CORE(REACTOR),         TASK_PRIO(REACTOR) },
+    { "cpu_load",       TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "trace",          TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "dlog",           TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "el_stats",       TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "mem_track",      TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "audio_tap",      TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+    { "speech_cmds",    TASK_CORE(DIAG),            TASK_PRIO(DIAG) },
+};
+
+static cpu_load_stats_t stats;
+static portMUX_TYPE     tasks_lock = portMUX_INITIALIZER_UNLOCKED;
+static cpu_task_load_t  task_load[CPU_LOAD_MAX_TASKS];
+static int              task_load_num;
+
+#if CONFIG_CPU_LOAD_REPORT
+
+typedef struct {
+    TaskHandle_t    handle;
+    uint32_t        counter;
+} run_prev_t;
+
+static TaskStatus_t *tasks;
+static run_prev_t   prev[CPU_LOAD_MAX_TASKS];
+static int          prev_num;
+static uint32_t     prev_total;
+
+static uint32_t _prev_counter(TaskHandle_t handle)
+{
+    for (int i = 0; i < prev_num; i++) {
+        if (prev[i].handle == handle) {
+            return prev[i].counter;
+        }
+    }
+    // created during the last period
+    return 0;
+}
+
+static void _report()
+{
+    uint32_t total = 0;
+    int num = uxTaskGetSystemState(tasks, CPU_LOAD_MAX_TASKS, &total);
+    uint32_t elapsed = total - prev_total;
+
+    if (num == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, no report", CPU_LOAD_MAX_TASKS);
+        return;
+    }
+    if (prev_total && elapsed) {
+        // per core, the run time clock counts once for each core
+        uint32_t idle[CPU_LOAD_MAX_CORES] = { 0 };
+        uint32_t rest = 0;
+
+        ESP_LOGI(TAG, "CPU load over %u ms, %d tasks", elapsed / 1000, num);
+        portENTER_CRITICAL(&tasks_lock);
+        task_load_num = 0;
+        portEXIT_CRITICAL(&tasks_lock);
+        for (int i = 0; i < num; i++) {
+            TaskStatus_t *t = &tasks[i];
+            uint32_t permille = (uint64_t)(t->ulRunTimeCounter - _prev_counter(t->xHandle)) * 1000 / elapsed;
+            int core = -1;
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+            core = t->xCoreID < CPU_LOAD_MAX_CORES ? t->xCoreID : -1;
+#endif
+            cpu_task_load_t tl = {
+                .core = core,
+                .load = permille,
+                .stack_free = t->usStackHighWaterMark,
+            };
+            strlcpy(tl.name, t->pcTaskName, sizeof(tl.name));
+            portENTER_CRITICAL(&tasks_lock);
+            task_load[task_load_num++] = tl;
+            portEXIT_CRITICAL(&tasks_lock);
+            if (strncmp(t->pcTaskName, "IDLE", 4) == 0) {
+                int c = t->pcTaskName[4] - '0';
+                if (c >= 0 && c < CPU_LOAD_MAX_CORES) {
+                    idle[c] = permille;
+                }
+                continue;
+            }
+            if (permille < CPU_LOAD_LIST_MIN) {
+                rest += permille;
+                continue;
+            }
+            ESP_LOGI(TAG, "  %-16s core %2d prio %2u %3u.%u%%  stack free %u",
+                     t->pcTaskName, core, t->uxCurrentPriority, permille / 10, permille % 10,
+                     t->usStackHighWaterMark);
+        }
+        ESP_LOGI(TAG, "  %-16s %3u.%u%%", "(others)", rest / 10, rest % 10);
+
+        stats.reports++;
+        for (int c = 0; c < portNUM_PROCESSORS && c < CPU_LOAD_MAX_CORES; c++) {
+            uint32_t load = idle[c] < 1000 ? 1000 - idle[c] : 0;
+            stats.core_load[c] = load;
+            if (load > stats.core_load_max[c]) {
+                stats.core_load_max[c] = load;
+            }
+            if (load >= CONFIG_CPU_LOAD_WARN_PCT * 10) {
+                ESP_LOGW(TAG, "Core %d load %u.%u%% (max %u.%u%%)", c, load / 10, load % 10,
+                         stats.core_load_max[c] / 10, stats.core_load_max[c] % 10);
+            } else {
+                ESP_LOGI(TAG, "Core %d load %u.%u%% (max %u.%u%%)", c, load / 10, load % 10,
+                         stats.core_load_max[c] / 10, stats.core_load_max[c] % 10);
+            }
+        }
+    }
+
+    for (int i = 0; i < num; i++) {
+        prev[i].handle = tasks[i].xHandle;
+        prev[i].counter = tasks[i].ulRunTimeCounter;
+    }
+    prev_num = num;
+    prev_total = total;
+}
+
+static void cpu_load_task(void *arg)
+{
+    while (1) {
+        _report();
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_CPU_LOAD_PERIOD_MS));
+    }
+}
+
+#endif /* CONFIG_CPU_LOAD_REPORT */
+
+void init_cpu_load(){
+    ESP_LOGI(TAG, "Task placement:");
+    for (int i = 0; i < sizeof(task_plan) / sizeof(task_plan[0]); i++) {
+        ESP_LOGI(TAG, "  %-14s core %d prio %2d", task_plan[i].name, task_plan[i].core, task_plan[i].prio);
+    }
+#if CONFIG_CPU_LOAD_REPORT
+    tasks = mem_calloc(MEM_SYS_SYSTEM, CPU_LOAD_MAX_TASKS, sizeof(TaskStatus_t));
+    mem_assert(tasks);
+    if (xTaskCreatePinnedToCore(cpu_load_task, "cpu_load", CPU_LOAD_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create cpu_load task failed");
+    }
+#else
+    ESP_LOGI(TAG, "CPU load report off, needs FreeRTOS trace facility and run time stats");
+#endif
+}
+
+void cpu_load_get_stats(cpu_load_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
+
+int cpu_load_get_tasks(cpu_task_load_t *out, int max){
+    portENTER_CRITICAL(&tasks_lock);
+    int num = task_load_num < max ? task_load_num : max;
+    memcpy(out, task_load, num * sizeof(cpu_task_load_t));
+    portEXIT_CRITICAL(&tasks_lock);
+    return num;
+}
@@ -0,0 +1,46 @@
+/*
+ * cpu_load.h
+ *
+ * Task placement plan and CPU load report. Core and priority of every
+ * task we create come from the "Task placement" Kconfig menu, TASK_CORE()
+ * and TASK_PRIO() name them at the creation sites. With FreeRTOS run time
+ * stats enabled a low priority task logs the CPU share of each task and
+ * the load of each core every CONFIG_CPU_LOAD_PERIOD_MS.
+ */
+
+#ifndef MAIN_CPU_LOAD_H_
+#define MAIN_CPU_LOAD_H_
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#define TASK_CORE(slot)     CONFIG_TASK_##slot##_CORE
+#define TASK_PRIO(slot)     CONFIG_TASK_##slot##_PRIO
+
+#define CPU_LOAD_MAX_CORES  (2)
+#define CPU_LOAD_MAX_TASKS  (48)
+
+typedef struct {
+    uint32_t reports;
+    // busy share of the last period, in 0.1%
+    uint32_t core_load[CPU_LOAD_MAX_CORES];
+    uint32_t core_load_max[CPU_LOAD_MAX_CORES];
+} cpu_load_stats_t;
+
+typedef struct {
+    char     name[16];
+    int      core;
+    // share of the last period, in 0.1%
+    uint32_t load;
+    uint32_t stack_free;
+} cpu_task_load_t;
+
+// logs the placement plan, then starts the report task if enabled
+void init_cpu_load();
+
+void cpu_load_get_stats(cpu_load_stats_t *stats);
+// every task of the last report, IDLE included, returns the count
+int cpu_load_get_tasks(cpu_task_load_t *out, int max);
+
+#endif /* MAIN_CPU_LOAD_H_ */
@@ -0,0 +1,55 @@
+#include "main.h"
+#include "ctl_server.h"
+#include "cpu_load.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "ctl_server";
+
+#define CTL_SERVER_MAX_URIS     (12)
+#define CTL_SERVER_QUERY_LEN    (128)
+
+static httpd_handle_t       server;
+static const httpd_uri_t    *uris[CTL_SERVER_MAX_URIS];
+static int                  num_uris;
+
+void init_ctl_server(){
+#if CONFIG_CTL_SERVER_ENABLE
+    httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
+    cfg.server_port = CONFIG_CTL_SERVER_PORT;
+    cfg.max_uri_handlers = CTL_SERVER_MAX_URIS;
+    // network slot, below every audio task
+    cfg.task_priority = TASK_PRIO(NET);
+    cfg.core_id = TASK_CORE(NET);
+    if (httpd_start(&server, &cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "Start control server on port %d failed", CONFIG_CTL_SERVER_PORT);
+        server = NULL;
+        return;
+    }
+    for (int i = 0; i < num_uris; i++) {
+        httpd_register_uri_handler(server, uris[i]);
+    }
+    ESP_LOGI(TAG, "Control server on port %d, %d endpoints", CONFIG_CTL_SERVER_PORT, num_uris);
+#endif
+}
+
+esp_err_t ctl_server_register(const httpd_uri_t *uri){
+    if (num_uris == CTL_SERVER_MAX_URIS) {
+        ESP_LOGE(TAG, "No room for %s", uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+    uris[num_uris++] = uri;
+    return server ? httpd_register_uri_handler(server, uri) : ESP_OK;
+}
+
+bool ctl_server_query(httpd_req_t *req, const char *key, char *val, size_t len){
+    char query[CTL_SERVER_QUERY_LEN];
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return false;
+    }
+    return httpd_query_key_value(query, key, val, len) == ESP_OK;
+}
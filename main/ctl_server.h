@@ -0,0 +1,22 @@
+/*
+ * ctl_server.h
+ *
+ * Small HTTP server for diagnostics and control endpoints. Modules
+ * register their handlers at any time, the server starts once the network
+ * stack is up and serves everything registered before and after.
+ */
+
+#ifndef MAIN_CTL_SERVER_H_
+#define MAIN_CTL_SERVER_H_
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// after init_wifi_work, needs the network stack
+void init_ctl_server();
+// uri must stay valid, handlers run in the httpd task
+esp_err_t ctl_server_register(const httpd_uri_t *uri);
+// query parameter key of req into val, false if missing
+bool ctl_server_query(httpd_req_t *req, const char *key, char *val, size_t len);
+
+#endif /* MAIN_CTL_SERVER_H_ */
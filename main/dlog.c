@@ -0,0 +1,266 @@
+#include "main.h"
+#include "dlog.h"
+#include "cpu_load.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "dlog";
+
+#define DLOG_REPORT_MS      (10 * 1000)
+#define DLOG_DRAIN_MS       (100)
+#define DLOG_TASK_STACK     (3 * 1024)
+#define DLOG_LINE_LEN       (160)
+
+typedef struct {
+    esp_log_level_t level;
+    const char      *tag;
+    const char      *fmt;
+} dlog_fmt_def_t;
+
+#define DLOG_DEF(name, lvl, t, f)   [DLOG_##name] = { .level = lvl, .tag = t, .fmt = f },
+static const dlog_fmt_def_t fmt_defs[DLOG_FMT_MAX] = {
+    DLOG_FMTS(DLOG_DEF)
+};
+#undef DLOG_DEF
+
+static const char level_chr[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+static volatile esp_log_level_t dlog_level = ESP_LOG_INFO;
+static uint32_t                 caller_us;
+static uint32_t                 format_us;
+static dlog_stats_t             stats;
+
+#if CONFIG_DLOG_DEFERRED
+
+#define DLOG_RING_SIZE      (CONFIG_DLOG_RING_SIZE)
+#define DLOG_RING_MASK      (DLOG_RING_SIZE - 1)
+
+_Static_assert((DLOG_RING_SIZE & DLOG_RING_MASK) == 0, "CONFIG_DLOG_RING_SIZE must be a power of two");
+
+// also the on-disk record after the file header, without seq
+typedef struct {
+    uint32_t    ts_us;
+    uint16_t    id;
+    uint8_t     nargs;
+    uint8_t     core;
+    uint32_t    args[DLOG_MAX_ARGS];
+} dlog_rec_t;
+
+typedef struct {
+    // write index + 1 once the record is complete
+    volatile uint32_t   seq;
+    dlog_rec_t          rec;
+} dlog_slot_t;
+
+// one ring per core, producers on a core rarely contend with each other
+static dlog_slot_t  ring[portNUM_PROCESSORS][DLOG_RING_SIZE];
+static uint32_t     w_idx[portNUM_PROCESSORS];
+// formatter task only
+static uint32_t     r_idx[portNUM_PROCESSORS];
+
+#endif /* CONFIG_DLOG_DEFERRED */
+
+static void _format(dlog_fmt_t id, uint32_t ts_us, const uint32_t *a)
+{
+    char line[DLOG_LINE_LEN];
+    const dlog_fmt_def_t *def = &fmt_defs[id];
+
+    // unused trailing arguments are ignored by the format
+    snprintf(line, sizeof(line), def->fmt, a[0], a[1], a[2], a[3]);
+    printf("%c (%u) %s: %s\n", level_chr[def->level], ts_us / 1000, def->tag, line);
+}
+
+#if CONFIG_DLOG_DEFERRED
+
+#if CONFIG_DLOG_SINK_FILE
+#define DLOG_SINK_NAME  "file " CONFIG_DLOG_FILE_PATH
+
+static FILE *sink_fp;
+
+static void _sink_write(const dlog_rec_t *rec)
+{
+    if (sink_fp == NULL) {
+        // SD may be mounted after boot, retry on the next record
+        sink_fp = fopen(CONFIG_DLOG_FILE_PATH, "wb");
+        if (sink_fp == NULL) {
+            stats.sink_errors++;
+            return;
+        }
+        // magic, record size, max args
+        const uint8_t hdr[8] = { 'D', 'L', 'G', '1', sizeof(dlog_rec_t), 0, DLOG_MAX_ARGS, 0 };
+        fwrite(hdr, sizeof(hdr), 1, sink_fp);
+    }
+    if (fwrite(rec, sizeof(dlog_rec_t), 1, sink_fp) != 1) {
+        stats.sink_errors++;
+    }
+}
+
+static void _sink_flush()
+{
+    if (sink_fp) {
+        fflush(sink_fp);
+    }
+}
+#else
+#define DLOG_SINK_NAME  "uart"
+
+static void _sink_write(const dlog_rec_t *rec)
+{
+    _format(rec->id, rec->ts_us, rec->args);
+}
+
+static void _sink_flush()
+{
+}
+#endif /* CONFIG_DLOG_SINK_FILE */
+
+void dlog_write(dlog_fmt_t id, const uint32_t *args, int nargs){
+    if (fmt_defs[id].level > dlog_level) {
+        return;
+    }
+    if (nargs > DLOG_MAX_ARGS) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    int core = xPortGetCoreID();
+    uint32_t idx = __atomic_fetch_add(&w_idx[core], 1, __ATOMIC_RELAXED);
+    dlog_slot_t *slot = &ring[core][idx & DLOG_RING_MASK];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED);
+    slot->rec.ts_us = (uint32_t)start;
+    slot->rec.id = id;
+    slot->rec.nargs = nargs;
+    slot->rec.core = core;
+    memcpy(slot->rec.args, args, nargs * sizeof(uint32_t));
+    __atomic_store_n(&slot->seq, idx + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&stats.records, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&caller_us, (uint32_t)(esp_timer_get_time() - start), __ATOMIC_RELAXED);
+}
+
+static void _drain_core(int core)
+{
+    uint32_t w = __atomic_load_n(&w_idx[core], __ATOMIC_ACQUIRE);
+    uint32_t r = r_idx[core];
+
+    if (w - r > DLOG_RING_SIZE) {
+        stats.dropped += w - r - DLOG_RING_SIZE;
+        r = w - DLOG_RING_SIZE;
+    }
+    while (r != w) {
+        dlog_slot_t *slot = &ring[core][r & DLOG_RING_MASK];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq != r + 1) {
+            if (seq == 0) {
+                // still being written, pick it up next time
+                break;
+            }
+            stats.dropped++;
+            r++;
+            continue;
+        }
+        dlog_rec_t rec = slot->rec;
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != r + 1) {
+            // overwritten while copied
+            stats.dropped++;
+            r++;
+            continue;
+        }
+        r++;
+        memset(&rec.args[rec.nargs], 0, (DLOG_MAX_ARGS - rec.nargs) * sizeof(uint32_t));
+        _sink_write(&rec);
+    }
+    r_idx[core] = r;
+}
+
+static void _drain()
+{
+    int64_t start = esp_timer_get_time();
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        _drain_core(core);
+    }
+    _sink_flush();
+    format_us += (uint32_t)(esp_timer_get_time() - start);
+}
+
+#else
+
+#define DLOG_SINK_NAME  "uart, synchronous"
+
+void dlog_write(dlog_fmt_t id, const uint32_t *args, int nargs){
+    uint32_t a[DLOG_MAX_ARGS] = { 0 };
+
+    if (fmt_defs[id].level > dlog_level) {
+        return;
+    }
+    if (nargs > DLOG_MAX_ARGS) {
+        __atomic_fetch_add(&stats.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    int64_t start = esp_timer_get_time();
+    memcpy(a, args, nargs * sizeof(uint32_t));
+    _format(id, (uint32_t)start, a);
+    __atomic_fetch_add(&stats.records, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&caller_us, (uint32_t)(esp_timer_get_time() - start), __ATOMIC_RELAXED);
+}
+
+static void _drain()
+{
+}
+
+#endif /* CONFIG_DLOG_DEFERRED */
+
+static void dlog_task(void *arg)
+{
+    TickType_t last_report = xTaskGetTickCount();
+    uint32_t last_records = 0;
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DLOG_DRAIN_MS));
+        _drain();
+        TickType_t now = xTaskGetTickCount();
+        uint32_t ms = (now - last_report) * portTICK_PERIOD_MS;
+        if (ms < DLOG_REPORT_MS) {
+            continue;
+        }
+        uint32_t records = stats.records;
+        stats.caller_us_per_s = (uint64_t)__atomic_exchange_n(&caller_us, 0, __ATOMIC_RELAXED) * 1000 / ms;
+        stats.format_us_per_s = (uint64_t)format_us * 1000 / ms;
+        stats.records_per_s = (uint64_t)(records - last_records) * 1000 / ms;
+        format_us = 0;
+        last_records = records;
+        last_report = now;
+        if (stats.records_per_s) {
+            ESP_LOGI(TAG, "logging cost: callers %u us/s, formatter %u us/s, %u records/s, dropped %u",
+                     stats.caller_us_per_s, stats.format_us_per_s, stats.records_per_s, stats.dropped);
+        }
+    }
+}
+
+void init_dlog(){
+    if (xTaskCreatePinnedToCore(dlog_task, "dlog", DLOG_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create dlog task failed");
+        return;
+    }
+    ESP_LOGI(TAG, "Deferred log ready, %d formats, %s sink", DLOG_FMT_MAX, DLOG_SINK_NAME);
+}
+
+void dlog_set_level(esp_log_level_t level){
+    dlog_level = level;
+}
+
+esp_log_level_t dlog_get_level(){
+    return dlog_level;
+}
+
+void dlog_get_stats(dlog_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
@@ -0,0 +1,55 @@
+/*
+ * dlog.h
+ *
+ * Deferred logger for hot paths. DLOG() stores a format id from
+ * dlog_fmt.h and up to DLOG_MAX_ARGS raw 32 bit arguments into a ring of
+ * the calling core, a low priority task formats them later to the UART, or
+ * writes the raw records to a file on the SD card for
+ * tools/dlog_decode.py. With CONFIG_DLOG_DEFERRED off the same calls
+ * format synchronously, so the cost of both can be compared: the time
+ * spent inside DLOG() and in the formatter is reported per second.
+ */
+
+#ifndef MAIN_DLOG_H_
+#define MAIN_DLOG_H_
+
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "dlog_fmt.h"
+
+#define DLOG_MAX_ARGS   (4)
+
+#define DLOG_ID(name, level, tag, fmt)  DLOG_##name,
+typedef enum {
+    DLOG_FMTS(DLOG_ID)
+    DLOG_FMT_MAX,
+} dlog_fmt_t;
+#undef DLOG_ID
+
+typedef struct {
+    uint32_t records;
+    // overwritten before the formatter got to them, or over DLOG_MAX_ARGS
+    uint32_t dropped;
+    uint32_t sink_errors;
+    // us spent in DLOG() callers and in the formatter, last report period
+    uint32_t caller_us_per_s;
+    uint32_t format_us_per_s;
+    uint32_t records_per_s;
+} dlog_stats_t;
+
+// DLOG(HTTP_WRITTEN, total) with up to DLOG_MAX_ARGS integer arguments
+#define DLOG(name, ...) do { \
+        const uint32_t _dlog_args[] = { 0, ##__VA_ARGS__ }; \
+        dlog_write(DLOG_##name, _dlog_args + 1, sizeof(_dlog_args) / sizeof(_dlog_args[0]) - 1); \
+    } while (0)
+
+void init_dlog();
+// any task, never blocks in deferred mode
+void dlog_write(dlog_fmt_t id, const uint32_t *args, int nargs);
+// records less severe than level are not stored at all
+void dlog_set_level(esp_log_level_t level);
+esp_log_level_t dlog_get_level();
+void dlog_get_stats(dlog_stats_t *stats);
+
+#endif /* MAIN_DLOG_H_ */
@@ -0,0 +1,24 @@
+/*
+ * dlog_fmt.h
+ *
+ * Format strings of the deferred logger. Only their id goes into the log
+ * ring, so every entry needs a unique name and at most DLOG_MAX_ARGS
+ * 32 bit integer conversions (%d %u %x %c), no strings. Append new
+ * entries at the end, ids of dumped logs are the position in this list.
+ * tools/dlog_decode.py parses this file to decode binary dumps.
+ */
+
+#ifndef MAIN_DLOG_FMT_H_
+#define MAIN_DLOG_FMT_H_
+
+#define DLOG_FMTS(X) \
+    X(HTTP_WRITTEN,         ESP_LOG_INFO,   "file2http",    "Total bytes written: %d") \
+    X(REC_WAKEUP_START,     ESP_LOG_INFO,   "wwe_work",     "rec_engine_cb - REC_EVENT_WAKEUP_START") \
+    X(REC_VAD_START,        ESP_LOG_INFO,   "wwe_work",     "rec_engine_cb - REC_EVENT_VAD_START") \
+    X(REC_VAD_STOP,         ESP_LOG_INFO,   "wwe_work",     "rec_engine_cb - REC_EVENT_VAD_STOP") \
+    X(REC_WAKEUP_END,       ESP_LOG_INFO,   "wwe_work",     "rec_engine_cb - REC_EVENT_WAKEUP_END") \
+    X(REC_COMMAND,          ESP_LOG_WARN,   "wwe_work",     "rec_engine_cb - AUDIO_REC_COMMAND_DECT, command %d") \
+    X(REC_UNKNOWN,          ESP_LOG_ERROR,  "wwe_work",     "rec_engine_cb - unknown event %d") \
+    X(REC_READ_END,         ESP_LOG_WARN,   "wwe_work",     "audio recorder read finished %d")
+
+#endif /* MAIN_DLOG_FMT_H_ */
@@ -0,0 +1,203 @@
+#include "main.h"
+#include "el_stats.h"
+#include "cpu_load.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_mem.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "el_stats";
+
+#define EL_STATS_TASK_STACK (3 * 1024)
+#define EL_STATS_LOG_MS     (60 * 1000)
+
+typedef struct {
+    el_stat_t               st;
+    audio_element_handle_t  el;
+    ringbuf_handle_t        rb;
+    int64_t                 last_pos;
+} el_entry_t;
+
+static SemaphoreHandle_t    stats_lock;
+static el_entry_t           entries[EL_STATS_MAX];
+static int                  num_entries;
+static el_stats_cost_t      cost;
+static uint64_t             cost_sum;
+
+static el_entry_t *_find(const char *pipe, const char *tag)
+{
+    for (int i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].st.pipe, pipe) == 0 && strcmp(entries[i].st.tag, tag) == 0) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+#if CONFIG_EL_STATS_ENABLE
+// bound by more than one pipeline
+static bool _shared(const el_entry_t *e)
+{
+    for (int i = 0; i < num_entries; i++) {
+        if (&entries[i] != e && entries[i].el == e->el) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _sample(el_entry_t *e, uint32_t period_ms)
+{
+    audio_element_info_t info = { 0 };
+
+    // a shared element only counts for the pipeline it is linked into now. Not
+    // applied to the others: an element with a read or write callback has no ring.
+    if (e->rb && _shared(e) && e->rb != audio_element_get_output_ringbuf(e->el)
+        && e->rb != audio_element_get_input_ringbuf(e->el)) {
+        return;
+    }
+    audio_element_getinfo(e->el, &info);
+    if (info.byte_pos < e->last_pos) {
+        // rearmed for a new job
+        e->last_pos = 0;
+    }
+    uint32_t delta = info.byte_pos - e->last_pos;
+    e->last_pos = info.byte_pos;
+    e->st.bytes += delta;
+    e->st.rate_bps = (uint64_t)delta * 1000 / period_ms;
+    if (e->st.rate_bps > e->st.rate_bps_max) {
+        e->st.rate_bps_max = e->st.rate_bps;
+    }
+
+    if (e->rb == NULL || audio_element_get_state(e->el) != AEL_STATE_RUNNING) {
+        return;
+    }
+    int size = rb_get_size(e->rb);
+    int filled = rb_bytes_filled(e->rb);
+    if (size <= 0) {
+        return;
+    }
+    int pct = filled * 100 / size;
+    e->st.rb_size = size;
+    e->st.fill_pct = pct;
+    if (e->st.samples == 0 || pct < e->st.fill_pct_min) {
+        e->st.fill_pct_min = pct;
+    }
+    if (e->st.samples == 0 || pct > e->st.fill_pct_max) {
+        e->st.fill_pct_max = pct;
+    }
+    if (filled <= 0) {
+        e->st.rb_empty++;
+    } else if (filled >= size) {
+        e->st.rb_full++;
+    }
+    e->st.samples++;
+}
+
+static void _log()
+{
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    for (int i = 0; i < num_entries; i++) {
+        el_stat_t *st = &entries[i].st;
+        ESP_LOGI(TAG, "%-11s %-7s %10llu B, %6u B/s (max %u), fill %d%% [%d..%d], empty %u, full %u",
+                 st->pipe, st->tag, st->bytes, st->rate_bps, st->rate_bps_max,
+                 st->fill_pct, st->fill_pct_min, st->fill_pct_max, st->rb_empty, st->rb_full);
+    }
+    xSemaphoreGive(stats_lock);
+    ESP_LOGI(TAG, "Sampler pass avg %u us, max %u us per %d ms", cost.pass_us_avg, cost.pass_us_max,
+             CONFIG_EL_STATS_PERIOD_MS);
+}
+
+static void el_stats_task(void *arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+    TickType_t last_log = wake;
+
+    while (1) {
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(CONFIG_EL_STATS_PERIOD_MS));
+        int64_t start = esp_timer_get_time();
+        xSemaphoreTake(stats_lock, portMAX_DELAY);
+        for (int i = 0; i < num_entries; i++) {
+            if (entries[i].el) {
+                _sample(&entries[i], CONFIG_EL_STATS_PERIOD_MS);
+            }
+        }
+        xSemaphoreGive(stats_lock);
+        uint32_t us = esp_timer_get_time() - start;
+        cost.passes++;
+        cost_sum += us;
+        cost.pass_us_avg = cost_sum / cost.passes;
+        if (us > cost.pass_us_max) {
+            cost.pass_us_max = us;
+        }
+        if (xTaskGetTickCount() - last_log >= pdMS_TO_TICKS(EL_STATS_LOG_MS)) {
+            last_log = xTaskGetTickCount();
+            _log();
+        }
+    }
+}
+
+#endif /* CONFIG_EL_STATS_ENABLE */
+
+void init_el_stats(){
+    stats_lock = xSemaphoreCreateMutex();
+    mem_assert(stats_lock);
+#if CONFIG_EL_STATS_ENABLE
+    if (xTaskCreatePinnedToCore(el_stats_task, "el_stats", EL_STATS_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create el_stats task failed");
+    }
+#endif
+}
+
+void el_stats_bind(const char *pipe, const char *tag, audio_element_handle_t el, ringbuf_handle_t rb){
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    el_entry_t *e = _find(pipe, tag);
+    if (e == NULL) {
+        if (num_entries == EL_STATS_MAX) {
+            xSemaphoreGive(stats_lock);
+            ESP_LOGW(TAG, "No slot for %s/%s", pipe, tag);
+            return;
+        }
+        e = &entries[num_entries++];
+        memset(e, 0, sizeof(el_entry_t));
+        e->st.pipe = pipe;
+        e->st.tag = tag;
+        e->st.fill_pct = -1;
+    }
+    e->el = el;
+    e->rb = rb;
+    e->last_pos = 0;
+    xSemaphoreGive(stats_lock);
+}
+
+void el_stats_unbind(const char *pipe){
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    for (int i = 0; i < num_entries; i++) {
+        if (strcmp(entries[i].st.pipe, pipe) == 0) {
+            entries[i].el = NULL;
+            entries[i].rb = NULL;
+        }
+    }
+    xSemaphoreGive(stats_lock);
+}
+
+int el_stats_snapshot(el_stat_t *out, int max){
+    xSemaphoreTake(stats_lock, portMAX_DELAY);
+    int n = num_entries < max ? num_entries : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = entries[i].st;
+    }
+    xSemaphoreGive(stats_lock);
+    return n;
+}
+
+void el_stats_get_cost(el_stats_cost_t *out){
+    memcpy(out, &cost, sizeof(cost));
+}
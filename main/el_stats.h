@@ -0,0 +1,56 @@
+/*
+ * el_stats.h
+ *
+ * Throughput and ring buffer fill of every registered pipeline element.
+ * Pipelines bind their elements by (pipeline, tag) together with the ring
+ * buffer to watch: the one the element writes, or for a sink the one it
+ * reads. A low priority task samples byte_pos and the fill level every
+ * CONFIG_EL_STATS_PERIOD_MS. Counters survive pipeline rebuilds.
+ */
+
+#ifndef MAIN_EL_STATS_H_
+#define MAIN_EL_STATS_H_
+
+#include <stdint.h>
+
+#include "audio_element.h"
+#include "ringbuf.h"
+
+#define EL_STATS_MAX        (24)
+
+typedef struct {
+    const char  *pipe;
+    const char  *tag;
+    // byte_pos progress summed over all jobs
+    uint64_t    bytes;
+    uint32_t    rate_bps;
+    uint32_t    rate_bps_max;
+    int         rb_size;
+    // fill in percent while the element runs, -1 before the first sample
+    int         fill_pct;
+    int         fill_pct_min;
+    int         fill_pct_max;
+    // running samples with the ring buffer empty / full
+    uint32_t    rb_empty;
+    uint32_t    rb_full;
+    uint32_t    samples;
+} el_stat_t;
+
+typedef struct {
+    uint32_t passes;
+    uint32_t pass_us_avg;
+    uint32_t pass_us_max;
+} el_stats_cost_t;
+
+void init_el_stats();
+
+// pipe and tag must stay valid, rb may be NULL
+void el_stats_bind(const char *pipe, const char *tag, audio_element_handle_t el, ringbuf_handle_t rb);
+// before the ring buffers of pipe are destroyed
+void el_stats_unbind(const char *pipe);
+
+// copies up to max entries, returns the count
+int el_stats_snapshot(el_stat_t *out, int max);
+void el_stats_get_cost(el_stats_cost_t *cost);
+
+#endif /* MAIN_EL_STATS_H_ */
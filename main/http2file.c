@@ -1,10 +1,12 @@
 #include "main.h"
+#include "pipeline_graph.h"
 
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 
 #include "audio_element.h"
@@ -25,9 +27,6 @@
 #include "periph_sdcard.h"
 #include "board.h"
 
-#include "sdcard_list.h"
-#include "sdcard_scan.h"
-
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 1, 0))
 #include "esp_netif.h"
 #else
@@ -36,129 +35,99 @@
 
 static const char *TAG = "http2file";
 
+#define HTTP2FILE_DEADLINE_MS   (120 * 1000)
+#define HTTP2FILE_STALL_MS      (5000)
+
+static const graph_el_spec_t http2file_els[] = {
+    { .tag = "http",    .type = GRAPH_EL_HTTP_READER, GRAPH_TASK(NET) },
+    { .tag = "fatfs",   .type = GRAPH_EL_FATFS_WRITER, GRAPH_TASK(SD) },
+};
+
+static const graph_spec_t http2file_spec = {
+    .name       = "http2file",
+    .els        = http2file_els,
+    .num_els    = sizeof(http2file_els) / sizeof(http2file_els[0]),
+    .mixer_port = GRAPH_NO_MIXER,
+};
+
+static pipeline_graph_t *http2file_graph;
 static audio_pipeline_handle_t http2file_pipeline;
 static audio_element_handle_t http_stream_reader;
 static audio_element_handle_t fatfs_stream_writer;
-static audio_event_iface_handle_t http2file_evt;
+static volatile bool http2file_abort = false;
 
 void init_http2file(){
     ESP_LOGI(TAG, "[1.0] Initialize peripherals management");
 //    ESP_LOGI(TAG, "[1.1] Initialize and start peripherals");
 
 
-    ESP_LOGI(TAG, "[3.0] Create http2file pipeline for download");
-    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
-    http2file_pipeline = audio_pipeline_init(&pipeline_cfg);
-    mem_assert(http2file_pipeline);
-
-    ESP_LOGI(TAG, "[3.1] Create http stream to read data");
-	http_stream_cfg_t http_cfg = HTTP_STREAM_CFG_DEFAULT();
-	http_stream_reader = http_stream_init(&http_cfg);
-
-    ESP_LOGI(TAG, "[3.2] Create fatfs stream to write data to sdcard");
-    fatfs_stream_cfg_t fatfs_cfg = FATFS_STREAM_CFG_DEFAULT();
-    fatfs_cfg.type = AUDIO_STREAM_WRITER;
-    fatfs_stream_writer = fatfs_stream_init(&fatfs_cfg);
-
-	ESP_LOGI(TAG, "[3.3] Register all elements to http2file pipeline");
-	audio_pipeline_register(http2file_pipeline, http_stream_reader, "http");
-	audio_pipeline_register(http2file_pipeline, fatfs_stream_writer, "fatfs");
-
-	ESP_LOGI(TAG, "[3.4] Link it together [http_server]-->http_stream-->fatfs_stream-->[sdcard]");
-	const char *link_tag[2] = {"http", "fatfs"};
-	audio_pipeline_link(http2file_pipeline, &link_tag[0], 2);
-
-//	ESP_LOGI(TAG, "[3.6] Set up  uri (http as http_stream, amr as amr decoder, and default output is i2s)");
-//	audio_element_set_uri(http_stream_reader, "https://dl.espressif.com/dl/audio/ff-16b-1c-8000hz.amr");
-//	audio_element_set_uri(http_stream_reader, "http://192.168.1.104:9000/test.mp3");
-
-
-    ESP_LOGI(TAG, "[4.0] Set up  event listener");
-    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
-    http2file_evt = audio_event_iface_init(&evt_cfg);
-
-//    ESP_LOGI(TAG, "[4.1] Listening event from all elements of pipeline");
-//    audio_pipeline_set_listener(http2player_pipeline, http2player_evt);
-
+    ESP_LOGI(TAG, "[3.0] Build [http_server]-->http_stream-->fatfs_stream-->[sdcard]");
+    http2file_graph = pipeline_graph_build(&http2file_spec);
+    http2file_pipeline = http2file_graph->pipeline;
+    http_stream_reader = pipeline_graph_el(http2file_graph, "http");
+    fatfs_stream_writer = pipeline_graph_el(http2file_graph, "fatfs");
 }
 
 void deinit_http2file(){
+    ESP_LOGI(TAG, "[ 7.1 ] Destroy http2file_pipeline");
+    pipeline_graph_destroy(http2file_graph);
+    http2file_graph = NULL;
+}
 
-    ESP_LOGI(TAG, "[ 7.1 ] Stop http2file_pipeline");
-    audio_pipeline_stop(http2file_pipeline);
-    audio_pipeline_wait_for_stop(http2file_pipeline);
-    audio_pipeline_terminate(http2file_pipeline);
-
-    ESP_LOGI(TAG, "[ 7.3 ] Unregister http2file_pipeline");
-    audio_pipeline_unregister(http2file_pipeline, fatfs_stream_writer);
-    audio_pipeline_unregister(http2file_pipeline, http_stream_reader);
-
-
-    /* Terminate the pipeline before removing the listener */
-    ESP_LOGI(TAG, "[ 7.4 ] Removing pipeline listener");
-    audio_pipeline_remove_listener(http2file_pipeline);
-
-    /* Stop all peripherals before removing the listener */
-
-    /* Make sure audio_pipeline_remove_listener & audio_event_iface_remove_listener are called before destroying event_iface */
-    audio_event_iface_destroy(http2file_evt);
+static reactor_result_t http2file_on_event(audio_event_iface_msg_t *msg)
+{
+	if (msg->source == (void *) http_stream_reader
+		&& msg->cmd == AEL_MSG_CMD_REPORT_STATUS
+		&& audio_element_get_state(http_stream_reader) == AEL_STATE_ERROR) {
+		ESP_LOGE(TAG, "[ * ] HTTP error,");
+		return REACTOR_ERROR;
+	}
+	if (msg->source == (void *) fatfs_stream_writer
+		&& msg->cmd == AEL_MSG_CMD_REPORT_STATUS) {
+		audio_element_state_t el_state = audio_element_get_state(fatfs_stream_writer);
+		if (el_state == AEL_STATE_FINISHED) {
+			ESP_LOGI(TAG, "[ * ] Finished,");
+			return REACTOR_DONE;
+		}
+		if (el_state == AEL_STATE_STOPPED && http2file_abort) {
+			ESP_LOGW(TAG, "[ * ] Aborted,");
+			return REACTOR_ABORTED;
+		}
+	}
+	return REACTOR_RUNNING;
+}
 
-    /* Release all resources */
-    audio_pipeline_deinit(http2file_pipeline);
-    audio_element_deinit(fatfs_stream_writer);
-    audio_element_deinit(http_stream_reader);
+static void http2file_stop()
+{
+	ESP_LOGW(TAG, "Abort http2file_pipeline.");
+	http2file_abort = true;
+	audio_pipeline_stop(http2file_pipeline);
 }
 
-void run_http2file(const char *src_url, const char *dst_url){
+static reactor_op_t http2file_op = {
+	.deadline_ms = HTTP2FILE_DEADLINE_MS,
+	.stall_ms = HTTP2FILE_STALL_MS,
+	.on_event = http2file_on_event,
+	.abort = http2file_stop,
+};
 
-	audio_element_state_t el_state = audio_element_get_state(fatfs_stream_writer);
-	if(AEL_STATE_RUNNING == el_state){
-	    audio_pipeline_stop(http2file_pipeline);
-	    ESP_LOGI(TAG, "[7.x] audio_pipeline_stop done: %d", __LINE__);
-	    audio_pipeline_wait_for_stop(http2file_pipeline);
-	    ESP_LOGI(TAG, "[7.x] audio_pipeline_wait_for_stop done: %d", __LINE__);
-	}
-    audio_pipeline_reset_ringbuffer(http2file_pipeline);
-    ESP_LOGI(TAG, "[7.x] audio_pipeline_reset_ringbuffer done: %d", __LINE__);
-    audio_pipeline_reset_elements(http2file_pipeline);
-    ESP_LOGI(TAG, "[7.x] audio_pipeline_reset_elements done: %d", __LINE__);
-    audio_pipeline_terminate(http2file_pipeline);
-    ESP_LOGI(TAG, "[7.x] audio_pipeline_terminate done: %d", __LINE__);
+esp_err_t start_http2file(const char *src_url, const char *dst_url, reactor_done_cb_t done){
+
+    int64_t start_us = esp_timer_get_time();
+    if (pipeline_graph_rearm(http2file_graph) != ESP_OK) {
+        return ESP_ERR_TIMEOUT;
+    }
     ESP_LOGI(TAG, "[7.2] Set http_stream_reader URL: %s", src_url);
 	audio_element_set_uri(http_stream_reader, src_url);
     ESP_LOGI(TAG, "[7.2] Set fatfs_stream_writer URL: %s", dst_url);
     audio_element_set_uri(fatfs_stream_writer, dst_url);
 
-    ESP_LOGI(TAG, "[7.3] Listen for all file2http_pipeline events (set it after pipeline_link)");
-    audio_pipeline_set_listener(http2file_pipeline, http2file_evt);
-    audio_pipeline_change_state(http2file_pipeline, AEL_STATE_INIT);
+    http2file_abort = false;
+    http2file_op.progress_el = http_stream_reader;
+    reactor_start(PIPE_HTTP2FILE, &http2file_op, done);
     audio_pipeline_run(http2file_pipeline);
-
-//    char* uri = audio_element_get_uri(http_stream_reader);
-//    ESP_LOGE(TAG, "[7.4] Get http_stream_reader URL: %s", uri);
-    ESP_LOGI(TAG, "[7.x] audio_pipeline_run done: %d", __LINE__);
-
-	while(1){
-		audio_event_iface_msg_t msg;
-		esp_err_t ret = audio_event_iface_listen(http2file_evt, &msg, portMAX_DELAY);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "[ * ] Event interface error : %d", ret);
-			break;
-		}
-		if (msg.source_type == AUDIO_ELEMENT_TYPE_ELEMENT) {
-			// Advance to the next song when previous finishes
-			if (msg.source == (void *) fatfs_stream_writer
-				&& msg.cmd == AEL_MSG_CMD_REPORT_STATUS) {
-				audio_element_state_t el_state = audio_element_get_state(fatfs_stream_writer);
-				if (el_state == AEL_STATE_FINISHED) {
-					ESP_LOGI(TAG, "[ * ] Finished,");
-					break;
-				}
-			}
-		} else {
-			ESP_LOGI(TAG, "[ * ] CMD:%d Type: %d,", msg.cmd, msg.source_type);
-		}
-	}
+    pipeline_start_record(PIPE_HTTP2FILE, start_us);
+    return ESP_OK;
 }
 
 void enable_http2file(bool enable){
@@ -175,3 +144,6 @@ void enable_http2file(bool enable){
 	}
 }
 
+void abort_http2file(){
+	reactor_abort(PIPE_HTTP2FILE);
+}
@@ -0,0 +1,17 @@
+#include "http_chunk.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+int http_chunk_header(char *buf, uint32_t len){
+    int n = 1;
+    while (n < 8 && (len >> (4 * n))) {
+        n++;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        buf[i] = hex_digits[len & 0xf];
+        len >>= 4;
+    }
+    buf[n] = '\r';
+    buf[n + 1] = '\n';
+    return n + 2;
+}
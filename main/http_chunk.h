@@ -0,0 +1,22 @@
+/*
+ * http_chunk.h
+ *
+ * Chunked transfer encoding framing for the upload stream: every chunk is
+ * "<size in hex>\r\n" <data> "\r\n", the body ends with a zero sized
+ * chunk. No ESP-IDF dependency, also built by the host bench.
+ */
+
+#ifndef MAIN_HTTP_CHUNK_H_
+#define MAIN_HTTP_CHUNK_H_
+
+#include <stdint.h>
+
+// 8 hex digits and CRLF
+#define HTTP_CHUNK_HDR_MAX  (10)
+#define HTTP_CHUNK_CRLF     "\r\n"
+#define HTTP_CHUNK_END      "0\r\n\r\n"
+
+// writes the size line of a len byte chunk into buf, returns its length
+int http_chunk_header(char *buf, uint32_t len);
+
+#endif /* MAIN_HTTP_CHUNK_H_ */
@@ -0,0 +1,88 @@
+#include "main.h"
+#include "i2s_work.h"
+#include "mixer_work.h"
+#include "cpu_load.h"
+#include "qemu_target.h"
+
+#include "esp_log.h"
+
+#include "audio_element.h"
+#include "audio_mem.h"
+#include "i2s_stream.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "i2s_work";
+
+#if I2S_WORK_DUPLEX && (CODEC_ADC_SAMPLE_RATE != MIXER_SAMPLE_RATE)
+#error "Full-duplex i2s needs the capture rate to match the mixer rate"
+#endif
+
+static audio_element_handle_t i2s_stream_reader;
+static audio_element_handle_t i2s_stream_writer;
+
+#if !CONFIG_QEMU_TARGET
+static void i2s_work_cfg(i2s_stream_cfg_t *cfg, audio_stream_type_t type)
+{
+    cfg->type = type;
+    cfg->task_core = TASK_CORE(I2S);
+    cfg->task_prio = TASK_PRIO(I2S);
+    cfg->i2s_config.use_apll = 0;
+#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
+    cfg->i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+#else
+    cfg->i2s_config.bits_per_sample = CODEC_ADC_BITS_PER_SAMPLE;
+#endif
+#if I2S_WORK_DUPLEX
+    // both streams install the same driver, neither may remove it
+    cfg->i2s_config.mode = I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_RX;
+    cfg->uninstall_drv = false;
+#endif
+}
+#endif
+
+void init_i2s_work(){
+#if CONFIG_QEMU_TARGET
+    ESP_LOGI(TAG, "[1.0] QEMU i2s stand-ins, capture %d Hz, playback %d Hz", CODEC_ADC_SAMPLE_RATE, MIXER_SAMPLE_RATE);
+    // capture is 2ch like the i2s reader, playback is what the mixer writes
+    i2s_stream_reader = qemu_i2s_stream_init(AUDIO_STREAM_READER,
+                                             CODEC_ADC_SAMPLE_RATE * 2 * (CODEC_ADC_BITS_PER_SAMPLE / 8),
+                                             TASK_CORE(I2S), TASK_PRIO(I2S));
+    i2s_stream_writer = qemu_i2s_stream_init(AUDIO_STREAM_WRITER,
+                                             MIXER_SAMPLE_RATE * MIXER_CHANNELS * (MIXER_BITS / 8),
+                                             TASK_CORE(I2S), TASK_PRIO(I2S));
+#else
+    ESP_LOGI(TAG, "[1.0] Create i2s reader, port %d, %d Hz", CODEC_ADC_I2S_PORT, CODEC_ADC_SAMPLE_RATE);
+    i2s_stream_cfg_t reader_cfg = I2S_STREAM_CFG_DEFAULT();
+    i2s_work_cfg(&reader_cfg, AUDIO_STREAM_READER);
+    reader_cfg.i2s_port = CODEC_ADC_I2S_PORT;
+    reader_cfg.i2s_config.sample_rate = CODEC_ADC_SAMPLE_RATE;
+    i2s_stream_reader = i2s_stream_init(&reader_cfg);
+
+    ESP_LOGI(TAG, "[1.1] Create i2s writer, port %d, %d Hz%s", CODEC_DAC_I2S_PORT, MIXER_SAMPLE_RATE,
+             I2S_WORK_DUPLEX ? ", full duplex" : "");
+    i2s_stream_cfg_t writer_cfg = I2S_STREAM_CFG_DEFAULT();
+    i2s_work_cfg(&writer_cfg, AUDIO_STREAM_WRITER);
+    writer_cfg.i2s_port = CODEC_DAC_I2S_PORT;
+    writer_cfg.i2s_config.sample_rate = MIXER_SAMPLE_RATE;
+#if !((CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1))
+    // mixer output is 16 bit
+    writer_cfg.need_expand = (CODEC_ADC_BITS_PER_SAMPLE != I2S_BITS_PER_SAMPLE_16BIT);
+#endif
+    i2s_stream_writer = i2s_stream_init(&writer_cfg);
+#endif
+
+    mem_assert(i2s_stream_reader && i2s_stream_writer);
+}
+
+void deinit_i2s_work(){
+    audio_element_deinit(i2s_stream_writer);
+    audio_element_deinit(i2s_stream_reader);
+}
+
+audio_element_handle_t i2s_work_get_reader(){
+    return i2s_stream_reader;
+}
+
+audio_element_handle_t i2s_work_get_writer(){
+    return i2s_stream_writer;
+}
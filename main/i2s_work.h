@@ -0,0 +1,44 @@
+/*
+ * i2s_work.h
+ *
+ * Single owner of the codec i2s device(s). Capture and playback run all the
+ * time at one fixed clock; pipelines only get the reader/writer elements and
+ * never touch the clock, so switching between listening and speaking needs no
+ * reclock and no pause/reset cycle.
+ */
+
+#ifndef MAIN_I2S_WORK_H_
+#define MAIN_I2S_WORK_H_
+
+#include "audio_element.h"
+#include "i2s_stream.h"
+#include "board.h"
+
+#ifndef CODEC_ADC_SAMPLE_RATE
+#warning "Please define CODEC_ADC_SAMPLE_RATE first, default value is 48kHz may not correctly"
+#define CODEC_ADC_SAMPLE_RATE    48000
+#endif
+
+#ifndef CODEC_ADC_BITS_PER_SAMPLE
+#warning "Please define CODEC_ADC_BITS_PER_SAMPLE first, default value 16 bits may not correctly"
+#define CODEC_ADC_BITS_PER_SAMPLE  I2S_BITS_PER_SAMPLE_16BIT
+#endif
+
+#ifndef CODEC_ADC_I2S_PORT
+#define CODEC_ADC_I2S_PORT  (0)
+#endif
+
+#define CODEC_DAC_I2S_PORT  (0)
+
+// capture and playback share one full-duplex i2s port
+#define I2S_WORK_DUPLEX     (CODEC_ADC_I2S_PORT == CODEC_DAC_I2S_PORT)
+
+void init_i2s_work();
+void deinit_i2s_work();
+
+// capture port, fixed at CODEC_ADC_SAMPLE_RATE, for the recorder pipeline
+audio_element_handle_t i2s_work_get_reader();
+// playback port, fixed at MIXER_SAMPLE_RATE, for the mixer pipeline
+audio_element_handle_t i2s_work_get_writer();
+
+#endif /* MAIN_I2S_WORK_H_ */
@@ -0,0 +1,593 @@
+#include "main.h"
+#include "job_sched.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "audio_mem.h"
+#include "cpu_load.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "job_sched";
+
+#define RES_I2S_OUT         JOB_RES_BIT(JOB_RES_I2S_OUT)
+#define RES_NET             JOB_RES_BIT(JOB_RES_NET)
+#define RES_SD              JOB_RES_BIT(JOB_RES_SD)
+#define PIPE_BIT(type)      (1 << (type))
+
+#define JOB_SCHED_TASK_STACK    (4 * 1024)
+
+#if CONFIG_BARGE_IN_ENABLE
+// wakenet keeps listening during playback, the wake word cancels it
+#define PLAYER_MUTES_WWE    false
+#else
+#define PLAYER_MUTES_WWE    true
+#endif
+
+typedef enum {
+    JOB_FREE = 0,
+    JOB_PENDING,
+    // holds its pipeline and resources, the sched task has yet to start it
+    JOB_STARTING,
+    JOB_RUNNING,
+} job_state_t;
+
+typedef struct {
+    job_id_t    id;
+    pipe_type_t type;
+    job_prio_t  prio;
+    job_state_t state;
+    bool        cancel;
+    // the sched task has called abort
+    bool        aborted;
+    uint32_t    seq;
+    int64_t     submit_us;
+    char        src[JOB_URL_LEN];
+    char        dst[JOB_URL_LEN];
+} job_t;
+
+typedef struct {
+    const char  *name;
+    void        (*init)();
+    void        (*deinit)();
+    esp_err_t   (*start)(const char *src_url, const char *dst_url, reactor_done_cb_t done);
+    void        (*abort)();
+    uint32_t    res;
+    bool        preemptible;
+    bool        mute_wwe;
+    // pipelines with an element of the same share key in their graph spec
+    uint32_t    shares;
+} job_ops_t;
+
+// tone2player is not scheduled, the assistant task and the boot calibration play it synchronously
+static const job_ops_t job_ops[PIPE_TYPE_MAX] = {
+    // wakenet must be off while uploading
+    [PIPE_FILE2HTTP]    = { "file2http",    init_file2http,     deinit_file2http,   start_file2http,    abort_file2http,    RES_NET | RES_SD,       false,  true,               PIPE_BIT(PIPE_FILE2PLAYER) },
+    [PIPE_HTTP2FILE]    = { "http2file",    init_http2file,     deinit_http2file,   start_http2file,    abort_http2file,    RES_NET | RES_SD,       true,   false },
+    [PIPE_FILE2PLAYER]  = { "file2player",  init_file2player,   deinit_file2player, start_file2player,  abort_file2player,  RES_I2S_OUT | RES_SD,   true,   PLAYER_MUTES_WWE,   PIPE_BIT(PIPE_FILE2HTTP) },
+    [PIPE_HTTP2PLAYER]  = { "http2player",  init_http2player,   deinit_http2player, start_http2player,  abort_http2player,  RES_I2S_OUT | RES_NET,  true,   PLAYER_MUTES_WWE },
+};
+
+static const int res_limit[JOB_RES_MAX] = {
+    // one voice at a time, prompt tones are mixed on top of it
+    [JOB_RES_I2S_OUT]   = 1,
+    [JOB_RES_NET]       = 2,
+    [JOB_RES_SD]        = 1,
+};
+
+// guards the tables, held only while they change; pipeline calls run in sched_task
+static SemaphoreHandle_t    sched_lock;
+static TaskHandle_t         sched_task;
+static job_t                jobs[JOB_SCHED_MAX_JOBS];
+// the job each pipeline is running
+static job_t                *running_job[PIPE_TYPE_MAX];
+static int                  res_used[JOB_RES_MAX];
+static int                  mute_count;
+// wakenet state sched_task last set, and when the last muting job ended
+static bool                 wwe_muted;
+static int64_t              unmute_from_us;
+static job_id_t             next_id;
+static uint32_t             next_seq;
+// pipeline exists, and when its last job ended
+static bool                 built[PIPE_TYPE_MAX];
+static int64_t              idle_since_us[PIPE_TYPE_MAX];
+// picked by job_sched_release_idle, no job starts on it until sched_task destroyed it
+static bool                 releasing[PIPE_TYPE_MAX];
+static job_observer_t       observer;
+static job_sched_stats_t    stats;
+static int64_t              wait_us_sum[JOB_PRIO_MAX];
+static uint32_t             wait_cnt[JOB_PRIO_MAX];
+
+static void _job_done(pipe_type_t type, reactor_result_t result);
+
+typedef struct {
+    size_t int_free;
+    size_t int_min;
+    size_t spi_free;
+    size_t spi_min;
+} heap_snap_t;
+
+static void _heap_snap(heap_snap_t *h)
+{
+    h->int_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    h->int_min = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    h->spi_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    h->spi_min = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+static void _heap_report(const char *name, const char *what, const heap_snap_t *before)
+{
+    heap_snap_t after;
+    _heap_snap(&after);
+    ESP_LOGI(TAG, "%s %s: internal %u -> %u (%+d, low %u), psram %u -> %u (%+d, low %u)",
+             name, what,
+             (unsigned)before->int_free, (unsigned)after.int_free,
+             (int)after.int_free - (int)before->int_free, (unsigned)after.int_min,
+             (unsigned)before->spi_free, (unsigned)after.spi_free,
+             (int)after.spi_free - (int)before->spi_free, (unsigned)after.spi_min);
+}
+
+// sched_task only, element tasks are created by the first audio_pipeline_run, see pipeline_graph_rearm
+static void _build(pipe_type_t type)
+{
+    heap_snap_t before;
+    _heap_snap(&before);
+    job_ops[type].init();
+    _heap_report(job_ops[type].name, "built", &before);
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    built[type] = true;
+    stats.builds++;
+    xSemaphoreGive(sched_lock);
+}
+
+// sched_task only
+static void _release(pipe_type_t type)
+{
+    heap_snap_t before;
+    _heap_snap(&before);
+    job_ops[type].deinit();
+    _heap_report(job_ops[type].name, "released", &before);
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    built[type] = false;
+    releasing[type] = false;
+    stats.releases++;
+    xSemaphoreGive(sched_lock);
+}
+
+static bool _pending(pipe_type_t type)
+{
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        if (jobs[i].state == JOB_PENDING && jobs[i].type == type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// releasing it would take a shared element out from under a running job
+static bool _sharer_busy(pipe_type_t type)
+{
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        if ((job_ops[type].shares & PIPE_BIT(t)) && running_job[t]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool _res_fits(uint32_t res)
+{
+    for (int r = 0; r < JOB_RES_MAX; r++) {
+        if ((res & JOB_RES_BIT(r)) && res_used[r] >= res_limit[r]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void _res_take(uint32_t res, int delta)
+{
+    for (int r = 0; r < JOB_RES_MAX; r++) {
+        if (res & JOB_RES_BIT(r)) {
+            res_used[r] += delta;
+        }
+    }
+}
+
+// sched_task aborts it, or drops it if it has not started yet
+static void _cancel_running(job_t *job)
+{
+    job->cancel = true;
+}
+
+// claim the pipeline and resources, sched_task starts it
+static void _start(job_t *job)
+{
+    const job_ops_t *ops = &job_ops[job->type];
+    int64_t wait_us = esp_timer_get_time() - job->submit_us;
+
+    job->state = JOB_STARTING;
+    _res_take(ops->res, 1);
+    if (ops->mute_wwe) {
+        mute_count++;
+    }
+    wait_us_sum[job->prio] += wait_us;
+    wait_cnt[job->prio]++;
+    stats.wait_us_avg[job->prio] = wait_us_sum[job->prio] / wait_cnt[job->prio];
+    if (wait_us > stats.wait_us_max[job->prio]) {
+        stats.wait_us_max[job->prio] = wait_us;
+    }
+    ESP_LOGI(TAG, "%s job %d start, prio %d, queued %lld us", ops->name, job->id, job->prio, (long long)wait_us);
+
+    running_job[job->type] = job;
+    if (observer) {
+        observer(job->type, true, REACTOR_RUNNING);
+    }
+}
+
+/*
+ * Only the highest priority waiter of a resource may preempt its holders,
+ * one victim per saturated resource. The victim's slot is freed when the
+ * reactor reports it stopped, which dispatches again.
+ */
+static void _preempt_for(job_t *job)
+{
+    const job_ops_t *ops = &job_ops[job->type];
+    job_t *busy = running_job[job->type];
+
+    if (busy && !busy->cancel && busy->prio < job->prio && job_ops[busy->type].preemptible) {
+        ESP_LOGW(TAG, "%s job %d preempted by job %d", job_ops[busy->type].name, busy->id, job->id);
+        stats.preempted++;
+        _cancel_running(busy);
+    }
+    for (int r = 0; r < JOB_RES_MAX; r++) {
+        if (!(ops->res & JOB_RES_BIT(r)) || res_used[r] < res_limit[r]) {
+            continue;
+        }
+        job_t *victim = NULL;
+        for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+            job_t *j = &jobs[i];
+            if ((j->state != JOB_STARTING && j->state != JOB_RUNNING) || j->cancel || j->prio >= job->prio
+                || !job_ops[j->type].preemptible || !(job_ops[j->type].res & JOB_RES_BIT(r))) {
+                continue;
+            }
+            if (victim == NULL || j->prio < victim->prio) {
+                victim = j;
+            }
+        }
+        if (victim) {
+            ESP_LOGW(TAG, "%s job %d preempted by job %d", job_ops[victim->type].name, victim->id, job->id);
+            stats.preempted++;
+            _cancel_running(victim);
+        }
+    }
+}
+
+// called with sched_lock held
+static void _dispatch()
+{
+    uint32_t visited = 0;
+    // resources a higher priority pending job is waiting for
+    uint32_t blocked = 0;
+
+    while (1) {
+        job_t *job = NULL;
+        int idx = -1;
+        for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+            job_t *j = &jobs[i];
+            if (j->state != JOB_PENDING || (visited & (1 << i))) {
+                continue;
+            }
+            if (job == NULL || j->prio > job->prio || (j->prio == job->prio && (int32_t)(j->seq - job->seq) < 0)) {
+                job = j;
+                idx = i;
+            }
+        }
+        if (job == NULL) {
+            break;
+        }
+        visited |= 1 << idx;
+
+        const job_ops_t *ops = &job_ops[job->type];
+        if (running_job[job->type] == NULL && !releasing[job->type] && !(ops->res & blocked)
+            && _res_fits(ops->res)) {
+            _start(job);
+            continue;
+        }
+        if (!(ops->res & blocked)) {
+            _preempt_for(job);
+        }
+        blocked |= ops->res;
+    }
+    xTaskNotifyGive(sched_task);
+}
+
+static void _finish(job_t *job, reactor_result_t result)
+{
+    const job_ops_t *ops = &job_ops[job->type];
+
+    _res_take(ops->res, -1);
+    if (ops->mute_wwe && --mute_count == 0) {
+        unmute_from_us = esp_timer_get_time();
+    }
+    if (job->cancel) {
+        stats.cancelled++;
+    } else if (result == REACTOR_DONE) {
+        stats.completed++;
+    } else {
+        stats.failed++;
+    }
+    ESP_LOGI(TAG, "%s job %d %s", ops->name, job->id, job->cancel ? "cancelled" : reactor_result_str(result));
+    running_job[job->type] = NULL;
+    idle_since_us[job->type] = esp_timer_get_time();
+    if (observer) {
+        observer(job->type, false, job->cancel ? REACTOR_ABORTED : result);
+    }
+    job->state = JOB_FREE;
+}
+
+// reactor task, may come in while sched_task is still in ops->start
+static void _job_done(pipe_type_t type, reactor_result_t result)
+{
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    if (running_job[type]) {
+        _finish(running_job[type], result);
+    }
+    _dispatch();
+    xSemaphoreGive(sched_lock);
+}
+
+typedef enum {
+    WORK_NONE = 0,
+    WORK_WWE,
+    WORK_ABORT,
+    WORK_START,
+    WORK_RELEASE,
+} work_t;
+
+// called with sched_lock held, the next pipeline call for sched_task
+static work_t _next_work(job_t **out, pipe_type_t *type)
+{
+    // wakenet follows mute_count before any job starts
+    if ((mute_count > 0) != wwe_muted) {
+        wwe_muted = mute_count > 0;
+        return WORK_WWE;
+    }
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        job_t *job = &jobs[i];
+        if (job->state == JOB_RUNNING && job->cancel && !job->aborted) {
+            job->aborted = true;
+            *type = job->type;
+            return WORK_ABORT;
+        }
+    }
+    job_t *next = NULL;
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        job_t *job = &jobs[i];
+        if (job->state != JOB_STARTING) {
+            continue;
+        }
+        if (job->cancel) {
+            // never started, nothing to abort
+            _finish(job, REACTOR_ABORTED);
+            _dispatch();
+            return _next_work(out, type);
+        }
+        if (next == NULL || job->prio > next->prio) {
+            next = job;
+        }
+    }
+    if (next) {
+        *out = next;
+        *type = next->type;
+        return WORK_START;
+    }
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        if (releasing[t] && (_pending(t) || _sharer_busy(t))) {
+            // wanted again since it was picked, or a pipeline sharing its elements started
+            releasing[t] = false;
+            _dispatch();
+        } else if (releasing[t]) {
+            *type = t;
+            return WORK_RELEASE;
+        }
+    }
+    return WORK_NONE;
+}
+
+static void job_sched_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (1) {
+            job_t *job = NULL;
+            pipe_type_t type = PIPE_TYPE_MAX;
+
+            xSemaphoreTake(sched_lock, portMAX_DELAY);
+            work_t work = _next_work(&job, &type);
+            bool mute = wwe_muted;
+            job_id_t id = job ? job->id : JOB_ID_INVALID;
+            xSemaphoreGive(sched_lock);
+
+            if (work == WORK_NONE) {
+                break;
+            }
+            switch (work) {
+                case WORK_WWE:
+                    enable_wwe_pipeline(!mute);
+                    if (!mute) {
+                        ESP_LOGI(TAG, "Job end to listening-ready: %lld us",
+                                 (long long)(esp_timer_get_time() - unmute_from_us));
+                    }
+                    break;
+                case WORK_ABORT:
+                    job_ops[type].abort();
+                    break;
+                case WORK_START:
+                    if (!built[type]) {
+                        _build(type);
+                    }
+                    // src/dst stay put, the slot is only reused after _job_done
+                    if (job_ops[type].start(job->src, job->dst, _job_done) != ESP_OK) {
+                        // the last run would not stop, the next job gets a fresh build
+                        ESP_LOGE(TAG, "%s job %d failed to start, releasing", job_ops[type].name, id);
+                        _release(type);
+                        xSemaphoreTake(sched_lock, portMAX_DELAY);
+                        if (job->state == JOB_STARTING && job->id == id) {
+                            _finish(job, REACTOR_ERROR);
+                        }
+                        _dispatch();
+                        xSemaphoreGive(sched_lock);
+                        break;
+                    }
+                    xSemaphoreTake(sched_lock, portMAX_DELAY);
+                    if (job->state == JOB_STARTING && job->id == id) {
+                        job->state = JOB_RUNNING;
+                    }
+                    xSemaphoreGive(sched_lock);
+                    break;
+                case WORK_RELEASE:
+                    _release(type);
+                    xSemaphoreTake(sched_lock, portMAX_DELAY);
+                    // jobs that came in meanwhile
+                    _dispatch();
+                    xSemaphoreGive(sched_lock);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void init_job_sched(){
+    sched_lock = xSemaphoreCreateMutex();
+    mem_assert(sched_lock);
+    if (xTaskCreatePinnedToCore(job_sched_task, "job_sched", JOB_SCHED_TASK_STACK, NULL,
+                                TASK_PRIO(REACTOR), &sched_task, TASK_CORE(REACTOR)) != pdPASS) {
+        ESP_LOGE(TAG, "Create job_sched task failed");
+    }
+    heap_snap_t h;
+    _heap_snap(&h);
+    ESP_LOGI(TAG, "Heap before first job: internal %u (low %u), psram %u (low %u)",
+             (unsigned)h.int_free, (unsigned)h.int_min, (unsigned)h.spi_free, (unsigned)h.spi_min);
+    ESP_LOGI(TAG, "Job scheduler ready, limits i2s_out:%d net:%d sd:%d",
+             res_limit[JOB_RES_I2S_OUT], res_limit[JOB_RES_NET], res_limit[JOB_RES_SD]);
+}
+
+void job_sched_set_observer(job_observer_t cb){
+    observer = cb;
+}
+
+job_id_t job_sched_submit(pipe_type_t type, job_prio_t prio, const char *src, const char *dst){
+    if (type >= PIPE_TYPE_MAX || job_ops[type].start == NULL) {
+        ESP_LOGE(TAG, "Pipeline %d can not be scheduled", type);
+        return JOB_ID_INVALID;
+    }
+    job_id_t id = JOB_ID_INVALID;
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        job_t *job = &jobs[i];
+        if (job->state != JOB_FREE) {
+            continue;
+        }
+        memset(job, 0, sizeof(job_t));
+        job->id = id = next_id++;
+        job->type = type;
+        job->prio = prio;
+        job->seq = next_seq++;
+        job->submit_us = esp_timer_get_time();
+        strlcpy(job->src, src ? src : "", sizeof(job->src));
+        strlcpy(job->dst, dst ? dst : "", sizeof(job->dst));
+        job->state = JOB_PENDING;
+        stats.submitted++;
+        _dispatch();
+        break;
+    }
+    if (id == JOB_ID_INVALID) {
+        stats.rejected++;
+    }
+    xSemaphoreGive(sched_lock);
+
+    if (id == JOB_ID_INVALID) {
+        ESP_LOGE(TAG, "Job queue full, drop %s: %s", job_ops[type].name, src);
+    }
+    return id;
+}
+
+static void _cancel(job_t *job)
+{
+    if (job->state == JOB_PENDING) {
+        ESP_LOGI(TAG, "%s job %d dropped", job_ops[job->type].name, job->id);
+        job->state = JOB_FREE;
+        stats.cancelled++;
+    } else if (job->state == JOB_STARTING || job->state == JOB_RUNNING) {
+        _cancel_running(job);
+    }
+}
+
+bool job_sched_cancel(job_id_t id){
+    bool found = false;
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        if (jobs[i].state != JOB_FREE && jobs[i].id == id) {
+            _cancel(&jobs[i]);
+            found = true;
+            break;
+        }
+    }
+    _dispatch();
+    xSemaphoreGive(sched_lock);
+    return found;
+}
+
+int job_sched_cancel_res(job_res_t res){
+    int n = 0;
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    for (int i = 0; i < JOB_SCHED_MAX_JOBS; i++) {
+        job_t *job = &jobs[i];
+        if (job->state != JOB_FREE && (job_ops[job->type].res & JOB_RES_BIT(res))) {
+            _cancel(job);
+            n++;
+        }
+    }
+    _dispatch();
+    xSemaphoreGive(sched_lock);
+    return n;
+}
+
+void job_sched_release_idle(){
+#if CONFIG_PIPELINE_IDLE_RELEASE_MS > 0
+    int64_t now = esp_timer_get_time();
+    bool release = false;
+
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        if (!built[t] || running_job[t] || releasing[t] || _sharer_busy(t)
+            || now - idle_since_us[t] < (int64_t)CONFIG_PIPELINE_IDLE_RELEASE_MS * 1000) {
+            continue;
+        }
+        if (!_pending(t)) {
+            releasing[t] = release = true;
+        }
+    }
+    xSemaphoreGive(sched_lock);
+    if (release) {
+        xTaskNotifyGive(sched_task);
+    }
+#endif
+}
+
+void job_sched_get_stats(job_sched_stats_t *out){
+    xSemaphoreTake(sched_lock, portMAX_DELAY);
+    memcpy(out, &stats, sizeof(stats));
+    xSemaphoreGive(sched_lock);
+}
@@ -0,0 +1,82 @@
+/*
+ * job_sched.h
+ *
+ * Runs the file/http/player pipelines as jobs instead of one blocking
+ * run_* call at a time. A job waits until its pipeline is idle and the
+ * resources it uses (i2s out, network, sd card) are under their limits.
+ * Higher priority jobs are dispatched first and may preempt lower priority
+ * ones holding a resource they need.
+ * Pipelines are built by the first job that needs them and released again
+ * after CONFIG_PIPELINE_IDLE_RELEASE_MS without a job. Building, starting,
+ * aborting and releasing them runs in the job_sched task, the scheduler
+ * lock is only held while the job tables change.
+ */
+
+#ifndef MAIN_JOB_SCHED_H_
+#define MAIN_JOB_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "msg_pool.h"
+#include "pipline_work.h"
+
+#define JOB_SCHED_MAX_JOBS  (8)
+#define JOB_URL_LEN         MSG_URL_LEN
+// how often the main loop should call job_sched_release_idle
+#define JOB_SCHED_IDLE_POLL_MS  (1000)
+
+typedef enum {
+    JOB_PRIO_LOW = 0,
+    JOB_PRIO_NORMAL,
+    JOB_PRIO_HIGH,
+    JOB_PRIO_MAX,
+} job_prio_t;
+
+typedef enum {
+    JOB_RES_I2S_OUT = 0,
+    JOB_RES_NET,
+    JOB_RES_SD,
+    JOB_RES_MAX,
+} job_res_t;
+
+#define JOB_RES_BIT(res)    (1 << (res))
+
+typedef int job_id_t;
+#define JOB_ID_INVALID      (-1)
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    // timed out, stalled or reported an error
+    uint32_t failed;
+    uint32_t cancelled;
+    uint32_t preempted;
+    uint32_t rejected;
+    int64_t  wait_us_max[JOB_PRIO_MAX];
+    int64_t  wait_us_avg[JOB_PRIO_MAX];
+    uint32_t builds;
+    uint32_t releases;
+} job_sched_stats_t;
+
+// started, or finished with result
+typedef void (*job_observer_t)(pipe_type_t type, bool started, reactor_result_t result);
+
+void init_job_sched();
+// one observer, called with the scheduler lock held, must not block;
+// started is reported when the job is dispatched, before its pipeline runs
+void job_sched_set_observer(job_observer_t observer);
+
+// src/dst are copied, the caller keeps ownership
+job_id_t job_sched_submit(pipe_type_t type, job_prio_t prio, const char *src, const char *dst);
+// drop a pending job or abort a running one
+bool job_sched_cancel(job_id_t id);
+// cancel every job using res, e.g. all playback on barge-in
+int job_sched_cancel_res(job_res_t res);
+
+// hand pipelines idle for longer than the release timeout to the job_sched task to destroy
+void job_sched_release_idle();
+
+void job_sched_get_stats(job_sched_stats_t *stats);
+
+#endif /* MAIN_JOB_SCHED_H_ */
@@ -0,0 +1,186 @@
+#include "main.h"
+#include "local_cmd.h"
+#include "job_sched.h"
+#include "log.h"
+#include "mem_track.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "audio_tone_uri.h"
+#include "board.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LOCAL_CMD_ENABLE
+
+static const char *TAG = "local_cmd";
+
+#define LOCAL_CMD_VOLUME_STEP   (10)
+#define LOCAL_CMD_NO_TONE       (TONE_TYPE_MAX)
+
+// MultiNet pinyin, same format as the list served by the speech server
+static const char builtin[] =
+    "light_on=da kai dian deng,kai dian deng\n"
+    "light_off=guan bi dian deng,guan dian deng\n"
+    "light_off=guan deng\n"
+    "volume_up=tiao da yin liang,da sheng yi dian\n"
+    "volume_down=tiao xiao yin liang,xiao sheng yi dian\n"
+    "stop=ting zhi bo fang,bie shuo le\n";
+
+static const tone_type_t action_tones[LOCAL_ACT_MAX] = {
+    [LOCAL_ACT_NONE]        = LOCAL_CMD_NO_TONE,
+    [LOCAL_ACT_LIGHT_ON]    = TONE_TYPE_HAODE,
+    [LOCAL_ACT_LIGHT_OFF]   = TONE_TYPE_HAODE,
+    [LOCAL_ACT_VOLUME_UP]   = TONE_TYPE_HAODE,
+    [LOCAL_ACT_VOLUME_DOWN] = TONE_TYPE_HAODE,
+    [LOCAL_ACT_STOP]        = LOCAL_CMD_NO_TONE,
+};
+
+// last committed and the spare one for prepare; active is current or NULL
+static local_cmd_list_t             lists[2];
+static local_cmd_list_t             *current;
+static local_cmd_list_t             *prepared;
+static local_cmd_list_t * volatile  active;
+static int                          led_gpio = -1;
+// set by the recorder callback, taken by the assistant task
+static volatile int                 pending = -1;
+static local_cmd_list_t * volatile  pending_list;
+static volatile int64_t             detect_us;
+static local_cmd_stats_t            stats;
+
+static void _volume_step(int step)
+{
+#if !CONFIG_QEMU_TARGET
+    audio_board_handle_t board = audio_board_get_handle();
+    int vol = 0;
+
+    if (board == NULL || audio_hal_get_volume(board->audio_hal, &vol) != ESP_OK) {
+        return;
+    }
+    vol += step;
+    vol = vol < 0 ? 0 : vol > 100 ? 100 : vol;
+    audio_hal_set_volume(board->audio_hal, vol);
+    ESP_LOGI(TAG, "Volume %d", vol);
+#endif
+}
+
+static void _action(local_action_t act)
+{
+    switch (act) {
+        case LOCAL_ACT_LIGHT_ON:
+        case LOCAL_ACT_LIGHT_OFF:
+            if (led_gpio >= 0) {
+                gpio_set_level(led_gpio, act == LOCAL_ACT_LIGHT_ON);
+            }
+            break;
+        case LOCAL_ACT_VOLUME_UP:
+            _volume_step(LOCAL_CMD_VOLUME_STEP);
+            break;
+        case LOCAL_ACT_VOLUME_DOWN:
+            _volume_step(-LOCAL_CMD_VOLUME_STEP);
+            break;
+        case LOCAL_ACT_STOP:
+            job_sched_cancel_res(JOB_RES_I2S_OUT);
+            break;
+        default:
+            break;
+    }
+}
+
+void init_local_cmd(){
+    prepared = &lists[0];
+    led_gpio = get_green_led_gpio();
+    if (led_gpio >= 0) {
+        gpio_reset_pin(led_gpio);
+        gpio_set_direction(led_gpio, GPIO_MODE_OUTPUT);
+    }
+    ESP_LOGI(TAG, "Up to %d local commands, light on gpio %d", LOCAL_CMD_MAX, led_gpio);
+}
+
+const char *local_cmd_builtin(){
+    return builtin;
+}
+
+bool local_cmd_prepare(const char *list){
+    return local_cmd_list_parse(prepared, list);
+}
+
+const char *local_cmd_prepared_phrases(){
+    return prepared->phrases;
+}
+
+void local_cmd_commit(){
+    current = prepared;
+    prepared = current == &lists[0] ? &lists[1] : &lists[0];
+    active = current;
+    ESP_LOGI(TAG, "%d commands in use", current->num);
+}
+
+void local_cmd_suspend(){
+    active = NULL;
+}
+
+void local_cmd_resume(){
+    active = current;
+}
+
+const char *local_cmd_phrases(){
+    return current ? current->phrases : NULL;
+}
+
+int local_cmd_count(){
+    local_cmd_list_t *l = active;
+    return l ? l->num : 0;
+}
+
+bool local_cmd_detect(int id){
+    local_cmd_list_t *l = active;
+
+    stats.detected++;
+    if (l == NULL || id < 0 || id >= l->num || l->cmds[id].action == LOCAL_ACT_NONE) {
+        stats.fallback++;
+        ESP_LOGI(TAG, "Command %d not local, left to the cloud", id);
+        return false;
+    }
+    detect_us = esp_timer_get_time();
+    pending_list = l;
+    pending = id;
+    return true;
+}
+
+void local_cmd_run(){
+    int id = pending;
+    local_cmd_list_t *l = pending_list;
+
+    pending = -1;
+    if (id < 0) {
+        return;
+    }
+    if (l != active) {
+        ESP_LOGW(TAG, "Command %d dropped, the command list changed", id);
+        return;
+    }
+    const local_cmd_t *cmd = &l->cmds[id];
+    _action(cmd->action);
+    TRACE(TRACE_ACTION, id);
+    int64_t us = esp_timer_get_time() - detect_us;
+    if (action_tones[cmd->action] != LOCAL_CMD_NO_TONE) {
+        run_tone2player(tone_uri[action_tones[cmd->action]], NULL);
+    }
+    stats.local++;
+    stats.last_us = us;
+    if (us > stats.max_us) {
+        stats.max_us = us;
+    }
+    ESP_LOGI(TAG, "Command %d '%.*s': %s in %lld us", id, cmd->len, l->phrases + cmd->off,
+             local_cmd_action_str(cmd->action), us);
+}
+
+void local_cmd_get_stats(local_cmd_stats_t *out){
+    memcpy(out, &stats, sizeof(*out));
+}
+
+#endif /* CONFIG_LOCAL_CMD_ENABLE */
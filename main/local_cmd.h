@@ -0,0 +1,63 @@
+/*
+ * local_cmd.h
+ *
+ * Speech commands handled on the device. The command table is parsed from
+ * a list of "<action>=<phrase>[,<phrase>...]" lines, the row is the
+ * MultiNet command id. A recognized command runs its action and canned
+ * tone from the assistant task and the utterance is not uploaded; ids
+ * without a local action go to the cloud as before. A new table is
+ * prepared next to the one in use and swapped in once MultiNet has the
+ * matching phrases, see speech_cmds.h.
+ */
+
+#ifndef MAIN_LOCAL_CMD_H_
+#define MAIN_LOCAL_CMD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "local_cmd_list.h"
+#include "sdkconfig.h"
+
+typedef struct {
+    uint32_t detected;
+    // ran on the device
+    uint32_t local;
+    // recognized, but no local action, left to the cloud
+    uint32_t fallback;
+    // MultiNet result to action done
+    int64_t  last_us;
+    int64_t  max_us;
+} local_cmd_stats_t;
+
+void init_local_cmd();
+// the list built into the firmware
+const char *local_cmd_builtin();
+
+/**
+ * Parse list into the spare table, the one in use is not touched. Format
+ * as local_cmd_list_parse, action "cloud" recognizes the phrases without
+ * a local action.
+ */
+bool local_cmd_prepare(const char *list);
+// MultiNet phrases of the prepared table
+const char *local_cmd_prepared_phrases();
+// use the prepared table; none is in use before the first commit
+void local_cmd_commit();
+// no table in use while MultiNet changes phrases, commands go to the cloud
+void local_cmd_suspend();
+// back to the last committed table, when MultiNet kept its phrases
+void local_cmd_resume();
+// MultiNet phrases of the last committed table, NULL before the first
+const char *local_cmd_phrases();
+// rows of the table in use, 0 when suspended
+int local_cmd_count();
+
+// recorder callback: true when id has a local action, it is then pending
+bool local_cmd_detect(int id);
+// assistant task, runs the pending command
+void local_cmd_run();
+
+void local_cmd_get_stats(local_cmd_stats_t *stats);
+
+#endif /* MAIN_LOCAL_CMD_H_ */
@@ -0,0 +1,74 @@
+#include "local_cmd_list.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "local_cmd";
+
+static const char *action_names[LOCAL_ACT_MAX] = {
+    [LOCAL_ACT_NONE]        = "cloud",
+    [LOCAL_ACT_LIGHT_ON]    = "light_on",
+    [LOCAL_ACT_LIGHT_OFF]   = "light_off",
+    [LOCAL_ACT_VOLUME_UP]   = "volume_up",
+    [LOCAL_ACT_VOLUME_DOWN] = "volume_down",
+    [LOCAL_ACT_STOP]        = "stop",
+};
+
+static bool _parse_action(const char *name, int len, local_action_t *act)
+{
+    for (int i = 0; i < LOCAL_ACT_MAX; i++) {
+        if (strlen(action_names[i]) == len && strncmp(name, action_names[i], len) == 0) {
+            *act = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool local_cmd_list_parse(local_cmd_list_t *l, const char *list){
+    int line = 0;
+    int pos = 0;
+
+    l->num = 0;
+    while (*list) {
+        const char *end = strchr(list, '\n');
+        int len = end ? end - list : strlen(list);
+        line++;
+        while (len > 0 && (list[len - 1] == '\r' || list[len - 1] == ' ')) {
+            len--;
+        }
+        const char *eq = memchr(list, '=', len);
+        if (len == 0 || list[0] == '#') {
+            // blank or comment
+        } else if (eq == NULL || eq == list + len - 1 || memchr(eq, ';', list + len - eq)) {
+            ESP_LOGE(TAG, "Line %d: not <action>=<phrases>", line);
+            return false;
+        } else {
+            local_cmd_t *cmd = &l->cmds[l->num];
+            int plen = list + len - eq - 1;
+            if (l->num == LOCAL_CMD_MAX || pos + plen + 2 > sizeof(l->phrases)) {
+                ESP_LOGE(TAG, "Line %d: more than %d commands or %d bytes", line, LOCAL_CMD_MAX,
+                         LOCAL_CMD_PHRASES_LEN);
+                return false;
+            }
+            if (!_parse_action(list, eq - list, &cmd->action)) {
+                ESP_LOGE(TAG, "Line %d: unknown action '%.*s'", line, (int)(eq - list), list);
+                return false;
+            }
+            cmd->off = pos;
+            cmd->len = plen;
+            memcpy(l->phrases + pos, eq + 1, plen);
+            pos += plen;
+            l->phrases[pos++] = ';';
+            l->num++;
+        }
+        list += end ? end - list + 1 : strlen(list);
+    }
+    l->phrases[pos] = 0;
+    return l->num > 0;
+}
+
+const char *local_cmd_action_str(local_action_t act){
+    return act < LOCAL_ACT_MAX ? action_names[act] : "?";
+}
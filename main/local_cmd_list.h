@@ -0,0 +1,53 @@
+/*
+ * local_cmd_list.h
+ *
+ * Parser of the local command list into a command table and the MultiNet
+ * phrase string. No ESP-IDF dependency besides logging, also built on the
+ * host.
+ */
+
+#ifndef MAIN_LOCAL_CMD_LIST_H_
+#define MAIN_LOCAL_CMD_LIST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOCAL_CMD_MAX           (32)
+// "phrase,phrase;phrase;" as recorder_sr_reset_speech_cmd takes it
+#define LOCAL_CMD_PHRASES_LEN   (512)
+
+typedef enum {
+    LOCAL_ACT_NONE = 0,
+    LOCAL_ACT_LIGHT_ON,
+    LOCAL_ACT_LIGHT_OFF,
+    LOCAL_ACT_VOLUME_UP,
+    LOCAL_ACT_VOLUME_DOWN,
+    // cancel whatever holds the i2s output
+    LOCAL_ACT_STOP,
+    LOCAL_ACT_MAX,
+} local_action_t;
+
+typedef struct {
+    // the row's phrases in list->phrases, without the ';'
+    uint16_t        off;
+    uint16_t        len;
+    local_action_t  action;
+} local_cmd_t;
+
+typedef struct {
+    int             num;
+    local_cmd_t     cmds[LOCAL_CMD_MAX];
+    char            phrases[LOCAL_CMD_PHRASES_LEN];
+} local_cmd_list_t;
+
+/**
+ * Lines are "<action>=<phrase>[,<phrase>...]", the row is the MultiNet
+ * command id. Blank lines and '#' comments are skipped, CRLF and trailing
+ * blanks are fine. False on a syntax error or overflow, the offending
+ * line is logged, or when the list has no command.
+ */
+bool local_cmd_list_parse(local_cmd_list_t *l, const char *text);
+
+const char *local_cmd_action_str(local_action_t act);
+
+#endif /* MAIN_LOCAL_CMD_LIST_H_ */
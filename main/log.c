@@ -5,6 +5,328 @@
  *      Author: devin
  */
 
+#include "main.h"
+#include "log.h"
+#include "cpu_load.h"
 
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "sdkconfig.h"
 
+#if CONFIG_TRACE_ENABLE
+
+static const char *TAG = "trace";
+
+#define TRACE_RING_SIZE     (CONFIG_TRACE_RING_SIZE)
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+#define TRACE_DRAIN_MS      (200)
+#define TRACE_HIST_LOG_MS   (60 * 1000)
+#define TRACE_TASK_STACK    (3 * 1024)
+#define TRACE_LINE_LEN      (32)
+#define TRACE_POST_LEN      (1024)
+
+#if CONFIG_TRACE_SINK_HTTP
+#define TRACE_SINK_NAME     "http"
+#else
+#define TRACE_SINK_NAME     "uart"
+#endif
+
+_Static_assert((TRACE_RING_SIZE & TRACE_RING_MASK) == 0, "CONFIG_TRACE_RING_SIZE must be a power of two");
+
+typedef struct {
+    // write index + 1 once the record is complete
+    volatile uint32_t   seq;
+    uint32_t            ts_us;
+    uint16_t            id;
+    uint16_t            core;
+    uint32_t            arg;
+} trace_rec_t;
+
+typedef struct {
+    trace_event_t from;
+    trace_event_t to;
+} trace_stage_def_t;
+
+static const trace_stage_def_t stage_defs[TRACE_STAGE_MAX] = {
+    [TRACE_STAGE_WAKE_TO_VAD]   = { TRACE_WAKE,         TRACE_VAD_START },
+    [TRACE_STAGE_SPEECH]        = { TRACE_VAD_START,    TRACE_VAD_END },
+    [TRACE_STAGE_FILE_CLOSE]    = { TRACE_VAD_END,      TRACE_FILE_CLOSE },
+    [TRACE_STAGE_UPLOAD_START]  = { TRACE_FILE_CLOSE,   TRACE_UPLOAD_FIRST },
+    [TRACE_STAGE_UPLOAD]        = { TRACE_UPLOAD_FIRST, TRACE_UPLOAD_LAST },
+    [TRACE_STAGE_RESPONSE]      = { TRACE_UPLOAD_LAST,  TRACE_RESPONSE },
+    [TRACE_STAGE_PLAY_START]    = { TRACE_RESPONSE,     TRACE_PLAY_START },
+    // user stops talking to the answer being heard
+    [TRACE_STAGE_END_TO_END]    = { TRACE_VAD_END,      TRACE_PLAY_START },
+    [TRACE_STAGE_LOCAL_ACTION]  = { TRACE_VAD_START,    TRACE_ACTION },
+    [TRACE_STAGE_CLOUD_ACTION]  = { TRACE_VAD_START,    TRACE_RESPONSE },
+};
+
+static trace_rec_t      ring[TRACE_RING_SIZE];
+static uint32_t         w_idx;
+// drain task only
+static uint32_t         r_idx;
+static bool             armed[TRACE_STAGE_MAX];
+static uint32_t         armed_ts[TRACE_STAGE_MAX];
+static uint32_t         hist_new;
+static trace_hist_t     hist[TRACE_STAGE_MAX];
+static trace_stats_t    stats;
+
+#endif /* CONFIG_TRACE_ENABLE */
+
+static volatile uint32_t trace_mask = TRACE_MASK_ALL;
+
+static const char *event_names[TRACE_EVENT_MAX] = {
+    [TRACE_WAKE]            = "wake",
+    [TRACE_VAD_START]       = "vad_start",
+    [TRACE_VAD_END]         = "vad_end",
+    [TRACE_FILE_CLOSE]      = "file_close",
+    [TRACE_UPLOAD_FIRST]    = "upload_first",
+    [TRACE_UPLOAD_LAST]     = "upload_last",
+    [TRACE_RESPONSE]        = "response",
+    [TRACE_PLAY_START]      = "play_start",
+    [TRACE_COMMAND]         = "command",
+    [TRACE_ACTION]          = "action",
+};
+
+static const char *stage_names[TRACE_STAGE_MAX] = {
+    [TRACE_STAGE_WAKE_TO_VAD]   = "wake_to_vad",
+    [TRACE_STAGE_SPEECH]        = "speech",
+    [TRACE_STAGE_FILE_CLOSE]    = "file_close",
+    [TRACE_STAGE_UPLOAD_START]  = "upload_start",
+    [TRACE_STAGE_UPLOAD]        = "upload",
+    [TRACE_STAGE_RESPONSE]      = "response",
+    [TRACE_STAGE_PLAY_START]    = "play_start",
+    [TRACE_STAGE_END_TO_END]    = "end_to_end",
+    [TRACE_STAGE_LOCAL_ACTION]  = "local_action",
+    [TRACE_STAGE_CLOUD_ACTION]  = "cloud_action",
+};
+
+const char *trace_event_str(trace_event_t id){
+    return id < TRACE_EVENT_MAX ? event_names[id] : "?";
+}
+
+const char *trace_stage_str(trace_stage_t stage){
+    return stage < TRACE_STAGE_MAX ? stage_names[stage] : "?";
+}
+
+void trace_set_mask(uint32_t mask){
+    trace_mask = mask & TRACE_MASK_ALL;
+}
+
+uint32_t trace_get_mask(){
+    return trace_mask;
+}
+
+#if CONFIG_TRACE_ENABLE
+
+void trace_event(trace_event_t id, uint32_t arg){
+    if (!(trace_mask & (1u << id))) {
+        return;
+    }
+    uint32_t idx = __atomic_fetch_add(&w_idx, 1, __ATOMIC_RELAXED);
+    trace_rec_t *rec = &ring[idx & TRACE_RING_MASK];
+
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    rec->ts_us = (uint32_t)esp_timer_get_time();
+    rec->id = id;
+    rec->core = xPortGetCoreID();
+    rec->arg = arg;
+    __atomic_store_n(&rec->seq, idx + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&stats.recorded, 1, __ATOMIC_RELAXED);
+}
+
+static void _hist_add(trace_hist_t *h, uint32_t ms)
+{
+    int b = 0;
+    while (b < TRACE_HIST_BUCKETS - 1 && ms >= (1u << b)) {
+        b++;
+    }
+    h->bucket[b]++;
+    if (h->count == 0 || ms < h->min_ms) {
+        h->min_ms = ms;
+    }
+    if (ms > h->max_ms) {
+        h->max_ms = ms;
+    }
+    h->sum_ms += ms;
+    h->count++;
+}
+
+static void _stage_update(const trace_rec_t *rec)
+{
+    for (int s = 0; s < TRACE_STAGE_MAX; s++) {
+        if (stage_defs[s].to == rec->id && armed[s]) {
+            _hist_add(&hist[s], (rec->ts_us - armed_ts[s]) / 1000);
+            armed[s] = false;
+            hist_new++;
+        }
+        if (stage_defs[s].from == rec->id) {
+            armed[s] = true;
+            armed_ts[s] = rec->ts_us;
+        }
+    }
+}
+
+#if CONFIG_TRACE_SINK_HTTP
+static char post_buf[TRACE_POST_LEN];
+static int  post_len;
+
+static void _sink_flush()
+{
+    char url[64];
+
+    if (post_len == 0) {
+        return;
+    }
+    snprintf(url, sizeof(url), "http://%s:%d/trace", CONFIG_TARGET_URL, CONFIG_TARGET_PORT);
+    esp_http_client_config_t cfg = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = 2000,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&cfg);
+    if (client == NULL) {
+        stats.sink_errors++;
+        return;
+    }
+    esp_http_client_set_header(client, "Content-Type", "text/plain");
+    esp_http_client_set_post_field(client, post_buf, post_len);
+    if (esp_http_client_perform(client) != ESP_OK) {
+        // keep going, the trace is best effort
+        stats.sink_errors++;
+    }
+    esp_http_client_cleanup(client);
+    post_len = 0;
+}
+
+static void _sink_write(const trace_rec_t *rec)
+{
+    if (post_len + TRACE_LINE_LEN > TRACE_POST_LEN) {
+        _sink_flush();
+    }
+    post_len += snprintf(post_buf + post_len, TRACE_POST_LEN - post_len, "T,%u,%u,%u\n",
+                         rec->ts_us, rec->id, rec->arg);
+}
+#else
+static void _sink_flush()
+{
+}
+
+static void _sink_write(const trace_rec_t *rec)
+{
+    printf("T,%u,%u,%u\n", rec->ts_us, rec->id, rec->arg);
+}
+#endif /* CONFIG_TRACE_SINK_HTTP */
+
+static void _drain()
+{
+    uint32_t w = __atomic_load_n(&w_idx, __ATOMIC_ACQUIRE);
+
+    if (w - r_idx > TRACE_RING_SIZE) {
+        stats.dropped += w - r_idx - TRACE_RING_SIZE;
+        r_idx = w - TRACE_RING_SIZE;
+    }
+    while (r_idx != w) {
+        trace_rec_t *slot = &ring[r_idx & TRACE_RING_MASK];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq != r_idx + 1) {
+            if (seq == 0) {
+                // still being written, pick it up next time
+                break;
+            }
+            stats.dropped++;
+            r_idx++;
+            continue;
+        }
+        trace_rec_t rec = *slot;
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != r_idx + 1) {
+            // overwritten while copied
+            stats.dropped++;
+            r_idx++;
+            continue;
+        }
+        r_idx++;
+        _sink_write(&rec);
+        _stage_update(&rec);
+    }
+    _sink_flush();
+}
+
+static void trace_task(void *arg)
+{
+    TickType_t last_dump = xTaskGetTickCount();
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_MS));
+        _drain();
+        if (hist_new && xTaskGetTickCount() - last_dump >= pdMS_TO_TICKS(TRACE_HIST_LOG_MS)) {
+            trace_dump_hist();
+            hist_new = 0;
+            last_dump = xTaskGetTickCount();
+        }
+    }
+}
+
+void init_trace(){
+    if (xTaskCreatePinnedToCore(trace_task, "trace", TRACE_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create trace task failed");
+        return;
+    }
+    ESP_LOGI(TAG, "Tracer ready, %d records, %s sink", TRACE_RING_SIZE, TRACE_SINK_NAME);
+}
+
+void trace_get_hist(trace_stage_t stage, trace_hist_t *out){
+    memcpy(out, &hist[stage], sizeof(trace_hist_t));
+}
+
+void trace_get_stats(trace_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
+
+void trace_dump_hist(){
+    // " " and up to 10 digits per uint32_t bucket
+    char line[TRACE_HIST_BUCKETS * 11 + 1];
+
+    for (int s = 0; s < TRACE_STAGE_MAX; s++) {
+        trace_hist_t *h = &hist[s];
+        if (h->count == 0) {
+            continue;
+        }
+        int len = 0;
+        line[0] = 0;
+        for (int b = 0; b < TRACE_HIST_BUCKETS && len < (int)sizeof(line); b++) {
+            len += snprintf(line + len, sizeof(line) - len, " %u", h->bucket[b]);
+        }
+        ESP_LOGI(TAG, "%-12s n=%u min %u avg %u max %u ms |%s", stage_names[s], h->count,
+                 h->min_ms, h->sum_ms / h->count, h->max_ms, line);
+    }
+    ESP_LOGI(TAG, "recorded %u, dropped %u, sink errors %u", stats.recorded, stats.dropped, stats.sink_errors);
+}
+
+#else
+
+void init_trace(){
+}
+
+void trace_event(trace_event_t id, uint32_t arg){
+}
+
+void trace_get_hist(trace_stage_t stage, trace_hist_t *out){
+    memset(out, 0, sizeof(trace_hist_t));
+}
+
+void trace_get_stats(trace_stats_t *out){
+    memset(out, 0, sizeof(trace_stats_t));
+}
+
+void trace_dump_hist(){
+}
+
+#endif /* CONFIG_TRACE_ENABLE */
@@ -3,13 +3,92 @@
  *
  *  Created on: May 31, 2023
  *      Author: devin
+ *
+ * Latency tracer. Hot paths record (timestamp, event id, arg) into a fixed
+ * size lock-free ring, a low priority task drains it to the sink (UART
+ * lines or HTTP POST) and keeps per-stage latency histograms. The dump
+ * format is "T,<us>,<id>,<arg>" per event, tools/trace_hist.py builds the
+ * same histograms on the host.
  */
 
 #ifndef MAIN_LOG_H_
 #define MAIN_LOG_H_
 
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef enum {
+    TRACE_WAKE = 0,
+    TRACE_VAD_START,
+    TRACE_VAD_END,
+    TRACE_FILE_CLOSE,
+    TRACE_UPLOAD_FIRST,
+    TRACE_UPLOAD_LAST,
+    TRACE_RESPONSE,
+    // first frame of a port mixed into the i2s writer, arg is the port
+    TRACE_PLAY_START,
+    // MultiNet result, arg is the command id
+    TRACE_COMMAND,
+    // local command action done, arg is the command id
+    TRACE_ACTION,
+    TRACE_EVENT_MAX,
+} trace_event_t;
+
+// latency from the last 'from' event to the next 'to' event
+typedef enum {
+    TRACE_STAGE_WAKE_TO_VAD = 0,
+    TRACE_STAGE_SPEECH,
+    TRACE_STAGE_FILE_CLOSE,
+    TRACE_STAGE_UPLOAD_START,
+    TRACE_STAGE_UPLOAD,
+    TRACE_STAGE_RESPONSE,
+    TRACE_STAGE_PLAY_START,
+    TRACE_STAGE_END_TO_END,
+    // speech onset to the command carried out, on the device or by the server
+    TRACE_STAGE_LOCAL_ACTION,
+    TRACE_STAGE_CLOUD_ACTION,
+    TRACE_STAGE_MAX,
+} trace_stage_t;
+
+#define TRACE_MASK_ALL      ((1u << TRACE_EVENT_MAX) - 1)
+
+// log2 buckets of milliseconds: [0,1), [1,2), [2,4) ... [16.4s, inf)
+#define TRACE_HIST_BUCKETS  (16)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint32_t sum_ms;
+    uint32_t bucket[TRACE_HIST_BUCKETS];
+} trace_hist_t;
+
+typedef struct {
+    uint32_t recorded;
+    // overwritten before the drain task got to them
+    uint32_t dropped;
+    uint32_t sink_errors;
+} trace_stats_t;
 
+#if CONFIG_TRACE_ENABLE
+#define TRACE(id, arg)      trace_event((id), (uint32_t)(arg))
+#else
+#define TRACE(id, arg)      do { } while (0)
+#endif
 
+void init_trace();
+// any task, never blocks
+void trace_event(trace_event_t id, uint32_t arg);
+// events whose bit is clear are not recorded, default TRACE_MASK_ALL
+void trace_set_mask(uint32_t mask);
+uint32_t trace_get_mask();
 
+const char *trace_event_str(trace_event_t id);
+const char *trace_stage_str(trace_stage_t stage);
+void trace_get_hist(trace_stage_t stage, trace_hist_t *hist);
+void trace_get_stats(trace_stats_t *stats);
+// log all stage histograms
+void trace_dump_hist();
 
 #endif /* MAIN_LOG_H_ */
@@ -0,0 +1,407 @@
+#include "main.h"
+#include "log_ctl.h"
+#include "log.h"
+#include "dlog.h"
+#include "ctl_server.h"
+#include "mem_track.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_console.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "audio_mem.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "log_ctl";
+
+#define LOG_CTL_NVS_NS      "log_ctl"
+#define LOG_CTL_NVS_KEY     "cfg"
+#define LOG_CTL_CFG_VER     (2)
+// version 1 saved the enabled events, of the ones before TRACE_COMMAND
+#define LOG_CTL_V1_EVENTS   ((1u << TRACE_COMMAND) - 1)
+#define LOG_CTL_MAX_TAGS    (24)
+#define LOG_CTL_TAG_LEN     (20)
+#define LOG_CTL_JSON_LEN    (1536)
+
+typedef struct {
+    const char      *tag;
+    esp_log_level_t level;
+} log_ctl_default_t;
+
+// quiet production levels, zoom in at runtime
+static const log_ctl_default_t defaults[] = {
+    { "*",              ESP_LOG_INFO },
+    { "HTTP_STREAM",    ESP_LOG_WARN },
+    { "AUDIO_THREAD",   ESP_LOG_ERROR },
+    { "I2C_BUS",        ESP_LOG_ERROR },
+    { "AUDIO_HAL",      ESP_LOG_ERROR },
+    { "ESP_AUDIO_TASK", ESP_LOG_ERROR },
+    { "ESP_DECODER",    ESP_LOG_ERROR },
+    { "I2S",            ESP_LOG_ERROR },
+    { "AUDIO_FORGE",    ESP_LOG_ERROR },
+    { "ESP_AUDIO_CTRL", ESP_LOG_ERROR },
+    { "AUDIO_PIPELINE", ESP_LOG_ERROR },
+    { "AUDIO_ELEMENT",  ESP_LOG_ERROR },
+    { "TONE_PARTITION", ESP_LOG_ERROR },
+    { "TONE_STREAM",    ESP_LOG_ERROR },
+    { "MP3_DECODER",    ESP_LOG_ERROR },
+    { "I2S_STREAM",     ESP_LOG_ERROR },
+    { "RSP_FILTER",     ESP_LOG_ERROR },
+    { "AUDIO_EVT",      ESP_LOG_ERROR },
+};
+
+typedef struct {
+    char    tag[LOG_CTL_TAG_LEN];
+    uint8_t level;
+} log_ctl_entry_t;
+
+// stored as one NVS blob, tags may be longer than an NVS key
+typedef struct {
+    uint8_t         version;
+    uint8_t         dlog_level;
+    uint8_t         num;
+    // disabled tracer events, events added later start enabled
+    uint32_t        trace_off;
+    log_ctl_entry_t tags[LOG_CTL_MAX_TAGS];
+} log_ctl_cfg_t;
+
+static const char *level_names[] = { "none", "error", "warn", "info", "debug", "verbose" };
+
+static SemaphoreHandle_t    cfg_lock;
+static log_ctl_cfg_t        cfg;
+
+// esp_log_level_set("*") drops every per-tag level, so "*" goes first and
+// the built-in levels and the overrides are set again after it
+static void _apply_levels()
+{
+    esp_log_level_t star = defaults[0].level;
+
+    for (int i = 0; i < cfg.num; i++) {
+        if (strcmp(cfg.tags[i].tag, "*") == 0) {
+            star = cfg.tags[i].level;
+        }
+    }
+    esp_log_level_set("*", star);
+    for (int i = 1; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+        esp_log_level_set(defaults[i].tag, defaults[i].level);
+    }
+    for (int i = 0; i < cfg.num; i++) {
+        if (strcmp(cfg.tags[i].tag, "*") != 0) {
+            esp_log_level_set(cfg.tags[i].tag, cfg.tags[i].level);
+        }
+    }
+}
+
+static void _apply_cfg()
+{
+    _apply_levels();
+    dlog_set_level(cfg.dlog_level);
+    trace_set_mask(TRACE_MASK_ALL & ~cfg.trace_off);
+}
+
+static void _cfg_default()
+{
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.version = LOG_CTL_CFG_VER;
+    cfg.dlog_level = ESP_LOG_INFO;
+}
+
+static void _load()
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(cfg);
+
+    _cfg_default();
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_OK) {
+        err = nvs_open(LOG_CTL_NVS_NS, NVS_READONLY, &nvs);
+    }
+    if (err != ESP_OK) {
+        // first boot, or NVS is repaired later by wifi_work
+        return;
+    }
+    err = nvs_get_blob(nvs, LOG_CTL_NVS_KEY, &cfg, &len);
+    nvs_close(nvs);
+    if (err == ESP_OK && len == sizeof(cfg) && cfg.version == 1) {
+        // same layout, the field held the enabled events then
+        cfg.trace_off = ~cfg.trace_off & LOG_CTL_V1_EVENTS;
+        cfg.version = LOG_CTL_CFG_VER;
+    }
+    if (err != ESP_OK || len != sizeof(cfg) || cfg.version != LOG_CTL_CFG_VER || cfg.num > LOG_CTL_MAX_TAGS) {
+        _cfg_default();
+    }
+}
+
+static void _save()
+{
+    nvs_handle_t nvs;
+
+    if (nvs_open(LOG_CTL_NVS_NS, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "NVS not available, change not saved");
+        return;
+    }
+    if (nvs_set_blob(nvs, LOG_CTL_NVS_KEY, &cfg, sizeof(cfg)) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Save to NVS failed");
+    }
+    nvs_close(nvs);
+}
+
+bool log_ctl_parse_level(const char *name, esp_log_level_t *level){
+    for (int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+        // full name or its first letter, like the ESP_LOG prefixes
+        if (strcasecmp(name, level_names[i]) == 0
+            || (name[0] && name[1] == 0 && (name[0] | 0x20) == level_names[i][0])) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *log_ctl_level_str(esp_log_level_t level){
+    return level <= ESP_LOG_VERBOSE ? level_names[level] : "?";
+}
+
+esp_err_t log_ctl_set_level(const char *tag, esp_log_level_t level){
+    if (level > ESP_LOG_VERBOSE || strlen(tag) >= LOG_CTL_TAG_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    if (strcmp(tag, "dlog") == 0) {
+        cfg.dlog_level = level;
+        dlog_set_level(level);
+    } else {
+        int i = 0;
+        while (i < cfg.num && strcmp(cfg.tags[i].tag, tag) != 0) {
+            i++;
+        }
+        if (i == LOG_CTL_MAX_TAGS) {
+            xSemaphoreGive(cfg_lock);
+            return ESP_ERR_NO_MEM;
+        }
+        if (i == cfg.num) {
+            strcpy(cfg.tags[cfg.num++].tag, tag);
+        }
+        cfg.tags[i].level = level;
+        if (strcmp(tag, "*") == 0) {
+            _apply_levels();
+        } else {
+            esp_log_level_set(tag, level);
+        }
+    }
+    _save();
+    xSemaphoreGive(cfg_lock);
+    ESP_LOGI(TAG, "%s -> %s", tag, log_ctl_level_str(level));
+    return ESP_OK;
+}
+
+esp_err_t log_ctl_set_trace(const char *event, bool on){
+    uint32_t bits = 0;
+
+    if (strcmp(event, "all") == 0) {
+        bits = TRACE_MASK_ALL;
+    } else {
+        for (int i = 0; i < TRACE_EVENT_MAX; i++) {
+            if (strcmp(event, trace_event_str(i)) == 0) {
+                bits = 1u << i;
+            }
+        }
+    }
+    if (bits == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    cfg.trace_off = on ? cfg.trace_off & ~bits : cfg.trace_off | bits;
+    trace_set_mask(TRACE_MASK_ALL & ~cfg.trace_off);
+    _save();
+    xSemaphoreGive(cfg_lock);
+    ESP_LOGI(TAG, "trace %s %s", event, on ? "on" : "off");
+    return ESP_OK;
+}
+
+void log_ctl_reset(){
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    // the "*" level set first also drops the old per-tag overrides
+    _cfg_default();
+    _apply_cfg();
+    _save();
+    xSemaphoreGive(cfg_lock);
+    ESP_LOGI(TAG, "Log levels reset to built-in defaults");
+}
+
+int log_ctl_json(char *buf, size_t size){
+    size_t len = 0;
+
+#define JSON_PUT(...) do { \
+        if (len < size) { \
+            len += snprintf(buf + len, size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+    xSemaphoreTake(cfg_lock, portMAX_DELAY);
+    JSON_PUT("{\"levels\":{");
+    for (int i = 0; i < sizeof(defaults) / sizeof(defaults[0]); i++) {
+        JSON_PUT("%s\"%s\":\"%s\"", i ? "," : "", defaults[i].tag, log_ctl_level_str(defaults[i].level));
+    }
+    JSON_PUT("},\"overrides\":{");
+    for (int i = 0; i < cfg.num; i++) {
+        JSON_PUT("%s\"%s\":\"%s\"", i ? "," : "", cfg.tags[i].tag, log_ctl_level_str(cfg.tags[i].level));
+    }
+    JSON_PUT("},\"dlog\":\"%s\",\"trace\":{", log_ctl_level_str(cfg.dlog_level));
+    for (int i = 0; i < TRACE_EVENT_MAX; i++) {
+        JSON_PUT("%s\"%s\":%s", i ? "," : "", trace_event_str(i), (cfg.trace_off & (1u << i)) ? "false" : "true");
+    }
+    JSON_PUT("}}");
+    xSemaphoreGive(cfg_lock);
+#undef JSON_PUT
+    return len < size ? len : size - 1;
+}
+
+#if CONFIG_LOG_CTL_CONSOLE
+
+static int _cmd_log(int argc, char **argv)
+{
+    esp_log_level_t level;
+
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        log_ctl_reset();
+        return 0;
+    }
+    if (argc == 3) {
+        if (!log_ctl_parse_level(argv[2], &level)) {
+            printf("unknown level %s\n", argv[2]);
+            return 1;
+        }
+        return log_ctl_set_level(argv[1], level) == ESP_OK ? 0 : 1;
+    }
+    if (argc != 1) {
+        printf("usage: log [<tag|*|dlog> <none|error|warn|info|debug|verbose>] | log reset\n");
+        return 1;
+    }
+    char *json = mem_malloc(MEM_SYS_SYSTEM, LOG_CTL_JSON_LEN);
+    if (json == NULL) {
+        return 1;
+    }
+    log_ctl_json(json, LOG_CTL_JSON_LEN);
+    printf("%s\n", json);
+    mem_free(json);
+    return 0;
+}
+
+static int _cmd_trace(int argc, char **argv)
+{
+    if (argc != 3 || (strcmp(argv[2], "on") != 0 && strcmp(argv[2], "off") != 0)) {
+        printf("usage: trace <event|all> <on|off>\n");
+        return 1;
+    }
+    if (log_ctl_set_trace(argv[1], strcmp(argv[2], "on") == 0) != ESP_OK) {
+        printf("unknown trace event %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+static void _console_start()
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_cfg = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_cfg = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    const esp_console_cmd_t cmds[] = {
+        {
+            .command = "log",
+            .help = "Show log levels, or set one: log <tag|*|dlog> <level>, log reset",
+            .func = _cmd_log,
+        },
+        {
+            .command = "trace",
+            .help = "Enable or disable a tracer event: trace <event|all> <on|off>",
+            .func = _cmd_trace,
+        },
+    };
+
+    repl_cfg.prompt = "bot>";
+    if (esp_console_new_repl_uart(&uart_cfg, &repl_cfg, &repl) != ESP_OK) {
+        ESP_LOGE(TAG, "Console on UART failed");
+        return;
+    }
+    esp_console_register_help_command();
+    for (int i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
+        esp_console_cmd_register(&cmds[i]);
+    }
+    esp_console_start_repl(repl);
+}
+
+#endif /* CONFIG_LOG_CTL_CONSOLE */
+
+// GET /log: levels as JSON. POST /log?tag=<tag>&level=<level>, POST /log?reset=1
+static esp_err_t _http_log(httpd_req_t *req)
+{
+    char tag[LOG_CTL_TAG_LEN];
+    char val[16];
+    esp_log_level_t level;
+
+    if (req->method == HTTP_POST) {
+        if (ctl_server_query(req, "reset", val, sizeof(val))) {
+            log_ctl_reset();
+        } else if (!ctl_server_query(req, "tag", tag, sizeof(tag))
+                   || !ctl_server_query(req, "level", val, sizeof(val))
+                   || !log_ctl_parse_level(val, &level)
+                   || log_ctl_set_level(tag, level) != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "tag=<tag>&level=<level> or reset=1");
+        }
+    }
+    char *json = mem_malloc(MEM_SYS_SYSTEM, LOG_CTL_JSON_LEN);
+    if (json == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    int len = log_ctl_json(json, LOG_CTL_JSON_LEN);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, json, len);
+    mem_free(json);
+    return err;
+}
+
+// POST /trace?event=<event|all>&on=<0|1>
+static esp_err_t _http_trace(httpd_req_t *req)
+{
+    char event[16];
+    char on[4];
+
+    if (!ctl_server_query(req, "event", event, sizeof(event))
+        || !ctl_server_query(req, "on", on, sizeof(on))
+        || log_ctl_set_trace(event, on[0] == '1') != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "event=<event|all>&on=<0|1>");
+    }
+    return httpd_resp_sendstr(req, "ok");
+}
+
+static const httpd_uri_t log_uris[] = {
+    { .uri = "/log",   .method = HTTP_GET,  .handler = _http_log },
+    { .uri = "/log",   .method = HTTP_POST, .handler = _http_log },
+    { .uri = "/trace", .method = HTTP_POST, .handler = _http_trace },
+};
+
+void init_log_ctl(){
+    cfg_lock = xSemaphoreCreateMutex();
+    mem_assert(cfg_lock);
+    // built-in levels while NVS comes up
+    _cfg_default();
+    _apply_cfg();
+    _load();
+    _apply_cfg();
+    ESP_LOGI(TAG, "%u built-in levels, %d saved overrides, trace mask 0x%02x",
+             (unsigned)(sizeof(defaults) / sizeof(defaults[0])), cfg.num, (unsigned)(TRACE_MASK_ALL & ~cfg.trace_off));
+
+    for (int i = 0; i < sizeof(log_uris) / sizeof(log_uris[0]); i++) {
+        ctl_server_register(&log_uris[i]);
+    }
+#if CONFIG_LOG_CTL_CONSOLE
+    _console_start();
+#endif
+}
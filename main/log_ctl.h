@@ -0,0 +1,34 @@
+/*
+ * log_ctl.h
+ *
+ * Runtime log control. Boot applies the built-in per-tag levels, then the
+ * overrides saved in NVS. Levels, the deferred log level (tag "dlog") and
+ * tracer event categories can be changed from the UART console ("log",
+ * "trace") or over HTTP (/log, /trace); every change is saved at once.
+ */
+
+#ifndef MAIN_LOG_CTL_H_
+#define MAIN_LOG_CTL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+// first thing in app_main, replaces the hard-coded level list
+void init_log_ctl();
+
+// tag "*" is the default level, "dlog" the deferred logger
+esp_err_t log_ctl_set_level(const char *tag, esp_log_level_t level);
+// event name from trace_event_str() or "all"
+esp_err_t log_ctl_set_trace(const char *event, bool on);
+// drop all overrides and apply the built-in levels again
+void log_ctl_reset();
+
+bool log_ctl_parse_level(const char *name, esp_log_level_t *level);
+const char *log_ctl_level_str(esp_log_level_t level);
+// current levels and trace categories as JSON, returns the length
+int log_ctl_json(char *buf, size_t len);
+
+#endif /* MAIN_LOG_CTL_H_ */
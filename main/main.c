@@ -31,6 +31,19 @@
 #include "freertos/task.h"
 
 #include "main.h"
+#include "job_sched.h"
+#include "cpu_load.h"
+#include "log.h"
+#include "el_stats.h"
+#include "mem_track.h"
+#include "dlog.h"
+#include "log_ctl.h"
+#include "ctl_server.h"
+#include "metrics.h"
+#include "replay.h"
+#include "qemu_target.h"
+#include "audio_tap.h"
+#include "speech_cmds.h"
 
 #include "periph_adc_button.h"
 #include "audio_mem.h"
@@ -39,32 +52,6 @@
 
 static char *TAG = "esp32_speech_bot";
 
-QueueHandle_t          	main_q      	= NULL;
-
-static void log_setup(void)
-{
-    esp_log_level_set("*", ESP_LOG_INFO);
-    esp_log_level_set("HTTP_STREAM", ESP_LOG_VERBOSE);
-
-
-    esp_log_level_set("AUDIO_THREAD", ESP_LOG_ERROR);
-    esp_log_level_set("I2C_BUS", ESP_LOG_ERROR);
-    esp_log_level_set("AUDIO_HAL", ESP_LOG_ERROR);
-    esp_log_level_set("ESP_AUDIO_TASK", ESP_LOG_ERROR);
-    esp_log_level_set("ESP_DECODER", ESP_LOG_ERROR);
-    esp_log_level_set("I2S", ESP_LOG_ERROR);
-    esp_log_level_set("AUDIO_FORGE", ESP_LOG_ERROR);
-    esp_log_level_set("ESP_AUDIO_CTRL", ESP_LOG_ERROR);
-    esp_log_level_set("AUDIO_PIPELINE", ESP_LOG_ERROR);
-    esp_log_level_set("AUDIO_ELEMENT", ESP_LOG_ERROR);
-    esp_log_level_set("TONE_PARTITION", ESP_LOG_ERROR);
-    esp_log_level_set("TONE_STREAM", ESP_LOG_ERROR);
-    esp_log_level_set("MP3_DECODER", ESP_LOG_ERROR);
-    esp_log_level_set("I2S_STREAM", ESP_LOG_ERROR);
-    esp_log_level_set("RSP_FILTER", ESP_LOG_ERROR);
-    esp_log_level_set("AUDIO_EVT", ESP_LOG_ERROR);
-}
-
 esp_err_t periph_callback(audio_event_iface_msg_t *event, void *context)
 {
     ESP_LOGD(TAG, "Periph Event received: src_type:%x, source:%p cmd:%d, data:%p, data_len:%d",
@@ -88,7 +75,8 @@ esp_err_t periph_callback(audio_event_iface_msg_t *event, void *context)
 
 void app_main(void)
 {
-    log_setup();
+    // built-in levels plus the overrides saved in NVS
+    init_log_ctl();
 
     esp_periph_config_t periph_cfg = DEFAULT_ESP_PERIPH_SET_CONFIG();
 //    periph_cfg.extern_stack = true;
@@ -96,6 +84,10 @@ void app_main(void)
     if (set != NULL) {
         esp_periph_set_register_callback(set, periph_callback, NULL);
     }
+#if CONFIG_QEMU_TARGET
+    // no SD slot, keys or panel on the emulated machine
+    init_qemu_sdcard();
+#else
     audio_board_sdcard_init(set, SD_MODE_1_LINE);
     audio_board_key_init(set);
 
@@ -104,53 +96,65 @@ void app_main(void)
 	ssd1306_clear_screen(&dev, false);
 	ssd1306_contrast(&dev, 0xff);
 	ssd1306_display_text(&dev, 0, "Hello", 5, false);
+#endif
+
+    // before anything that may post to main_q or start a pipeline
+    init_dlog();
+    init_trace();
+    init_el_stats();
+    init_mem_track();
+    init_msg_pool();
+    init_cpu_load();
+    init_reactor();
+    init_metrics();
 
     init_wifi_work(set);
+#if CONFIG_QEMU_TARGET
+    init_qemu_inputs();
+#endif
+    init_ctl_server();
     init_wwe_work();
-    init_file2http();
-    init_http2file();
-    init_http2player();
-
-    main_q = xQueueCreate(8, sizeof(main_msg_t));
-    main_msg_t msg;
+#if CONFIG_LOCAL_CMD_ENABLE
+    // cached or built-in commands go in once the assistant is idle
+    init_speech_cmds();
+#endif
+#if CONFIG_REPLAY_ENABLE
+    init_replay();
+#endif
+#if CONFIG_AUDIO_TAP_ENABLE
+    init_audio_tap();
+#endif
+    // transfer and player pipelines are built by their first job
+    init_job_sched();
+
+    main_msg_t *msg;
 
     while (1) {
 
-        if (xQueueReceive(main_q, &msg, portMAX_DELAY) == pdTRUE) {
-            switch (msg.msg_id) {
+        if (xQueueReceive(main_q, &msg, pdMS_TO_TICKS(JOB_SCHED_IDLE_POLL_MS)) == pdTRUE) {
+            switch (msg->msg_id) {
                 case FILE2HTTP:
-                    ESP_LOGI(TAG, "Upload file: %s to %s.", msg.src, msg.dst);
-                    // MUST be disable wakenet !
-					enable_wwe_pipeline(false);
-					enable_file2http(true);
-                    run_file2http(msg.src, msg.dst);
-                    enable_file2http(false);
-					enable_wwe_pipeline(true);
+                    ESP_LOGI(TAG, "Upload file: %s to %s.", msg->xfer.src, msg->xfer.dst);
+                    job_sched_submit(PIPE_FILE2HTTP, JOB_PRIO_NORMAL, msg->xfer.src, msg->xfer.dst);
                     break;
                 case HTTP2FILE:
-                    ESP_LOGI(TAG, "Download file: %s", msg.msg);
+                    ESP_LOGI(TAG, "Download file: %s", msg->xfer.src);
+                    job_sched_submit(PIPE_HTTP2FILE, JOB_PRIO_LOW, msg->xfer.src, msg->xfer.dst);
                     break;
                 case FILE2PLAYER:
-                    ESP_LOGI(TAG, "Play local file: %s", msg.src);
-					enable_wwe_pipeline(false);
-					enable_file2player(true);
-					run_file2player(msg.src, msg.dst);
-					enable_file2player(false);
-					enable_wwe_pipeline(true);
+                    ESP_LOGI(TAG, "Play local file: %s", msg->xfer.src);
+                    job_sched_submit(PIPE_FILE2PLAYER, JOB_PRIO_LOW, msg->xfer.src, msg->xfer.dst);
                     break;
                 case HTTP2PLAYER:
-                    ESP_LOGI(TAG, "Play online file: %s", msg.src);
-					enable_wwe_pipeline(false);
-					enable_http2player(true);
-					run_http2player(msg.src, msg.dst);
-					enable_http2player(false);
-					enable_wwe_pipeline(true);
+                    // the answer to a query wins over local media
+                    ESP_LOGI(TAG, "Play online file: %s", msg->xfer.src);
+                    job_sched_submit(PIPE_HTTP2PLAYER, JOB_PRIO_HIGH, msg->xfer.src, msg->xfer.dst);
                     break;
                 default:
                     break;
             }
+            msg_pool_free(msg);
         }
+        job_sched_release_idle();
     }
-
-    deinit_file2http();
 }
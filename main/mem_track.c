@@ -0,0 +1,235 @@
+#include "main.h"
+#include "mem_track.h"
+#include "cpu_load.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "audio_mem.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mem_track";
+
+#define MEM_TRACK_TASK_STACK    (3 * 1024)
+#define MEM_HDR_MAGIC           (0x4d54)
+// smaller drops over a soak window are noise from short lived buffers
+#define MEM_SOAK_MIN_DROP       (1024)
+
+// a multiple of the 4 byte heap alignment, so the returned pointer keeps
+// it; buffers that need more must not come through mem_malloc
+typedef struct {
+    uint32_t size;
+    uint16_t sys;
+    uint16_t magic;
+} mem_hdr_t;
+
+_Static_assert(sizeof(mem_hdr_t) % 4 == 0, "mem_hdr_t must keep the heap alignment");
+
+static const char *sys_names[MEM_SYS_MAX] = {
+    [MEM_SYS_RECORDER]  = "recorder",
+    [MEM_SYS_PIPELINE]  = "pipeline",
+    [MEM_SYS_NET]       = "network",
+    [MEM_SYS_SYSTEM]    = "system",
+};
+
+static portMUX_TYPE     mem_lock = portMUX_INITIALIZER_UNLOCKED;
+static mem_sys_stats_t  sys_stats[MEM_SYS_MAX];
+
+static void *_track(mem_sys_t sys, mem_hdr_t *hdr, size_t size)
+{
+    if (hdr == NULL) {
+        portENTER_CRITICAL(&mem_lock);
+        sys_stats[sys].fails++;
+        portEXIT_CRITICAL(&mem_lock);
+        ESP_LOGE(TAG, "%s: allocation of %d bytes failed", sys_names[sys], size);
+        return NULL;
+    }
+    hdr->size = size;
+    hdr->sys = sys;
+    hdr->magic = MEM_HDR_MAGIC;
+    portENTER_CRITICAL(&mem_lock);
+    mem_sys_stats_t *st = &sys_stats[sys];
+    st->allocs++;
+    st->cur_bytes += size;
+    if (st->cur_bytes > st->peak_bytes) {
+        st->peak_bytes = st->cur_bytes;
+    }
+    portEXIT_CRITICAL(&mem_lock);
+    return hdr + 1;
+}
+
+void *mem_calloc(mem_sys_t sys, size_t n, size_t size){
+    size_t bytes = n * size;
+    return _track(sys, audio_calloc(1, sizeof(mem_hdr_t) + bytes), bytes);
+}
+
+void *mem_malloc(mem_sys_t sys, size_t size){
+    return _track(sys, audio_malloc(sizeof(mem_hdr_t) + size), size);
+}
+
+void mem_free(void *ptr){
+    if (ptr == NULL) {
+        return;
+    }
+    mem_hdr_t *hdr = (mem_hdr_t *)ptr - 1;
+    if (hdr->magic != MEM_HDR_MAGIC || hdr->sys >= MEM_SYS_MAX) {
+        ESP_LOGE(TAG, "mem_free of %p not from mem_calloc/mem_malloc", ptr);
+        abort();
+    }
+    hdr->magic = 0;
+    portENTER_CRITICAL(&mem_lock);
+    mem_sys_stats_t *st = &sys_stats[hdr->sys];
+    st->frees++;
+    st->cur_bytes -= hdr->size;
+    portEXIT_CRITICAL(&mem_lock);
+    audio_free(hdr);
+}
+
+void mem_snapshot(mem_snapshot_t *snap){
+    snap->int_free = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snap->int_largest = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snap->int_min = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    snap->spi_free = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    snap->spi_largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    snap->spi_min = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+}
+
+void mem_track_get_stats(mem_sys_t sys, mem_sys_stats_t *out){
+    portENTER_CRITICAL(&mem_lock);
+    memcpy(out, &sys_stats[sys], sizeof(mem_sys_stats_t));
+    portEXIT_CRITICAL(&mem_lock);
+}
+
+const char *mem_sys_str(mem_sys_t sys){
+    return sys < MEM_SYS_MAX ? sys_names[sys] : "?";
+}
+
+// share of the free memory not usable as one block
+static int _frag_pct(size_t free, size_t largest)
+{
+    return free ? 100 - (int)(largest * 100 / free) : 0;
+}
+
+void mem_track_dump(const char *why){
+    mem_snapshot_t s;
+    mem_snapshot(&s);
+    ESP_LOGI(TAG, "[%s] internal free %d, largest %d, frag %d%%, min %d | psram free %d, largest %d, frag %d%%, min %d",
+             why, s.int_free, s.int_largest, _frag_pct(s.int_free, s.int_largest), s.int_min,
+             s.spi_free, s.spi_largest, _frag_pct(s.spi_free, s.spi_largest), s.spi_min);
+    for (int i = 0; i < MEM_SYS_MAX; i++) {
+        mem_sys_stats_t st;
+        mem_track_get_stats(i, &st);
+        if (st.allocs == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "  %-8s %7d bytes (peak %d), %u allocs, %u frees, %u fails", sys_names[i],
+                 st.cur_bytes, st.peak_bytes, st.allocs, st.frees, st.fails);
+    }
+}
+
+#if CONFIG_MEM_SOAK
+typedef struct {
+    mem_snapshot_t  heap;
+    size_t          sys_bytes[MEM_SYS_MAX];
+} soak_point_t;
+
+static soak_point_t soak[CONFIG_MEM_SOAK_WINDOW];
+static int          soak_num;
+
+// true when v only moves one way over the window and by more than the noise
+static bool _monotonic(size_t (*get)(const soak_point_t *, int), int arg, bool falling)
+{
+    for (int i = 1; i < CONFIG_MEM_SOAK_WINDOW; i++) {
+        size_t a = get(&soak[i - 1], arg);
+        size_t b = get(&soak[i], arg);
+        if (falling ? b > a : b < a) {
+            return false;
+        }
+    }
+    size_t first = get(&soak[0], arg);
+    size_t last = get(&soak[CONFIG_MEM_SOAK_WINDOW - 1], arg);
+    return falling ? first - last >= MEM_SOAK_MIN_DROP : last - first >= MEM_SOAK_MIN_DROP;
+}
+
+static size_t _int_free(const soak_point_t *p, int arg)
+{
+    return p->heap.int_free;
+}
+
+static size_t _spi_free(const soak_point_t *p, int arg)
+{
+    return p->heap.spi_free;
+}
+
+static size_t _int_largest(const soak_point_t *p, int arg)
+{
+    return p->heap.int_largest;
+}
+
+static size_t _sys_bytes(const soak_point_t *p, int sys)
+{
+    return p->sys_bytes[sys];
+}
+
+static void _soak_check()
+{
+    if (soak_num == CONFIG_MEM_SOAK_WINDOW) {
+        memmove(&soak[0], &soak[1], sizeof(soak_point_t) * (CONFIG_MEM_SOAK_WINDOW - 1));
+        soak_num--;
+    }
+    soak_point_t *p = &soak[soak_num++];
+    mem_snapshot(&p->heap);
+    for (int i = 0; i < MEM_SYS_MAX; i++) {
+        mem_sys_stats_t st;
+        mem_track_get_stats(i, &st);
+        p->sys_bytes[i] = st.cur_bytes;
+    }
+    if (soak_num < CONFIG_MEM_SOAK_WINDOW) {
+        return;
+    }
+    int minutes = CONFIG_MEM_SOAK_WINDOW * CONFIG_MEM_TRACK_PERIOD_MS / 60000;
+    if (_monotonic(_int_free, 0, true)) {
+        ESP_LOGW(TAG, "SOAK: internal free fell %d bytes over %d min without recovering",
+                 soak[0].heap.int_free - p->heap.int_free, minutes);
+    }
+    if (_monotonic(_spi_free, 0, true)) {
+        ESP_LOGW(TAG, "SOAK: psram free fell %d bytes over %d min without recovering",
+                 soak[0].heap.spi_free - p->heap.spi_free, minutes);
+    }
+    if (_monotonic(_int_largest, 0, true)) {
+        ESP_LOGW(TAG, "SOAK: internal largest block shrank %d bytes over %d min, fragmenting",
+                 soak[0].heap.int_largest - p->heap.int_largest, minutes);
+    }
+    for (int i = 0; i < MEM_SYS_MAX; i++) {
+        if (_monotonic(_sys_bytes, i, false)) {
+            ESP_LOGW(TAG, "SOAK: %s grew %d bytes over %d min", sys_names[i],
+                     p->sys_bytes[i] - soak[0].sys_bytes[i], minutes);
+        }
+    }
+}
+#endif /* CONFIG_MEM_SOAK */
+
+static void mem_track_task(void *arg)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_MEM_TRACK_PERIOD_MS));
+        mem_track_dump("periodic");
+#if CONFIG_MEM_SOAK
+        _soak_check();
+#endif
+    }
+}
+
+void init_mem_track(){
+    mem_track_dump("boot");
+    if (xTaskCreatePinnedToCore(mem_track_task, "mem_track", MEM_TRACK_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), NULL, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create mem_track task failed");
+    }
+#if CONFIG_MEM_SOAK
+    ESP_LOGW(TAG, "Soak mode, window %d x %d ms", CONFIG_MEM_SOAK_WINDOW, CONFIG_MEM_TRACK_PERIOD_MS);
+#endif
+}
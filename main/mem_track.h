@@ -0,0 +1,57 @@
+/*
+ * mem_track.h
+ *
+ * Heap health over long uptimes. Allocations made through mem_calloc /
+ * mem_malloc are attributed to a subsystem, a small header remembers the
+ * size and owner so mem_free can take it back off. A low priority task
+ * logs internal/PSRAM free, largest free block, fragmentation and the
+ * min-ever free every CONFIG_MEM_TRACK_PERIOD_MS; in soak mode it warns
+ * when free memory keeps falling, or a subsystem keeps growing, across
+ * the whole window of snapshots.
+ */
+
+#ifndef MAIN_MEM_TRACK_H_
+#define MAIN_MEM_TRACK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    MEM_SYS_RECORDER = 0,
+    MEM_SYS_PIPELINE,
+    MEM_SYS_NET,
+    MEM_SYS_SYSTEM,
+    MEM_SYS_MAX,
+} mem_sys_t;
+
+typedef struct {
+    size_t   cur_bytes;
+    size_t   peak_bytes;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t fails;
+} mem_sys_stats_t;
+
+typedef struct {
+    size_t int_free;
+    size_t int_largest;
+    size_t int_min;
+    size_t spi_free;
+    size_t spi_largest;
+    size_t spi_min;
+} mem_snapshot_t;
+
+void init_mem_track();
+
+// audio_calloc/audio_malloc with attribution, release only with mem_free
+void *mem_calloc(mem_sys_t sys, size_t n, size_t size);
+void *mem_malloc(mem_sys_t sys, size_t size);
+void mem_free(void *ptr);
+
+void mem_snapshot(mem_snapshot_t *snap);
+void mem_track_get_stats(mem_sys_t sys, mem_sys_stats_t *stats);
+const char *mem_sys_str(mem_sys_t sys);
+// log a snapshot and the per-subsystem usage now
+void mem_track_dump(const char *why);
+
+#endif /* MAIN_MEM_TRACK_H_ */
@@ -0,0 +1,200 @@
+#include "metrics.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// flushed whenever the next piece does not fit
+#define METRICS_BUF_LEN     (256)
+#define METRICS_LABEL_LEN   (48)
+
+struct metrics_writer {
+    metrics_fmt_t           fmt;
+    metrics_flush_t         flush;
+    void                    *ctx;
+    int                     err;
+    const metric_family_t   *fam;
+    int                     samples;
+    int                     len;
+    char                    buf[METRICS_BUF_LEN];
+};
+
+static const metric_family_t    *families[METRICS_MAX_FAMILIES];
+static int                      num_families;
+
+static const char *type_names[] = { "counter", "gauge", "histogram" };
+
+int metrics_register(const metric_family_t *fam){
+    if (num_families == METRICS_MAX_FAMILIES) {
+        return -1;
+    }
+    families[num_families++] = fam;
+    return 0;
+}
+
+void metrics_clear(){
+    num_families = 0;
+}
+
+static void _flush(metrics_writer_t *w)
+{
+    if (w->len && w->err == 0) {
+        int ret = w->flush(w->ctx, w->buf, w->len);
+        if (ret < 0) {
+            w->err = ret;
+        }
+    }
+    w->len = 0;
+}
+
+static void _put(metrics_writer_t *w, const char *fmt, ...)
+{
+    va_list ap;
+
+    for (int retry = 0; retry < 2; retry++) {
+        va_start(ap, fmt);
+        int n = vsnprintf(w->buf + w->len, METRICS_BUF_LEN - w->len, fmt, ap);
+        va_end(ap);
+        if (n < METRICS_BUF_LEN - w->len) {
+            w->len += n;
+            return;
+        }
+        // did not fit, send what we have and write it again
+        _flush(w);
+    }
+    // longer than the whole buffer, cut
+    w->len = METRICS_BUF_LEN - 1;
+}
+
+// label values are free text, keep them valid in both formats
+static const char *_escape(const char *in, char *out, int size)
+{
+    int o = 0;
+    for (; *in && o < size - 2; in++) {
+        if (*in == '"' || *in == '\\') {
+            out[o++] = '\\';
+            out[o++] = *in;
+        } else if ((unsigned char)*in >= ' ') {
+            out[o++] = *in;
+        }
+    }
+    out[o] = 0;
+    return out;
+}
+
+static void _family_begin(metrics_writer_t *w, const metric_family_t *fam, bool first)
+{
+    w->fam = fam;
+    w->samples = 0;
+    if (w->fmt == METRICS_FMT_PROMETHEUS) {
+        _put(w, "# HELP %s %s\n# TYPE %s %s\n", fam->name, fam->help, fam->name, type_names[fam->type]);
+    } else {
+        _put(w, "%s\"%s\":{\"type\":\"%s\",\"help\":\"%s\"", first ? "" : ",",
+             fam->name, type_names[fam->type], fam->help);
+    }
+}
+
+static void _family_end(metrics_writer_t *w)
+{
+    if (w->fmt == METRICS_FMT_JSON) {
+        _put(w, (w->fam->label && w->samples) ? "}}" : "}");
+    }
+}
+
+// JSON: open the sample, prometheus: nothing, labels go on every line
+static void _sample_begin(metrics_writer_t *w, const char *label)
+{
+    if (w->fmt != METRICS_FMT_JSON) {
+        return;
+    }
+    if (w->fam->label) {
+        _put(w, "%s\"%s\":", w->samples ? "," : ",\"values\":{", label);
+    } else {
+        _put(w, ",\"value\":");
+    }
+}
+
+void metrics_value(metrics_writer_t *w, const char *label_val, int64_t value){
+    char label[METRICS_LABEL_LEN];
+
+    _escape(label_val ? label_val : "", label, sizeof(label));
+    if (w->fmt == METRICS_FMT_PROMETHEUS) {
+        if (w->fam->label) {
+            _put(w, "%s{%s=\"%s\"} %" PRId64 "\n", w->fam->name, w->fam->label, label, value);
+        } else {
+            _put(w, "%s %" PRId64 "\n", w->fam->name, value);
+        }
+    } else {
+        _sample_begin(w, label);
+        _put(w, "%" PRId64, value);
+    }
+    w->samples++;
+}
+
+void metrics_hist(metrics_writer_t *w, const char *label_val, const uint32_t *le,
+                  const uint32_t *counts, int n, uint64_t sum){
+    char label[METRICS_LABEL_LEN];
+    char sel[METRICS_LABEL_LEN + 32];
+    uint64_t cum = 0;
+
+    _escape(label_val ? label_val : "", label, sizeof(label));
+    if (w->fmt == METRICS_FMT_PROMETHEUS) {
+        if (w->fam->label) {
+            snprintf(sel, sizeof(sel), "%s=\"%s\",", w->fam->label, label);
+        } else {
+            sel[0] = 0;
+        }
+        for (int b = 0; b < n; b++) {
+            cum += counts[b];
+            if (b < n - 1) {
+                _put(w, "%s_bucket{%sle=\"%" PRIu32 "\"} %" PRIu64 "\n", w->fam->name, sel, le[b], cum);
+            } else {
+                _put(w, "%s_bucket{%sle=\"+Inf\"} %" PRIu64 "\n", w->fam->name, sel, cum);
+            }
+        }
+        // selector without the trailing comma
+        int sl = strlen(sel);
+        if (sl) {
+            sel[sl - 1] = 0;
+        }
+        _put(w, "%s_sum%s%s%s %" PRIu64 "\n", w->fam->name, sl ? "{" : "", sel, sl ? "}" : "", sum);
+        _put(w, "%s_count%s%s%s %" PRIu64 "\n", w->fam->name, sl ? "{" : "", sel, sl ? "}" : "", cum);
+    } else {
+        _sample_begin(w, label);
+        _put(w, "{\"buckets\":{");
+        for (int b = 0; b < n; b++) {
+            cum += counts[b];
+            if (b < n - 1) {
+                _put(w, "%s\"%" PRIu32 "\":%" PRIu64, b ? "," : "", le[b], cum);
+            } else {
+                _put(w, "%s\"+Inf\":%" PRIu64, b ? "," : "", cum);
+            }
+        }
+        _put(w, "},\"sum\":%" PRIu64 ",\"count\":%" PRIu64 "}", sum, cum);
+    }
+    w->samples++;
+}
+
+int metrics_render(metrics_fmt_t fmt, metrics_flush_t flush, void *ctx){
+    metrics_writer_t w = {
+        .fmt = fmt,
+        .flush = flush,
+        .ctx = ctx,
+    };
+
+    if (fmt == METRICS_FMT_JSON) {
+        _put(&w, "{");
+    }
+    for (int i = 0; i < num_families && w.err == 0; i++) {
+        _family_begin(&w, families[i], i == 0);
+        families[i]->collect(&w);
+        _family_end(&w);
+    }
+    if (fmt == METRICS_FMT_JSON) {
+        _put(&w, "}\n");
+    }
+    _flush(&w);
+    return w.err;
+}
@@ -0,0 +1,58 @@
+/*
+ * metrics.h
+ *
+ * Metrics registry and exposition. Families register a collect callback
+ * that reads the existing stats snapshots at scrape time, so nothing is
+ * added to the audio paths. metrics_render() writes every family as
+ * Prometheus text or JSON through a flush callback in small chunks.
+ * Plain C without ESP-IDF dependencies, the host build links it as is.
+ */
+
+#ifndef MAIN_METRICS_H_
+#define MAIN_METRICS_H_
+
+#include <stdint.h>
+
+#define METRICS_MAX_FAMILIES    (40)
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} metric_type_t;
+
+typedef enum {
+    METRICS_FMT_PROMETHEUS = 0,
+    METRICS_FMT_JSON,
+} metrics_fmt_t;
+
+typedef struct metrics_writer metrics_writer_t;
+
+typedef struct {
+    const char      *name;
+    const char      *help;
+    metric_type_t   type;
+    // label key of the samples, NULL for a single unlabeled sample
+    const char      *label;
+    void            (*collect)(metrics_writer_t *w);
+} metric_family_t;
+
+// returns < 0 to stop rendering
+typedef int (*metrics_flush_t)(void *ctx, const char *data, int len);
+
+// fam must stay valid, registration is not thread safe: do it at init
+int metrics_register(const metric_family_t *fam);
+void metrics_clear();
+// 0, or the first error returned by flush
+int metrics_render(metrics_fmt_t fmt, metrics_flush_t flush, void *ctx);
+
+// firmware families and the /metrics, /metrics.json endpoints (metrics_sys.c)
+void init_metrics();
+
+// from collect(), label_val is NULL for unlabeled families
+void metrics_value(metrics_writer_t *w, const char *label_val, int64_t value);
+// counts[n] per bucket, not cumulative; le[n - 1] upper bounds, the last bucket is +Inf
+void metrics_hist(metrics_writer_t *w, const char *label_val, const uint32_t *le,
+                  const uint32_t *counts, int n, uint64_t sum);
+
+#endif /* MAIN_METRICS_H_ */
@@ -0,0 +1,331 @@
+#include "main.h"
+#include "metrics.h"
+#include "ctl_server.h"
+#include "assistant.h"
+#include "cpu_load.h"
+#include "el_stats.h"
+#include "job_sched.h"
+#include "log.h"
+#include "dlog.h"
+#include "mem_track.h"
+#include "mixer_work.h"
+#include "msg_pool.h"
+#include "pipline_work.h"
+#include "audio_tap.h"
+#include "local_cmd.h"
+#include "speech_cmds.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+static const char *TAG = "metrics";
+
+// scrapes run one at a time in the httpd task
+static el_stat_t        el_snap[EL_STATS_MAX];
+static cpu_task_load_t  task_snap[CPU_LOAD_MAX_TASKS];
+
+static const char *port_names[MIXER_PORT_MAX] = { "tone", "speech", "media" };
+
+static void _uptime(metrics_writer_t *w)
+{
+    metrics_value(w, NULL, esp_timer_get_time() / 1000000);
+}
+
+static void _wakes(metrics_writer_t *w)
+{
+    assist_stats_t st;
+    assistant_get_stats(&st);
+    metrics_value(w, NULL, st.conversations);
+}
+
+static void _conversations(metrics_writer_t *w)
+{
+    assist_stats_t st;
+    assistant_get_stats(&st);
+    metrics_value(w, "completed", st.completed);
+    metrics_value(w, "local_command", st.local_commands);
+    metrics_value(w, "timeout", st.timeouts);
+    metrics_value(w, "lost_event", st.lost_events);
+}
+
+static void _latency(metrics_writer_t *w)
+{
+    // trace buckets are [0,1) [1,2) [2,4) ... ms, as inclusive upper bounds
+    uint32_t le[TRACE_HIST_BUCKETS - 1];
+    for (int b = 0; b < TRACE_HIST_BUCKETS - 1; b++) {
+        le[b] = (1u << b) - 1;
+    }
+    for (int s = 0; s < TRACE_STAGE_MAX; s++) {
+        trace_hist_t h;
+        trace_get_hist(s, &h);
+        metrics_hist(w, trace_stage_str(s), le, h.bucket, TRACE_HIST_BUCKETS, h.sum_ms);
+    }
+}
+
+static void _upload_bytes(metrics_writer_t *w)
+{
+    metrics_value(w, NULL, file2http_bytes_total());
+}
+
+static void _underruns(metrics_writer_t *w)
+{
+    mixer_stats_t st;
+    mixer_get_stats(&st);
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        metrics_value(w, port_names[i], st.underruns[i]);
+    }
+}
+
+static void _mix_cycles(metrics_writer_t *w)
+{
+    mixer_stats_t st;
+    mixer_get_stats(&st);
+    metrics_value(w, "avg", st.cycles_avg);
+    metrics_value(w, "max", st.cycles_max);
+}
+
+static void _heap_free(metrics_writer_t *w)
+{
+    mem_snapshot_t s;
+    mem_snapshot(&s);
+    metrics_value(w, "internal", s.int_free);
+    metrics_value(w, "psram", s.spi_free);
+}
+
+static void _heap_min_free(metrics_writer_t *w)
+{
+    mem_snapshot_t s;
+    mem_snapshot(&s);
+    metrics_value(w, "internal", s.int_min);
+    metrics_value(w, "psram", s.spi_min);
+}
+
+static void _heap_largest(metrics_writer_t *w)
+{
+    mem_snapshot_t s;
+    mem_snapshot(&s);
+    metrics_value(w, "internal", s.int_largest);
+    metrics_value(w, "psram", s.spi_largest);
+}
+
+static void _mem_sys(metrics_writer_t *w)
+{
+    for (int i = 0; i < MEM_SYS_MAX; i++) {
+        mem_sys_stats_t st;
+        mem_track_get_stats(i, &st);
+        metrics_value(w, mem_sys_str(i), st.cur_bytes);
+    }
+}
+
+static void _core_load(metrics_writer_t *w)
+{
+    char core[4];
+    cpu_load_stats_t st;
+    cpu_load_get_stats(&st);
+    for (int c = 0; c < portNUM_PROCESSORS && c < CPU_LOAD_MAX_CORES; c++) {
+        snprintf(core, sizeof(core), "%d", c);
+        metrics_value(w, core, st.core_load[c]);
+    }
+}
+
+static void _task_load(metrics_writer_t *w)
+{
+    int num = cpu_load_get_tasks(task_snap, CPU_LOAD_MAX_TASKS);
+    for (int i = 0; i < num; i++) {
+        metrics_value(w, task_snap[i].name, task_snap[i].load);
+    }
+}
+
+static void _task_stack(metrics_writer_t *w)
+{
+    int num = cpu_load_get_tasks(task_snap, CPU_LOAD_MAX_TASKS);
+    for (int i = 0; i < num; i++) {
+        metrics_value(w, task_snap[i].name, task_snap[i].stack_free);
+    }
+}
+
+static void _rssi(metrics_writer_t *w)
+{
+    wifi_ap_record_t ap;
+    // no sample while not associated
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        metrics_value(w, NULL, ap.rssi);
+    }
+}
+
+static void _jobs(metrics_writer_t *w)
+{
+    job_sched_stats_t st;
+    job_sched_get_stats(&st);
+    metrics_value(w, "submitted", st.submitted);
+    metrics_value(w, "completed", st.completed);
+    metrics_value(w, "failed", st.failed);
+    metrics_value(w, "cancelled", st.cancelled);
+    metrics_value(w, "preempted", st.preempted);
+    metrics_value(w, "rejected", st.rejected);
+}
+
+static void _msg_drops(metrics_writer_t *w)
+{
+    msg_pool_stats_t st;
+    msg_pool_get_stats(&st);
+    metrics_value(w, "no_slot", st.no_slot);
+    metrics_value(w, "queue_full", st.queue_full);
+    metrics_value(w, "oversize", st.oversize);
+}
+
+static void _el_bytes(metrics_writer_t *w)
+{
+    char name[32];
+    int num = el_stats_snapshot(el_snap, EL_STATS_MAX);
+    for (int i = 0; i < num; i++) {
+        snprintf(name, sizeof(name), "%s/%s", el_snap[i].pipe, el_snap[i].tag);
+        metrics_value(w, name, el_snap[i].bytes);
+    }
+}
+
+static void _el_fill_min(metrics_writer_t *w)
+{
+    char name[32];
+    int num = el_stats_snapshot(el_snap, EL_STATS_MAX);
+    for (int i = 0; i < num; i++) {
+        if (el_snap[i].fill_pct < 0) {
+            continue;
+        }
+        snprintf(name, sizeof(name), "%s/%s", el_snap[i].pipe, el_snap[i].tag);
+        metrics_value(w, name, el_snap[i].fill_pct_min);
+    }
+}
+
+static void _log_drops(metrics_writer_t *w)
+{
+    trace_stats_t ts;
+    dlog_stats_t ds;
+    trace_get_stats(&ts);
+    dlog_get_stats(&ds);
+    metrics_value(w, "trace", ts.dropped);
+    metrics_value(w, "dlog", ds.dropped);
+}
+
+#if CONFIG_LOCAL_CMD_ENABLE
+static void _commands(metrics_writer_t *w)
+{
+    local_cmd_stats_t st;
+    local_cmd_get_stats(&st);
+    metrics_value(w, "local", st.local);
+    metrics_value(w, "cloud", st.fallback);
+}
+
+static void _command_action(metrics_writer_t *w)
+{
+    local_cmd_stats_t st;
+    local_cmd_get_stats(&st);
+    metrics_value(w, "last", st.last_us);
+    metrics_value(w, "max", st.max_us);
+}
+
+static void _cmds_reset(metrics_writer_t *w)
+{
+    speech_cmds_stats_t st;
+    speech_cmds_get_stats(&st);
+    metrics_value(w, "last", st.reset_us_last);
+    metrics_value(w, "max", st.reset_us_max);
+    metrics_value(w, "idle_wait", st.idle_wait_us_last);
+}
+#endif
+
+#if CONFIG_AUDIO_TAP_ENABLE
+static void _tap_bytes(metrics_writer_t *w)
+{
+    tap_stats_t st;
+    for (int i = 0; i < TAP_MAX; i++) {
+        audio_tap_get_stats(i, &st);
+        metrics_value(w, audio_tap_str(i), st.bytes);
+    }
+}
+
+static void _tap_dropped(metrics_writer_t *w)
+{
+    tap_stats_t st;
+    for (int i = 0; i < TAP_MAX; i++) {
+        audio_tap_get_stats(i, &st);
+        metrics_value(w, audio_tap_str(i), st.dropped_bytes);
+    }
+}
+#endif
+
+static const metric_family_t families[] = {
+    { "uptime_seconds", "Time since boot", METRIC_GAUGE, NULL, _uptime },
+    { "wake_total", "Wake words detected", METRIC_COUNTER, NULL, _wakes },
+    { "conversation_end_total", "Conversations by outcome", METRIC_COUNTER, "result", _conversations },
+    { "latency_ms", "Voice pipeline stage latency, speech is the VAD duration", METRIC_HISTOGRAM, "stage", _latency },
+    { "upload_bytes_total", "Bytes uploaded by file2http", METRIC_COUNTER, NULL, _upload_bytes },
+    { "mixer_underrun_total", "Mixer port underruns", METRIC_COUNTER, "port", _underruns },
+    { "mixer_frame_cycles", "CPU cycles per 10ms mix frame", METRIC_GAUGE, "stat", _mix_cycles },
+    { "heap_free_bytes", "Free heap", METRIC_GAUGE, "region", _heap_free },
+    { "heap_min_free_bytes", "Lowest free heap since boot", METRIC_GAUGE, "region", _heap_min_free },
+    { "heap_largest_free_bytes", "Largest free heap block", METRIC_GAUGE, "region", _heap_largest },
+    { "mem_subsystem_bytes", "Heap held through mem_calloc per subsystem", METRIC_GAUGE, "subsystem", _mem_sys },
+    { "cpu_core_load_permille", "Core load over the last report period", METRIC_GAUGE, "core", _core_load },
+    { "cpu_task_load_permille", "Task CPU share over the last report period", METRIC_GAUGE, "task", _task_load },
+    { "task_stack_free_bytes", "Task stack high water mark", METRIC_GAUGE, "task", _task_stack },
+    { "wifi_rssi_dbm", "RSSI of the associated AP", METRIC_GAUGE, NULL, _rssi },
+    { "job_total", "Pipeline jobs by outcome", METRIC_COUNTER, "result", _jobs },
+    { "msg_drop_total", "Messages to the main loop dropped", METRIC_COUNTER, "reason", _msg_drops },
+    { "element_bytes_total", "Bytes moved per pipeline element", METRIC_COUNTER, "element", _el_bytes },
+    { "element_fill_min_pct", "Lowest ring buffer fill per pipeline element", METRIC_GAUGE, "element", _el_fill_min },
+    { "log_drop_total", "Tracer and deferred log records lost", METRIC_COUNTER, "log", _log_drops },
+#if CONFIG_LOCAL_CMD_ENABLE
+    { "speech_command_total", "MultiNet commands by where they ran", METRIC_COUNTER, "handler", _commands },
+    { "speech_command_action_us", "MultiNet result to local action done", METRIC_GAUGE, "stat", _command_action },
+    { "speech_command_reset_us", "MultiNet command list reset and the idle wait", METRIC_GAUGE, "stat", _cmds_reset },
+#endif
+#if CONFIG_AUDIO_TAP_ENABLE
+    { "audio_tap_bytes_total", "Audio offered to enabled tap points", METRIC_COUNTER, "tap", _tap_bytes },
+    { "audio_tap_dropped_bytes_total", "Tap audio dropped with the ring full", METRIC_COUNTER, "tap", _tap_dropped },
+#endif
+};
+
+static int _flush_chunk(void *ctx, const char *data, int len)
+{
+    return httpd_resp_send_chunk((httpd_req_t *)ctx, data, len) == ESP_OK ? 0 : -1;
+}
+
+static esp_err_t _serve(httpd_req_t *req, metrics_fmt_t fmt)
+{
+    httpd_resp_set_type(req, fmt == METRICS_FMT_JSON ? "application/json" : "text/plain; version=0.0.4");
+    if (metrics_render(fmt, _flush_chunk, req) != 0) {
+        // client went away, the connection is dropped by httpd
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static esp_err_t _http_prometheus(httpd_req_t *req)
+{
+    return _serve(req, METRICS_FMT_PROMETHEUS);
+}
+
+static esp_err_t _http_json(httpd_req_t *req)
+{
+    return _serve(req, METRICS_FMT_JSON);
+}
+
+static const httpd_uri_t metrics_uris[] = {
+    { .uri = "/metrics",      .method = HTTP_GET, .handler = _http_prometheus },
+    { .uri = "/metrics.json", .method = HTTP_GET, .handler = _http_json },
+};
+
+void init_metrics(){
+    for (int i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+        metrics_register(&families[i]);
+    }
+    for (int i = 0; i < sizeof(metrics_uris) / sizeof(metrics_uris[0]); i++) {
+        ctl_server_register(&metrics_uris[i]);
+    }
+    ESP_LOGI(TAG, "%d metric families on /metrics and /metrics.json", sizeof(families) / sizeof(families[0]));
+}
@@ -0,0 +1,90 @@
+#include "mixer_kernel.h"
+
+#include <string.h>
+
+// sub-step precision of the gain ramp
+#define RAMP_SHIFT  (8)
+
+static inline int16_t sat16(int32_t v)
+{
+    if (v > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (v < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)v;
+}
+
+int32_t mixer_kernel_gain(int percent)
+{
+    percent = percent < 0 ? 0 : percent > 100 ? 100 : percent;
+    return percent * MIXER_GAIN_UNITY / 100;
+}
+
+void mixer_kernel_mix(int16_t *out, int32_t *acc,
+                      const int16_t *const *in,
+                      const int32_t *gain_from, const int32_t *gain_to,
+                      int num_in, int num_frames)
+{
+    const int n = num_frames * MIXER_KERNEL_CHANNELS;
+
+    memset(acc, 0, n * sizeof(int32_t));
+
+    for (int i = 0; i < num_in; i++) {
+        const int16_t *src = in[i];
+        if (src == NULL || (gain_from[i] == 0 && gain_to[i] == 0)) {
+            continue;
+        }
+        if (gain_from[i] == gain_to[i]) {
+            const int32_t g = gain_from[i];
+            // one stereo frame (L/R pair) per iteration
+            for (int s = 0; s < n; s += 2) {
+                acc[s]     += src[s] * g;
+                acc[s + 1] += src[s + 1] * g;
+            }
+        } else {
+            int32_t g = gain_from[i] << RAMP_SHIFT;
+            const int32_t step = ((gain_to[i] - gain_from[i]) << RAMP_SHIFT) / num_frames;
+            for (int s = 0; s < n; s += 2) {
+                const int32_t gs = g >> RAMP_SHIFT;
+                acc[s]     += src[s] * gs;
+                acc[s + 1] += src[s + 1] * gs;
+                g += step;
+            }
+        }
+    }
+
+    for (int s = 0; s < n; s++) {
+        out[s] = sat16(acc[s] >> MIXER_GAIN_SHIFT);
+    }
+}
+
+bool mixer_kernel_port_want(mixer_port_state_t *p, int filled, int frame_bytes)
+{
+    if (filled >= frame_bytes) {
+        return true;
+    }
+    if (p->starved < MIXER_TAIL_FRAMES) {
+        p->starved++;
+    }
+    // flush a partial tail, or look for the end of stream of a dry port
+    return p->starved >= MIXER_TAIL_FRAMES && (filled > 0 || p->active);
+}
+
+bool mixer_kernel_port_update(mixer_port_state_t *p, int got, int frame_bytes, bool eos)
+{
+    bool underrun = false;
+
+    if (got > 0) {
+        // producer fell behind in the middle of a stream
+        underrun = p->active && p->starved > 0 && got == frame_bytes;
+        p->starved = 0;
+        p->active = true;
+    } else if (p->active && p->starved >= MIXER_TAIL_FRAMES) {
+        // a stall longer than the tail, the port fades in again when data is back
+        underrun = !eos;
+        p->active = false;
+    }
+    return underrun;
+}
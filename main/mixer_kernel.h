@@ -0,0 +1,61 @@
+/*
+ * mixer_kernel.h
+ *
+ * Fixed-point mix kernel used by the mixer element, and the per port
+ * starvation and underrun bookkeeping. Kept free of any ESP-IDF/ADF
+ * dependency so it can be benchmarked and tested off target.
+ */
+
+#ifndef MAIN_MIXER_KERNEL_H_
+#define MAIN_MIXER_KERNEL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MIXER_KERNEL_CHANNELS   (2)
+#define MIXER_KERNEL_MAX_INPUTS (4)
+
+// Q14 gain, up to unity MIXER_KERNEL_MAX_INPUTS full scale inputs fit the int32 accumulator
+#define MIXER_GAIN_SHIFT        (14)
+#define MIXER_GAIN_UNITY        (1 << MIXER_GAIN_SHIFT)
+
+// a port holding less than a frame is flushed after this many starved frames
+#define MIXER_TAIL_FRAMES       (2)
+
+typedef struct {
+    // mixed in the last frames, until it runs dry
+    bool    active;
+    // frames in a row with less than a full frame buffered
+    int     starved;
+} mixer_port_state_t;
+
+// percent to Q14 gain, clamped to 0..100 so the accumulator cannot overflow
+int32_t mixer_kernel_gain(int percent);
+
+/**
+ * Mix interleaved stereo int16 inputs into out.
+ *
+ * Each input i is scaled by a gain ramped linearly from gain_from[i] to
+ * gain_to[i] across the frame, so gain and ducking changes do not click.
+ * Gains must lie in 0..MIXER_GAIN_UNITY, see mixer_kernel_gain. The sum
+ * saturates to int16 once, after all inputs are added. A NULL input (or
+ * zero gain) is skipped. acc is caller owned scratch of
+ * num_frames * MIXER_KERNEL_CHANNELS words.
+ */
+void mixer_kernel_mix(int16_t *out, int32_t *acc,
+                      const int16_t *const *in,
+                      const int32_t *gain_from, const int32_t *gain_to,
+                      int num_in, int num_frames);
+
+// whether to read the port this frame, filled is what its ring holds
+bool mixer_kernel_port_want(mixer_port_state_t *p, int filled, int frame_bytes);
+
+/**
+ * Every frame after mixer_kernel_port_want: got is what the read returned,
+ * 0 or less for nothing, eos whether the producer ended its stream. True
+ * on an underrun: a full frame back after a short gap, or an active port
+ * running dry for MIXER_TAIL_FRAMES without an end of stream.
+ */
+bool mixer_kernel_port_update(mixer_port_state_t *p, int got, int frame_bytes, bool eos);
+
+#endif /* MAIN_MIXER_KERNEL_H_ */
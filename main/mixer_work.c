@@ -0,0 +1,245 @@
+#include "main.h"
+#include "mixer_work.h"
+#include "mixer_kernel.h"
+#include "aec_ref.h"
+#include "i2s_work.h"
+#include "cpu_load.h"
+#include "log.h"
+#include "el_stats.h"
+#include "mem_track.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "hal/cpu_hal.h"
+
+#include "audio_element.h"
+#include "audio_pipeline.h"
+#include "audio_mem.h"
+#include "audio_common.h"
+#include "ringbuf.h"
+#include "sdkconfig.h"
+
+#include "board.h"
+
+static const char *TAG = "mixer_work";
+
+// 10ms of 48kHz stereo per mix frame
+#define MIXER_FRAME_SAMPLES (MIXER_SAMPLE_RATE / 100)
+#define MIXER_FRAME_BYTES   (MIXER_FRAME_SAMPLES * MIXER_CHANNELS * (MIXER_BITS / 8))
+#define MIXER_PORT_FRAMES   (4)
+#define MIXER_STATS_FRAMES  (1000)
+
+typedef struct {
+    ringbuf_handle_t    rb;
+    int32_t             gain;
+    int32_t             gain_cur;
+    int32_t             duck_gain;
+    bool                duck_others;
+    mixer_port_state_t  st;
+    // set by mixer_port_reset, a port emptied by an abort has no end of stream
+    volatile bool       reset;
+} mixer_port_ctx_t;
+
+static audio_pipeline_handle_t  mixer_pipeline;
+static audio_element_handle_t   mixer_el;
+static audio_element_handle_t   i2s_stream_writer;
+static mixer_port_ctx_t         ports[MIXER_PORT_MAX];
+static int16_t                  *port_buf[MIXER_PORT_MAX];
+static int32_t                  *mix_acc;
+static mixer_stats_t            stats;
+static uint64_t                 cycles_sum;
+
+static int _port_read(audio_element_handle_t self, int i)
+{
+    mixer_port_ctx_t *p = &ports[i];
+    int ret = 0;
+
+    if (mixer_kernel_port_want(&p->st, rb_bytes_filled(p->rb), MIXER_FRAME_BYTES)) {
+        ret = audio_element_multi_input(self, (char *)port_buf[i], MIXER_FRAME_BYTES, i, 0);
+        if (ret > 0 && ret < MIXER_FRAME_BYTES) {
+            memset((char *)port_buf[i] + ret, 0, MIXER_FRAME_BYTES - ret);
+        }
+    }
+    if (ret > 0) {
+        p->reset = false;
+    }
+    bool eos = ret == RB_DONE || ret == RB_ABORT || p->reset;
+    if (mixer_kernel_port_update(&p->st, ret, MIXER_FRAME_BYTES, eos)) {
+        stats.underruns[i]++;
+    }
+    return ret > 0 ? ret : 0;
+}
+
+static audio_element_err_t _mixer_process(audio_element_handle_t self, char *buffer, int len)
+{
+    uint32_t start = cpu_hal_get_cycle_count();
+    const int16_t *in[MIXER_PORT_MAX] = { 0 };
+    int32_t gain_from[MIXER_PORT_MAX];
+    int32_t gain_to[MIXER_PORT_MAX];
+    int32_t duck = MIXER_GAIN_UNITY;
+
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        bool was_active = ports[i].st.active;
+        if (_port_read(self, i) > 0) {
+            in[i] = port_buf[i];
+            if (!was_active) {
+                TRACE(TRACE_PLAY_START, i);
+            }
+            if (ports[i].duck_others && ports[i].duck_gain < duck) {
+                duck = ports[i].duck_gain;
+            }
+        }
+    }
+
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        mixer_port_ctx_t *p = &ports[i];
+        int32_t target = p->gain;
+        if (!p->duck_others) {
+            target = (target * duck) >> MIXER_GAIN_SHIFT;
+        }
+        // a port (re)starting fades in from silence
+        gain_from[i] = in[i] ? p->gain_cur : 0;
+        gain_to[i] = target;
+        p->gain_cur = in[i] ? target : 0;
+    }
+
+    mixer_kernel_mix((int16_t *)buffer, mix_acc, in, gain_from, gain_to,
+                     MIXER_PORT_MAX, MIXER_FRAME_SAMPLES);
+#if CONFIG_AEC_SOFTWARE_REF
+    // final PCM handed to the i2s writer is the AEC reference
+    aec_ref_push((int16_t *)buffer, MIXER_FRAME_SAMPLES);
+#endif
+
+    uint32_t cycles = cpu_hal_get_cycle_count() - start;
+    stats.frames++;
+    cycles_sum += cycles;
+    if (stats.cycles_min == 0 || cycles < stats.cycles_min) {
+        stats.cycles_min = cycles;
+    }
+    if (cycles > stats.cycles_max) {
+        stats.cycles_max = cycles;
+    }
+    stats.cycles_avg = cycles_sum / stats.frames;
+    if ((stats.frames % MIXER_STATS_FRAMES) == 0) {
+        ESP_LOGD(TAG, "mix frame cycles min/avg/max: %u/%u/%u, underruns tone:%u speech:%u media:%u",
+                 stats.cycles_min, stats.cycles_avg, stats.cycles_max,
+                 stats.underruns[MIXER_PORT_TONE], stats.underruns[MIXER_PORT_SPEECH],
+                 stats.underruns[MIXER_PORT_MEDIA]);
+    }
+
+    return audio_element_output(self, buffer, MIXER_FRAME_BYTES);
+}
+
+static audio_element_handle_t mixer_element_init()
+{
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    cfg.process = _mixer_process;
+    cfg.buffer_len = MIXER_FRAME_BYTES;
+    cfg.multi_in_rb_num = MIXER_PORT_MAX;
+    cfg.task_stack = 3 * 1024;
+    cfg.task_prio = TASK_PRIO(MIXER);
+    cfg.task_core = TASK_CORE(MIXER);
+    cfg.out_rb_size = 2 * MIXER_FRAME_BYTES;
+    cfg.tag = "mixer";
+    return audio_element_init(&cfg);
+}
+
+void init_mixer_work(){
+    ESP_LOGI(TAG, "[1.0] Create mixer ports");
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        ports[i].rb = rb_create(MIXER_FRAME_BYTES, MIXER_PORT_FRAMES);
+        port_buf[i] = mem_calloc(MEM_SYS_PIPELINE, 1, MIXER_FRAME_BYTES);
+        mem_assert(ports[i].rb && port_buf[i]);
+        ports[i].gain = MIXER_GAIN_UNITY;
+        ports[i].duck_gain = MIXER_GAIN_UNITY;
+    }
+    mix_acc = mem_calloc(MEM_SYS_PIPELINE, MIXER_FRAME_SAMPLES * MIXER_CHANNELS, sizeof(int32_t));
+    mem_assert(mix_acc);
+    // prompts are heard over speech and media
+    mixer_set_ducking(MIXER_PORT_TONE, true, 30);
+
+    ESP_LOGI(TAG, "[2.0] Create mixer pipeline");
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    mixer_pipeline = audio_pipeline_init(&pipeline_cfg);
+    mem_assert(mixer_pipeline);
+
+    mixer_el = mixer_element_init();
+    mem_assert(mixer_el);
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        audio_element_set_multi_input_ringbuf(mixer_el, ports[i].rb, i);
+    }
+
+    // playback port of the shared i2s owner, clock is fixed there
+    i2s_stream_writer = i2s_work_get_writer();
+
+    ESP_LOGI(TAG, "[2.2] Link it together [mixer]-->i2s_stream-->[codec_chip]");
+    audio_pipeline_register(mixer_pipeline, mixer_el, "mixer");
+    audio_pipeline_register(mixer_pipeline, i2s_stream_writer, "i2s");
+    const char *link_tag[2] = {"mixer", "i2s"};
+    audio_pipeline_link(mixer_pipeline, &link_tag[0], 2);
+    el_stats_bind("mixer", "mixer", mixer_el, audio_element_get_output_ringbuf(mixer_el));
+    el_stats_bind("mixer", "i2s", i2s_stream_writer, audio_element_get_input_ringbuf(i2s_stream_writer));
+
+    audio_pipeline_run(mixer_pipeline);
+    ESP_LOGI(TAG, "Mixer is running");
+}
+
+void deinit_mixer_work(){
+    el_stats_unbind("mixer");
+    audio_pipeline_stop(mixer_pipeline);
+    audio_pipeline_wait_for_stop(mixer_pipeline);
+    audio_pipeline_terminate(mixer_pipeline);
+
+    audio_pipeline_unregister(mixer_pipeline, mixer_el);
+    audio_pipeline_unregister(mixer_pipeline, i2s_stream_writer);
+
+    audio_pipeline_deinit(mixer_pipeline);
+    audio_element_deinit(mixer_el);
+
+    for (int i = 0; i < MIXER_PORT_MAX; i++) {
+        rb_destroy(ports[i].rb);
+        mem_free(port_buf[i]);
+    }
+    mem_free(mix_acc);
+}
+
+void mixer_connect(mixer_port_t port, audio_element_handle_t el){
+    audio_element_set_output_ringbuf(el, ports[port].rb);
+}
+
+void mixer_port_reset(mixer_port_t port){
+    ports[port].reset = true;
+    rb_reset(ports[port].rb);
+}
+
+bool mixer_port_idle(mixer_port_t port){
+    return rb_bytes_filled(ports[port].rb) <= 0 && !ports[port].st.active;
+}
+
+bool mixer_port_drain(mixer_port_t port, TickType_t ticks){
+    TickType_t start = xTaskGetTickCount();
+    while (!mixer_port_idle(port)) {
+        if (xTaskGetTickCount() - start >= ticks) {
+            ESP_LOGW(TAG, "port %d drain timeout", port);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+void mixer_set_gain(mixer_port_t port, int gain_percent){
+    ports[port].gain = mixer_kernel_gain(gain_percent);
+}
+
+void mixer_set_ducking(mixer_port_t port, bool duck_others, int duck_percent){
+    ports[port].duck_gain = mixer_kernel_gain(duck_percent);
+    ports[port].duck_others = duck_others;
+}
+
+void mixer_get_stats(mixer_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
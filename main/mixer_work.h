@@ -0,0 +1,59 @@
+/*
+ * mixer_work.h
+ *
+ * Single playback output: [mixer]-->i2s_stream-->[codec_chip].
+ * Player pipelines write 48kHz/16bit/stereo PCM into a mixer port instead of
+ * owning an i2s writer, so tones, TTS and local files can overlap.
+ */
+
+#ifndef MAIN_MIXER_WORK_H_
+#define MAIN_MIXER_WORK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "audio_element.h"
+#include "ringbuf.h"
+
+#define MIXER_SAMPLE_RATE   (48000)
+#define MIXER_BITS          (16)
+#define MIXER_CHANNELS      (2)
+
+typedef enum {
+    MIXER_PORT_TONE = 0,
+    MIXER_PORT_SPEECH,
+    MIXER_PORT_MEDIA,
+    MIXER_PORT_MAX,
+} mixer_port_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t cycles_min;
+    uint32_t cycles_max;
+    uint32_t cycles_avg;
+    // gaps inside a stream, short ones and stalls that outlast the tail
+    uint32_t underruns[MIXER_PORT_MAX];
+} mixer_stats_t;
+
+void init_mixer_work();
+void deinit_mixer_work();
+
+// route the output of el (last element of a player pipeline) into port
+void mixer_connect(mixer_port_t port, audio_element_handle_t el);
+// drop stale data and the done flag before a new job starts on port
+void mixer_port_reset(mixer_port_t port);
+// nothing queued on port and its last frame has been mixed out
+bool mixer_port_idle(mixer_port_t port);
+// wait until everything written to port has been mixed out
+bool mixer_port_drain(mixer_port_t port, TickType_t ticks);
+
+// gain in percent, 100 is unity and the most, larger values are clamped
+void mixer_set_gain(mixer_port_t port, int gain_percent);
+// while port has data, other ports are attenuated to duck_percent
+void mixer_set_ducking(mixer_port_t port, bool duck_others, int duck_percent);
+
+void mixer_get_stats(mixer_stats_t *stats);
+
+#endif /* MAIN_MIXER_WORK_H_ */
@@ -0,0 +1,116 @@
+#include "msg_pool.h"
+
+#include <assert.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "audio_mem.h"
+
+static const char *TAG = "msg_pool";
+
+QueueHandle_t               main_q      = NULL;
+
+static main_msg_t           slots[MSG_POOL_SLOTS];
+// stack of free slot indices
+static uint8_t              free_idx[MSG_POOL_SLOTS];
+static int                  free_top;
+static portMUX_TYPE         pool_lock   = portMUX_INITIALIZER_UNLOCKED;
+static msg_pool_stats_t     stats;
+
+void init_msg_pool(){
+    for (int i = 0; i < MSG_POOL_SLOTS; i++) {
+        free_idx[i] = MSG_POOL_SLOTS - 1 - i;
+    }
+    free_top = MSG_POOL_SLOTS;
+    main_q = xQueueCreate(MSG_POOL_SLOTS, sizeof(main_msg_t *));
+    mem_assert(main_q);
+}
+
+main_msg_t *msg_pool_alloc(){
+    main_msg_t *msg = NULL;
+
+    portENTER_CRITICAL(&pool_lock);
+    if (free_top > 0) {
+        msg = &slots[free_idx[--free_top]];
+        stats.in_use++;
+        if (stats.in_use > stats.high_water) {
+            stats.high_water = stats.in_use;
+        }
+    } else {
+        stats.no_slot++;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    return msg;
+}
+
+void msg_pool_free(main_msg_t *msg){
+    if (msg == NULL) {
+        return;
+    }
+    int idx = msg - slots;
+    assert(idx >= 0 && idx < MSG_POOL_SLOTS);
+    portENTER_CRITICAL(&pool_lock);
+    free_idx[free_top++] = idx;
+    stats.in_use--;
+    portEXIT_CRITICAL(&pool_lock);
+}
+
+static bool _post(main_msg_t *msg)
+{
+    if (xQueueSend(main_q, &msg, 0) != pdPASS) {
+        portENTER_CRITICAL(&pool_lock);
+        stats.queue_full++;
+        portEXIT_CRITICAL(&pool_lock);
+        ESP_LOGE(TAG, "main queue send failed, msg %d", msg->msg_id);
+        msg_pool_free(msg);
+        return false;
+    }
+    portENTER_CRITICAL(&pool_lock);
+    stats.posted++;
+    portEXIT_CRITICAL(&pool_lock);
+    return true;
+}
+
+bool main_msg_post(int msg_id){
+    main_msg_t *msg = msg_pool_alloc();
+    if (msg == NULL) {
+        ESP_LOGE(TAG, "No free slot for msg %d", msg_id);
+        return false;
+    }
+    msg->msg_id = msg_id;
+    return _post(msg);
+}
+
+bool main_msg_post_xfer(int msg_id, const char *src, const char *dst){
+    if (src == NULL) {
+        src = "";
+    }
+    if (dst == NULL) {
+        dst = "";
+    }
+    // a truncated path or url is worse than no message
+    if (strlen(src) >= MSG_URL_LEN || strlen(dst) >= MSG_URL_LEN) {
+        portENTER_CRITICAL(&pool_lock);
+        stats.oversize++;
+        portEXIT_CRITICAL(&pool_lock);
+        ESP_LOGE(TAG, "Payload of msg %d too long: %s", msg_id, src);
+        return false;
+    }
+    main_msg_t *msg = msg_pool_alloc();
+    if (msg == NULL) {
+        ESP_LOGE(TAG, "No free slot for msg %d: %s", msg_id, src);
+        return false;
+    }
+    msg->msg_id = msg_id;
+    strcpy(msg->xfer.src, src);
+    strcpy(msg->xfer.dst, dst);
+    return _post(msg);
+}
+
+void msg_pool_get_stats(msg_pool_stats_t *out){
+    portENTER_CRITICAL(&pool_lock);
+    memcpy(out, &stats, sizeof(stats));
+    portEXIT_CRITICAL(&pool_lock);
+}
@@ -0,0 +1,65 @@
+/*
+ * msg_pool.h
+ *
+ * Messages to app_main live in a fixed pool of preallocated slots, their
+ * payload is copied inline so a sender's buffers can be reused right after
+ * posting. main_q carries slot pointers, the receiver frees the slot.
+ */
+
+#ifndef MAIN_MSG_POOL_H_
+#define MAIN_MSG_POOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define MSG_POOL_SLOTS  (8)
+#define MSG_URL_LEN     (96)
+
+enum _main_msg_id {
+    FILE2HTTP = 1,
+    HTTP2FILE,
+    FILE2PLAYER,
+    HTTP2PLAYER,
+    EXIT
+};
+
+// FILE2HTTP, HTTP2FILE, FILE2PLAYER, HTTP2PLAYER
+typedef struct {
+    char            src[MSG_URL_LEN];
+    char            dst[MSG_URL_LEN];
+} main_msg_xfer_t;
+
+typedef struct {
+    int             msg_id;
+    union {
+        main_msg_xfer_t xfer;
+    };
+} main_msg_t;
+
+typedef struct {
+    uint32_t posted;
+    // pool exhausted, main_q full or payload too long for a slot
+    uint32_t no_slot;
+    uint32_t queue_full;
+    uint32_t oversize;
+    uint32_t in_use;
+    uint32_t high_water;
+} msg_pool_stats_t;
+
+extern QueueHandle_t main_q;
+
+void init_msg_pool();
+
+// NULL when every slot is taken
+main_msg_t *msg_pool_alloc();
+void msg_pool_free(main_msg_t *msg);
+
+bool main_msg_post(int msg_id);
+bool main_msg_post_xfer(int msg_id, const char *src, const char *dst);
+
+void msg_pool_get_stats(msg_pool_stats_t *stats);
+
+#endif /* MAIN_MSG_POOL_H_ */
@@ -0,0 +1,292 @@
+#include "main.h"
+#include "pipeline_graph.h"
+#include "mixer_work.h"
+#include "el_stats.h"
+#include "mem_track.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "audio_element.h"
+#include "audio_pipeline.h"
+#include "audio_mem.h"
+#include "fatfs_stream.h"
+#include "http_stream.h"
+#include "tone_stream.h"
+#include "wav_decoder.h"
+#include "mp3_decoder.h"
+#include "filter_resample.h"
+
+static const char *TAG = "pipeline_graph";
+
+#define GRAPH_MAX_SHARED    (4)
+// the reactor already gave up on a pipeline that is still running here
+#define GRAPH_STOP_MS       (2000)
+
+typedef struct {
+    const char              *key;
+    audio_element_handle_t  el;
+    int                     refs;
+} shared_el_t;
+
+static shared_el_t shared[GRAPH_MAX_SHARED];
+
+#define GRAPH_APPLY_TASK(cfg, s) do {                   \
+        if ((s)->core) {                                \
+            (cfg).task_core = (s)->core - 1;            \
+        }                                               \
+        if ((s)->prio) {                                \
+            (cfg).task_prio = (s)->prio;                \
+        }                                               \
+    } while (0)
+
+#define GRAPH_APPLY(cfg, s) do {                        \
+        if ((s)->out_rb_size) {                         \
+            (cfg).out_rb_size = (s)->out_rb_size;       \
+        }                                               \
+        GRAPH_APPLY_TASK(cfg, s);                       \
+    } while (0)
+
+static audio_element_handle_t _create(const graph_el_spec_t *s)
+{
+    switch (s->type) {
+        case GRAPH_EL_FATFS_READER:
+        case GRAPH_EL_FATFS_WRITER: {
+            fatfs_stream_cfg_t cfg = FATFS_STREAM_CFG_DEFAULT();
+            cfg.type = s->type == GRAPH_EL_FATFS_READER ? AUDIO_STREAM_READER : AUDIO_STREAM_WRITER;
+            GRAPH_APPLY(cfg, s);
+            return fatfs_stream_init(&cfg);
+        }
+        case GRAPH_EL_HTTP_READER:
+        case GRAPH_EL_HTTP_WRITER: {
+            http_stream_cfg_t cfg = HTTP_STREAM_CFG_DEFAULT();
+            cfg.type = s->type == GRAPH_EL_HTTP_READER ? AUDIO_STREAM_READER : AUDIO_STREAM_WRITER;
+            cfg.event_handle = s->http_event;
+            GRAPH_APPLY(cfg, s);
+            return http_stream_init(&cfg);
+        }
+        case GRAPH_EL_TONE_READER: {
+            tone_stream_cfg_t cfg = TONE_STREAM_CFG_DEFAULT();
+            cfg.type = AUDIO_STREAM_READER;
+            GRAPH_APPLY_TASK(cfg, s);
+            return tone_stream_init(&cfg);
+        }
+        case GRAPH_EL_WAV_DECODER: {
+            wav_decoder_cfg_t cfg = DEFAULT_WAV_DECODER_CONFIG();
+            GRAPH_APPLY(cfg, s);
+            return wav_decoder_init(&cfg);
+        }
+        case GRAPH_EL_MP3_DECODER: {
+            mp3_decoder_cfg_t cfg = DEFAULT_MP3_DECODER_CONFIG();
+            GRAPH_APPLY(cfg, s);
+            return mp3_decoder_init(&cfg);
+        }
+        case GRAPH_EL_RESAMPLE: {
+            rsp_filter_cfg_t cfg = DEFAULT_RESAMPLE_FILTER_CONFIG();
+            if (s->src_rate) {
+                cfg.src_rate = s->src_rate;
+                cfg.src_bits = s->src_bits;
+                cfg.src_ch = s->src_ch;
+            }
+            cfg.dest_rate = s->dest_rate;
+            cfg.dest_ch = s->dest_ch;
+            GRAPH_APPLY(cfg, s);
+            return rsp_filter_init(&cfg);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static audio_element_handle_t _new(const graph_el_spec_t *s)
+{
+    audio_element_handle_t el = _create(s);
+    if (el) {
+        reactor_attach(el);
+    }
+    return el;
+}
+
+static void _delete(audio_element_handle_t el)
+{
+    reactor_detach(el);
+    audio_element_deinit(el);
+}
+
+static audio_element_handle_t _get(const graph_el_spec_t *s)
+{
+    shared_el_t *slot = NULL;
+
+    if (s->share == NULL) {
+        return _new(s);
+    }
+    for (int i = 0; i < GRAPH_MAX_SHARED; i++) {
+        if (shared[i].refs && strcmp(shared[i].key, s->share) == 0) {
+            shared[i].refs++;
+            ESP_LOGI(TAG, "Share %s element", s->share);
+            return shared[i].el;
+        }
+        if (shared[i].refs == 0 && slot == NULL) {
+            slot = &shared[i];
+        }
+    }
+    if (slot == NULL) {
+        ESP_LOGW(TAG, "No share slot for %s, create a private one", s->share);
+        return _new(s);
+    }
+    slot->el = _new(s);
+    if (slot->el) {
+        slot->key = s->share;
+        slot->refs = 1;
+    }
+    return slot->el;
+}
+
+// graphs holding el, 0 for a private element
+static int _refs(audio_element_handle_t el)
+{
+    for (int i = 0; i < GRAPH_MAX_SHARED; i++) {
+        if (shared[i].refs && shared[i].el == el) {
+            return shared[i].refs;
+        }
+    }
+    return 0;
+}
+
+static void _put(audio_element_handle_t el)
+{
+    for (int i = 0; i < GRAPH_MAX_SHARED; i++) {
+        if (shared[i].refs && shared[i].el == el) {
+            if (--shared[i].refs == 0) {
+                _delete(el);
+            }
+            return;
+        }
+    }
+    _delete(el);
+}
+
+pipeline_graph_t *pipeline_graph_build(const graph_spec_t *spec){
+    const char *link_tag[GRAPH_MAX_ELS];
+
+    assert(spec->num_els <= GRAPH_MAX_ELS);
+    pipeline_graph_t *graph = mem_calloc(MEM_SYS_PIPELINE, 1, sizeof(pipeline_graph_t));
+    mem_assert(graph);
+    graph->spec = spec;
+
+    audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
+    graph->pipeline = audio_pipeline_init(&pipeline_cfg);
+    mem_assert(graph->pipeline);
+
+    for (int i = 0; i < spec->num_els; i++) {
+        graph->els[i] = _get(&spec->els[i]);
+        mem_assert(graph->els[i]);
+        audio_pipeline_register(graph->pipeline, graph->els[i], spec->els[i].tag);
+        link_tag[i] = spec->els[i].tag;
+    }
+    audio_pipeline_link(graph->pipeline, &link_tag[0], spec->num_els);
+
+    audio_element_handle_t tail = graph->els[spec->num_els - 1];
+    if (spec->mixer_port != GRAPH_NO_MIXER) {
+        mixer_connect(spec->mixer_port, tail);
+    }
+    // remember the links so a shared element can be pointed back at them
+    for (int i = 0; i < spec->num_els; i++) {
+        graph->in_rb[i] = audio_element_get_input_ringbuf(graph->els[i]);
+        graph->out_rb[i] = audio_element_get_output_ringbuf(graph->els[i]);
+        el_stats_bind(spec->name, spec->els[i].tag, graph->els[i],
+                      graph->out_rb[i] ? graph->out_rb[i] : graph->in_rb[i]);
+    }
+
+    ESP_LOGI(TAG, "Built %s pipeline, %d elements", spec->name, spec->num_els);
+    return graph;
+}
+
+void pipeline_graph_destroy(pipeline_graph_t *graph){
+    const graph_spec_t *spec = graph->spec;
+    bool kept[GRAPH_MAX_ELS] = { 0 };
+
+    el_stats_unbind(spec->name);
+    // a shared element another graph still holds only leaves this pipeline, its task stays up
+    for (int i = 0; i < spec->num_els; i++) {
+        if (_refs(graph->els[i]) > 1) {
+            audio_pipeline_unregister(graph->pipeline, graph->els[i]);
+            kept[i] = true;
+            ESP_LOGI(TAG, "Keep shared %s element for the other graphs", spec->els[i].share);
+        }
+    }
+    audio_pipeline_stop(graph->pipeline);
+    audio_pipeline_wait_for_stop(graph->pipeline);
+    audio_pipeline_terminate(graph->pipeline);
+
+    for (int i = 0; i < spec->num_els; i++) {
+        if (!kept[i]) {
+            audio_pipeline_unregister(graph->pipeline, graph->els[i]);
+        }
+    }
+    audio_pipeline_deinit(graph->pipeline);
+    /* Terminate the pipeline before removing the listeners */
+    for (int i = 0; i < spec->num_els; i++) {
+        _put(graph->els[i]);
+    }
+    ESP_LOGI(TAG, "Destroyed %s pipeline", spec->name);
+    mem_free(graph);
+}
+
+audio_element_handle_t pipeline_graph_el(pipeline_graph_t *graph, const char *tag){
+    for (int i = 0; i < graph->spec->num_els; i++) {
+        if (strcmp(graph->spec->els[i].tag, tag) == 0) {
+            return graph->els[i];
+        }
+    }
+    return NULL;
+}
+
+audio_element_handle_t pipeline_graph_tail(pipeline_graph_t *graph){
+    return graph->els[graph->spec->num_els - 1];
+}
+
+void pipeline_graph_bind(pipeline_graph_t *graph){
+    for (int i = 0; i < graph->spec->num_els; i++) {
+        if (graph->spec->els[i].share == NULL) {
+            continue;
+        }
+        if (graph->in_rb[i]) {
+            audio_element_set_input_ringbuf(graph->els[i], graph->in_rb[i]);
+        }
+        if (graph->out_rb[i]) {
+            audio_element_set_output_ringbuf(graph->els[i], graph->out_rb[i]);
+        }
+    }
+}
+
+/*
+ * Element tasks are created by the first audio_pipeline_run and stay alive
+ * until audio_pipeline_terminate, which is only done on release. Between
+ * jobs the pipeline is only brought back to AEL_STATE_INIT with empty ring
+ * buffers, audio_pipeline_run then just resumes the existing tasks.
+ */
+esp_err_t pipeline_graph_rearm(pipeline_graph_t *graph){
+    bool idle = true;
+
+    for (int i = 0; i < graph->spec->num_els; i++) {
+        audio_element_state_t st = audio_element_get_state(graph->els[i]);
+        if (st != AEL_STATE_NONE && st != AEL_STATE_INIT && st != AEL_STATE_STOPPED && st != AEL_STATE_FINISHED) {
+            idle = false;
+        }
+    }
+    if (!idle) {
+        // any element of the last job still going, stop them all but keep the tasks
+        audio_pipeline_stop(graph->pipeline);
+        if (audio_pipeline_wait_for_stop_with_ticks(graph->pipeline, pdMS_TO_TICKS(GRAPH_STOP_MS)) != ESP_OK) {
+            // resetting under running element tasks races them, leave it to a rebuild
+            ESP_LOGE(TAG, "%s did not stop in %d ms", graph->spec->name, GRAPH_STOP_MS);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    audio_pipeline_reset_ringbuffer(graph->pipeline);
+    audio_pipeline_reset_elements(graph->pipeline);
+    audio_pipeline_change_state(graph->pipeline, AEL_STATE_INIT);
+    return ESP_OK;
+}
@@ -0,0 +1,91 @@
+/*
+ * pipeline_graph.h
+ *
+ * Pipelines described as a table of element specs in link order. The
+ * builder creates the elements, registers and links them, routes the tail
+ * into a mixer port and the events to the reactor, and tears it all down
+ * again. Elements with the same share key are created once and rebound to
+ * the ring buffers of whichever graph runs them; destroying one graph
+ * leaves them to the others and deletes them with the last.
+ */
+
+#ifndef MAIN_PIPELINE_GRAPH_H_
+#define MAIN_PIPELINE_GRAPH_H_
+
+#include "audio_element.h"
+#include "audio_pipeline.h"
+#include "http_stream.h"
+#include "cpu_load.h"
+
+#define GRAPH_MAX_ELS       (4)
+// spec core field, 0 keeps the element default
+#define GRAPH_ON_CORE(n)    ((n) + 1)
+#define GRAPH_NO_MIXER      (-1)
+// core and priority of a Kconfig task placement slot
+#define GRAPH_TASK(slot)    .core = GRAPH_ON_CORE(TASK_CORE(slot)), .prio = TASK_PRIO(slot)
+
+typedef enum {
+    GRAPH_EL_FATFS_READER = 0,
+    GRAPH_EL_FATFS_WRITER,
+    GRAPH_EL_HTTP_READER,
+    GRAPH_EL_HTTP_WRITER,
+    GRAPH_EL_TONE_READER,
+    GRAPH_EL_WAV_DECODER,
+    GRAPH_EL_MP3_DECODER,
+    GRAPH_EL_RESAMPLE,
+} graph_el_type_t;
+
+typedef struct {
+    const char                  *tag;
+    graph_el_type_t             type;
+    // 0 keeps the element defaults
+    int                         out_rb_size;
+    int                         core;
+    int                         prio;
+    // resample only, a 0 source is taken from the decoder's music info later
+    int                         src_rate;
+    int                         src_bits;
+    int                         src_ch;
+    int                         dest_rate;
+    int                         dest_ch;
+    // http streams only
+    http_stream_event_handle_t  http_event;
+    /*
+     * Specs with the same share key use one element instance. Only for
+     * graphs that can never run at the same time, e.g. both hold a
+     * scheduler resource limited to one job.
+     */
+    const char                  *share;
+} graph_el_spec_t;
+
+typedef struct {
+    const char              *name;
+    const graph_el_spec_t   *els;
+    int                     num_els;
+    // mixer_port_t the tail writes to, GRAPH_NO_MIXER otherwise
+    int                     mixer_port;
+} graph_spec_t;
+
+typedef struct {
+    const graph_spec_t      *spec;
+    audio_pipeline_handle_t pipeline;
+    audio_element_handle_t  els[GRAPH_MAX_ELS];
+    ringbuf_handle_t        in_rb[GRAPH_MAX_ELS];
+    ringbuf_handle_t        out_rb[GRAPH_MAX_ELS];
+} pipeline_graph_t;
+
+pipeline_graph_t *pipeline_graph_build(const graph_spec_t *spec);
+void pipeline_graph_destroy(pipeline_graph_t *graph);
+
+audio_element_handle_t pipeline_graph_el(pipeline_graph_t *graph, const char *tag);
+audio_element_handle_t pipeline_graph_tail(pipeline_graph_t *graph);
+// point shared elements at this graph's ring buffers, before every run
+void pipeline_graph_bind(pipeline_graph_t *graph);
+/**
+ * Warm restart between jobs: keep element tasks, clear buffers and state.
+ * Elements still running are stopped first. ESP_ERR_TIMEOUT when they do
+ * not stop, nothing is reset then and the graph must be destroyed.
+ */
+esp_err_t pipeline_graph_rearm(pipeline_graph_t *graph);
+
+#endif /* MAIN_PIPELINE_GRAPH_H_ */
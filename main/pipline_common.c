@@ -0,0 +1,42 @@
+#include "main.h"
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+
+static const char *TAG = "pipline_common";
+
+typedef struct {
+    uint32_t    count;
+    int64_t     min_us;
+    int64_t     max_us;
+    int64_t     sum_us;
+} start_stat_t;
+
+static const char *pipe_names[PIPE_TYPE_MAX] = {
+    [PIPE_FILE2HTTP]    = "file2http",
+    [PIPE_HTTP2FILE]    = "http2file",
+    [PIPE_FILE2PLAYER]  = "file2player",
+    [PIPE_HTTP2PLAYER]  = "http2player",
+    [PIPE_TONE2PLAYER]  = "tone2player",
+};
+
+static start_stat_t start_stats[PIPE_TYPE_MAX];
+
+void pipeline_start_record(pipe_type_t type, int64_t start_us){
+    start_stat_t *st = &start_stats[type];
+    int64_t us = esp_timer_get_time() - start_us;
+
+    if (st->count == 0 || us < st->min_us) {
+        st->min_us = us;
+    }
+    if (us > st->max_us) {
+        st->max_us = us;
+    }
+    st->sum_us += us;
+    st->count++;
+    ESP_LOGI(TAG, "%s job start %lld us (min %lld, avg %lld, max %lld, n=%u)", pipe_names[type],
+             us, st->min_us, st->sum_us / st->count, st->max_us, st->count);
+}
@@ -10,29 +10,54 @@
 
 
 #include "board.h"
+#include "audio_element.h"
+#include "audio_pipeline.h"
+#include "reactor.h"
+
+// job-start latency, from start_*/run_* entry to audio_pipeline_run returning
+void pipeline_start_record(pipe_type_t type, int64_t start_us);
 
 // header of file2http
 void init_file2http();
 void deinit_file2http();
-void run_file2http(const char *src_url, const char *dst_url);
+// returns once the pipeline runs, the result is reported to done; an error when the last run did not stop
+esp_err_t start_file2http(const char *src_url, const char *dst_url, reactor_done_cb_t done);
 void enable_file2http(bool enable);
+void abort_file2http();
+// bytes uploaded since boot
+uint64_t file2http_bytes_total();
 
 // header of file2player
 void init_file2player();
 void deinit_file2player();
-void run_file2player(const char *src_url, const char *dst_url);
+// returns once the pipeline runs, the result is reported to done; an error when the last run did not stop
+esp_err_t start_file2player(const char *src_url, const char *dst_url, reactor_done_cb_t done);
 void enable_file2player(bool enable);
+void abort_file2player();
 
 // header of http2player
 void init_http2player();
 void deinit_http2player();
-void run_http2player(const char *src_url, const char *dst_url);
+// returns once the pipeline runs, the result is reported to done; an error when the last run did not stop
+esp_err_t start_http2player(const char *src_url, const char *dst_url, reactor_done_cb_t done);
 void enable_http2player(bool enable);
+void abort_http2player();
 
 // header of http2file
 void init_http2file();
 void deinit_http2file();
-void run_http2file(const char *src_url, const char *dst_url);
+// returns once the pipeline runs, the result is reported to done; an error when the last run did not stop
+esp_err_t start_http2file(const char *src_url, const char *dst_url, reactor_done_cb_t done);
 void enable_http2file(bool enable);
+void abort_http2file();
+
+// header of tone2player
+void init_tone2player();
+void deinit_tone2player();
+/*
+ * Blocks until the tone is played out, up to the reactor deadline of 5 s,
+ * not from the reactor task. Calls from other tasks wait their turn.
+ */
+void run_tone2player(const char *src_url, const char *dst_url);
 
 #endif /* MAIN_PIPLINE_WORK_H_ */
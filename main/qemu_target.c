@@ -0,0 +1,284 @@
+#include "main.h"
+#include "qemu_target.h"
+#include "mem_track.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_eth.h"
+#include "esp_http_client.h"
+#include "esp_vfs_fat.h"
+#include "audio_idf_version.h"
+#include "diskio_impl.h"
+#include "ff.h"
+#include "sdkconfig.h"
+
+#if CONFIG_QEMU_TARGET
+
+#if !CONFIG_ETH_USE_OPENETH
+#error "The QEMU target needs CONFIG_ETH_USE_OPENETH, build with sdkconfig.qemu"
+#endif
+
+static const char *TAG = "qemu_target";
+
+#define QEMU_SD_BASE        "/sdcard"
+#define QEMU_SD_MAX_FILES   (8)
+#define QEMU_SECTOR_SIZE    (512)
+#define QEMU_GOT_IP         BIT0
+#define QEMU_FETCH_BUF      (1024)
+// i2s stand-ins move this much audio per process call
+#define QEMU_I2S_FRAME_MS   (10)
+// further behind than this the clock restarts instead of catching up
+#define QEMU_I2S_SLIP_MS    (100)
+
+typedef struct {
+    int         bytes_per_s;
+    int64_t     next_us;
+} qemu_i2s_t;
+
+static uint8_t              *ramdisk;
+static uint32_t             ramdisk_sectors;
+static EventGroupHandle_t   net_evt;
+
+static DSTATUS _disk_init(BYTE pdrv)
+{
+    return 0;
+}
+
+static DSTATUS _disk_status(BYTE pdrv)
+{
+    return 0;
+}
+
+static DRESULT _disk_read(BYTE pdrv, BYTE *buf, DWORD sector, UINT count)
+{
+    if (sector + count > ramdisk_sectors) {
+        return RES_PARERR;
+    }
+    memcpy(buf, ramdisk + sector * QEMU_SECTOR_SIZE, count * QEMU_SECTOR_SIZE);
+    return RES_OK;
+}
+
+static DRESULT _disk_write(BYTE pdrv, const BYTE *buf, DWORD sector, UINT count)
+{
+    if (sector + count > ramdisk_sectors) {
+        return RES_PARERR;
+    }
+    memcpy(ramdisk + sector * QEMU_SECTOR_SIZE, buf, count * QEMU_SECTOR_SIZE);
+    return RES_OK;
+}
+
+static DRESULT _disk_ioctl(BYTE pdrv, BYTE cmd, void *buf)
+{
+    switch (cmd) {
+        case CTRL_SYNC:
+            return RES_OK;
+        case GET_SECTOR_COUNT:
+            *(DWORD *)buf = ramdisk_sectors;
+            return RES_OK;
+        case GET_SECTOR_SIZE:
+            *(WORD *)buf = QEMU_SECTOR_SIZE;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *(DWORD *)buf = 1;
+            return RES_OK;
+        default:
+            return RES_PARERR;
+    }
+}
+
+static const ff_diskio_impl_t ramdisk_impl = {
+    .init = _disk_init,
+    .status = _disk_status,
+    .read = _disk_read,
+    .write = _disk_write,
+    .ioctl = _disk_ioctl,
+};
+
+void init_qemu_sdcard(){
+    BYTE pdrv = 0xFF;
+    char drv[3] = { 0 };
+    FATFS *fs = NULL;
+
+    ramdisk_sectors = CONFIG_QEMU_RAMDISK_KB * 1024 / QEMU_SECTOR_SIZE;
+    ramdisk = mem_calloc(MEM_SYS_SYSTEM, ramdisk_sectors, QEMU_SECTOR_SIZE);
+    mem_assert(ramdisk);
+    ESP_ERROR_CHECK(ff_diskio_get_drive(&pdrv));
+    ff_diskio_register(pdrv, &ramdisk_impl);
+    drv[0] = '0' + pdrv;
+    drv[1] = ':';
+    ESP_ERROR_CHECK(esp_vfs_fat_register(QEMU_SD_BASE, drv, QEMU_SD_MAX_FILES, &fs));
+
+    // a fresh volume every boot, runs must not see each other's files
+    void *work = mem_malloc(MEM_SYS_SYSTEM, FF_MAX_SS);
+    mem_assert(work);
+    const MKFS_PARM opt = { .fmt = FM_ANY };
+    FRESULT res = f_mkfs(drv, &opt, work, FF_MAX_SS);
+    mem_free(work);
+    if (res == FR_OK) {
+        res = f_mount(fs, drv, 1);
+    }
+    if (res != FR_OK) {
+        ESP_LOGE(TAG, "RAM FAT on %s failed (%d)", QEMU_SD_BASE, res);
+        return;
+    }
+    ESP_LOGI(TAG, "RAM FAT on %s, %d KB", QEMU_SD_BASE, CONFIG_QEMU_RAMDISK_KB);
+}
+
+static void _got_ip(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    ip_event_got_ip_t *ev = (ip_event_got_ip_t *)data;
+    ESP_LOGI(TAG, "open_eth address " IPSTR, IP2STR(&ev->ip_info.ip));
+    xEventGroupSetBits(net_evt, QEMU_GOT_IP);
+}
+
+void init_qemu_network(){
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_CHECK(err);
+    }
+    net_evt = xEventGroupCreate();
+    mem_assert(net_evt);
+
+    esp_netif_config_t netif_cfg = ESP_NETIF_DEFAULT_ETH();
+    esp_netif_t *netif = esp_netif_new(&netif_cfg);
+    eth_mac_config_t mac_cfg = ETH_MAC_DEFAULT_CONFIG();
+    eth_phy_config_t phy_cfg = ETH_PHY_DEFAULT_CONFIG();
+    // the emulated PHY has no link negotiation to wait for
+    phy_cfg.autonego_timeout_ms = 100;
+    esp_eth_mac_t *mac = esp_eth_mac_new_openeth(&mac_cfg);
+    esp_eth_phy_t *phy = esp_eth_phy_new_dp83848(&phy_cfg);
+    esp_eth_config_t eth_cfg = ETH_DEFAULT_CONFIG(mac, phy);
+    esp_eth_handle_t eth = NULL;
+    ESP_ERROR_CHECK(esp_eth_driver_install(&eth_cfg, &eth));
+#if (ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0))
+    ESP_ERROR_CHECK(esp_eth_set_default_handlers(netif));
+#endif
+    ESP_ERROR_CHECK(esp_netif_attach(netif, esp_eth_new_netif_glue(eth)));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, _got_ip, NULL));
+    ESP_ERROR_CHECK(esp_eth_start(eth));
+
+    ESP_LOGI(TAG, "Start and wait for open_eth network");
+    xEventGroupWaitBits(net_evt, QEMU_GOT_IP, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+static bool _fetch_file(const char *url, const char *path)
+{
+    esp_http_client_config_t cfg = {
+        .url = url,
+        .timeout_ms = 5000,
+    };
+    esp_http_client_handle_t http = esp_http_client_init(&cfg);
+    char *buf = mem_malloc(MEM_SYS_NET, QEMU_FETCH_BUF);
+    FILE *fp = NULL;
+    int total = 0;
+    int ret = -1;
+
+    if (http == NULL || buf == NULL || esp_http_client_open(http, 0) != ESP_OK) {
+        goto out;
+    }
+    esp_http_client_fetch_headers(http);
+    if (esp_http_client_get_status_code(http) != 200) {
+        goto out;
+    }
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        goto out;
+    }
+    while ((ret = esp_http_client_read(http, buf, QEMU_FETCH_BUF)) > 0) {
+        if (fwrite(buf, 1, ret, fp) != (size_t)ret) {
+            ret = -1;
+            break;
+        }
+        total += ret;
+    }
+    fclose(fp);
+    ESP_LOGI(TAG, "Fetched %s into %s, %d bytes", url, path, total);
+out:
+    if (http) {
+        esp_http_client_close(http);
+        esp_http_client_cleanup(http);
+    }
+    mem_free(buf);
+    return fp != NULL && ret == 0;
+}
+
+void init_qemu_inputs(){
+    char url[64];
+
+    snprintf(url, sizeof(url), "http://%s:%d/qemu/replay.wav", CONFIG_TARGET_URL, CONFIG_TARGET_PORT);
+    if (!_fetch_file(url, CONFIG_REPLAY_FILE)) {
+        ESP_LOGW(TAG, "No replay input at %s", url);
+    }
+}
+
+static void _pace(qemu_i2s_t *q, int bytes)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (q->next_us == 0 || now - q->next_us > QEMU_I2S_SLIP_MS * 1000) {
+        q->next_us = now;
+    }
+    q->next_us += (int64_t)bytes * 1000000 / q->bytes_per_s;
+    int64_t ahead_ms = (q->next_us - now) / 1000;
+    if (ahead_ms > 0) {
+        vTaskDelay(pdMS_TO_TICKS(ahead_ms));
+    }
+}
+
+static audio_element_err_t _reader_process(audio_element_handle_t self, char *buffer, int len)
+{
+    memset(buffer, 0, len);
+    _pace(audio_element_getdata(self), len);
+    return audio_element_output(self, buffer, len);
+}
+
+static audio_element_err_t _writer_process(audio_element_handle_t self, char *buffer, int len)
+{
+    int ret = audio_element_input(self, buffer, len);
+    if (ret > 0) {
+        _pace(audio_element_getdata(self), ret);
+    }
+    return ret;
+}
+
+static esp_err_t _i2s_destroy(audio_element_handle_t self)
+{
+    mem_free(audio_element_getdata(self));
+    return ESP_OK;
+}
+
+audio_element_handle_t qemu_i2s_stream_init(audio_stream_type_t type, int bytes_per_s, int core, int prio){
+    qemu_i2s_t *q = mem_calloc(MEM_SYS_PIPELINE, 1, sizeof(qemu_i2s_t));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->bytes_per_s = bytes_per_s;
+
+    audio_element_cfg_t cfg = DEFAULT_AUDIO_ELEMENT_CONFIG();
+    cfg.process = type == AUDIO_STREAM_READER ? _reader_process : _writer_process;
+    cfg.destroy = _i2s_destroy;
+    cfg.buffer_len = bytes_per_s * QEMU_I2S_FRAME_MS / 1000;
+    cfg.task_stack = 3 * 1024;
+    cfg.task_core = core;
+    cfg.task_prio = prio;
+    cfg.out_rb_size = 8 * 1024;
+    cfg.tag = type == AUDIO_STREAM_READER ? "qemu_i2s_r" : "qemu_i2s_w";
+    audio_element_handle_t el = audio_element_init(&cfg);
+    if (el == NULL) {
+        mem_free(q);
+        return NULL;
+    }
+    audio_element_setdata(el, q);
+    return el;
+}
+
+#endif /* CONFIG_QEMU_TARGET */
@@ -0,0 +1,30 @@
+/*
+ * qemu_target.h
+ *
+ * Stand-ins for what the ESP32 QEMU machine does not emulate, built with
+ * CONFIG_QEMU_TARGET: a RAM backed FAT volume on /sdcard, the open_eth NIC
+ * instead of Wi-Fi, and i2s elements that produce silence and discard
+ * playback at the codec rate. tools/qemu_scenario.py boots the image
+ * against a local mock server and drives it over the control server.
+ */
+
+#ifndef MAIN_QEMU_TARGET_H_
+#define MAIN_QEMU_TARGET_H_
+
+#include "audio_common.h"
+#include "audio_element.h"
+
+// RAM backed FAT on /sdcard, instead of audio_board_sdcard_init
+void init_qemu_sdcard();
+// open_eth up with a lease from the QEMU user network, blocks until then
+void init_qemu_network();
+// replay input served by the scenario runner into CONFIG_REPLAY_FILE, if any
+void init_qemu_inputs();
+
+/**
+ * Reader outputs silence, writer discards its input, both paced at
+ * bytes_per_s against esp_timer so the pipelines run at the codec rate.
+ */
+audio_element_handle_t qemu_i2s_stream_init(audio_stream_type_t type, int bytes_per_s, int core, int prio);
+
+#endif /* MAIN_QEMU_TARGET_H_ */
@@ -0,0 +1,308 @@
+#include "main.h"
+#include "reactor.h"
+#include "cpu_load.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "audio_mem.h"
+
+static const char *TAG = "reactor";
+
+#define REACTOR_TICK_MS         (100)
+#define REACTOR_DRAIN_TICK_MS   (10)
+#define REACTOR_DRAIN_MS        (1000)
+// an aborted pipeline that does not report STOPPED in time is given up on
+#define REACTOR_ABORT_GRACE_MS  (2000)
+// every element of every attached pipeline adds its event queue to the set
+#define REACTOR_QUEUE_SET_SIZE  (16 * DEFAULT_AUDIO_EVENT_IFACE_SIZE)
+#define REACTOR_TASK_STACK      (4 * 1024)
+
+typedef enum {
+    OP_IDLE = 0,
+    OP_RUNNING,
+    OP_ABORTING,
+    OP_DRAINING,
+} op_state_t;
+
+typedef struct {
+    volatile op_state_t state;
+    const reactor_op_t  *op;
+    reactor_done_cb_t   done;
+    // reported once an abort or drain completes
+    reactor_result_t    result;
+    int64_t             start_us;
+    int64_t             phase_us;
+    int64_t             progress_us;
+    int64_t             byte_pos;
+} op_ctx_t;
+
+static audio_event_iface_handle_t   reactor_evt;
+static op_ctx_t                     ops[PIPE_TYPE_MAX];
+static portMUX_TYPE                 ops_lock = portMUX_INITIALIZER_UNLOCKED;
+static reactor_stats_t              stats;
+static uint64_t                     dispatch_us_sum;
+
+static const char *pipe_name(pipe_type_t type)
+{
+    static const char *names[PIPE_TYPE_MAX] = {
+        [PIPE_FILE2HTTP]    = "file2http",
+        [PIPE_HTTP2FILE]    = "http2file",
+        [PIPE_FILE2PLAYER]  = "file2player",
+        [PIPE_HTTP2PLAYER]  = "http2player",
+        [PIPE_TONE2PLAYER]  = "tone2player",
+    };
+    return names[type];
+}
+
+const char *reactor_result_str(reactor_result_t result){
+    switch (result) {
+        case REACTOR_RUNNING:   return "running";
+        case REACTOR_DONE:      return "done";
+        case REACTOR_ABORTED:   return "aborted";
+        case REACTOR_TIMEOUT:   return "timeout";
+        case REACTOR_STALLED:   return "stalled";
+        default:                return "error";
+    }
+}
+
+static void _complete(pipe_type_t type)
+{
+    op_ctx_t *ctx = &ops[type];
+    reactor_result_t result = ctx->result;
+    reactor_done_cb_t done = ctx->done;
+
+    stats.completed[type]++;
+    ESP_LOGI(TAG, "%s %s after %lld ms", pipe_name(type), reactor_result_str(result),
+             (esp_timer_get_time() - ctx->start_us) / 1000);
+    portENTER_CRITICAL(&ops_lock);
+    ctx->state = OP_IDLE;
+    portEXIT_CRITICAL(&ops_lock);
+    if (done) {
+        done(type, result);
+    }
+}
+
+// transition to OP_ABORTING, the caller stops the pipeline
+static bool _begin_abort(op_ctx_t *ctx, reactor_result_t result)
+{
+    bool stop = false;
+
+    portENTER_CRITICAL(&ops_lock);
+    if (ctx->state == OP_RUNNING) {
+        ctx->state = OP_ABORTING;
+        ctx->result = result;
+        ctx->phase_us = esp_timer_get_time();
+        stop = true;
+    } else if (ctx->state == OP_DRAINING) {
+        // already finished, dropping the queued output ends the drain
+        ctx->result = result;
+        stop = true;
+    }
+    portEXIT_CRITICAL(&ops_lock);
+    return stop;
+}
+
+static void _final(pipe_type_t type, reactor_result_t result)
+{
+    op_ctx_t *ctx = &ops[type];
+
+    if (ctx->state == OP_ABORTING) {
+        // STOPPED after a deadline or cancel, report why it was stopped
+        _complete(type);
+        return;
+    }
+    ctx->result = result;
+    if (result == REACTOR_DONE && ctx->op->drained) {
+        portENTER_CRITICAL(&ops_lock);
+        if (ctx->state == OP_RUNNING) {
+            ctx->state = OP_DRAINING;
+            ctx->phase_us = esp_timer_get_time();
+        }
+        portEXIT_CRITICAL(&ops_lock);
+        return;
+    }
+    _complete(type);
+}
+
+static void _dispatch(audio_event_iface_msg_t *msg)
+{
+    bool active = false;
+
+    if (msg->source_type != AUDIO_ELEMENT_TYPE_ELEMENT) {
+        ESP_LOGD(TAG, "CMD:%d Type: %d", msg->cmd, msg->source_type);
+        return;
+    }
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        op_state_t state = ops[t].state;
+        if (state != OP_RUNNING && state != OP_ABORTING) {
+            continue;
+        }
+        active = true;
+        reactor_result_t result = ops[t].op->on_event(msg);
+        if (result != REACTOR_RUNNING) {
+            _final(t, result);
+        }
+    }
+    if (!active) {
+        stats.orphans++;
+    }
+}
+
+static void _expire(pipe_type_t type, reactor_result_t result)
+{
+    op_ctx_t *ctx = &ops[type];
+
+    if (result == REACTOR_TIMEOUT) {
+        stats.timeouts[type]++;
+    } else {
+        stats.stalls[type]++;
+    }
+    ESP_LOGW(TAG, "%s %s, abort it", pipe_name(type), reactor_result_str(result));
+    if (_begin_abort(ctx, result)) {
+        ctx->op->abort();
+    }
+}
+
+static void _check_timers()
+{
+    int64_t now = esp_timer_get_time();
+
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        op_ctx_t *ctx = &ops[t];
+        const reactor_op_t *op = ctx->op;
+
+        switch (ctx->state) {
+            case OP_RUNNING:
+                if (op->deadline_ms && now - ctx->start_us > op->deadline_ms * 1000LL) {
+                    _expire(t, REACTOR_TIMEOUT);
+                    break;
+                }
+                if ((op->progress_el || op->progress) && op->stall_ms) {
+                    int64_t pos;
+                    bool finished = false;
+                    if (op->progress) {
+                        pos = (int64_t)op->progress();
+                    } else {
+                        audio_element_info_t info = {0};
+                        audio_element_getinfo(op->progress_el, &info);
+                        pos = info.byte_pos;
+                        // a source that reached its end waits for the rest of the pipeline
+                        finished = audio_element_get_state(op->progress_el) == AEL_STATE_FINISHED;
+                    }
+                    if (pos != ctx->byte_pos || finished) {
+                        ctx->byte_pos = pos;
+                        ctx->progress_us = now;
+                    } else if (now - ctx->progress_us > op->stall_ms * 1000LL) {
+                        _expire(t, REACTOR_STALLED);
+                    }
+                }
+                break;
+            case OP_ABORTING:
+                if (now - ctx->phase_us > REACTOR_ABORT_GRACE_MS * 1000LL) {
+                    ESP_LOGE(TAG, "%s did not stop in %d ms", pipe_name(t), REACTOR_ABORT_GRACE_MS);
+                    _complete(t);
+                }
+                break;
+            case OP_DRAINING:
+                if (op->drained()) {
+                    _complete(t);
+                } else if (now - ctx->phase_us > REACTOR_DRAIN_MS * 1000LL) {
+                    ESP_LOGW(TAG, "%s drain timeout", pipe_name(t));
+                    _complete(t);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+static bool _draining()
+{
+    for (int t = 0; t < PIPE_TYPE_MAX; t++) {
+        if (ops[t].state == OP_DRAINING) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void reactor_task(void *args)
+{
+    while (1) {
+        audio_event_iface_msg_t msg;
+        TickType_t wait = pdMS_TO_TICKS(_draining() ? REACTOR_DRAIN_TICK_MS : REACTOR_TICK_MS);
+
+        if (audio_event_iface_listen(reactor_evt, &msg, wait) == ESP_OK) {
+            int64_t start = esp_timer_get_time();
+            _dispatch(&msg);
+            uint32_t us = esp_timer_get_time() - start;
+            stats.events++;
+            dispatch_us_sum += us;
+            stats.dispatch_us_avg = dispatch_us_sum / stats.events;
+            if (us > stats.dispatch_us_max) {
+                stats.dispatch_us_max = us;
+            }
+        }
+        _check_timers();
+    }
+}
+
+void init_reactor(){
+    audio_event_iface_cfg_t evt_cfg = AUDIO_EVENT_IFACE_DEFAULT_CFG();
+    evt_cfg.queue_set_size = REACTOR_QUEUE_SET_SIZE;
+    reactor_evt = audio_event_iface_init(&evt_cfg);
+    mem_assert(reactor_evt);
+
+    if (xTaskCreatePinnedToCore(reactor_task, "reactor", REACTOR_TASK_STACK, NULL,
+                                TASK_PRIO(REACTOR), NULL, TASK_CORE(REACTOR)) != pdPASS) {
+        ESP_LOGE(TAG, "Create reactor task failed");
+    }
+}
+
+void reactor_attach(audio_element_handle_t el){
+    if (audio_element_msg_set_listener(el, reactor_evt) != ESP_OK) {
+        ESP_LOGE(TAG, "Listen to %s failed", audio_element_get_tag(el));
+    }
+}
+
+void reactor_detach(audio_element_handle_t el){
+    audio_element_msg_remove_listener(el, reactor_evt);
+}
+
+void reactor_start(pipe_type_t type, const reactor_op_t *op, reactor_done_cb_t done){
+    op_ctx_t *ctx = &ops[type];
+
+    if (ctx->state != OP_IDLE) {
+        ESP_LOGE(TAG, "%s is still active", pipe_name(type));
+    }
+    ctx->op = op;
+    ctx->done = done;
+    ctx->result = REACTOR_DONE;
+    ctx->start_us = esp_timer_get_time();
+    ctx->progress_us = ctx->start_us;
+    ctx->byte_pos = -1;
+    portENTER_CRITICAL(&ops_lock);
+    ctx->state = OP_RUNNING;
+    portEXIT_CRITICAL(&ops_lock);
+}
+
+bool reactor_is_active(pipe_type_t type){
+    return ops[type].state != OP_IDLE;
+}
+
+void reactor_abort(pipe_type_t type){
+    op_ctx_t *ctx = &ops[type];
+
+    if (_begin_abort(ctx, REACTOR_ABORTED)) {
+        ctx->op->abort();
+    }
+}
+
+void reactor_get_stats(reactor_stats_t *out){
+    memcpy(out, &stats, sizeof(stats));
+}
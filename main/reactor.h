@@ -0,0 +1,82 @@
+/*
+ * reactor.h
+ *
+ * One task listens to the element events of every pipeline instead of each
+ * run_* blocking in its own audio_event_iface_listen loop. A started
+ * pipeline registers an operation with a deadline and a stall limit, the
+ * reactor routes element events to it, aborts it when it overruns and
+ * reports the result through a completion callback.
+ */
+
+#ifndef MAIN_REACTOR_H_
+#define MAIN_REACTOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "audio_element.h"
+#include "audio_event_iface.h"
+#include "audio_pipeline.h"
+
+typedef enum {
+    PIPE_FILE2HTTP = 0,
+    PIPE_HTTP2FILE,
+    PIPE_FILE2PLAYER,
+    PIPE_HTTP2PLAYER,
+    PIPE_TONE2PLAYER,
+    PIPE_TYPE_MAX,
+} pipe_type_t;
+
+typedef enum {
+    REACTOR_RUNNING = 0,
+    REACTOR_DONE,
+    REACTOR_ABORTED,
+    REACTOR_TIMEOUT,
+    REACTOR_STALLED,
+    REACTOR_ERROR,
+} reactor_result_t;
+
+// called from the reactor task, must not block
+typedef void (*reactor_done_cb_t)(pipe_type_t type, reactor_result_t result);
+
+typedef struct {
+    // element whose byte position must advance, NULL to skip stall detection
+    audio_element_handle_t  progress_el;
+    // optional, a byte count that must advance instead; reaching the end does not count
+    uint64_t                (*progress)();
+    uint32_t                deadline_ms;
+    uint32_t                stall_ms;
+    // REACTOR_RUNNING while the operation goes on, a final result otherwise
+    reactor_result_t        (*on_event)(audio_event_iface_msg_t *msg);
+    // optional, polled after REACTOR_DONE until the output is played out
+    bool                    (*drained)();
+    void                    (*abort)();
+} reactor_op_t;
+
+typedef struct {
+    uint32_t events;
+    // element events nobody is waiting for, e.g. late ones of an aborted job
+    uint32_t orphans;
+    uint32_t dispatch_us_max;
+    uint32_t dispatch_us_avg;
+    uint32_t completed[PIPE_TYPE_MAX];
+    uint32_t timeouts[PIPE_TYPE_MAX];
+    uint32_t stalls[PIPE_TYPE_MAX];
+} reactor_stats_t;
+
+void init_reactor();
+
+// route the events of el to the reactor, once per element even if shared
+void reactor_attach(audio_element_handle_t el);
+void reactor_detach(audio_element_handle_t el);
+
+// register before audio_pipeline_run so no event is missed
+void reactor_start(pipe_type_t type, const reactor_op_t *op, reactor_done_cb_t done);
+bool reactor_is_active(pipe_type_t type);
+// stop the operation, op->abort runs right away, done is reported by the reactor
+void reactor_abort(pipe_type_t type);
+
+const char *reactor_result_str(reactor_result_t result);
+void reactor_get_stats(reactor_stats_t *stats);
+
+#endif /* MAIN_REACTOR_H_ */
@@ -0,0 +1,310 @@
+#include "replay.h"
+#include "wav_header.h"
+#include "mem_track.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "replay";
+
+// file frames converted per step, bounds the scratch buffer
+#define REPLAY_CHUNK_FRAMES (256)
+#define REPLAY_NAME_LEN     (48)
+
+typedef struct {
+    uint32_t    pos_ms;
+    uint32_t    wall_ms;
+    int32_t     arg;
+    uint8_t     ev;
+} replay_ev_rec_t;
+
+typedef struct {
+    char        name[REPLAY_NAME_LEN];
+    uint32_t    bytes;
+    uint32_t    pos_ms;
+    bool        kept;
+} replay_file_rec_t;
+
+static const char *ev_names[REPLAY_EV_MAX] = {
+    [REPLAY_EV_WAKE]        = "wake",
+    [REPLAY_EV_WAKE_END]    = "wake_end",
+    [REPLAY_EV_VAD_START]   = "vad_start",
+    [REPLAY_EV_VAD_END]     = "vad_end",
+    [REPLAY_EV_COMMAND]     = "command",
+};
+
+static const char *state_names[] = { "idle", "running", "tail", "done" };
+
+// source, owned by the reader once running
+static FILE                 *fp;
+static wav_info_t           info;
+static long                 data_start;
+static uint32_t             data_left;
+static int16_t              *scratch;
+static int                  loops_left;
+static uint32_t             tail_left;
+
+static volatile replay_state_t  state = REPLAY_IDLE;
+static volatile bool            stop_req;
+static char                     path[REPLAY_NAME_LEN];
+static int                      speed;
+static int64_t                  start_us;
+// frames fed so far, the time base of the report
+static volatile uint32_t        pos;
+
+static portMUX_TYPE             lock = portMUX_INITIALIZER_UNLOCKED;
+static replay_ev_rec_t          events[REPLAY_MAX_EVENTS];
+static replay_file_rec_t        files[REPLAY_MAX_FILES];
+static uint32_t                 num_events;
+static uint32_t                 num_files;
+static uint32_t                 dropped;
+
+static uint32_t _pos_ms()
+{
+    return (uint64_t)pos * 1000 / REPLAY_SAMPLE_RATE;
+}
+
+static void _finish()
+{
+    fclose(fp);
+    fp = NULL;
+    mem_free(scratch);
+    scratch = NULL;
+    __atomic_store_n(&state, REPLAY_DONE, __ATOMIC_RELEASE);
+    replay_log();
+}
+
+bool replay_start(const char *file, int speed_pct, int loops){
+    if (replay_active()) {
+        ESP_LOGW(TAG, "Replay of %s still running", path);
+        return false;
+    }
+    fp = fopen(file, "rb");
+    if (fp == NULL) {
+        ESP_LOGE(TAG, "Open %s failed", file);
+        return false;
+    }
+    if (!wav_header_read(fp, &info) || info.bits != 16 || info.rate != REPLAY_SAMPLE_RATE || info.channels == 0) {
+        ESP_LOGE(TAG, "%s is not 16kHz/16bit PCM WAV", file);
+        fclose(fp);
+        fp = NULL;
+        return false;
+    }
+    scratch = mem_malloc(MEM_SYS_RECORDER, REPLAY_CHUNK_FRAMES * info.channels * sizeof(int16_t));
+    if (scratch == NULL) {
+        fclose(fp);
+        fp = NULL;
+        return false;
+    }
+    data_start = ftell(fp);
+    data_left = info.data_size;
+    loops_left = loops > 0 ? loops : 1;
+    tail_left = REPLAY_SAMPLE_RATE * REPLAY_TAIL_MS / 1000;
+    strncpy(path, file, REPLAY_NAME_LEN - 1);
+    speed = speed_pct > 0 ? speed_pct : 0;
+
+    num_events = 0;
+    num_files = 0;
+    dropped = 0;
+    pos = 0;
+    stop_req = false;
+    start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Replay %s, %u ch, %u ms x%d at %d%%", path, info.channels,
+             (uint32_t)((uint64_t)info.data_size * 1000 / (REPLAY_SAMPLE_RATE * 2 * info.channels)),
+             loops_left, speed);
+    // the reader picks the source up from here
+    __atomic_store_n(&state, REPLAY_RUNNING, __ATOMIC_RELEASE);
+    return true;
+}
+
+void replay_stop(){
+    // the reader closes the file, it may be inside fread
+    stop_req = true;
+}
+
+bool replay_active(){
+    replay_state_t s = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+    return s == REPLAY_RUNNING || s == REPLAY_TAIL;
+}
+
+replay_state_t replay_get_state(){
+    return state;
+}
+
+// up to n frames from the file into out, 0 at the end of the data
+static int _read_file(int16_t *out, int n, int channels)
+{
+    const int frame_bytes = info.channels * sizeof(int16_t);
+
+    if (n > REPLAY_CHUNK_FRAMES) {
+        n = REPLAY_CHUNK_FRAMES;
+    }
+    if (n > data_left / frame_bytes) {
+        n = data_left / frame_bytes;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    int16_t *in = info.channels == channels ? out : scratch;
+    n = fread(in, frame_bytes, n, fp);
+    data_left -= n * frame_bytes;
+    if (in == out) {
+        return n;
+    }
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < channels; c++) {
+            out[i * channels + c] = c < info.channels ? in[i * info.channels + c] : 0;
+        }
+    }
+    return n;
+}
+
+int replay_read(int16_t *buf, int len, int channels){
+    replay_state_t s = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+    const int frames = len / (channels * sizeof(int16_t));
+    int done = 0;
+
+    if (s != REPLAY_RUNNING && s != REPLAY_TAIL) {
+        return 0;
+    }
+    if (stop_req) {
+        ESP_LOGI(TAG, "Replay stopped at %u ms", _pos_ms());
+        _finish();
+        return 0;
+    }
+    while (done < frames) {
+        int16_t *out = buf + done * channels;
+        int n = frames - done;
+        if (s == REPLAY_RUNNING) {
+            n = _read_file(out, n, channels);
+            if (n == 0) {
+                if (--loops_left > 0 && fseek(fp, data_start, SEEK_SET) == 0) {
+                    data_left = info.data_size;
+                } else {
+                    s = REPLAY_TAIL;
+                    __atomic_store_n(&state, s, __ATOMIC_RELEASE);
+                }
+                continue;
+            }
+        } else {
+            if (tail_left == 0) {
+                break;
+            }
+            if (n > tail_left) {
+                n = tail_left;
+            }
+            memset(out, 0, n * channels * sizeof(int16_t));
+            tail_left -= n;
+        }
+        done += n;
+    }
+    if (done < frames) {
+        memset(buf + done * channels, 0, (frames - done) * channels * sizeof(int16_t));
+    }
+    pos += frames;
+    if (s == REPLAY_TAIL && tail_left == 0) {
+        _finish();
+        return len;
+    }
+
+    if (speed > 0) {
+        // absolute schedule, a late read is made up by the next ones
+        int64_t due = start_us + (int64_t)pos * 1000000 * 100 / ((int64_t)REPLAY_SAMPLE_RATE * speed);
+        int64_t ahead_us = due - esp_timer_get_time();
+        if (ahead_us >= portTICK_PERIOD_MS * 1000) {
+            vTaskDelay(pdMS_TO_TICKS(ahead_us / 1000));
+        }
+    }
+    return len;
+}
+
+void replay_mark(replay_event_t ev, int arg){
+    if (!replay_active()) {
+        return;
+    }
+    uint32_t wall_ms = (esp_timer_get_time() - start_us) / 1000;
+    uint32_t pos_ms = _pos_ms();
+
+    portENTER_CRITICAL(&lock);
+    if (num_events < REPLAY_MAX_EVENTS) {
+        events[num_events] = (replay_ev_rec_t) { .pos_ms = pos_ms, .wall_ms = wall_ms, .arg = arg, .ev = ev };
+        __atomic_store_n(&num_events, num_events + 1, __ATOMIC_RELEASE);
+    } else {
+        dropped++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void replay_mark_file(const char *name, uint32_t bytes, bool kept){
+    if (!replay_active()) {
+        return;
+    }
+    uint32_t pos_ms = _pos_ms();
+
+    portENTER_CRITICAL(&lock);
+    if (num_files < REPLAY_MAX_FILES) {
+        replay_file_rec_t *f = &files[num_files];
+        strncpy(f->name, name, REPLAY_NAME_LEN - 1);
+        f->name[REPLAY_NAME_LEN - 1] = 0;
+        f->bytes = bytes;
+        f->pos_ms = pos_ms;
+        f->kept = kept;
+        __atomic_store_n(&num_files, num_files + 1, __ATOMIC_RELEASE);
+    } else {
+        dropped++;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+const char *replay_event_str(replay_event_t ev){
+    return ev < REPLAY_EV_MAX ? ev_names[ev] : "?";
+}
+
+int replay_json(char *buf, size_t size){
+    size_t len = 0;
+    uint32_t ne = __atomic_load_n(&num_events, __ATOMIC_ACQUIRE);
+    uint32_t nf = __atomic_load_n(&num_files, __ATOMIC_ACQUIRE);
+
+#define JSON_PUT(...) do { \
+        if (len < size) { \
+            len += snprintf(buf + len, size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+    JSON_PUT("{\"state\":\"%s\",\"file\":\"%s\",\"speed\":%d,\"position_ms\":%u,\"dropped\":%u,\"events\":[",
+             state_names[state], path, speed, _pos_ms(), dropped);
+    for (uint32_t i = 0; i < ne; i++) {
+        JSON_PUT("%s{\"event\":\"%s\",\"pos_ms\":%u,\"wall_ms\":%u,\"arg\":%d}", i ? "," : "",
+                 replay_event_str(events[i].ev), events[i].pos_ms, events[i].wall_ms, events[i].arg);
+    }
+    JSON_PUT("],\"files\":[");
+    for (uint32_t i = 0; i < nf; i++) {
+        JSON_PUT("%s{\"name\":\"%s\",\"bytes\":%u,\"pos_ms\":%u,\"kept\":%s}", i ? "," : "",
+                 files[i].name, files[i].bytes, files[i].pos_ms, files[i].kept ? "true" : "false");
+    }
+    JSON_PUT("]}");
+#undef JSON_PUT
+    return len < size ? len : size - 1;
+}
+
+void replay_log(){
+    uint32_t ne = __atomic_load_n(&num_events, __ATOMIC_ACQUIRE);
+    uint32_t nf = __atomic_load_n(&num_files, __ATOMIC_ACQUIRE);
+
+    ESP_LOGI(TAG, "Replay %s %s at %u ms, %u events, %u files, %u dropped",
+             path, state_names[state], _pos_ms(), ne, nf, dropped);
+    for (uint32_t i = 0; i < ne; i++) {
+        ESP_LOGI(TAG, "  %6u ms  %-9s arg %d (+%u ms wall)", events[i].pos_ms,
+                 replay_event_str(events[i].ev), events[i].arg, events[i].wall_ms);
+    }
+    for (uint32_t i = 0; i < nf; i++) {
+        ESP_LOGI(TAG, "  %6u ms  %s %u bytes%s", files[i].pos_ms, files[i].name,
+                 files[i].bytes, files[i].kept ? "" : " (dropped)");
+    }
+}
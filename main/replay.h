@@ -0,0 +1,74 @@
+/*
+ * replay.h
+ *
+ * Deterministic capture for tuning the recorder path. While a replay runs
+ * the AFE feed reads a 16kHz/16bit WAV file instead of the microphones,
+ * paced at a percentage of real time, followed by a tail of silence so
+ * trailing VAD and wake-up end events can fire. Recorder events and the
+ * utterance files they produce are stamped with the replay position and
+ * kept for the report until the next replay starts.
+ * No ESP-IDF dependency besides logging and the timer, the host replay
+ * harness drives the same code.
+ */
+
+#ifndef MAIN_REPLAY_H_
+#define MAIN_REPLAY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define REPLAY_SAMPLE_RATE  (16000)
+#define REPLAY_TAIL_MS      (2000)
+#define REPLAY_MAX_EVENTS   (64)
+#define REPLAY_MAX_FILES    (16)
+
+typedef enum {
+    REPLAY_EV_WAKE = 0,
+    REPLAY_EV_WAKE_END,
+    REPLAY_EV_VAD_START,
+    REPLAY_EV_VAD_END,
+    REPLAY_EV_COMMAND,
+    REPLAY_EV_MAX,
+} replay_event_t;
+
+typedef enum {
+    REPLAY_IDLE = 0,
+    REPLAY_RUNNING,
+    // file played, feeding silence
+    REPLAY_TAIL,
+    REPLAY_DONE,
+} replay_state_t;
+
+// /replay endpoints, after init_wwe_work (replay_sys.c)
+void init_replay();
+
+/**
+ * speed_pct 100 is real time, 0 feeds as fast as the reader pulls.
+ * loops is the number of passes over the file, at least one.
+ */
+bool replay_start(const char *path, int speed_pct, int loops);
+// takes effect on the next read, the reader closes the file
+void replay_stop();
+// true while the feed comes from the file or its tail
+bool replay_active();
+replay_state_t replay_get_state();
+
+/**
+ * Next len bytes of interleaved 16 bit frames with channels channels: file
+ * channels first, the others zero. Blocks for pacing. Returns len, or 0
+ * once the replay is over.
+ */
+int replay_read(int16_t *buf, int len, int channels);
+
+// no-ops unless a replay is active
+void replay_mark(replay_event_t ev, int arg);
+void replay_mark_file(const char *name, uint32_t bytes, bool kept);
+
+const char *replay_event_str(replay_event_t ev);
+// events and files of the last replay as JSON, returns the length
+int replay_json(char *buf, size_t len);
+// the same as log lines
+void replay_log();
+
+#endif /* MAIN_REPLAY_H_ */
@@ -0,0 +1,67 @@
+#include "main.h"
+#include "replay.h"
+#include "ctl_server.h"
+#include "mem_track.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#if CONFIG_REPLAY_ENABLE
+
+static const char *TAG = "replay";
+
+#define REPLAY_JSON_LEN (6 * 1024)
+
+// GET /replay: report of the last replay as JSON.
+// POST /replay?file=<path>&speed=<percent>&loops=<n>, POST /replay?stop=1
+static esp_err_t _http_replay(httpd_req_t *req)
+{
+    char file[48];
+    char val[8];
+
+    if (req->method == HTTP_POST) {
+        if (ctl_server_query(req, "stop", val, sizeof(val))) {
+            replay_stop();
+            return httpd_resp_sendstr(req, "ok");
+        }
+        if (!ctl_server_query(req, "file", file, sizeof(file))) {
+            strcpy(file, CONFIG_REPLAY_FILE);
+        }
+        int speed = ctl_server_query(req, "speed", val, sizeof(val)) ? atoi(val) : CONFIG_REPLAY_SPEED;
+        int loops = ctl_server_query(req, "loops", val, sizeof(val)) ? atoi(val) : 1;
+        if (!replay_start(file, speed, loops)) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "replay busy or not a 16kHz/16bit WAV");
+        }
+        return httpd_resp_sendstr(req, "ok");
+    }
+    char *json = mem_malloc(MEM_SYS_SYSTEM, REPLAY_JSON_LEN);
+    if (json == NULL) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+    }
+    int len = replay_json(json, REPLAY_JSON_LEN);
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t err = httpd_resp_send(req, json, len);
+    mem_free(json);
+    return err;
+}
+
+static const httpd_uri_t replay_uris[] = {
+    { .uri = "/replay", .method = HTTP_GET,  .handler = _http_replay },
+    { .uri = "/replay", .method = HTTP_POST, .handler = _http_replay },
+};
+
+void init_replay(){
+    for (int i = 0; i < sizeof(replay_uris) / sizeof(replay_uris[0]); i++) {
+        ctl_server_register(&replay_uris[i]);
+    }
+#if CONFIG_REPLAY_AUTOSTART
+    // after init_wwe_work, the recorder pulls the feed
+    replay_start(CONFIG_REPLAY_FILE, CONFIG_REPLAY_SPEED, 1);
+#endif
+    ESP_LOGI(TAG, "Capture replay on /replay, default %s", CONFIG_REPLAY_FILE);
+}
+
+#endif /* CONFIG_REPLAY_ENABLE */
@@ -0,0 +1,244 @@
+#include "main.h"
+#include "speech_cmds.h"
+#include "local_cmd.h"
+#include "assistant.h"
+#include "cpu_load.h"
+#include "ctl_server.h"
+#include "mem_track.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_client.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#if CONFIG_LOCAL_CMD_ENABLE
+
+static const char *TAG = "speech_cmds";
+
+#define SPEECH_CMDS_LIST_LEN        (1024)
+#define SPEECH_CMDS_ERR_LEN         (200)
+#define SPEECH_CMDS_IDLE_POLL_MS    (200)
+#define SPEECH_CMDS_TASK_STACK      (4 * 1024)
+#define SPEECH_CMDS_NVS_NS          "speech_cmds"
+#define SPEECH_CMDS_NVS_KEY         "list"
+
+static const char *src_names[SPEECH_CMDS_SRC_MAX] = {
+    [SPEECH_CMDS_NONE]      = "none",
+    [SPEECH_CMDS_BUILTIN]   = "builtin",
+    [SPEECH_CMDS_NVS]       = "nvs",
+    [SPEECH_CMDS_SERVER]    = "server",
+};
+
+static TaskHandle_t         task;
+// the list in use and the one just fetched, owned by the task
+static char                 list[SPEECH_CMDS_LIST_LEN];
+static char                 fetched[SPEECH_CMDS_LIST_LEN];
+static speech_cmds_src_t    source;
+static speech_cmds_stats_t  stats;
+
+static bool _load(char *buf, size_t len)
+{
+    nvs_handle_t nvs;
+
+    if (nvs_open(SPEECH_CMDS_NVS_NS, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    esp_err_t err = nvs_get_str(nvs, SPEECH_CMDS_NVS_KEY, buf, &len);
+    nvs_close(nvs);
+    return err == ESP_OK;
+}
+
+static void _save(const char *buf)
+{
+    nvs_handle_t nvs;
+
+    if (nvs_open(SPEECH_CMDS_NVS_NS, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "NVS not available, list not cached");
+        return;
+    }
+    if (nvs_set_str(nvs, SPEECH_CMDS_NVS_KEY, buf) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Save to NVS failed");
+    }
+    nvs_close(nvs);
+}
+
+static bool _apply(const char *text, speech_cmds_src_t src)
+{
+    char err[SPEECH_CMDS_ERR_LEN];
+    int64_t took_us;
+
+    if (!local_cmd_prepare(text)) {
+        ESP_LOGE(TAG, "Bad list from %s", src_names[src]);
+        return false;
+    }
+    // MultiNet only listens after a wake word, an idle assistant keeps the reset out of a conversation
+    int64_t wait_start = esp_timer_get_time();
+    while (assistant_get_state() != ASSIST_IDLE) {
+        vTaskDelay(pdMS_TO_TICKS(SPEECH_CMDS_IDLE_POLL_MS));
+    }
+    stats.idle_wait_us_last = esp_timer_get_time() - wait_start;
+
+    local_cmd_suspend();
+    esp_err_t ret = wwe_reset_speech_cmds(local_cmd_prepared_phrases(), err, &took_us);
+    stats.resets++;
+    stats.reset_us_last = took_us;
+    if (took_us > stats.reset_us_max) {
+        stats.reset_us_max = took_us;
+    }
+    if (ret != ESP_OK) {
+        stats.reset_fails++;
+        ESP_LOGE(TAG, "MultiNet rejected the %s list, phrases %s", src_names[src], err);
+        // back to the previous phrases, or no local commands at all
+        const char *old = local_cmd_phrases();
+        if (old && wwe_reset_speech_cmds(old, err, &took_us) == ESP_OK) {
+            local_cmd_resume();
+        }
+        return false;
+    }
+    local_cmd_commit();
+    source = src;
+    ESP_LOGI(TAG, "%d commands from %s, reset %lld ms after %lld ms waiting for idle", local_cmd_count(),
+             src_names[src], stats.reset_us_last / 1000, stats.idle_wait_us_last / 1000);
+    return true;
+}
+
+static bool _fetch(char *buf, int len)
+{
+    char url[96];
+
+    snprintf(url, sizeof(url), "http://%s:%d/%s", CONFIG_TARGET_URL, CONFIG_TARGET_PORT, CONFIG_SPEECH_CMDS_PATH);
+    esp_http_client_config_t cfg = {
+        .url = url,
+        .timeout_ms = 5000,
+    };
+    esp_http_client_handle_t http = esp_http_client_init(&cfg);
+    int total = 0;
+    int ret = -1;
+
+    if (http == NULL || esp_http_client_open(http, 0) != ESP_OK) {
+        goto out;
+    }
+    esp_http_client_fetch_headers(http);
+    if (esp_http_client_get_status_code(http) != 200) {
+        goto out;
+    }
+    while (total < len - 1 && (ret = esp_http_client_read(http, buf + total, len - 1 - total)) > 0) {
+        total += ret;
+    }
+    if (ret > 0) {
+        // full buffer, check that nothing is left
+        char c;
+        ret = esp_http_client_read(http, &c, 1) > 0 ? -1 : 0;
+    }
+    buf[total] = 0;
+out:
+    if (http) {
+        esp_http_client_close(http);
+        esp_http_client_cleanup(http);
+    }
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Fetch %s failed", url);
+    }
+    return ret == 0;
+}
+
+static void _update()
+{
+    stats.fetches++;
+    if (!_fetch(fetched, sizeof(fetched))) {
+        stats.fetch_fails++;
+        return;
+    }
+    if (strcmp(fetched, list) == 0) {
+        stats.unchanged++;
+        ESP_LOGI(TAG, "Server list unchanged, no reset");
+        return;
+    }
+    if (_apply(fetched, SPEECH_CMDS_SERVER)) {
+        strcpy(list, fetched);
+        _save(list);
+    }
+}
+
+static void speech_cmds_task(void *arg)
+{
+    if (!_load(list, sizeof(list)) || !_apply(list, SPEECH_CMDS_NVS)) {
+        strlcpy(list, local_cmd_builtin(), sizeof(list));
+        _apply(list, SPEECH_CMDS_BUILTIN);
+    }
+#if CONFIG_SPEECH_CMDS_FETCH_BOOT
+    _update();
+#endif
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _update();
+    }
+}
+
+// GET /speech_cmds: the list in use, status as '#' comments.
+// POST /speech_cmds?fetch=1
+static esp_err_t _http_speech_cmds(httpd_req_t *req)
+{
+    char val[8];
+    char head[256];
+
+    if (req->method == HTTP_POST) {
+        if (!ctl_server_query(req, "fetch", val, sizeof(val))) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "fetch=1");
+        }
+        return httpd_resp_sendstr(req, speech_cmds_fetch() ? "ok" : "fetch pending");
+    }
+    snprintf(head, sizeof(head),
+             "# source %s, %d commands\n# resets %u, failed %u, last %lld ms, max %lld ms, idle wait %lld ms\n"
+             "# fetches %u, failed %u, unchanged %u\n",
+             src_names[source], local_cmd_count(), stats.resets, stats.reset_fails, stats.reset_us_last / 1000,
+             stats.reset_us_max / 1000, stats.idle_wait_us_last / 1000, stats.fetches, stats.fetch_fails,
+             stats.unchanged);
+    httpd_resp_set_type(req, "text/plain");
+    if (httpd_resp_send_chunk(req, head, strlen(head)) != ESP_OK
+        || (source != SPEECH_CMDS_NONE && httpd_resp_send_chunk(req, list, strlen(list)) != ESP_OK)) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static const httpd_uri_t speech_cmds_uris[] = {
+    { .uri = "/speech_cmds", .method = HTTP_GET,  .handler = _http_speech_cmds },
+    { .uri = "/speech_cmds", .method = HTTP_POST, .handler = _http_speech_cmds },
+};
+
+void init_speech_cmds(){
+    if (xTaskCreatePinnedToCore(speech_cmds_task, "speech_cmds", SPEECH_CMDS_TASK_STACK, NULL,
+                                TASK_PRIO(DIAG), &task, TASK_CORE(DIAG)) != pdPASS) {
+        ESP_LOGE(TAG, "Create speech_cmds task failed");
+        return;
+    }
+    for (int i = 0; i < sizeof(speech_cmds_uris) / sizeof(speech_cmds_uris[0]); i++) {
+        ctl_server_register(&speech_cmds_uris[i]);
+    }
+}
+
+bool speech_cmds_fetch(){
+    // fails while a request is still pending, or without the task
+    return task && xTaskNotify(task, 1, eSetValueWithoutOverwrite) == pdPASS;
+}
+
+speech_cmds_src_t speech_cmds_source(){
+    return source;
+}
+
+const char *speech_cmds_src_str(speech_cmds_src_t src){
+    return src < SPEECH_CMDS_SRC_MAX ? src_names[src] : "?";
+}
+
+void speech_cmds_get_stats(speech_cmds_stats_t *out){
+    memcpy(out, &stats, sizeof(*out));
+}
+
+#endif /* CONFIG_LOCAL_CMD_ENABLE */
@@ -0,0 +1,54 @@
+/*
+ * speech_cmds.h
+ *
+ * Where the MultiNet command list comes from. Boot takes the list cached
+ * in NVS, or the built-in one, and a low priority task applies it once
+ * the assistant is idle: app_main waits for neither the reset nor the
+ * network. MultiNet starts with the model's own phrases, so every boot
+ * still pays one reset, and local commands are off until it is done. The
+ * task then fetches the list from the speech server and only when it
+ * differs resets MultiNet again and caches it. GET
+ * /speech_cmds shows the list in use and the reset times, POST
+ * /speech_cmds?fetch=1 fetches again.
+ */
+
+#ifndef MAIN_SPEECH_CMDS_H_
+#define MAIN_SPEECH_CMDS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef enum {
+    SPEECH_CMDS_NONE = 0,
+    SPEECH_CMDS_BUILTIN,
+    SPEECH_CMDS_NVS,
+    SPEECH_CMDS_SERVER,
+    SPEECH_CMDS_SRC_MAX,
+} speech_cmds_src_t;
+
+typedef struct {
+    uint32_t resets;
+    uint32_t reset_fails;
+    // recorder_sr_reset_speech_cmd alone
+    int64_t  reset_us_last;
+    int64_t  reset_us_max;
+    // for the assistant to be idle before the last reset
+    int64_t  idle_wait_us_last;
+    uint32_t fetches;
+    uint32_t fetch_fails;
+    // fetched list equal to the one in use, no reset
+    uint32_t unchanged;
+} speech_cmds_stats_t;
+
+// after init_wwe_work, the recorder must exist
+void init_speech_cmds();
+// fetch from the server in the background, false if one is pending
+bool speech_cmds_fetch();
+
+speech_cmds_src_t speech_cmds_source();
+const char *speech_cmds_src_str(speech_cmds_src_t src);
+void speech_cmds_get_stats(speech_cmds_stats_t *stats);
+
+#endif /* MAIN_SPEECH_CMDS_H_ */
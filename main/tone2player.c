@@ -0,0 +1,154 @@
+#include "main.h"
+#include "mixer_work.h"
+#include "pipeline_graph.h"
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "audio_element.h"
+#include "audio_pipeline.h"
+#include "audio_mem.h"
+#include "audio_event_iface.h"
+#include "audio_common.h"
+#include "tone_stream.h"
+#include "mp3_decoder.h"
+#include "filter_resample.h"
+#include "sdkconfig.h"
+
+#include "board.h"
+
+static const char *TAG = "tone2player";
+
+#define TONE2PLAYER_DEADLINE_MS (5000)
+#define TONE2PLAYER_STALL_MS    (1000)
+// the reactor reports by the deadline, the margin covers the done callback
+#define TONE2PLAYER_WAIT_MS     (TONE2PLAYER_DEADLINE_MS + 1000)
+
+static const graph_el_spec_t tone2player_els[] = {
+    { .tag = "tone",    .type = GRAPH_EL_TONE_READER, GRAPH_TASK(DECODER) },
+    { .tag = "mp3",     .type = GRAPH_EL_MP3_DECODER, GRAPH_TASK(DECODER) },
+    { .tag = "filter",  .type = GRAPH_EL_RESAMPLE, .dest_rate = MIXER_SAMPLE_RATE, .dest_ch = MIXER_CHANNELS, GRAPH_TASK(DECODER) },
+};
+
+static const graph_spec_t tone2player_spec = {
+    .name       = "tone2player",
+    .els        = tone2player_els,
+    .num_els    = sizeof(tone2player_els) / sizeof(tone2player_els[0]),
+    .mixer_port = MIXER_PORT_TONE,
+};
+
+static pipeline_graph_t *tone2player_graph;
+static audio_pipeline_handle_t tone2player_pipeline;
+static audio_element_handle_t tone_stream_reader;
+static audio_element_handle_t mp3_decoder;
+static audio_element_handle_t rsp_handle;
+static SemaphoreHandle_t tone2player_done;
+// callers in the assistant task and app_main share the one pipeline
+static SemaphoreHandle_t tone2player_lock;
+static volatile bool tone2player_abort = false;
+
+static void _build()
+{
+    tone2player_graph = pipeline_graph_build(&tone2player_spec);
+    tone2player_pipeline = tone2player_graph->pipeline;
+    tone_stream_reader = pipeline_graph_el(tone2player_graph, "tone");
+    mp3_decoder = pipeline_graph_el(tone2player_graph, "mp3");
+    rsp_handle = pipeline_graph_el(tone2player_graph, "filter");
+}
+
+void init_tone2player(){
+    ESP_LOGI(TAG, "[1.0] Build [flash]-->tone_stream-->mp3_decoder-->resample-->[mixer]");
+    _build();
+
+    tone2player_done = xSemaphoreCreateBinary();
+    mem_assert(tone2player_done);
+    tone2player_lock = xSemaphoreCreateMutex();
+    mem_assert(tone2player_lock);
+}
+
+void deinit_tone2player(){
+    ESP_LOGI(TAG, "[ 3.1 ] Destroy tone2player_pipeline");
+    pipeline_graph_destroy(tone2player_graph);
+    tone2player_graph = NULL;
+    vSemaphoreDelete(tone2player_done);
+    vSemaphoreDelete(tone2player_lock);
+}
+
+static reactor_result_t tone2player_on_event(audio_event_iface_msg_t *msg)
+{
+    if (msg->source == (void *) mp3_decoder
+        && msg->cmd == AEL_MSG_CMD_REPORT_MUSIC_INFO) {
+        audio_element_info_t music_info = {0};
+        audio_element_getinfo(mp3_decoder, &music_info);
+        rsp_filter_set_src_info(rsp_handle, music_info.sample_rates, music_info.channels);
+        return REACTOR_RUNNING;
+    }
+    if (msg->source == (void *) rsp_handle
+        && msg->cmd == AEL_MSG_CMD_REPORT_STATUS) {
+        audio_element_state_t el_state = audio_element_get_state(rsp_handle);
+        if (el_state == AEL_STATE_FINISHED) {
+            return REACTOR_DONE;
+        }
+        if (el_state == AEL_STATE_STOPPED && tone2player_abort) {
+            return REACTOR_ABORTED;
+        }
+    }
+    return REACTOR_RUNNING;
+}
+
+static bool tone2player_drained()
+{
+    return mixer_port_idle(MIXER_PORT_TONE);
+}
+
+static void tone2player_stop()
+{
+    tone2player_abort = true;
+    audio_pipeline_stop(tone2player_pipeline);
+    mixer_port_reset(MIXER_PORT_TONE);
+}
+
+static void tone2player_finished(pipe_type_t type, reactor_result_t result)
+{
+    xSemaphoreGive(tone2player_done);
+}
+
+static reactor_op_t tone2player_op = {
+    .deadline_ms = TONE2PLAYER_DEADLINE_MS,
+    .stall_ms = TONE2PLAYER_STALL_MS,
+    .on_event = tone2player_on_event,
+    .drained = tone2player_drained,
+    .abort = tone2player_stop,
+};
+
+void run_tone2player(const char *src_url, const char *dst_url){
+    xSemaphoreTake(tone2player_lock, portMAX_DELAY);
+    int64_t start_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "URL: %s", src_url);
+    // a report that came after the last wait gave up
+    xSemaphoreTake(tone2player_done, 0);
+    if (pipeline_graph_rearm(tone2player_graph) != ESP_OK) {
+        // not scheduled, so rebuilt here like job_sched does for the others
+        pipeline_graph_destroy(tone2player_graph);
+        _build();
+    }
+    audio_element_set_uri(tone_stream_reader, src_url);
+    mixer_port_reset(MIXER_PORT_TONE);
+    tone2player_abort = false;
+    tone2player_op.progress_el = tone_stream_reader;
+    reactor_start(PIPE_TONE2PLAYER, &tone2player_op, tone2player_finished);
+    audio_pipeline_run(tone2player_pipeline);
+    pipeline_start_record(PIPE_TONE2PLAYER, start_us);
+
+    // sync play: return once the tone has been mixed out
+    if (xSemaphoreTake(tone2player_done, pdMS_TO_TICKS(TONE2PLAYER_WAIT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "No report %d ms after the start", TONE2PLAYER_WAIT_MS);
+    }
+    xSemaphoreGive(tone2player_lock);
+}
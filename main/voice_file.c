@@ -0,0 +1,51 @@
+#include "voice_file.h"
+
+#include <string.h>
+
+static void _write_header(voice_file_t *vf)
+{
+    uint8_t hdr[WAV_HEADER_LEN];
+
+    wav_header_build(hdr, vf->bytes, vf->fmt.channels, vf->fmt.rate, vf->fmt.bits);
+    fwrite(hdr, WAV_HEADER_LEN, 1, vf->fp);
+}
+
+bool voice_file_open(voice_file_t *vf, const char *name, const wav_info_t *fmt){
+    memset(vf, 0, sizeof(*vf));
+    strncpy(vf->name, name, VOICE_FILE_NAME_LEN - 1);
+    vf->fp = fopen(vf->name, "wb");
+    if (vf->fp == NULL) {
+        return false;
+    }
+    if (fmt) {
+        vf->wav = true;
+        vf->fmt = *fmt;
+        // size is unknown until close
+        _write_header(vf);
+    }
+    return true;
+}
+
+bool voice_file_write(voice_file_t *vf, const void *data, int len){
+    if (vf->fp == NULL || fwrite(data, len, 1, vf->fp) != 1) {
+        return false;
+    }
+    vf->bytes += len;
+    return true;
+}
+
+uint32_t voice_file_close(voice_file_t *vf, bool keep){
+    if (vf->fp == NULL) {
+        return 0;
+    }
+    if (keep && vf->wav) {
+        fseek(vf->fp, 0, SEEK_SET);
+        _write_header(vf);
+    }
+    fclose(vf->fp);
+    vf->fp = NULL;
+    if (!keep) {
+        remove(vf->name);
+    }
+    return vf->bytes;
+}
@@ -0,0 +1,34 @@
+/*
+ * voice_file.h
+ *
+ * One recorded utterance on the SD card. WAV files get a placeholder
+ * header on open that is rewritten with the exact data size on close.
+ * No ESP-IDF dependency, the host replay harness writes its files with it.
+ */
+
+#ifndef MAIN_VOICE_FILE_H_
+#define MAIN_VOICE_FILE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wav_header.h"
+
+#define VOICE_FILE_NAME_LEN (50)
+
+typedef struct {
+    FILE        *fp;
+    char        name[VOICE_FILE_NAME_LEN];
+    // NULL fmt on open: raw encoder output, no header
+    bool        wav;
+    wav_info_t  fmt;
+    uint32_t    bytes;
+} voice_file_t;
+
+bool voice_file_open(voice_file_t *vf, const char *name, const wav_info_t *fmt);
+bool voice_file_write(voice_file_t *vf, const void *data, int len);
+// keep false deletes the file, returns the payload bytes written
+uint32_t voice_file_close(voice_file_t *vf, bool keep);
+
+#endif /* MAIN_VOICE_FILE_H_ */
@@ -0,0 +1,79 @@
+#include "wav_header.h"
+
+#include <string.h>
+
+static uint8_t *_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+void wav_header_build(uint8_t *hdr, uint32_t data_size, uint16_t num_channels,
+                      uint32_t sampling_rate, uint16_t bits_per_sample){
+    uint8_t *p = hdr;
+
+    memcpy(p, "RIFF", 4);
+    p = _le32(p + 4, data_size + 36);
+    memcpy(p, "WAVEfmt ", 8);
+    p = _le32(p + 8, 16);
+    // PCM
+    p = _le16(p, 1);
+    p = _le16(p, num_channels);
+    p = _le32(p, sampling_rate);
+    p = _le32(p, num_channels * sampling_rate * bits_per_sample / 8);
+    p = _le16(p, num_channels * bits_per_sample / 8);
+    p = _le16(p, bits_per_sample);
+    memcpy(p, "data", 4);
+    _le32(p + 4, data_size);
+}
+
+static uint32_t _get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t _get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+bool wav_header_read(FILE *fp, wav_info_t *info){
+    uint8_t buf[16];
+    bool fmt = false;
+
+    if (fread(buf, 12, 1, fp) != 1 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+    while (fread(buf, 8, 1, fp) == 1) {
+        uint32_t size = _get32(buf + 4);
+        if (memcmp(buf, "data", 4) == 0) {
+            info->data_size = size;
+            return fmt;
+        }
+        if (memcmp(buf, "fmt ", 4) == 0 && size >= 16) {
+            if (fread(buf, 16, 1, fp) != 1 || _get16(buf) != 1) {
+                return false;
+            }
+            info->channels = _get16(buf + 2);
+            info->rate = _get32(buf + 4);
+            info->bits = _get16(buf + 14);
+            fmt = true;
+            size -= 16;
+        }
+        // chunks are padded to an even size
+        if (fseek(fp, size + (size & 1), SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,30 @@
+/*
+ * wav_header.h
+ *
+ * Canonical 44 byte PCM WAV header, built in memory so it is written with
+ * a single fwrite, and the reader for replayed capture files. No ESP-IDF
+ * dependency, also built on the host.
+ */
+
+#ifndef MAIN_WAV_HEADER_H_
+#define MAIN_WAV_HEADER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define WAV_HEADER_LEN  (44)
+
+typedef struct {
+    uint16_t channels;
+    uint32_t rate;
+    uint16_t bits;
+    uint32_t data_size;
+} wav_info_t;
+
+void wav_header_build(uint8_t *hdr, uint32_t data_size, uint16_t num_channels,
+                      uint32_t sampling_rate, uint16_t bits_per_sample);
+// PCM files only, skips chunks other than fmt and leaves fp at the samples
+bool wav_header_read(FILE *fp, wav_info_t *info);
+
+#endif /* MAIN_WAV_HEADER_H_ */
@@ -7,6 +7,7 @@
 #include "esp_peripherals.h"
 #include "periph_wifi.h"
 #include "audio_idf_version.h"
+#include "qemu_target.h"
 
 #if (ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 1, 0))
 #include "esp_netif.h"
@@ -31,7 +32,10 @@ void init_wifi_work(esp_periph_set_handle_t set){
 	tcpip_adapter_init();
 #endif
 
-
+#if CONFIG_QEMU_TARGET
+	// the emulated machine has a NIC instead of the radio
+	init_qemu_network();
+#else
 	ESP_LOGI(TAG, "Start and wait for Wi-Fi network");
 	periph_wifi_cfg_t wifi_cfg = {
 		.ssid = CONFIG_WIFI_SSID,
@@ -41,4 +45,5 @@ void init_wifi_work(esp_periph_set_handle_t set){
 	esp_periph_handle_t wifi_handle = periph_wifi_init(&wifi_cfg);
 	esp_periph_start(set, wifi_handle);
 	periph_wifi_wait_for_connected(wifi_handle, portMAX_DELAY);
+#endif
 }
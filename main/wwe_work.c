@@ -1,4 +1,5 @@
 #include "main.h"
+#include "job_sched.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -17,22 +18,34 @@
 #include "freertos/task.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "amrnb_encoder.h"
 #include "amrwb_encoder.h"
 #include "filter_resample.h"
-#include "i2s_stream.h"
-#include "mp3_decoder.h"
 #include "raw_stream.h"
+#include "ringbuf.h"
 #include "recorder_encoder.h"
 #include "recorder_sr.h"
-#include "tone_stream.h"
 #include "es7210.h"
 #include "sdkconfig.h"
 
 #include "model_path.h"
 
 #include "wav_encoder.h"
+#include "mixer_work.h"
+#include "aec_ref.h"
+#include "i2s_work.h"
+#include "cpu_load.h"
+#include "assistant.h"
+#include "log.h"
+#include "el_stats.h"
+#include "mem_track.h"
+#include "dlog.h"
+#include "voice_file.h"
+#include "replay.h"
+#include "audio_tap.h"
+#include "local_cmd.h"
 
 static char *TAG = "wwe_work";
 
@@ -49,19 +62,11 @@ static char *TAG = "wwe_work";
 #define RECORDER_ENC_ENABLE (ENC_2_WAV)
 #define VOICE2FILE          (true)
 #define WAKENET_ENABLE      (true)
+#if CONFIG_LOCAL_CMD_ENABLE
+// the command list is set later from the idle assistant, see speech_cmds.h
+#define MULTINET_ENABLE     (true)
+#else
 #define MULTINET_ENABLE     (false)
-#define SPEECH_CMDS_RESET   (false)
-
-#define SPEECH_COMMANDS     ("da kai dian deng,kai dian deng;guan bi dian deng,guan dian deng;guan deng;")
-
-#ifndef CODEC_ADC_SAMPLE_RATE
-#warning "Please define CODEC_ADC_SAMPLE_RATE first, default value is 48kHz may not correctly"
-#define CODEC_ADC_SAMPLE_RATE    48000
-#endif
-
-#ifndef CODEC_ADC_BITS_PER_SAMPLE
-#warning "Please define CODEC_ADC_BITS_PER_SAMPLE first, default value 16 bits may not correctly"
-#define CODEC_ADC_BITS_PER_SAMPLE  I2S_BITS_PER_SAMPLE_16BIT
 #endif
 
 #ifndef RECORD_HARDWARE_AEC
@@ -69,295 +74,211 @@ static char *TAG = "wwe_work";
 #define RECORD_HARDWARE_AEC  (false)
 #endif
 
-#ifndef CODEC_ADC_I2S_PORT
-#define CODEC_ADC_I2S_PORT  (0)
+#if CONFIG_BARGE_IN_ENABLE && !RECORD_HARDWARE_AEC && !CONFIG_AEC_SOFTWARE_REF
+#warning "Barge-in without a playback reference, wakenet may be triggered by the speaker"
 #endif
 
-enum _rec_msg_id {
-    REC_START = 1,
-    REC_STOP,
-    REC_CANCEL,
-};
+#define SOFTWARE_AEC_REF    (CONFIG_AEC_SOFTWARE_REF && !RECORD_HARDWARE_AEC)
+
+#define VOICE_BUF_LEN       (2 * 1024)
 
-static esp_audio_handle_t     	player 		= NULL;
 static audio_rec_handle_t     	recorder 	= NULL;
+static void                    *sr_handle   = NULL;
 static audio_element_handle_t 	raw_read 	= NULL;
 static audio_element_handle_t 	i2s_stream_reader 	= NULL;
-static QueueHandle_t          	rec_q      	= NULL;
 static audio_pipeline_handle_t pipeline 	= NULL;
-static bool                   	voice_reading = false;
-
-
-static void add_wav_file_header(FILE *fp,
-								const uint32_t duration,
-								const uint16_t num_channels,
-								const uint32_t sampling_rate,
-								const uint16_t bits_per_sample){
-	  uint32_t data_size = sampling_rate * num_channels * bits_per_sample * duration / 8;
-
-	  /* *************** ADD ".WAV" HEADER *************** */
-	  uint8_t CHUNK_ID[4] = {'R', 'I', 'F', 'F'};
-      fwrite(CHUNK_ID, 4, 1, fp);
-
-	  uint32_t chunk_size = data_size + 36;
-	  uint8_t CHUNK_SIZE[4] = {chunk_size, chunk_size >> 8, chunk_size >> 16, chunk_size >> 24};
-      fwrite(CHUNK_SIZE, 4, 1, fp);
-
-	  uint8_t FORMAT[4] = {'W', 'A', 'V', 'E'};
-      fwrite(FORMAT, 4, 1, fp);
-
-	  uint8_t SUBCHUNK_1_ID[4] = {'f', 'm', 't', ' '};
-      fwrite(SUBCHUNK_1_ID, 4, 1, fp);
-
-	  uint8_t SUBCHUNK_1_SIZE[4] = {0x10, 0x00, 0x00, 0x00};
-      fwrite(SUBCHUNK_1_SIZE, 4, 1, fp);
-
-	  uint8_t AUDIO_FORMAT[2] = {0x01, 0x00};
-      fwrite(AUDIO_FORMAT, 2, 1, fp);
+// current utterance, owned by the assistant task
+static uint8_t                 *voice_buf   = NULL;
+static voice_file_t             voice_file;
+static int                      voice_fcnt  = 0;
+// interleaved channels the AFE feed expects
+static int                      feed_channels = 2;
 
-	  uint8_t NUM_CHANNELS[2] = {num_channels, num_channels >> 8};
-      fwrite(NUM_CHANNELS, 2, 1, fp);
 
-	  uint8_t SAMPLING_RATE[4] = {sampling_rate, sampling_rate >> 8, sampling_rate >> 16, sampling_rate >> 24};
-      fwrite(SAMPLING_RATE, 4, 1, fp);
-
-	  uint32_t byte_rate = num_channels * sampling_rate * bits_per_sample / 8;
-	  uint8_t BYTE_RATE[4] = {byte_rate, byte_rate >> 8, byte_rate >> 16, byte_rate >> 24};
-      fwrite(BYTE_RATE, 4, 1, fp);
-
-	  uint16_t block_align = num_channels * bits_per_sample / 8;
-	  uint8_t BLOCK_ALIGN[2] = {block_align, block_align >> 8};
-      fwrite(BLOCK_ALIGN, 2, 1, fp);
-
-	  uint8_t BITS_PER_SAMPLE[2] = {bits_per_sample, bits_per_sample >> 8};
-      fwrite(BITS_PER_SAMPLE, 2, 1, fp);
-
-	  uint8_t SUBCHUNK_2_ID[4] = {'d', 'a', 't', 'a'};
-      fwrite(SUBCHUNK_2_ID, 4, 1, fp);
-
-	  uint8_t SUBCHUNK_2_SIZE[4] = {data_size, data_size >> 8, data_size >> 16, data_size >> 24};
-      fwrite(SUBCHUNK_2_SIZE, 4, 1, fp);
-}
-
-
-static void mod_wav_file_header(FILE *fp,
-								const uint32_t duration,
-								const uint16_t num_channels,
-								const uint32_t sampling_rate,
-								const uint16_t bits_per_sample){
-	fseek(fp, 0, SEEK_SET);
-	add_wav_file_header(fp, duration, num_channels, sampling_rate, bits_per_sample);
-	fseek(fp, 0, SEEK_END);
-}
-
-
-static esp_audio_handle_t setup_player()
+static void setup_player()
 {
-    esp_audio_cfg_t cfg = DEFAULT_ESP_AUDIO_CONFIG();
+#if !CONFIG_QEMU_TARGET
     audio_board_handle_t board_handle = audio_board_init();
-
-    cfg.vol_handle = board_handle->audio_hal;
-    cfg.vol_set = (audio_volume_set)audio_hal_set_volume;
-    cfg.vol_get = (audio_volume_get)audio_hal_get_volume;
-    cfg.resample_rate = 48000;
-    cfg.prefer_type = ESP_AUDIO_PREFER_MEM;
-
-    player = esp_audio_create(&cfg);
     audio_hal_ctrl_codec(board_handle->audio_hal, AUDIO_HAL_CODEC_MODE_BOTH, AUDIO_HAL_CTRL_START);
-
-    // Create readers and add to esp_audio
-    tone_stream_cfg_t tone_cfg = TONE_STREAM_CFG_DEFAULT();
-    tone_cfg.type = AUDIO_STREAM_READER;
-    esp_audio_input_stream_add(player, tone_stream_init(&tone_cfg));
-
-    // Add decoders and encoders to esp_audio
-    mp3_decoder_cfg_t mp3_dec_cfg = DEFAULT_MP3_DECODER_CONFIG();
-    mp3_dec_cfg.task_core = 1;
-    esp_audio_codec_lib_add(player, AUDIO_CODEC_TYPE_DECODER, mp3_decoder_init(&mp3_dec_cfg));
-
-    // Create writers and add to esp_audio
-    i2s_stream_cfg_t i2s_writer = I2S_STREAM_CFG_DEFAULT();
-    i2s_writer.i2s_config.sample_rate = 48000;
-#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
-    i2s_writer.i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
-#else
-    i2s_writer.i2s_config.bits_per_sample = CODEC_ADC_BITS_PER_SAMPLE;
-    i2s_writer.need_expand = (CODEC_ADC_BITS_PER_SAMPLE != I2S_BITS_PER_SAMPLE_16BIT);
 #endif
-    i2s_writer.type = AUDIO_STREAM_WRITER;
 
-    esp_audio_output_stream_add(player, i2s_stream_init(&i2s_writer));
+    // One i2s owner for capture and playback, one writer shared by tones, TTS and local files
+    init_i2s_work();
+    init_mixer_work();
+    init_tone2player();
 
+#if !CONFIG_QEMU_TARGET
     // Set default volume
-    esp_audio_vol_set(player, 80);
-    AUDIO_MEM_SHOW(TAG);
-
-    ESP_LOGI(TAG, "esp_audio instance is:%p\r\n", player);
-    return player;
+    audio_hal_set_volume(board_handle->audio_hal, 80);
+#endif
+    mem_track_dump("audio up");
 }
 
+bool voice_rec_begin(){
 #if VOICE2FILE == (true)
-static void voice_2_file(uint8_t *buffer, int len)
-{
-#define MAX_FNAME_LEN (50)
-    static FILE *fp = NULL;
-    static int fcnt = 0;
-    static int data_size = 0;
-    static char fname[MAX_FNAME_LEN] = { 0 };
-
-    if (voice_reading) {
-        if (!fp) {
-            if (fp == NULL) {
-                if (RECORDER_ENC_ENABLE == ENC_2_AMRNB) {
-                    snprintf(fname, MAX_FNAME_LEN - 1, "/sdcard/amr_%d.amr", fcnt++);
-                } else if (RECORDER_ENC_ENABLE == ENC_2_AMRWB){
-                    snprintf(fname, MAX_FNAME_LEN - 1, "/sdcard/wamr_%d.amr", fcnt++);
-                } else if (RECORDER_ENC_ENABLE == ENC_2_WAV){
-                    snprintf(fname, MAX_FNAME_LEN - 1, "/sdcard/wav_%d.wav", fcnt++);
-                } else {
-                    snprintf(fname, MAX_FNAME_LEN - 1, "/sdcard/pcm_%d.pcm", fcnt++);
-                }
-                fp = fopen(fname, "wb");
-                ESP_LOGI(TAG, "File opened: %s ", fname);
-                data_size = 0;
-                if(RECORDER_ENC_ENABLE == ENC_2_WAV){		//set wav header
-                	size_t duration = 0; 					// lazy write
-                	//16kHz mono 16000
-    				mod_wav_file_header(fp, duration, CONFIG_AUDIO_CHANNELS, CONFIG_AUDIO_SAMPLE_RATE, CONFIG_AUDIO_BITS);
-                }
-                if (!fp) {
-                    ESP_LOGE(TAG, "File open failed");
-                }
-            }
-        }
-        if (len) {
-        	data_size += len;
-            fwrite(buffer, len, 1, fp);
-        }
+    char fname[VOICE_FILE_NAME_LEN];
+    // 16kHz mono 16bit, the size is filled in on close
+    const wav_info_t wav_fmt = {
+        .channels = CONFIG_AUDIO_CHANNELS,
+        .rate = CONFIG_AUDIO_SAMPLE_RATE,
+        .bits = CONFIG_AUDIO_BITS,
+    };
+
+    if (RECORDER_ENC_ENABLE == ENC_2_AMRNB) {
+        snprintf(fname, sizeof(fname), "/sdcard/amr_%d.amr", voice_fcnt++);
+    } else if (RECORDER_ENC_ENABLE == ENC_2_AMRWB){
+        snprintf(fname, sizeof(fname), "/sdcard/wamr_%d.amr", voice_fcnt++);
+    } else if (RECORDER_ENC_ENABLE == ENC_2_WAV){
+        snprintf(fname, sizeof(fname), "/sdcard/wav_%d.wav", voice_fcnt++);
     } else {
-        if (fp) {
-        	if(RECORDER_ENC_ENABLE == ENC_2_WAV){	//reset wav header
-				size_t duration = data_size * 8 / CONFIG_AUDIO_BITS / CONFIG_AUDIO_CHANNELS / CONFIG_AUDIO_SAMPLE_RATE; // lazy write
-                ESP_LOGI(TAG, "duration: %d", duration);
-				mod_wav_file_header(fp, duration, CONFIG_AUDIO_CHANNELS, CONFIG_AUDIO_SAMPLE_RATE, CONFIG_AUDIO_BITS);
-			}
-        	data_size = 0;
-            ESP_LOGI(TAG, "File closed: %s ", fname);
-            fclose(fp);
-            fp = NULL;
-#if UPLOAD_HTTP_STREAM == (true)
-            char dst_url[64];
-            sprintf(dst_url, "http://%s:%d", CONFIG_TARGET_URL, CONFIG_TARGET_PORT);
-            main_msg_t msg = {
-            		.msg_id = FILE2HTTP,
-            		.src = fname,
-            		.dst = dst_url,
-            };
-            if (xQueueSend(main_q, &msg, 0) != pdPASS) {
-                ESP_LOGE(TAG, "main queue send failed");
-            }
-#endif /* UPLOAD_HTTP_STREAM == (true) */
-        }
+        snprintf(fname, sizeof(fname), "/sdcard/pcm_%d.pcm", voice_fcnt++);
     }
-}
+    if (!voice_file_open(&voice_file, fname, RECORDER_ENC_ENABLE == ENC_2_WAV ? &wav_fmt : NULL)) {
+        ESP_LOGE(TAG, "File open failed: %s", fname);
+        return false;
+    }
+    ESP_LOGI(TAG, "File opened: %s ", fname);
 #endif /* VOICE2FILE == (true) */
+    return true;
+}
 
-static void voice_read_task(void *args)
-{
-    const int buf_len = 2 * 1024;
-    uint8_t *voiceData = audio_calloc(1, buf_len);
-    int msg = 0;
-    TickType_t delay = portMAX_DELAY;
-
-    while (true) {
-        if (xQueueReceive(rec_q, &msg, delay) == pdTRUE) {
-            switch (msg) {
-                case REC_START: {
-                    ESP_LOGW(TAG, "voice read begin");
-                    delay = 0;
-                    voice_reading = true;
-                    break;
-                }
-                case REC_STOP: {
-                    ESP_LOGW(TAG, "voice read stopped");
-                    delay = portMAX_DELAY;
-                    voice_reading = false;
-                    break;
-                }
-                case REC_CANCEL: {
-                    ESP_LOGW(TAG, "voice read cancel");
-                    delay = portMAX_DELAY;
-                    voice_reading = false;
-                    break;
-                }
-                default:
-                    break;
-            }
-        }
-        int ret = 0;
-        if (voice_reading) {
-            ret = audio_recorder_data_read(recorder, voiceData, buf_len, portMAX_DELAY);
-
-            if (ret <= 0) {
-                ESP_LOGW(TAG, "audio recorder read finished %d", ret);
-                delay = portMAX_DELAY;
-                voice_reading = false;
-            }
-        }
+int voice_rec_step(){
+    int ret = audio_recorder_data_read(recorder, voice_buf, VOICE_BUF_LEN, portMAX_DELAY);
+    if (ret <= 0) {
+        DLOG(REC_READ_END, ret);
+        return ret;
+    }
+    AUDIO_TAP(TAP_REC_OUT, voice_buf, ret);
 #if VOICE2FILE == (true)
-        voice_2_file(voiceData, ret);
+    voice_file_write(&voice_file, voice_buf, ret);
 #endif /* VOICE2FILE == (true) */
-    }
+    return ret;
+}
 
-    free(voiceData);
-    vTaskDelete(NULL);
+bool voice_rec_end(bool upload){
+#if VOICE2FILE == (true)
+    if (!voice_file.fp) {
+        return false;
+    }
+    uint32_t size = voice_file_close(&voice_file, upload);
+#if CONFIG_REPLAY_ENABLE
+    replay_mark_file(voice_file.name, size, upload);
+#endif
+    if (!upload) {
+        ESP_LOGI(TAG, "File dropped: %s ", voice_file.name);
+        return false;
+    }
+    TRACE(TRACE_FILE_CLOSE, size);
+    ESP_LOGI(TAG, "File closed: %s, %u bytes", voice_file.name, size);
+#if UPLOAD_HTTP_STREAM == (true)
+    char dst_url[64];
+    sprintf(dst_url, "http://%s:%d", CONFIG_TARGET_URL, CONFIG_TARGET_PORT);
+    // fname and dst_url are copied into the message slot
+    return main_msg_post_xfer(FILE2HTTP, voice_file.name, dst_url);
+#endif /* UPLOAD_HTTP_STREAM == (true) */
+#endif /* VOICE2FILE == (true) */
+    return false;
 }
 
+#if CONFIG_REPLAY_ENABLE
+#define REPLAY_MARK(ev, arg)    replay_mark(ev, arg)
+#else
+#define REPLAY_MARK(ev, arg)
+#endif
+
 static esp_err_t rec_engine_cb(audio_rec_evt_t type, void *user_data)
 {
+    // only report, the assistant task owns the conversation state
     if (AUDIO_REC_WAKEUP_START == type) {
-        ESP_LOGI(TAG, "rec_engine_cb - REC_EVENT_WAKEUP_START");
-        esp_audio_sync_play(player, tone_uri[TONE_TYPE_DINGDONG], 0);
-        if (voice_reading) {
-            int msg = REC_CANCEL;
-            if (xQueueSend(rec_q, &msg, 0) != pdPASS) {
-                ESP_LOGE(TAG, "rec cancel send failed");
-            }
-        }
+        DLOG(REC_WAKEUP_START);
+        REPLAY_MARK(REPLAY_EV_WAKE, 0);
+        TRACE(TRACE_WAKE, 0);
+        assistant_post(ASSIST_EV_WAKEUP);
     } else if (AUDIO_REC_VAD_START == type) {
-        ESP_LOGI(TAG, "rec_engine_cb - REC_EVENT_VAD_START");
-        if (!voice_reading) {
-            int msg = REC_START;
-            if (xQueueSend(rec_q, &msg, 0) != pdPASS) {
-                ESP_LOGE(TAG, "rec start send failed");
-            }
-        }
+        DLOG(REC_VAD_START);
+        REPLAY_MARK(REPLAY_EV_VAD_START, 0);
+        TRACE(TRACE_VAD_START, 0);
+        assistant_post(ASSIST_EV_VAD_START);
     } else if (AUDIO_REC_VAD_END == type) {
-        ESP_LOGI(TAG, "rec_engine_cb - REC_EVENT_VAD_STOP");
-        if (voice_reading) {
-            int msg = REC_STOP;
-            if (xQueueSend(rec_q, &msg, 0) != pdPASS) {
-                ESP_LOGE(TAG, "rec stop send failed");
-            }
-        }
-
+        DLOG(REC_VAD_STOP);
+        REPLAY_MARK(REPLAY_EV_VAD_END, 0);
+        TRACE(TRACE_VAD_END, 0);
+        assistant_post(ASSIST_EV_VAD_END);
     } else if (AUDIO_REC_WAKEUP_END == type) {
-        ESP_LOGI(TAG, "rec_engine_cb - REC_EVENT_WAKEUP_END");
+        DLOG(REC_WAKEUP_END);
+        REPLAY_MARK(REPLAY_EV_WAKE_END, 0);
+        assistant_post(ASSIST_EV_WAKEUP_END);
     } else if (AUDIO_REC_COMMAND_DECT <= type) {
-        ESP_LOGI(TAG, "rec_engine_cb - AUDIO_REC_COMMAND_DECT");
-        ESP_LOGW(TAG, "command %d", type);
-//        esp_audio_sync_play(player, tone_uri[TONE_TYPE_HAODE], 0);
+        DLOG(REC_COMMAND, type);
+        REPLAY_MARK(REPLAY_EV_COMMAND, type - AUDIO_REC_COMMAND_DECT);
+        TRACE(TRACE_COMMAND, type - AUDIO_REC_COMMAND_DECT);
+#if CONFIG_LOCAL_CMD_ENABLE
+        // no local action: the utterance is uploaded as usual
+        if (local_cmd_detect(type - AUDIO_REC_COMMAND_DECT)) {
+            assistant_post(ASSIST_EV_COMMAND);
+        }
+#endif
     } else {
-        ESP_LOGE(TAG, "Unkown event");
+        DLOG(REC_UNKNOWN, type);
     }
     return ESP_OK;
 }
 
 static int input_cb_for_afe(int16_t *buffer, int buf_sz, void *user_ctx, TickType_t ticks)
 {
-    return raw_stream_read(raw_read, (char *)buffer, buf_sz);
+    int ret = 0;
+#if CONFIG_REPLAY_ENABLE
+    // the file stands in for the microphones, live capture is dropped so i2s never blocks
+    if (replay_active()) {
+        // drained without blocking into buffer, the replay overwrites it; rb_reset would race the writer
+        ringbuf_handle_t rb = audio_element_get_input_ringbuf(raw_read);
+        int filled;
+        while ((filled = rb_bytes_filled(rb)) > 0
+               && rb_read(rb, (char *)buffer, filled < buf_sz ? filled : buf_sz, 0) > 0) {
+        }
+        ret = replay_read(buffer, buf_sz, feed_channels);
+    }
+    if (ret <= 0)
+#endif
+    {
+        ret = raw_stream_read(raw_read, (char *)buffer, buf_sz);
+        AUDIO_TAP(TAP_RESAMPLE, buffer, ret);
+    }
+#if SOFTWARE_AEC_REF
+    // capture is 2ch interleaved, ch1 carries the delayed playback reference
+    if (ret > 0) {
+        aec_ref_fill(buffer, ret / (2 * sizeof(int16_t)), 2, 1);
+    }
+#endif
+    AUDIO_TAP(TAP_AFE_IN, buffer, ret);
+    return ret;
+}
+
+#if CONFIG_AUDIO_TAP_ENABLE
+// i2s output hook for TAP_MIC, otherwise the same write the linked ringbuf gets
+static int _mic_tap_write(audio_element_handle_t self, char *buffer, int len, TickType_t ticks, void *context)
+{
+    AUDIO_TAP(TAP_MIC, buffer, len);
+    return rb_write((ringbuf_handle_t)context, buffer, len, ticks);
 }
 
+static void _tap_formats(audio_element_handle_t filter, int filter_ch)
+{
+    audio_tap_set_format(TAP_MIC, CODEC_ADC_SAMPLE_RATE, 2, CODEC_ADC_BITS_PER_SAMPLE);
+    if (filter) {
+        audio_tap_set_format(TAP_RESAMPLE, 16000, filter_ch, 16);
+    } else {
+        audio_tap_set_format(TAP_RESAMPLE, CODEC_ADC_SAMPLE_RATE, 2, CODEC_ADC_BITS_PER_SAMPLE);
+    }
+    audio_tap_set_format(TAP_AFE_IN, 16000, feed_channels, 16);
+    if (RECORDER_ENC_ENABLE == ENC_2_WAV) {
+        audio_tap_set_format(TAP_REC_OUT, CONFIG_AUDIO_SAMPLE_RATE, CONFIG_AUDIO_CHANNELS, CONFIG_AUDIO_BITS);
+    } else {
+        audio_tap_set_format(TAP_REC_OUT, 0, 0, 0);
+    }
+}
+#endif
+
 static void start_recorder()
 {
     audio_pipeline_cfg_t pipeline_cfg = DEFAULT_AUDIO_PIPELINE_CONFIG();
@@ -366,23 +287,17 @@ static void start_recorder()
         return;
     }
 
-    i2s_stream_cfg_t i2s_cfg = I2S_STREAM_CFG_DEFAULT();
-    i2s_cfg.i2s_port = CODEC_ADC_I2S_PORT;
-    i2s_cfg.i2s_config.use_apll = 0;
-    i2s_cfg.i2s_config.sample_rate = CODEC_ADC_SAMPLE_RATE;
-#if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 1)
-    i2s_cfg.i2s_config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
-#else
-    i2s_cfg.i2s_config.bits_per_sample = CODEC_ADC_BITS_PER_SAMPLE;
-#endif
-    i2s_cfg.type = AUDIO_STREAM_READER;
-    i2s_stream_reader = i2s_stream_init(&i2s_cfg);
+    // capture port of the shared i2s owner, clock is fixed there
+    i2s_stream_reader = i2s_work_get_reader();
 
     audio_element_handle_t filter = NULL;
+    int filter_ch = 2;
 #if CODEC_ADC_SAMPLE_RATE != (16000)
     rsp_filter_cfg_t rsp_cfg = DEFAULT_RESAMPLE_FILTER_CONFIG();
     rsp_cfg.src_rate = CODEC_ADC_SAMPLE_RATE;
     rsp_cfg.dest_rate = 16000;
+    rsp_cfg.task_core = TASK_CORE(CAPTURE);
+    rsp_cfg.task_prio = TASK_PRIO(CAPTURE);
 #if (CONFIG_ESP32_S3_KORVO2_V3_BOARD == 1) && (CONFIG_AFE_MIC_NUM == 2)
     rsp_cfg.mode = RESAMPLE_UNCROSS_MODE;
     rsp_cfg.src_ch = 4;
@@ -390,6 +305,7 @@ static void start_recorder()
     rsp_cfg.max_indata_bytes = 1024;
 #endif
     filter = rsp_filter_init(&rsp_cfg);
+    filter_ch = rsp_cfg.dest_ch;
 #endif
 
     raw_stream_cfg_t raw_cfg = RAW_STREAM_CFG_DEFAULT();
@@ -407,11 +323,26 @@ static void start_recorder()
         const char *link_tag[2] = {"i2s", "raw"};
         audio_pipeline_link(pipeline, &link_tag[0], 2);
     }
+    // the ring i2s writes, seen from its reader: the TAP_MIC write callback below hides it from i2s
+    el_stats_bind("recorder", "i2s", i2s_stream_reader, audio_element_get_input_ringbuf(filter ? filter : raw_read));
+    if (filter) {
+        el_stats_bind("recorder", "filter", filter, audio_element_get_output_ringbuf(filter));
+    }
+    el_stats_bind("recorder", "raw", raw_read, audio_element_get_input_ringbuf(raw_read));
+#if CONFIG_AUDIO_TAP_ENABLE
+    // set after linking, the recorder pipeline is never relinked
+    audio_element_set_write_cb(i2s_stream_reader, _mic_tap_write,
+                               audio_element_get_output_ringbuf(i2s_stream_reader));
+#endif
 
     audio_pipeline_run(pipeline);
     ESP_LOGI(TAG, "Recorder has been created");
 
     recorder_sr_cfg_t recorder_sr_cfg = DEFAULT_RECORDER_SR_CFG();
+    recorder_sr_cfg.feed_task_core = TASK_CORE(AFE_FEED);
+    recorder_sr_cfg.feed_task_prio = TASK_PRIO(AFE_FEED);
+    recorder_sr_cfg.fetch_task_core = TASK_CORE(AFE_FETCH);
+    recorder_sr_cfg.fetch_task_prio = TASK_PRIO(AFE_FETCH);
     recorder_sr_cfg.afe_cfg.memory_alloc_mode = AFE_MEMORY_ALLOC_MORE_PSRAM;
     recorder_sr_cfg.afe_cfg.wakenet_init = WAKENET_ENABLE;
     recorder_sr_cfg.multinet_init = MULTINET_ENABLE;
@@ -426,6 +357,15 @@ static void start_recorder()
 
     es7210_mic_select(ES7210_INPUT_MIC1 | ES7210_INPUT_MIC3);
 #endif
+#if SOFTWARE_AEC_REF
+    aec_ref_init(CONFIG_AEC_REF_DELAY_MS);
+    recorder_sr_cfg.afe_cfg.aec_init = true;
+    recorder_sr_cfg.afe_cfg.pcm_config.mic_num = 1;
+    recorder_sr_cfg.afe_cfg.pcm_config.ref_num = 1;
+    recorder_sr_cfg.afe_cfg.pcm_config.total_ch_num = 2;
+    recorder_sr_cfg.input_order[0] = DAT_CH_0;
+    recorder_sr_cfg.input_order[1] = DAT_CH_1;
+#endif
 
 #if RECORDER_ENC_ENABLE
     recorder_encoder_cfg_t recorder_encoder_cfg = { 0 };
@@ -461,37 +401,50 @@ static void start_recorder()
 #endif
 
     audio_rec_cfg_t cfg = AUDIO_RECORDER_DEFAULT_CFG();
+    feed_channels = recorder_sr_cfg.afe_cfg.pcm_config.total_ch_num;
     cfg.read = (recorder_data_read_t)&input_cb_for_afe;
-    cfg.sr_handle = recorder_sr_create(&recorder_sr_cfg, &cfg.sr_iface);
-#if SPEECH_CMDS_RESET
-    char err[200];
-    recorder_sr_reset_speech_cmd(cfg.sr_handle, SPEECH_COMMANDS, err);
+#if CONFIG_AUDIO_TAP_ENABLE
+    _tap_formats(filter, filter_ch);
 #endif
+    cfg.sr_handle = recorder_sr_create(&recorder_sr_cfg, &cfg.sr_iface);
+    sr_handle = cfg.sr_handle;
 #if RECORDER_ENC_ENABLE
     cfg.encoder_handle = recorder_encoder_create(&recorder_encoder_cfg, &cfg.encoder_iface);
 #endif
     cfg.event_cb = rec_engine_cb;
+    cfg.pinned_core = TASK_CORE(RECORDER);
+    cfg.task_prio = TASK_PRIO(RECORDER);
     cfg.vad_off = 1000;
     recorder = audio_recorder_create(&cfg);
 }
 
+/*
+ * Capture keeps running at a fixed clock on the shared i2s owner, so a mode
+ * switch only toggles wakenet: no reclock, no pause/reset of the pipeline.
+ */
 void enable_wwe_pipeline(bool enable){
+	int64_t start = esp_timer_get_time();
 	if(enable){
-	    ESP_LOGI(TAG, "Enable wwe pipeline.");
-	    /// remember set i2s clk again !
-        i2s_stream_set_clk(i2s_stream_reader, CODEC_ADC_SAMPLE_RATE, CODEC_ADC_BITS_PER_SAMPLE, 2);
-		audio_pipeline_reset_ringbuffer(pipeline);
-		audio_pipeline_reset_elements(pipeline);
-	    audio_pipeline_resume(pipeline);
 	    audio_recorder_wakenet_enable(recorder, true);
-	    ESP_LOGI(TAG, "enable_wwe_pipeline: %d.", __LINE__);
 	} else {
-	    ESP_LOGI(TAG, "Disable wwe pipeline.");
 	    audio_recorder_wakenet_enable(recorder, false);
-	    audio_pipeline_pause(pipeline);
 	}
+	ESP_LOGI(TAG, "%s wwe pipeline, mode switch %lld us.", enable ? "Enable" : "Disable",
+			 esp_timer_get_time() - start);
 }
 
+#if MULTINET_ENABLE
+esp_err_t wwe_reset_speech_cmds(const char *phrases, char *err, int64_t *took_us){
+    int64_t start = esp_timer_get_time();
+
+    err[0] = 0;
+    esp_err_t ret = recorder_sr_reset_speech_cmd(sr_handle, (char *)phrases, err);
+    *took_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "Speech command reset %s in %lld us", ret == ESP_OK ? "done" : "failed", *took_us);
+    return ret;
+}
+#endif
+
 void enable_wwe_trigger(bool enable){
 	if(enable){
 		audio_recorder_trigger_start(recorder);
@@ -503,10 +456,27 @@ void enable_wwe_trigger(bool enable){
 void init_wwe_work(){
 //    audio_board_init();
     setup_player();
+    // before the recorder, its callback posts to the assistant
+    voice_buf = mem_calloc(MEM_SYS_RECORDER, 1, VOICE_BUF_LEN);
+    mem_assert(voice_buf);
+    init_assistant();
+#if CONFIG_LOCAL_CMD_ENABLE
+    // the command list is set up with the recorder
+    init_local_cmd();
+#endif
     start_recorder();
 
-    rec_q = xQueueCreate(8, sizeof(int));
-    audio_thread_create(NULL, "read_task", voice_read_task, NULL, 4 * 1024, 5, true, 0);
+
+#if SOFTWARE_AEC_REF && CONFIG_AEC_REF_CALIBRATE
+    // 1s of capture around the wake tone
+    if (aec_ref_calibrate_start(AEC_REF_SAMPLE_RATE)) {
+        run_tone2player(tone_uri[TONE_TYPE_DINGDONG], NULL);
+        for (int i = 0; i < 20 && !aec_ref_calibrate_done(); i++) {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+        aec_ref_calibrate_finish(AEC_REF_MAX_DELAY_MS);
+    }
+#endif
 
 
     ESP_LOGI(TAG, "init_wwe_work done");
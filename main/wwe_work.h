@@ -2,12 +2,24 @@
 #define MAIN_WWE_WORK_H_
 
 #include "board.h"
-#include "esp_audio.h"
 #include "audio_recorder.h"
 
 void init_wwe_work();
 
 void enable_wwe_pipeline(bool enable);
 void enable_wwe_trigger(bool enable);
+/**
+ * New MultiNet command list on the running recorder, command ids follow
+ * the order of the phrases. Blocks for the reset, which is reported in
+ * took_us; err gets the ids of rejected phrases, at least 200 bytes.
+ */
+esp_err_t wwe_reset_speech_cmds(const char *phrases, char *err, int64_t *took_us);
+
+// recording of one utterance, from the assistant task only
+bool voice_rec_begin();
+// reads and stores the next chunk, <= 0 when the recorder has no more
+int voice_rec_step();
+// closes the file, then posts it for upload or deletes it
+bool voice_rec_end(bool upload);
 
 #endif /* MAIN_WWE_WORK_H_ */
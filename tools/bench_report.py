@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Collect and compare on-device benchmark runs.
+
+Reads the "BENCH {json}" lines the bench app prints (UART log capture) or
+the bench_<n>.jsonl files it saves on the SD card. One run is printed as a
+table; with two or more runs every metric of the first (the baseline) is
+compared with the others.
+
+    cd bench && idf.py flash monitor | tee rev_b.log
+    tools/bench_report.py rev_a.log rev_b.log
+"""
+
+import argparse
+import json
+import sys
+
+PREFIX = "BENCH "
+
+
+def load(path):
+    run = {"meta": {}, "cases": {}, "path": path}
+    with open(path, errors="replace") as f:
+        for line in f:
+            pos = line.find(PREFIX)
+            text = line[pos + len(PREFIX):] if pos >= 0 else line
+            try:
+                rec = json.loads(text.strip())
+            except ValueError:
+                continue
+            if not isinstance(rec, dict):
+                continue
+            if rec.get("type") == "meta":
+                # a log may hold several runs, keep the last one
+                run = {"meta": rec, "cases": {}, "path": path}
+            elif rec.get("type") == "case":
+                run["cases"][rec["name"]] = rec
+    return run
+
+
+def label(run):
+    m = run["meta"]
+    if not m:
+        return run["path"]
+    return "%s %s rev%s %s idf %s adf %s" % (m.get("board_rev") or run["path"], m.get("chip", "?"),
+                                             m.get("chip_rev", "?"), m.get("app", ""), m.get("idf", "?"),
+                                             m.get("adf", "?"))
+
+
+def show(run):
+    print(label(run))
+    for name, case in run["cases"].items():
+        status = "ok" if case["ok"] else "FAIL %s %s" % (case["err"], case.get("note", ""))
+        print("  %-22s %s" % (name, status))
+        for key, value in case["metrics"].items():
+            print("    %-24s %12.3f" % (key, value))
+
+
+def compare(runs):
+    base = runs[0]
+    for i, run in enumerate(runs):
+        print("[%d] %s" % (i, label(run)))
+    header = "  %-22s %-24s" % ("case", "metric") + "".join(" %20s" % ("[%d]" % i) for i in range(len(runs)))
+    print(header)
+    for name, case in base["cases"].items():
+        for key, value in case["metrics"].items():
+            cols = [" %20.3f" % value]
+            for run in runs[1:]:
+                other = run["cases"].get(name)
+                if other is None or key not in other["metrics"]:
+                    cols.append(" %20s" % "-")
+                    continue
+                v = other["metrics"][key]
+                delta = "%+.0f%%" % ((v - value) * 100.0 / value) if value else ""
+                cols.append(" %20s" % ("%.3f %s" % (v, delta)))
+            print("  %-22s %-24s%s" % (name, key, "".join(cols)))
+        for run in runs[1:]:
+            other = run["cases"].get(name)
+            if other is not None and other["ok"] != case["ok"]:
+                print("  %-22s ok changed: %s -> %s in %s" % (name, case["ok"], other["ok"], run["path"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("runs", nargs="+", help="UART logs or bench_<n>.jsonl files, the first is the baseline")
+    args = parser.parse_args()
+
+    runs = [load(p) for p in args.runs]
+    empty = [r["path"] for r in runs if not r["cases"]]
+    if empty:
+        print("no BENCH records in %s" % ", ".join(empty), file=sys.stderr)
+        return 1
+    if len(runs) == 1:
+        show(runs[0])
+    else:
+        compare(runs)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Local endpoints for the bench app's HTTP throughput cases.
+
+POST /bench reads and discards a (chunked) upload, GET /bench.bin serves
+--size bytes. Point BENCH_UPLOAD_URL and BENCH_DOWNLOAD_URL at this host.
+
+    tools/bench_server.py --port 9000 --size 1048576
+"""
+
+import argparse
+import http.server
+import time
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    size = 1 << 20
+
+    def _read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            total = 0
+            while True:
+                n = int(self.rfile.readline().split(b";")[0], 16)
+                if n == 0:
+                    self.rfile.readline()
+                    return total
+                total += len(self.rfile.read(n))
+                self.rfile.readline()
+        n = int(self.headers.get("Content-Length", 0))
+        return len(self.rfile.read(n))
+
+    def do_POST(self):
+        start = time.time()
+        n = self._read_body()
+        body = ("%d bytes in %.3f s\n" % (n, time.time() - start)).encode()
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        if self.path != "/bench.bin":
+            self.send_error(404)
+            return
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        self.send_header("Content-Length", str(self.size))
+        self.end_headers()
+        chunk = bytes(range(256)) * 64
+        left = self.size
+        while left > 0:
+            self.wfile.write(chunk[:min(left, len(chunk))])
+            left -= len(chunk)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=9000)
+    parser.add_argument("--size", type=int, default=1 << 20, help="bytes served by GET /bench.bin")
+    args = parser.parse_args()
+    Handler.size = args.size
+    http.server.ThreadingHTTPServer(("", args.port), Handler).serve_forever()
+
+
+if __name__ == "__main__":
+    main()
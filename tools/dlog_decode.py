@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""Decode a binary dump of the deferred logger.
+
+Reads the file written by the CONFIG_DLOG_SINK_FILE sink (CONFIG_DLOG_FILE_PATH
+on the SD card) and prints the records the way the UART sink would, using
+the format table in main/dlog_fmt.h. The table must match the firmware that
+wrote the dump, ids are the position of an entry in DLOG_FMTS.
+
+    tools/dlog_decode.py /media/sdcard/dlog.bin
+    tools/dlog_decode.py --fmt other_tree/main/dlog_fmt.h dlog.bin
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+DEFAULT_FMT = os.path.join(os.path.dirname(__file__), "..", "main", "dlog_fmt.h")
+
+ENTRY = re.compile(r'X\((\w+),\s*ESP_LOG_(\w+),\s*"([^"]*)",\s*"((?:[^"\\]|\\.)*)"\)')
+CONV = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|l|ll|z)?([diuxXoc%])")
+LEVELS = {"NONE": "N", "ERROR": "E", "WARN": "W", "INFO": "I", "DEBUG": "D", "VERBOSE": "V"}
+
+# file header: magic, record size, max args
+HEADER = struct.Struct("<4sBBBB")
+# dlog_rec_t without args: ts_us, id, nargs, core
+REC = struct.Struct("<IHBB")
+
+
+def load_formats(path):
+    fmts = []
+    with open(path) as f:
+        for m in ENTRY.finditer(f.read()):
+            name, level, tag, fmt = m.groups()
+            fmt = fmt.encode().decode("unicode_escape")
+            fmts.append((name, LEVELS.get(level, "?"), tag, fmt))
+    if not fmts:
+        sys.exit("no DLOG_FMTS entries in %s" % path)
+    return fmts
+
+
+def render(fmt, args):
+    """printf with 32 bit integer arguments, %d/%i are signed."""
+    out = []
+    pos = 0
+    argi = 0
+    for m in CONV.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group(1)
+        if conv == "%":
+            out.append("%")
+            continue
+        v = args[argi] if argi < len(args) else 0
+        argi += 1
+        spec = re.sub(r"(hh|h|ll|l|z)", "", m.group(0))
+        if conv in "di":
+            v = v - (1 << 32) if v & 0x80000000 else v
+        elif conv == "u":
+            spec = spec[:-1] + "d"
+        elif conv == "c":
+            v = chr(v & 0xff)
+        out.append(spec % v)
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("dump", help="binary dump from the SD card")
+    ap.add_argument("--fmt", default=DEFAULT_FMT, help="dlog_fmt.h of the firmware that wrote the dump")
+    ap.add_argument("--core", action="store_true", help="prefix lines with the core that logged them")
+    args = ap.parse_args()
+
+    fmts = load_formats(args.fmt)
+    with open(args.dump, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        sys.exit("%s: too short" % args.dump)
+    magic, rec_size, _, max_args, _ = HEADER.unpack_from(data)
+    if magic != b"DLG1" or rec_size != REC.size + 4 * max_args:
+        sys.exit("%s: not a dlog dump (magic %r, record %d bytes)" % (args.dump, magic, rec_size))
+
+    count = 0
+    for off in range(HEADER.size, len(data) - rec_size + 1, rec_size):
+        ts_us, fid, nargs, core = REC.unpack_from(data, off)
+        vals = struct.unpack_from("<%dI" % max_args, data, off + REC.size)[:nargs]
+        prefix = "[%d] " % core if args.core else ""
+        if fid >= len(fmts):
+            print("%s? (%d) dlog: unknown format id %d, args %s" % (prefix, ts_us // 1000, fid, list(vals)))
+            continue
+        _, level, tag, fmt = fmts[fid]
+        print("%s%s (%d) %s: %s" % (prefix, level, ts_us // 1000, tag, render(fmt, vals)))
+        count += 1
+    tail = (len(data) - HEADER.size) % rec_size
+    if tail:
+        print("# %d trailing bytes of a partial record ignored" % tail, file=sys.stderr)
+    print("# %d records" % count, file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
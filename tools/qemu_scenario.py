@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""Latency and heap regression run of the firmware under QEMU.
+
+Boots a CONFIG_QEMU_TARGET build (see sdkconfig.qemu) in qemu-system-xtensa
+next to a mock speech server, runs the steps of a scenario file over the
+control server and checks the tracer stages and heap watermarks against
+the scenario thresholds, and optionally against a previous run.
+
+The mock server listens on the host side of the QEMU user network
+(10.0.2.2:<port> from the guest):
+    GET  /qemu/replay.wav   the --wav input, fetched into the RAM FAT at boot
+    POST /                  the utterance upload, answered with the reply name
+    GET  /<reply>           a generated 16kHz tone the device plays back
+    POST /trace             tracer lines, when built with TRACE_SINK_HTTP
+
+    idf.py -B build_qemu -D SDKCONFIG=build_qemu/sdkconfig \\
+        -D SDKCONFIG_DEFAULTS="sdkconfig.defaults;sdkconfig.qemu" build
+    tools/qemu_scenario.py --build-dir build_qemu --wav hi_esp_light_on.wav \\
+        --out run.json [--baseline last_good.json]
+
+Exit status 0 when every check passes, 1 on a regression, 2 when the run
+itself failed (no boot, no network, scenario step timed out).
+"""
+
+import argparse
+import http.server
+import io
+import json
+import math
+import os
+import struct
+import subprocess
+import sys
+import threading
+import time
+import urllib.request
+import wave
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import trace_hist  # noqa: E402
+
+DEFAULT_SCENARIO = os.path.join(os.path.dirname(os.path.abspath(__file__)), "qemu", "wake_upload_play.json")
+
+
+def tone_wav(seconds=1.0, rate=16000, freq=440):
+    buf = io.BytesIO()
+    with wave.open(buf, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(rate)
+        w.writeframes(b"".join(struct.pack("<h", int(8000 * math.sin(2 * math.pi * freq * i / rate)))
+                               for i in range(int(seconds * rate))))
+    return buf.getvalue()
+
+
+class MockServer(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    replay = None
+    reply_name = "reply.wav"
+    reply = b""
+    uploads = []
+    trace_lines = []
+
+    def log_message(self, fmt, *args):
+        pass
+
+    def _read_body(self):
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            data = b""
+            while True:
+                n = int(self.rfile.readline().split(b";")[0], 16)
+                if n == 0:
+                    self.rfile.readline()
+                    return data
+                data += self.rfile.read(n)
+                self.rfile.readline()
+        return self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+    def _send(self, code, body, ctype="text/plain"):
+        self.send_response(code)
+        self.send_header("Content-Type", ctype)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        body = self._read_body()
+        if self.path == "/trace":
+            MockServer.trace_lines += body.decode(errors="replace").splitlines()
+            self._send(200, b"ok")
+            return
+        MockServer.uploads.append({"t": time.time(), "bytes": len(body),
+                                   "rate": self.headers.get("x-audio-sample-rates"),
+                                   "riff": body[:4] == b"RIFF"})
+        self._send(200, self.reply_name.encode())
+
+    def do_GET(self):
+        if self.path == "/qemu/replay.wav" and self.replay is not None:
+            self._send(200, self.replay, "audio/wav")
+        elif self.path == "/" + self.reply_name:
+            self._send(200, self.reply, "audio/wav")
+        else:
+            self._send(404, b"")
+
+
+class Qemu:
+    def __init__(self, cmd, log_path):
+        self.lines = []
+        self.lock = threading.Lock()
+        self.log = open(log_path, "w")
+        self.proc = subprocess.Popen(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                                     stderr=subprocess.STDOUT)
+        threading.Thread(target=self._pump, daemon=True).start()
+
+    def _pump(self):
+        for raw in self.proc.stdout:
+            line = raw.decode(errors="replace").rstrip("\r\n")
+            self.log.write(line + "\n")
+            with self.lock:
+                self.lines.append(line)
+
+    def snapshot(self):
+        with self.lock:
+            return list(self.lines)
+
+    def wait_for(self, pred, timeout_s):
+        end = time.time() + timeout_s
+        while time.time() < end:
+            if self.proc.poll() is not None:
+                return False
+            if pred(self.snapshot()):
+                return True
+            time.sleep(0.2)
+        return False
+
+    def stop(self):
+        self.proc.terminate()
+        try:
+            self.proc.wait(5)
+        except subprocess.TimeoutExpired:
+            self.proc.kill()
+        self.log.close()
+
+
+def merge_flash(build_dir, flash_size):
+    image = os.path.join(build_dir, "qemu_flash.bin")
+    subprocess.check_call([sys.executable, "-m", "esptool", "--chip", "esp32", "merge_bin",
+                           "--fill-flash-size", flash_size, "-o", "qemu_flash.bin", "@flash_args"],
+                          cwd=build_dir)
+    return image
+
+
+def device(port, path, method="GET", timeout=10):
+    req = urllib.request.Request("http://127.0.0.1:%d%s" % (port, path), method=method,
+                                 data=b"" if method == "POST" else None)
+    with urllib.request.urlopen(req, timeout=timeout) as resp:
+        return resp.read()
+
+
+def run_steps(scenario, qemu, ctl_port):
+    for step in scenario["steps"]:
+        timeout = step.get("timeout_s", 30)
+        if "post" in step:
+            device(ctl_port, step["post"], "POST")
+        elif "sleep_s" in step:
+            time.sleep(step["sleep_s"])
+        elif "wait_stage" in step:
+            name = step["wait_stage"]
+            if not qemu.wait_for(lambda lines: trace_hist.collect(lines + MockServer.trace_lines)[name], timeout):
+                return "stage %s not reached in %d s" % (name, timeout)
+        elif "wait_log" in step:
+            text = step["wait_log"]
+            if not qemu.wait_for(lambda lines: any(text in l for l in lines), timeout):
+                return "'%s' not logged in %d s" % (text, timeout)
+    return None
+
+
+def heap_watermarks(ctl_port):
+    metrics = json.loads(device(ctl_port, "/metrics.json"))
+    return metrics.get("heap_min_free_bytes", {}).get("values", {})
+
+
+def check(result, thresholds, baseline):
+    failures = []
+    pct = thresholds.get("regress_pct", 20)
+    slack = thresholds.get("regress_slack_ms", 50)
+    for name, limit in thresholds.get("stage_max_ms", {}).items():
+        st = result["stages"].get(name)
+        if st is None:
+            failures.append("%s: no sample" % name)
+            continue
+        if st["max"] > limit:
+            failures.append("%s: max %d ms over the %d ms limit" % (name, st["max"], limit))
+        base = baseline and baseline["stages"].get(name)
+        if base and st["max"] > base["max"] * (100 + pct) / 100 + slack:
+            failures.append("%s: max %d ms, baseline %d ms (+%d%%)" % (name, st["max"], base["max"], pct))
+    for region, floor in thresholds.get("heap_min_free", {}).items():
+        got = result["heap_min_free"].get(region)
+        if got is None:
+            failures.append("heap %s: not reported" % region)
+            continue
+        if got < floor:
+            failures.append("heap %s: min free %d below %d" % (region, got, floor))
+        base = baseline and baseline["heap_min_free"].get(region)
+        if base and got < base * (100 - pct) / 100:
+            failures.append("heap %s: min free %d, baseline %d (-%d%%)" % (region, got, base, pct))
+    return failures
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("scenario", nargs="?", default=DEFAULT_SCENARIO)
+    ap.add_argument("--build-dir", default="build_qemu")
+    ap.add_argument("--qemu", default="qemu-system-xtensa")
+    ap.add_argument("--wav", help="16kHz/16bit WAV replayed as the microphones")
+    ap.add_argument("--port", type=int, default=9000, help="mock server port, CONFIG_TARGET_PORT")
+    ap.add_argument("--ctl-port", type=int, default=8080, help="host port forwarded to the control server")
+    ap.add_argument("--flash-size", default="8MB")
+    ap.add_argument("--icount", type=int, help="instruction counting for repeatable timing, e.g. 3")
+    ap.add_argument("--out", help="write the run result as JSON")
+    ap.add_argument("--baseline", help="result JSON of a good run to compare against")
+    args = ap.parse_args()
+
+    with open(args.scenario) as f:
+        scenario = json.load(f)
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    if args.wav:
+        with open(args.wav, "rb") as f:
+            MockServer.replay = f.read()
+    MockServer.reply = tone_wav(scenario.get("reply_s", 1.0))
+    server = http.server.ThreadingHTTPServer(("", args.port), MockServer)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+    image = merge_flash(args.build_dir, args.flash_size)
+    cmd = [args.qemu, "-nographic", "-machine", "esp32", "-m", "4M",
+           "-drive", "file=%s,if=mtd,format=raw" % image,
+           "-nic", "user,model=open_eth,hostfwd=tcp:127.0.0.1:%d-:80" % args.ctl_port,
+           "-global", "driver=timer.esp32.timg,property=wdt_disable,value=true"]
+    if args.icount is not None:
+        cmd += ["-icount", str(args.icount)]
+    log_path = os.path.join(args.build_dir, "qemu_%s.log" % scenario["name"])
+    qemu = Qemu(cmd, log_path)
+
+    error = None
+    heap = {}
+    start = time.time()
+    try:
+        ready = scenario.get("ready", "Capture replay on /replay")
+        if not qemu.wait_for(lambda lines: any(ready in l for l in lines), scenario.get("boot_timeout_s", 120)):
+            error = "no '%s' on the console" % ready
+        else:
+            error = run_steps(scenario, qemu, args.ctl_port)
+            heap = heap_watermarks(args.ctl_port)
+    except OSError as e:
+        error = "control server: %s" % e
+    finally:
+        qemu.stop()
+        server.shutdown()
+
+    samples = trace_hist.collect(qemu.snapshot() + MockServer.trace_lines)
+    result = {
+        "scenario": scenario["name"],
+        "wall_s": round(time.time() - start, 1),
+        "error": error,
+        "stages": {name: {"n": len(ms), "min": min(ms), "max": max(ms), "avg": sum(ms) // len(ms)}
+                   for name, ms in samples.items() if ms},
+        "heap_min_free": {k: int(v) for k, v in heap.items()},
+        "uploads": MockServer.uploads,
+    }
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(result, f, indent=1)
+
+    print("%-14s %6s %8s %8s %8s" % ("stage", "n", "min", "avg", "max"))
+    for name, st in result["stages"].items():
+        print("%-14s %6d %8d %8d %8d" % (name, st["n"], st["min"], st["avg"], st["max"]))
+    for region, v in result["heap_min_free"].items():
+        print("heap min free %-8s %d" % (region, v))
+    print("console log: %s" % log_path)
+    if error:
+        print("RUN FAILED: %s" % error)
+        return 2
+    failures = check(result, scenario.get("thresholds", {}), baseline)
+    for f in failures:
+        print("REGRESSION: %s" % f)
+    print("PASS" if not failures else "FAIL")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
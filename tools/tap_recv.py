@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Receiver for the UDP audio tap sink.
+
+Writes one file per tap point that sends, tap_<name>.wav (or .raw for
+formats without PCM bits), until interrupted. Audio the device dropped
+with a full ring and datagrams lost on the network are filled with
+silence so the files stay time aligned; both are reported at the end.
+
+    tools/tap_recv.py --port 5005 --out taps/
+    curl -X POST 'http://<device>/tap?points=mic,afe_in&sink=udp&dest=<host ip>:5005'
+    curl -X POST 'http://<device>/tap?stop=1'
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import wave
+
+# keep in sync with tap_udp_hdr_t and tap_point_t in main/audio_tap.h
+HDR = struct.Struct("<HBBBBHIII")
+MAGIC = 0x5441
+TAPS = ["mic", "resample", "afe_in", "rec_out"]
+# drain unit on the device, TAP_CHUNK in main/audio_tap.c
+CHUNK = 1024
+
+
+class Tap:
+    def __init__(self, out_dir, tap, channels, bits, rate):
+        self.name = TAPS[tap] if tap < len(TAPS) else "tap%d" % tap
+        self.frame = max(1, channels * bits // 8)
+        self.bytes = 0
+        self.dropped = 0
+        self.lost = 0
+        self.next_seq = 0
+        if bits:
+            self.path = os.path.join(out_dir, "tap_%s.wav" % self.name)
+            self.f = wave.open(self.path, "wb")
+            self.f.setnchannels(channels)
+            self.f.setsampwidth(bits // 8)
+            self.f.setframerate(rate)
+            self.write = self.f.writeframes
+        else:
+            self.path = os.path.join(out_dir, "tap_%s.raw" % self.name)
+            self.f = open(self.path, "wb")
+            self.write = self.f.write
+
+    def pad(self, n):
+        n -= n % self.frame
+        if n > 0:
+            self.write(b"\0" * n)
+
+    def feed(self, seq, dropped_total, data):
+        if seq > self.next_seq:
+            # only the count is known, a lost datagram is taken as a full chunk
+            self.lost += seq - self.next_seq
+            self.pad((seq - self.next_seq) * CHUNK)
+        if dropped_total > self.dropped:
+            self.pad(dropped_total - self.dropped)
+            self.dropped = dropped_total
+        self.next_seq = seq + 1
+        self.bytes += len(data)
+        self.write(data)
+
+    def close(self):
+        self.f.close()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--port", type=int, default=5005)
+    ap.add_argument("--out", default=".", help="directory for the tap files")
+    args = ap.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    sock.bind(("", args.port))
+    print("listening on udp %d, Ctrl-C to finish" % args.port)
+
+    taps = {}
+    try:
+        while True:
+            pkt = sock.recv(HDR.size + 65536)
+            if len(pkt) < HDR.size:
+                continue
+            magic, tap, channels, bits, _, length, seq, rate, dropped = HDR.unpack_from(pkt)
+            data = pkt[HDR.size:HDR.size + length]
+            if magic != MAGIC or len(data) != length:
+                continue
+            t = taps.get(tap)
+            if t is None or seq < t.next_seq:
+                # first datagram, or the device started a new session
+                if t is not None:
+                    t.close()
+                t = taps[tap] = Tap(args.out, tap, channels, bits, rate)
+                print("%s: %d Hz, %d ch, %d bit -> %s" % (t.name, rate, channels, bits, t.path))
+            t.feed(seq, dropped, data)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for t in taps.values():
+            t.close()
+            print("%-9s %10d bytes, device dropped %d bytes, %d datagrams lost"
+                  % (t.name, t.bytes, t.dropped, t.lost))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""Per-stage latency histograms from a tracer dump.
+
+Reads "T,<us>,<id>,<arg>" lines (UART log capture or the bodies POSTed to
+/trace) from the given files or stdin and applies the same stage rules as
+main/log.c: a stage is armed by its 'from' event and closed by the next
+'to' event.
+
+    idf.py monitor | tee boot.log
+    tools/trace_hist.py boot.log
+"""
+
+import argparse
+import re
+import sys
+
+# keep in sync with trace_event_t in main/log.h
+EVENTS = ["wake", "vad_start", "vad_end", "file_close",
+          "upload_first", "upload_last", "response", "play_start",
+          "command", "action"]
+
+# keep in sync with stage_defs in main/log.c
+STAGES = [
+    ("wake_to_vad", "wake", "vad_start"),
+    ("speech", "vad_start", "vad_end"),
+    ("file_close", "vad_end", "file_close"),
+    ("upload_start", "file_close", "upload_first"),
+    ("upload", "upload_first", "upload_last"),
+    ("response", "upload_last", "response"),
+    ("play_start", "response", "play_start"),
+    ("end_to_end", "vad_end", "play_start"),
+    ("local_action", "vad_start", "action"),
+    ("cloud_action", "vad_start", "response"),
+]
+
+BUCKETS = 16
+LINE = re.compile(r"T,(\d+),(\d+),(\d+)")
+
+
+def bucket(ms):
+    b = 0
+    while b < BUCKETS - 1 and ms >= (1 << b):
+        b += 1
+    return b
+
+
+def bucket_label(b):
+    if b == 0:
+        return "<1ms"
+    if b == BUCKETS - 1:
+        return ">=%dms" % (1 << (b - 1))
+    return "%d-%dms" % (1 << (b - 1), 1 << b)
+
+
+def collect(lines, verbose=False):
+    """Stage name -> list of latencies in ms, from an iterable of lines."""
+    armed = {}
+    samples = {name: [] for name, _, _ in STAGES}
+
+    for line in lines:
+        m = LINE.search(line)
+        if not m:
+            continue
+        ts, eid, arg = (int(x) for x in m.groups())
+        if eid >= len(EVENTS):
+            continue
+        ev = EVENTS[eid]
+        if verbose:
+            print("%12d %-13s %d" % (ts, ev, arg))
+        for name, frm, to in STAGES:
+            if to == ev and name in armed:
+                # 32 bit microsecond clock on the device
+                samples[name].append(((ts - armed.pop(name)) & 0xffffffff) // 1000)
+            if frm == ev:
+                armed[name] = ts
+    return samples
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("files", nargs="*", help="dump files, stdin if none")
+    ap.add_argument("-v", "--verbose", action="store_true", help="list every event")
+    args = ap.parse_args()
+
+    streams = [open(f, errors="replace") for f in args.files] or [sys.stdin]
+    samples = collect((line for stream in streams for line in stream), args.verbose)
+
+    for name, _, _ in STAGES:
+        ms = samples[name]
+        if not ms:
+            continue
+        ms.sort()
+        print("%-13s n=%d min %d p50 %d p90 %d max %d avg %d ms" % (
+            name, len(ms), ms[0], ms[len(ms) // 2], ms[min(len(ms) - 1, len(ms) * 9 // 10)],
+            ms[-1], sum(ms) // len(ms)))
+        hist = [0] * BUCKETS
+        for v in ms:
+            hist[bucket(v)] += 1
+        for b, n in enumerate(hist):
+            if n:
+                print("    %-14s %5d %s" % (bucket_label(b), n, "#" * min(n, 60)))
+
+
+if __name__ == "__main__":
+    main()